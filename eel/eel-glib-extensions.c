@@ -33,6 +33,7 @@
 #include <glib-object.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
 #include <sys/utsname.h>
 #include <time.h>
@@ -568,6 +569,180 @@ eel_g_list_partition (GList *list,
     return predicate_true;
 }
 
+/* Sorting on more threads stops paying off below this many
+ * elements per thread.
+ */
+#define PARALLEL_SORT_MIN_CHUNK 4096
+#define PARALLEL_SORT_MAX_THREADS 8
+
+typedef struct
+{
+    gpointer *source;
+    gpointer *destination;
+    /* [start, middle) is merged with [middle, end) */
+    guint start;
+    guint middle;
+    guint end;
+    GCompareDataFunc compare_func;
+    gpointer user_data;
+} SortRun;
+
+static gint
+compare_pointed_to (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    SortRun *run;
+
+    run = user_data;
+    return run->compare_func (*(gpointer *) a, *(gpointer *) b, run->user_data);
+}
+
+static gpointer
+sort_run (gpointer data)
+{
+    SortRun *run;
+
+    run = data;
+    g_qsort_with_data (run->source + run->start, run->end - run->start,
+                       sizeof (gpointer), compare_pointed_to, run);
+
+    return NULL;
+}
+
+static gpointer
+merge_runs (gpointer data)
+{
+    SortRun *run;
+    guint i, j, k;
+
+    run = data;
+    i = run->start;
+    j = run->middle;
+    k = run->start;
+
+    while (i < run->middle && j < run->end)
+    {
+        /* Take from the left on ties to keep the sort stable */
+        if (run->compare_func (run->source[j], run->source[i], run->user_data) < 0)
+        {
+            run->destination[k++] = run->source[j++];
+        }
+        else
+        {
+            run->destination[k++] = run->source[i++];
+        }
+    }
+    memcpy (run->destination + k, run->source + i, (run->middle - i) * sizeof (gpointer));
+    k += run->middle - i;
+    memcpy (run->destination + k, run->source + j, (run->end - j) * sizeof (gpointer));
+
+    return NULL;
+}
+
+static void
+run_in_threads (GThreadFunc func, SortRun *runs, guint n_runs)
+{
+    GThread **threads;
+    guint i;
+
+    threads = g_new (GThread *, n_runs);
+    for (i = 1; i < n_runs; i++)
+    {
+        threads[i] = g_thread_new ("eel-sort", func, &runs[i]);
+    }
+
+    /* The calling thread takes its share too */
+    func (&runs[0]);
+
+    for (i = 1; i < n_runs; i++)
+    {
+        g_thread_join (threads[i]);
+    }
+    g_free (threads);
+}
+
+/**
+ * eel_sort_in_parallel:
+ *
+ * Sort an array of pointers like g_qsort_with_data, splitting large
+ * arrays in chunks that are sorted and then merged on several threads.
+ * The sort is stable. It returns when the array is sorted, but
+ * @compare_func is called from other threads in the meantime, so it
+ * must not change anything or read what another thread could change.
+ *
+ * @array: The pointers to sort.
+ * @length: The number of pointers in @array.
+ * @compare_func: Comparison function, called with the pointers.
+ * @user_data: Data to pass to @compare_func.
+ */
+void
+eel_sort_in_parallel (gpointer *array,
+                      guint length,
+                      GCompareDataFunc compare_func,
+                      gpointer user_data)
+{
+    SortRun *runs;
+    gpointer *source, *destination, *swap;
+    guint *bounds;
+    guint n_chunks, n_merges, width, i;
+
+    n_chunks = MIN ((guint) g_get_num_processors (), PARALLEL_SORT_MAX_THREADS);
+    n_chunks = MIN (n_chunks, length / PARALLEL_SORT_MIN_CHUNK);
+    n_chunks = MAX (n_chunks, 1);
+
+    runs = g_new (SortRun, n_chunks);
+    bounds = g_new (guint, n_chunks + 1);
+    for (i = 0; i <= n_chunks; i++)
+    {
+        bounds[i] = (guint64) length * i / n_chunks;
+    }
+
+    for (i = 0; i < n_chunks; i++)
+    {
+        runs[i].source = array;
+        runs[i].destination = NULL;
+        runs[i].start = bounds[i];
+        runs[i].middle = bounds[i + 1];
+        runs[i].end = bounds[i + 1];
+        runs[i].compare_func = compare_func;
+        runs[i].user_data = user_data;
+    }
+    run_in_threads (sort_run, runs, n_chunks);
+
+    /* Merge the sorted chunks pairwise, back and forth between the
+     * array and a buffer, until there is only one left.
+     */
+    source = array;
+    destination = n_chunks > 1 ? g_new (gpointer, length) : NULL;
+    for (width = 1; width < n_chunks; width *= 2)
+    {
+        n_merges = 0;
+        for (i = 0; i < n_chunks; i += 2 * width)
+        {
+            runs[n_merges].source = source;
+            runs[n_merges].destination = destination;
+            runs[n_merges].start = bounds[i];
+            runs[n_merges].middle = bounds[MIN (i + width, n_chunks)];
+            runs[n_merges].end = bounds[MIN (i + 2 * width, n_chunks)];
+            n_merges++;
+        }
+        run_in_threads (merge_runs, runs, n_merges);
+
+        swap = source;
+        source = destination;
+        destination = swap;
+    }
+
+    if (source != array)
+    {
+        memcpy (array, source, length * sizeof (gpointer));
+        destination = source;
+    }
+
+    g_free (destination);
+    g_free (bounds);
+    g_free (runs);
+}
+
 /**
  * eel_get_system_time
  *
@@ -979,6 +1154,41 @@ eel_test_predicate (gpointer data,
     return g_ascii_strcasecmp (data, callback_data) <= 0;
 }
 
+static int
+compare_test_pointers (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    return GPOINTER_TO_INT (a) / 2 - GPOINTER_TO_INT (b) / 2;
+}
+
+static gboolean
+check_sort_in_parallel (guint length)
+{
+    gpointer *array;
+    guint i;
+    gboolean sorted;
+
+    /* Pairs of equal keys, in reverse, checks stability too */
+    array = g_new (gpointer, length);
+    for (i = 0; i < length; i++)
+    {
+        array[i] = GINT_TO_POINTER (2 * (length - 1 - i / 2) + i % 2);
+    }
+
+    eel_sort_in_parallel (array, length, compare_test_pointers, NULL);
+
+    sorted = TRUE;
+    for (i = 1; i < length; i++)
+    {
+        if (GPOINTER_TO_INT (array[i - 1]) >= GPOINTER_TO_INT (array[i]))
+        {
+            sorted = FALSE;
+        }
+    }
+    g_free (array);
+
+    return sorted;
+}
+
 static char *
 test_strftime (const char *format,
                int year,
@@ -1111,6 +1321,11 @@ eel_self_check_glib_extensions (void)
     g_list_free (expected_failed);
     g_list_free (actual_failed);
 
+    /* eel_sort_in_parallel */
+    EEL_CHECK_BOOLEAN_RESULT (check_sort_in_parallel (0), TRUE);
+    EEL_CHECK_BOOLEAN_RESULT (check_sort_in_parallel (7), TRUE);
+    EEL_CHECK_BOOLEAN_RESULT (check_sort_in_parallel (100003), TRUE);
+
     /* eel_strdup_strftime */
     huge_string = g_new (char, 10000+1);
     memset (huge_string, 'a', 10000);
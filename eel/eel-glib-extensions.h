@@ -54,6 +54,12 @@ GList *     eel_g_list_partition                        (GList                 *
         gpointer               user_data,
         GList                **removed);
 
+/* Sorting. */
+void        eel_sort_in_parallel                        (gpointer              *array,
+        guint                  length,
+        GCompareDataFunc       compare_func,
+        gpointer               user_data);
+
 /* List functions for lists of g_free'able objects. */
 void        eel_g_list_free_deep                        (GList                 *list);
 void        eel_g_list_free_deep_custom                 (GList                 *list,
@@ -24,6 +24,8 @@
 
 #include <config.h>
 
+#include "caja-debug-log.h"
+#include "caja-directory-cache.h"
 #include "caja-directory-notify.h"
 #include "caja-directory-private.h"
 #include "caja-file-attributes.h"
@@ -33,11 +35,14 @@
 #include "caja-global-preferences.h"
 #include "caja-link.h"
 #include "caja-marshal.h"
+#include "caja-thumbnails.h"
 #include <eel/eel-glib-extensions.h>
+#include <gio/gunixmounts.h>
 #include <gtk/gtk.h>
 #include <libxml/parser.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /* turn this on to see messages about each load_directory call: */
 #if 0
@@ -54,10 +59,71 @@
 #define DEBUG_START_STOP
 #endif
 
+/* Number of files asked for in the first g_file_enumerator_next_files
+ * call of a directory load. Later calls adapt the batch size to how
+ * fast the file system answers and how busy the main loop is.
+ */
 #define DIRECTORY_LOAD_ITEMS_PER_CALLBACK 100
+#define DIRECTORY_LOAD_MIN_ITEMS_PER_CALLBACK 25
+#define DIRECTORY_LOAD_MAX_ITEMS_PER_CALLBACK 1600
+
+/* Batches answered faster than this grow, slower ones shrink (usec). */
+#define DIRECTORY_LOAD_FAST_LATENCY (10 * 1000)
+#define DIRECTORY_LOAD_SLOW_LATENCY (250 * 1000)
+
+/* Main loop time dequeue_pending_idle_callback may use per iteration
+ * before it yields to let the UI draw a frame (usec).
+ */
+#define DEQUEUE_PENDING_TIME_BUDGET (10 * 1000)
+#define DEQUEUE_PENDING_CHECK_INTERVAL 32
+
+/* Limits on the number of async. jobs kept in flight, used until the
+ * preferences have been read.
+ */
+#define DEFAULT_ASYNC_JOBS_PER_KIND 8
+#define DEFAULT_ASYNC_JOBS_PER_FILESYSTEM 16
+
+/* How far into the work queue we look for files to start file info
+ * requests for, while earlier ones are still in flight.
+ */
+#define FILE_INFO_PIPELINE_LOOKAHEAD 64
 
-/* Keep async. jobs down to this number for all directories. */
-#define MAX_ASYNC_JOBS 10
+/* How long the thumbnails of a directory nobody shows any more stay
+ * queued, so that showing it again soon, like when switching views,
+ * doesn't start over (seconds).
+ */
+#define THUMBNAIL_CANCEL_DELAY 5
+
+typedef enum
+{
+    ASYNC_JOB_FILE_LIST,
+    ASYNC_JOB_FILE_INFO,
+    ASYNC_JOB_LINK_INFO,
+    ASYNC_JOB_DIRECTORY_COUNT,
+    ASYNC_JOB_DEEP_COUNT,
+    ASYNC_JOB_MIME_LIST,
+    ASYNC_JOB_TOP_LEFT,
+    ASYNC_JOB_EXTENSION_INFO,
+    ASYNC_JOB_THUMBNAIL,
+    ASYNC_JOB_MOUNT,
+    ASYNC_JOB_FILESYSTEM_INFO,
+    ASYNC_JOB_LAST
+} AsyncJobKind;
+
+static const char * const async_job_names[ASYNC_JOB_LAST] =
+{
+    "file list",
+    "file info",
+    "link info",
+    "directory count",
+    "deep count",
+    "MIME list",
+    "top left",
+    "extension info",
+    "thumbnail",
+    "mount",
+    "filesystem info"
+};
 
 struct TopLeftTextReadState
 {
@@ -105,6 +171,8 @@ struct DirectoryLoadState
     GHashTable *load_mime_list_hash;
     CajaFile *load_directory_file;
     int load_file_count;
+    int items_per_callback;
+    gint64 request_time;
 };
 
 struct MimeListState
@@ -114,11 +182,14 @@ struct MimeListState
     GCancellable *cancellable;
     GFileEnumerator *enumerator;
     GHashTable *mime_list_hash;
+    int items_per_callback;
+    gint64 request_time;
 };
 
 struct GetInfoState
 {
     CajaDirectory *directory;
+    CajaFile *file;
     GCancellable *cancellable;
 };
 
@@ -136,6 +207,8 @@ struct DirectoryCountState
     GCancellable *cancellable;
     GFileEnumerator *enumerator;
     int file_count;
+    int items_per_callback;
+    gint64 request_time;
 };
 
 struct DeepCountState
@@ -147,6 +220,8 @@ struct DeepCountState
     GList *deep_count_subdirectories;
     GArray *seen_deep_count_inodes;
     char *fs_id;
+    int items_per_callback;
+    gint64 request_time;
 };
 
 
@@ -187,9 +262,35 @@ typedef struct
 typedef gboolean (* RequestCheck) (Request);
 typedef gboolean (* FileCheck) (CajaFile *);
 
-/* Current number of async. jobs. */
+/* Jobs, active directories and waiting directories on one file system. */
+typedef struct
+{
+    int jobs;
+    int directories;
+    int waiting;
+    gboolean slot_freed; /* since its directories were last woken up */
+    gboolean waking; /* slot_freed, as async_job_wake_up found it */
+} AsyncJobFilesystem;
+
+/* Current number of async. jobs, in total, per kind and per file system. */
 static int async_job_count;
-static GHashTable *waiting_directories;
+static int async_job_kind_count[ASYNC_JOB_LAST];
+static GHashTable *async_job_filesystems;
+
+/* Number of directories that have at least one job running. */
+static int async_job_active_directories;
+
+/* Directories blocked on a job slot, in the order they asked for one. */
+static GQueue waiting_directories = G_QUEUE_INIT;
+
+/* A slot that any directory may be waiting for was freed, like that
+ * of a kind that was at its limit.
+ */
+static gboolean async_job_wake_all;
+
+static gboolean async_job_limits_initialized;
+static int async_jobs_per_kind = DEFAULT_ASYNC_JOBS_PER_KIND;
+static int async_jobs_per_filesystem = DEFAULT_ASYNC_JOBS_PER_FILESYSTEM;
 #ifdef DEBUG_ASYNC_JOBS
 static GHashTable *async_jobs;
 #endif
@@ -198,6 +299,7 @@ static GHashTable *async_jobs;
 static char *kde_trash_dir_name = NULL;
 
 /* Forward declarations for functions that need them. */
+static void     async_job_wake_up                             (void);
 static void     deep_count_load                               (DeepCountState         *state,
         GFile                  *location);
 static gboolean request_is_satisfied                          (CajaDirectory      *directory,
@@ -372,44 +474,260 @@ caja_directory_verify_request_counts (CajaDirectory *directory)
 }
 #endif
 
+static void
+async_job_limits_changed_callback (gpointer callback_data)
+{
+    async_jobs_per_kind = MAX (1, g_settings_get_int (caja_preferences,
+                                   CAJA_PREFERENCES_ASYNC_JOBS_PER_KIND));
+    async_jobs_per_filesystem = MAX (1, g_settings_get_int (caja_preferences,
+                                     CAJA_PREFERENCES_ASYNC_JOBS_PER_FILESYSTEM));
+
+    /* Raising the limits may unblock some directories. */
+    if (callback_data == NULL)
+    {
+        async_job_wake_all = TRUE;
+        async_job_wake_up ();
+    }
+}
+
+static void
+async_job_limits_init (void)
+{
+    if (async_job_limits_initialized)
+    {
+        return;
+    }
+    async_job_limits_initialized = TRUE;
+
+    async_job_filesystems = g_hash_table_new_full (g_str_hash, g_str_equal,
+                            g_free, g_free);
+
+    async_job_limits_changed_callback (GINT_TO_POINTER (1));
+    g_signal_connect_swapped (caja_preferences,
+                              "changed::" CAJA_PREFERENCES_ASYNC_JOBS_PER_KIND,
+                              G_CALLBACK (async_job_limits_changed_callback),
+                              NULL);
+    g_signal_connect_swapped (caja_preferences,
+                              "changed::" CAJA_PREFERENCES_ASYNC_JOBS_PER_FILESYSTEM,
+                              G_CALLBACK (async_job_limits_changed_callback),
+                              NULL);
+}
+
+/* Return the mount point of a local path from the mount table, which
+ * is only read again after it changed. Nothing on the path itself is
+ * looked at, so this can't block on a hung file system.
+ */
+static char *
+get_mount_point (const char *path)
+{
+    static GList *mounts;
+    static guint64 mounts_time;
+    const char *mount_path, *best;
+    gsize length, best_length;
+    GList *l;
+
+    if (mounts == NULL || g_unix_mounts_changed_since (mounts_time))
+    {
+        g_list_free_full (mounts, (GDestroyNotify) g_unix_mount_free);
+        mounts = g_unix_mounts_get (&mounts_time);
+    }
+
+    best = NULL;
+    best_length = 0;
+    for (l = mounts; l != NULL; l = l->next)
+    {
+        mount_path = g_unix_mount_get_mount_path (l->data);
+        length = strlen (mount_path);
+        if ((best == NULL || length > best_length) &&
+                g_str_has_prefix (path, mount_path) &&
+                (path[length] == '/' || path[length] == '\0' ||
+                 (length > 0 && mount_path[length - 1] == '/')))
+        {
+            best = mount_path;
+            best_length = length;
+        }
+    }
+
+    return g_strdup (best);
+}
+
+/* Return the key used to count the jobs running on the file system
+ * the directory lives on: the mount point of a local directory, the
+ * scheme and host part of the URI of any other. This is known up
+ * front and never changes, so a directory is always counted under the
+ * same key, even before its file system id is read.
+ */
+static const char *
+async_job_get_filesystem_key (CajaDirectory *directory)
+{
+    char *uri, *path, *mount_point, *p;
+
+    if (directory->details->async_job_filesystem != NULL)
+    {
+        return directory->details->async_job_filesystem;
+    }
+
+    mount_point = NULL;
+    if (g_file_is_native (directory->details->location))
+    {
+        path = g_file_get_path (directory->details->location);
+        if (path != NULL)
+        {
+            mount_point = get_mount_point (path);
+            g_free (path);
+        }
+    }
+
+    if (mount_point != NULL)
+    {
+        directory->details->async_job_filesystem =
+            g_strconcat ("file://", mount_point, NULL);
+        g_free (mount_point);
+
+        return directory->details->async_job_filesystem;
+    }
+
+    uri = g_file_get_uri (directory->details->location);
+    p = strstr (uri, "://");
+    if (p != NULL)
+    {
+        p = strchr (p + 3, '/');
+        if (p != NULL)
+        {
+            *p = '\0';
+        }
+    }
+    directory->details->async_job_filesystem = uri;
+
+    return directory->details->async_job_filesystem;
+}
+
+static AsyncJobFilesystem *
+async_job_get_filesystem (CajaDirectory *directory)
+{
+    const char *key;
+    AsyncJobFilesystem *filesystem;
+
+    async_job_limits_init ();
+
+    key = async_job_get_filesystem_key (directory);
+    filesystem = g_hash_table_lookup (async_job_filesystems, key);
+    if (filesystem == NULL)
+    {
+        filesystem = g_new0 (AsyncJobFilesystem, 1);
+        g_hash_table_insert (async_job_filesystems, g_strdup (key), filesystem);
+    }
+
+    return filesystem;
+}
+
+/* Forget a file system once nothing runs or waits on it any more. */
+static void
+async_job_release_filesystem (CajaDirectory *directory,
+                              AsyncJobFilesystem *filesystem)
+{
+    if (filesystem->jobs == 0 && filesystem->waiting == 0)
+    {
+        g_assert (filesystem->directories == 0);
+        g_hash_table_remove (async_job_filesystems,
+                             async_job_get_filesystem_key (directory));
+    }
+}
+
+static void
+async_job_wait (CajaDirectory *directory)
+{
+    if (directory->details->async_job_waiting)
+    {
+        return;
+    }
+
+    directory->details->async_job_waiting = TRUE;
+    g_queue_push_tail (&waiting_directories, directory);
+    async_job_get_filesystem (directory)->waiting += 1;
+
+    caja_directory_async_log_queue_depths ();
+}
+
+static void
+async_job_clear_waiting (CajaDirectory *directory)
+{
+    AsyncJobFilesystem *filesystem;
+
+    directory->details->async_job_waiting = FALSE;
+
+    filesystem = async_job_get_filesystem (directory);
+    g_assert (filesystem->waiting > 0);
+    filesystem->waiting -= 1;
+    async_job_release_filesystem (directory, filesystem);
+}
+
+static void
+async_job_stop_waiting (CajaDirectory *directory)
+{
+    if (directory->details->async_job_waiting)
+    {
+        /* The others get a bigger share of the file system */
+        async_job_get_filesystem (directory)->slot_freed = TRUE;
+
+        g_queue_remove (&waiting_directories, directory);
+        async_job_clear_waiting (directory);
+    }
+}
+
 /* Start a job. This is really just a way of limiting the number of
  * async. requests that we issue at any given time. Without this, the
- * number of requests is unbounded.
+ * number of requests is unbounded. Jobs are limited per kind and per
+ * file system, and while other directories are waiting for a slot on
+ * the same file system a directory can only use its fair share of that
+ * file system's limit.
  */
 static gboolean
 async_job_start (CajaDirectory *directory,
-                 const char *job)
+                 AsyncJobKind kind)
 {
+    AsyncJobFilesystem *filesystem;
+    int directories, fair_share;
 #ifdef DEBUG_ASYNC_JOBS
     char *key;
 #endif
 
 #ifdef DEBUG_START_STOP
-    g_message ("starting %s in %p", job, directory->details->location);
+    g_message ("starting %s in %p", async_job_names[kind], directory->details->location);
 #endif
 
     g_assert (async_job_count >= 0);
-    g_assert (async_job_count <= MAX_ASYNC_JOBS);
+    g_assert (async_job_kind_count[kind] >= 0);
 
-    if (async_job_count >= MAX_ASYNC_JOBS)
-    {
-        if (waiting_directories == NULL)
-        {
-            waiting_directories = eel_g_hash_table_new_free_at_exit
-                                  (NULL, NULL,
-                                   "caja-directory-async.c: waiting_directories");
-        }
+    filesystem = async_job_get_filesystem (directory);
 
-        g_hash_table_insert (waiting_directories,
-                             directory,
-                             directory);
+    /* Share the file system limit between the directories running on
+     * it and the ones waiting for it, counting this one once.
+     */
+    fair_share = async_jobs_per_filesystem;
+    directories = filesystem->directories + filesystem->waiting;
+    if (directory->details->async_job_count == 0 &&
+            !directory->details->async_job_waiting)
+    {
+        directories += 1;
+    }
+    if (directories > 1 && filesystem->waiting > 0)
+    {
+        fair_share = MAX (1, async_jobs_per_filesystem / directories);
+    }
 
+    if (async_job_kind_count[kind] >= async_jobs_per_kind ||
+            filesystem->jobs >= async_jobs_per_filesystem ||
+            directory->details->async_job_count >= fair_share)
+    {
+        async_job_wait (directory);
         return FALSE;
     }
 
 #ifdef DEBUG_ASYNC_JOBS
     {
         char *uri;
+        int count;
         if (async_jobs == NULL)
         {
             async_jobs = eel_g_hash_table_new_free_at_exit
@@ -417,117 +735,191 @@ async_job_start (CajaDirectory *directory,
                           "caja-directory-async.c: async_jobs");
         }
         uri = caja_directory_get_uri (directory);
-        key = g_strconcat (uri, ": ", job, NULL);
-        if (g_hash_table_lookup (async_jobs, key) != NULL)
+        key = g_strconcat (uri, ": ", async_job_names[kind], NULL);
+        count = GPOINTER_TO_INT (g_hash_table_lookup (async_jobs, key));
+        if (count != 0 && kind != ASYNC_JOB_FILE_INFO)
         {
             g_warning ("same job twice: %s in %s",
-                       job, uri);
+                       async_job_names[kind], uri);
         }
         g_free (uri);
-        g_hash_table_insert (async_jobs, key, directory);
+        g_hash_table_replace (async_jobs, key, GINT_TO_POINTER (count + 1));
     }
 #endif
 
     async_job_count += 1;
+    async_job_kind_count[kind] += 1;
+    filesystem->jobs += 1;
+    if (directory->details->async_job_count == 0)
+    {
+        async_job_active_directories += 1;
+        filesystem->directories += 1;
+    }
+    directory->details->async_job_count += 1;
+
     return TRUE;
 }
 
 /* End a job. */
 static void
 async_job_end (CajaDirectory *directory,
-               const char *job)
+               AsyncJobKind kind)
 {
+    AsyncJobFilesystem *filesystem;
 #ifdef DEBUG_ASYNC_JOBS
     char *key;
-    gpointer table_key, value;
 #endif
 
 #ifdef DEBUG_START_STOP
-    g_message ("stopping %s in %p", job, directory->details->location);
+    g_message ("stopping %s in %p", async_job_names[kind], directory->details->location);
 #endif
 
     g_assert (async_job_count > 0);
+    g_assert (async_job_kind_count[kind] > 0);
+    g_assert (directory->details->async_job_count > 0);
 
 #ifdef DEBUG_ASYNC_JOBS
     {
         char *uri;
+        int count;
         uri = caja_directory_get_uri (directory);
         g_assert (async_jobs != NULL);
-        key = g_strconcat (uri, ": ", job, NULL);
-        if (!g_hash_table_lookup_extended (async_jobs, key, &table_key, &value))
+        key = g_strconcat (uri, ": ", async_job_names[kind], NULL);
+        count = GPOINTER_TO_INT (g_hash_table_lookup (async_jobs, key));
+        if (count == 0)
         {
             g_warning ("ending job we didn't start: %s in %s",
-                       job, uri);
+                       async_job_names[kind], uri);
+            g_free (key);
         }
-        else
+        else if (count == 1)
         {
             g_hash_table_remove (async_jobs, key);
-            g_free (table_key);
+            g_free (key);
+        }
+        else
+        {
+            g_hash_table_replace (async_jobs, key, GINT_TO_POINTER (count - 1));
         }
         g_free (uri);
-        g_free (key);
     }
 #endif
 
+    /* Directories on other file systems may wait for this kind */
+    if (async_job_kind_count[kind] >= async_jobs_per_kind)
+    {
+        async_job_wake_all = TRUE;
+    }
+
     async_job_count -= 1;
-}
+    async_job_kind_count[kind] -= 1;
 
-/* Helper to get one value from a hash table. */
-static void
-get_one_value_callback (gpointer key, gpointer value, gpointer callback_data)
-{
-    gpointer *returned_value;
+    filesystem = async_job_get_filesystem (directory);
+    g_assert (filesystem->jobs > 0);
+    filesystem->jobs -= 1;
+    filesystem->slot_freed = TRUE;
+
+    directory->details->async_job_count -= 1;
+    if (directory->details->async_job_count == 0)
+    {
+        async_job_active_directories -= 1;
+        filesystem->directories -= 1;
+    }
 
-    returned_value = callback_data;
-    *returned_value = value;
+    async_job_release_filesystem (directory, filesystem);
 }
 
-/* return a single value from a hash table. */
-static gpointer
-get_one_value (GHashTable *table)
+static void
+async_job_filesystem_start_waking (gpointer key,
+                                   gpointer value,
+                                   gpointer user_data)
 {
-    gpointer value;
+    AsyncJobFilesystem *filesystem;
 
-    value = NULL;
-    if (table != NULL)
-    {
-        g_hash_table_foreach (table, get_one_value_callback, &value);
-    }
-    return value;
+    filesystem = value;
+    filesystem->waking = filesystem->slot_freed;
+    filesystem->slot_freed = FALSE;
 }
 
-/* Wake up directories that are "blocked" as long as there are job
- * slots available.
+/* Wake up directories that are "blocked" on a job slot on a file
+ * system where one was freed, or all of them if it was a slot they
+ * may all be waiting for. Each of them gets one chance, in the order
+ * they started waiting; the ones that still can't get a slot go to
+ * the back of the queue, so that no directory can starve the others.
  */
 static void
 async_job_wake_up (void)
 {
     static gboolean already_waking_up = FALSE;
-    gpointer value;
+    CajaDirectory *directory;
+    gboolean wake_all;
+    guint n;
 
     g_assert (async_job_count >= 0);
-    g_assert (async_job_count <= MAX_ASYNC_JOBS);
 
-    if (already_waking_up)
+    if (already_waking_up || g_queue_is_empty (&waiting_directories))
     {
         return;
     }
 
     already_waking_up = TRUE;
-    while (async_job_count < MAX_ASYNC_JOBS)
+
+    /* Slots freed by the directories woken up here are for the next
+     * round.
+     */
+    wake_all = async_job_wake_all;
+    async_job_wake_all = FALSE;
+    g_hash_table_foreach (async_job_filesystems,
+                          async_job_filesystem_start_waking, NULL);
+
+    n = g_queue_get_length (&waiting_directories);
+    while (n-- > 0)
     {
-        value = get_one_value (waiting_directories);
-        if (value == NULL)
+        directory = g_queue_pop_head (&waiting_directories);
+        if (directory == NULL)
         {
             break;
         }
-        g_hash_table_remove (waiting_directories, value);
-        caja_directory_async_state_changed
-        (CAJA_DIRECTORY (value));
+        if (!wake_all && !async_job_get_filesystem (directory)->waking)
+        {
+            g_queue_push_tail (&waiting_directories, directory);
+            continue;
+        }
+        async_job_clear_waiting (directory);
+        caja_directory_async_state_changed (directory);
     }
     already_waking_up = FALSE;
 }
 
+void
+caja_directory_async_log_queue_depths (void)
+{
+    GString *counts;
+    int i;
+
+    if (!caja_debug_log_is_domain_enabled (CAJA_DEBUG_LOG_DOMAIN_ASYNC))
+    {
+        return;
+    }
+
+    counts = g_string_new (NULL);
+    for (i = 0; i < ASYNC_JOB_LAST; i++)
+    {
+        if (async_job_kind_count[i] > 0)
+        {
+            g_string_append_printf (counts, ", %s: %d",
+                                    async_job_names[i], async_job_kind_count[i]);
+        }
+    }
+
+    caja_debug_log (FALSE, CAJA_DEBUG_LOG_DOMAIN_ASYNC,
+                    "async jobs: %d running in %d directories, %d directories waiting%s",
+                    async_job_count, async_job_active_directories,
+                    g_queue_get_length (&waiting_directories), counts->str);
+
+    g_string_free (counts, TRUE);
+}
+
 static void
 directory_count_cancel (CajaDirectory *directory)
 {
@@ -552,7 +944,7 @@ deep_count_cancel (CajaDirectory *directory)
         directory->details->deep_count_in_progress = NULL;
         directory->details->deep_count_file = NULL;
 
-        async_job_end (directory, "deep count");
+        async_job_end (directory, ASYNC_JOB_DEEP_COUNT);
     }
 }
 
@@ -574,7 +966,7 @@ top_left_cancel (CajaDirectory *directory)
         directory->details->top_left_read_state->directory = NULL;
         directory->details->top_left_read_state = NULL;
 
-        async_job_end (directory, "top left");
+        async_job_end (directory, ASYNC_JOB_TOP_LEFT);
     }
 }
 
@@ -586,7 +978,7 @@ link_info_cancel (CajaDirectory *directory)
         g_cancellable_cancel (directory->details->link_info_read_state->cancellable);
         directory->details->link_info_read_state->directory = NULL;
         directory->details->link_info_read_state = NULL;
-        async_job_end (directory, "link info");
+        async_job_end (directory, ASYNC_JOB_LINK_INFO);
     }
 }
 
@@ -598,7 +990,7 @@ thumbnail_cancel (CajaDirectory *directory)
         g_cancellable_cancel (directory->details->thumbnail_state->cancellable);
         directory->details->thumbnail_state->directory = NULL;
         directory->details->thumbnail_state = NULL;
-        async_job_end (directory, "thumbnail");
+        async_job_end (directory, ASYNC_JOB_THUMBNAIL);
     }
 }
 
@@ -610,22 +1002,37 @@ mount_cancel (CajaDirectory *directory)
         g_cancellable_cancel (directory->details->mount_state->cancellable);
         directory->details->mount_state->directory = NULL;
         directory->details->mount_state = NULL;
-        async_job_end (directory, "mount");
+        async_job_end (directory, ASYNC_JOB_MOUNT);
     }
 }
 
+static void
+file_info_cancel_state (CajaDirectory *directory,
+                        GetInfoState *state)
+{
+    g_cancellable_cancel (state->cancellable);
+    state->directory = NULL;
+    g_hash_table_remove (directory->details->get_info_in_progress, state->file);
+
+    async_job_end (directory, ASYNC_JOB_FILE_INFO);
+}
+
 static void
 file_info_cancel (CajaDirectory *directory)
 {
-    if (directory->details->get_info_in_progress != NULL)
+    GList *states, *l;
+
+    if (g_hash_table_size (directory->details->get_info_in_progress) == 0)
     {
-        g_cancellable_cancel (directory->details->get_info_in_progress->cancellable);
-        directory->details->get_info_in_progress->directory = NULL;
-        directory->details->get_info_in_progress = NULL;
-        directory->details->get_info_file = NULL;
+        return;
+    }
 
-        async_job_end (directory, "file info");
+    states = g_hash_table_get_values (directory->details->get_info_in_progress);
+    for (l = states; l != NULL; l = l->next)
+    {
+        file_info_cancel_state (directory, l->data);
     }
+    g_list_free (states);
 }
 
 static void
@@ -941,19 +1348,79 @@ should_skip_file (CajaDirectory *directory, GFileInfo *info)
     return FALSE;
 }
 
-static gboolean
-dequeue_pending_idle_callback (gpointer callback_data)
+/* The batch size for the next g_file_enumerator_next_files_async
+ * call of a count or mime list. These do not put anything on screen,
+ * so only how fast the file system answered matters.
+ */
+static int
+next_batch_size (int items_per_callback,
+                 gint64 request_time,
+                 int count)
 {
-    CajaDirectory *directory;
-    GList *pending_file_info;
+    gint64 latency;
+
+    latency = g_get_monotonic_time () - request_time;
+    if (latency > DIRECTORY_LOAD_SLOW_LATENCY)
+    {
+        items_per_callback /= 2;
+    }
+    else if (latency < DIRECTORY_LOAD_FAST_LATENCY &&
+             count >= items_per_callback)
+    {
+        items_per_callback *= 2;
+    }
+
+    return CLAMP (items_per_callback,
+                  DIRECTORY_LOAD_MIN_ITEMS_PER_CALLBACK,
+                  DIRECTORY_LOAD_MAX_ITEMS_PER_CALLBACK);
+}
+
+static void
+directory_load_set_batch_size (CajaDirectory *directory,
+                               DirectoryLoadState *state,
+                               int items_per_callback,
+                               const char *reason)
+{
+    char *uri;
+
+    items_per_callback = CLAMP (items_per_callback,
+                                DIRECTORY_LOAD_MIN_ITEMS_PER_CALLBACK,
+                                DIRECTORY_LOAD_MAX_ITEMS_PER_CALLBACK);
+    if (items_per_callback == state->items_per_callback)
+    {
+        return;
+    }
+
+    if (caja_debug_log_is_domain_enabled (CAJA_DEBUG_LOG_DOMAIN_ASYNC))
+    {
+        uri = caja_directory_get_uri (directory);
+        caja_debug_log (FALSE, CAJA_DEBUG_LOG_DOMAIN_ASYNC,
+                        "directory load of %s: batch size %d -> %d (%s)",
+                        uri, state->items_per_callback, items_per_callback, reason);
+        g_free (uri);
+    }
+
+    state->items_per_callback = items_per_callback;
+}
+
+/* Turn the pending GFileInfos into CajaFiles. When time_limited is
+ * set, stop after DEQUEUE_PENDING_TIME_BUDGET and leave the rest for
+ * another idle.
+ */
+static void
+dequeue_pending_files (CajaDirectory *directory,
+                       gboolean time_limited)
+{
+    GList *pending_file_info, *remaining_file_info;
     GList *node, *next;
     CajaFile *file;
     GList *changed_files, *added_files;
     GFileInfo *file_info;
     const char *mimetype, *name;
     DirectoryLoadState *dir_load_state;
-
-    directory = CAJA_DIRECTORY (callback_data);
+    gint64 start_time;
+    int count;
+    gboolean from_cache;
 
     caja_directory_ref (directory);
 
@@ -972,16 +1439,52 @@ dequeue_pending_idle_callback (gpointer callback_data)
 
     added_files = NULL;
     changed_files = NULL;
+    remaining_file_info = NULL;
 
     dir_load_state = directory->details->directory_load_in_progress;
 
+    start_time = g_get_monotonic_time ();
+    count = 0;
+
     /* Build a list of CajaFile objects. */
     for (node = pending_file_info; node != NULL; node = node->next)
     {
+        /* Don't hog the main loop; leave the rest for the next idle. */
+        if (time_limited &&
+                ++count % DEQUEUE_PENDING_CHECK_INTERVAL == 0 &&
+                g_get_monotonic_time () - start_time > DEQUEUE_PENDING_TIME_BUDGET)
+        {
+            remaining_file_info = node->next;
+            if (remaining_file_info != NULL)
+            {
+                node->next = NULL;
+                remaining_file_info->prev = NULL;
+            }
+        }
+
         file_info = node->data;
 
         name = g_file_info_get_name (file_info);
 
+        /* Files from the snapshot stand in for the real ones until
+         * the enumeration confirms them or they are found to be gone.
+         */
+        from_cache = g_file_info_get_attribute_boolean (file_info,
+                     CAJA_DIRECTORY_CACHE_ATTRIBUTE);
+        if (from_cache)
+        {
+            if (caja_directory_find_file_by_name (directory, name) == NULL)
+            {
+                file = caja_file_new_from_info (directory, file_info);
+                caja_directory_add_file (directory, file);
+                set_file_unconfirmed (file, TRUE);
+                file->details->from_directory_snapshot = TRUE;
+                file->details->is_added = TRUE;
+                added_files = g_list_prepend (added_files, file);
+            }
+            continue;
+        }
+
         /* Update the file count. */
         /* FIXME bugzilla.gnome.org 45063: This could count a
          * file twice if we get it from both load_directory
@@ -1010,12 +1513,20 @@ dequeue_pending_idle_callback (gpointer callback_data)
             /* file already exists in dir, check if we still need to
              *  emit file_added or if it changed */
             set_file_unconfirmed (file, FALSE);
+            file->details->from_directory_snapshot = FALSE;
             if (!file->details->is_added)
             {
                 /* We consider this newly added even if its in the list.
                  * This can happen if someone called caja_file_get_by_uri()
                  * on a file in the folder before the add signal was
                  * emitted */
+                if (!file->details->file_info_is_up_to_date)
+                {
+                    /* The enumeration got us the same attributes a
+                     * query_info would, so don't ask for them again.
+                     */
+                    caja_file_update_info (file, file_info);
+                }
                 caja_file_ref (file);
                 file->details->is_added = TRUE;
                 added_files = g_list_prepend (added_files, file);
@@ -1037,10 +1548,30 @@ dequeue_pending_idle_callback (gpointer callback_data)
         }
     }
 
+    if (remaining_file_info != NULL)
+    {
+        /* The UI is falling behind, so ask for smaller batches. */
+        if (dir_load_state != NULL)
+        {
+            directory_load_set_batch_size (directory, dir_load_state,
+                                           dir_load_state->items_per_callback / 2,
+                                           "main loop budget exceeded");
+        }
+
+        /* Put the files we didn't get to back in front of any that
+         * arrived in the meantime, and come back for them.
+         */
+        directory->details->pending_file_info =
+            g_list_concat (directory->details->pending_file_info,
+                           g_list_reverse (remaining_file_info));
+        caja_directory_schedule_dequeue_pending (directory);
+    }
+
     /* If we are done loading, then we assume that any unconfirmed
          * files are gone.
      */
-    if (directory->details->directory_loaded)
+    if (directory->details->directory_loaded &&
+            directory->details->pending_file_info == NULL)
     {
         for (node = directory->details->file_list;
                 node != NULL; node = next)
@@ -1065,7 +1596,8 @@ dequeue_pending_idle_callback (gpointer callback_data)
     caja_file_list_free (added_files);
 
     if (directory->details->directory_loaded &&
-            !directory->details->directory_loaded_sent_notification)
+            !directory->details->directory_loaded_sent_notification &&
+            directory->details->pending_file_info == NULL)
     {
         /* Send the done_loading signal. */
         caja_directory_emit_done_loading (directory);
@@ -1084,6 +1616,13 @@ dequeue_pending_idle_callback (gpointer callback_data)
             file->details->mime_list = istr_set_get_as_list
                                        (dir_load_state->load_mime_list_hash);
 
+            if (dir_load_state->load_file_count >= CAJA_DIRECTORY_CACHE_MIN_FILES)
+            {
+                caja_directory_cache_save (directory->details->location,
+                                           file->details->mtime,
+                                           directory->details->file_list);
+            }
+
             caja_file_changed (file);
         }
 
@@ -1099,6 +1638,13 @@ drain:
     caja_directory_async_state_changed (directory);
 
     caja_directory_unref (directory);
+}
+
+static gboolean
+dequeue_pending_idle_callback (gpointer callback_data)
+{
+    dequeue_pending_files (CAJA_DIRECTORY (callback_data), TRUE);
+
     return FALSE;
 }
 
@@ -1139,6 +1685,55 @@ directory_load_one (CajaDirectory *directory,
     caja_directory_schedule_dequeue_pending (directory);
 }
 
+/* Files from a snapshot that the enumeration never got to may not
+ * exist any more, so they can't be left in the directory when a load
+ * stops before it is done.
+ */
+static gboolean
+drop_snapshot_files_idle_callback (gpointer callback_data)
+{
+    CajaDirectory *directory;
+    GList *node, *next, *changed_files;
+    CajaFile *file;
+
+    directory = callback_data;
+    directory->details->drop_snapshot_files_idle_id = 0;
+
+    /* A new load reconciles them with what is really there. */
+    if (directory->details->directory_load_in_progress != NULL ||
+            directory->details->directory_loaded)
+    {
+        caja_directory_unref (directory);
+        return FALSE;
+    }
+
+    changed_files = NULL;
+    for (node = directory->details->file_list; node != NULL; node = next)
+    {
+        file = CAJA_FILE (node->data);
+        next = node->next;
+
+        if (file->details->from_directory_snapshot &&
+                file->details->unconfirmed)
+        {
+            caja_file_ref (file);
+            changed_files = g_list_prepend (changed_files, file);
+
+            caja_file_mark_gone (file);
+        }
+    }
+
+    if (changed_files != NULL)
+    {
+        caja_directory_emit_change_signals (directory, changed_files);
+        caja_file_list_free (changed_files);
+    }
+
+    caja_directory_unref (directory);
+
+    return FALSE;
+}
+
 static void
 directory_load_cancel (CajaDirectory *directory)
 {
@@ -1158,7 +1753,18 @@ directory_load_cancel (CajaDirectory *directory)
         g_cancellable_cancel (state->cancellable);
         state->directory = NULL;
         directory->details->directory_load_in_progress = NULL;
-        async_job_end (directory, "file list");
+        async_job_end (directory, ASYNC_JOB_FILE_LIST);
+
+        /* This is also how a finished load ends; only a load that
+         * was stopped half way can leave snapshot files behind.
+         */
+        if (!directory->details->directory_loaded &&
+                directory->details->drop_snapshot_files_idle_id == 0)
+        {
+            directory->details->drop_snapshot_files_idle_id =
+                g_idle_add (drop_snapshot_files_idle_callback,
+                            caja_directory_ref (directory));
+        }
     }
 }
 
@@ -1200,32 +1806,61 @@ directory_load_done (CajaDirectory *directory,
          * we don't know the status of the files in this directory.
          * We clear the unconfirmed bit on each file here so that
          * they won't be marked "gone" later -- we don't know enough
-         * about them to know whether they are really gone.
+         * about them to know whether they are really gone. Files
+         * that only come from a snapshot are not known to exist at
+         * all, so those stay unconfirmed and are dropped.
          */
         for (node = directory->details->file_list;
                 node != NULL; node = node->next)
         {
-            set_file_unconfirmed (CAJA_FILE (node->data), FALSE);
+            if (!CAJA_FILE (node->data)->details->from_directory_snapshot)
+            {
+                set_file_unconfirmed (CAJA_FILE (node->data), FALSE);
+            }
         }
 
         caja_directory_emit_load_error (directory, error);
     }
 
-    /* Call the idle function right away. */
+    /* Call the idle function right away, and let it finish the job
+     * while we still have the load state it reports the count and
+     * MIME list from.
+     */
     if (directory->details->dequeue_pending_idle_id != 0)
     {
         g_source_remove (directory->details->dequeue_pending_idle_id);
     }
-    dequeue_pending_idle_callback (directory);
+    dequeue_pending_files (directory, FALSE);
 
     directory_load_cancel (directory);
 }
 
+static gboolean
+cancel_thumbnails_callback (gpointer callback_data)
+{
+    CajaDirectory *directory;
+    char *uri;
+
+    directory = CAJA_DIRECTORY (callback_data);
+    directory->details->thumbnail_cancel_timeout_id = 0;
+
+    if (directory->details->monitor_list == NULL)
+    {
+        uri = caja_directory_get_uri (directory);
+        caja_thumbnail_cancel_directory (uri);
+        g_free (uri);
+    }
+
+    return FALSE;
+}
+
 void
 caja_directory_monitor_remove_internal (CajaDirectory *directory,
                                         CajaFile *file,
                                         gconstpointer client)
 {
+    char *uri;
+
     g_assert (CAJA_IS_DIRECTORY (directory));
     g_assert (file == NULL || CAJA_IS_FILE (file));
     g_assert (client != NULL);
@@ -1239,6 +1874,28 @@ caja_directory_monitor_remove_internal (CajaDirectory *directory,
         directory->details->monitor = NULL;
     }
 
+    /* Nobody shows this directory any more, so let the thumbnail
+     * threads do the folders that are shown first, and cancel its
+     * thumbnails if that is still so a bit later.
+     */
+    if (directory->details->monitor_list == NULL)
+    {
+        uri = caja_directory_get_uri (directory);
+        caja_thumbnail_deprioritize_directory (uri);
+        g_free (uri);
+
+        if (directory->details->thumbnail_cancel_timeout_id != 0)
+        {
+            g_source_remove (directory->details->thumbnail_cancel_timeout_id);
+        }
+        directory->details->thumbnail_cancel_timeout_id =
+            g_timeout_add_seconds_full (G_PRIORITY_DEFAULT,
+                                        THUMBNAIL_CANCEL_DELAY,
+                                        cancel_thumbnails_callback,
+                                        caja_directory_ref (directory),
+                                        (GDestroyNotify) caja_directory_unref);
+    }
+
     /* XXX - do we need to remove anything from the work queue? */
 
     caja_directory_async_state_changed (directory);
@@ -1677,6 +2334,7 @@ caja_async_destroying_file (CajaFile *file)
     GList *node, *next;
     ReadyCallback *callback;
     Monitor *monitor;
+    GetInfoState *state;
 
     directory = file->details->directory;
     changed = FALSE;
@@ -1734,9 +2392,10 @@ caja_async_destroying_file (CajaFile *file)
         directory->details->mime_list_in_progress->mime_list_file = NULL;
         changed = TRUE;
     }
-    if (directory->details->get_info_file == file)
+    state = g_hash_table_lookup (directory->details->get_info_in_progress, file);
+    if (state != NULL)
     {
-        directory->details->get_info_file = NULL;
+        file_info_cancel_state (directory, state);
         changed = TRUE;
     }
     if (directory->details->top_left_read_state != NULL
@@ -2292,6 +2951,9 @@ more_files_callback (GObject *source_object,
     GError *error;
     GList *files, *l;
     GFileInfo *info;
+    gint64 latency;
+    int count;
+    gboolean ui_caught_up;
 
     state = user_data;
 
@@ -2310,12 +2972,20 @@ more_files_callback (GObject *source_object,
     error = NULL;
     files = g_file_enumerator_next_files_finish (state->enumerator,
             res, &error);
+    latency = g_get_monotonic_time () - state->request_time;
 
+    /* Whether the files of the last batch made it to the views; the
+     * ones below schedule the idle for this batch.
+     */
+    ui_caught_up = directory->details->dequeue_pending_idle_id == 0;
+
+    count = 0;
     for (l = files; l != NULL; l = l->next)
     {
         info = l->data;
         directory_load_one (directory, info);
         g_object_unref (info);
+        count++;
     }
 
     if (files == NULL)
@@ -2325,8 +2995,27 @@ more_files_callback (GObject *source_object,
     }
     else
     {
+        /* Get more per round trip from fast file systems, and get
+         * the first files on screen sooner from slow ones.
+         */
+        if (latency > DIRECTORY_LOAD_SLOW_LATENCY)
+        {
+            directory_load_set_batch_size (directory, state,
+                                           state->items_per_callback / 2,
+                                           "slow file system");
+        }
+        else if (latency < DIRECTORY_LOAD_FAST_LATENCY &&
+                 count >= state->items_per_callback &&
+                 ui_caught_up)
+        {
+            directory_load_set_batch_size (directory, state,
+                                           state->items_per_callback * 2,
+                                           "fast file system");
+        }
+
+        state->request_time = g_get_monotonic_time ();
         g_file_enumerator_next_files_async (state->enumerator,
-                                            DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
+                                            state->items_per_callback,
                                             G_PRIORITY_DEFAULT,
                                             state->cancellable,
                                             more_files_callback,
@@ -2375,8 +3064,9 @@ enumerate_children_callback (GObject *source_object,
     else
     {
         state->enumerator = enumerator;
+        state->request_time = g_get_monotonic_time ();
         g_file_enumerator_next_files_async (state->enumerator,
-                                            DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
+                                            state->items_per_callback,
                                             G_PRIORITY_DEFAULT,
                                             state->cancellable,
                                             more_files_callback,
@@ -2385,6 +3075,31 @@ enumerate_children_callback (GObject *source_object,
 }
 
 
+/* Queue the files of the last snapshot of a directory we don't have in
+ * memory, so they show up right away. The enumeration that follows
+ * reconciles them with what is really there.
+ */
+static void
+directory_load_from_cache (CajaDirectory *directory,
+                           CajaFile *directory_file)
+{
+    GList *infos, *l;
+
+    if (directory->details->file_list != NULL ||
+            !directory_file->details->file_info_is_up_to_date)
+    {
+        return;
+    }
+
+    infos = caja_directory_cache_load (directory->details->location,
+                                       directory_file->details->mtime);
+    for (l = infos; l != NULL; l = l->next)
+    {
+        directory_load_one (directory, l->data);
+    }
+    g_list_free_full (infos, g_object_unref);
+}
+
 /* Start monitoring the file list if it isn't already. */
 static void
 start_monitoring_file_list (CajaDirectory *directory)
@@ -2404,7 +3119,7 @@ start_monitoring_file_list (CajaDirectory *directory)
         return;
     }
 
-    if (!async_job_start (directory, "file list"))
+    if (!async_job_start (directory, ASYNC_JOB_FILE_LIST))
     {
         return;
     }
@@ -2416,6 +3131,7 @@ start_monitoring_file_list (CajaDirectory *directory)
     state->cancellable = g_cancellable_new ();
     state->load_mime_list_hash = istr_set_new ();
     state->load_file_count = 0;
+    state->items_per_callback = DIRECTORY_LOAD_ITEMS_PER_CALLBACK;
 
     g_assert (directory->details->location != NULL);
     state->load_directory_file =
@@ -2447,6 +3163,8 @@ start_monitoring_file_list (CajaDirectory *directory)
 
     directory->details->directory_load_in_progress = state;
 
+    directory_load_from_cache (directory, state->load_directory_file);
+
     g_file_enumerate_children_async (directory->details->location,
                                      CAJA_FILE_DEFAULT_ATTRIBUTES,
                                      0, /* flags */
@@ -2708,7 +3426,7 @@ count_children_done (CajaDirectory *directory,
     caja_file_changed (count_file);
 
     /* Start up the next one. */
-    async_job_end (directory, "directory count");
+    async_job_end (directory, ASYNC_JOB_DIRECTORY_COUNT);
     caja_directory_async_state_changed (directory);
 }
 
@@ -2747,7 +3465,7 @@ count_more_files_callback (GObject *source_object,
         /* Operation was cancelled. Bail out */
         directory->details->count_in_progress = NULL;
 
-        async_job_end (directory, "directory count");
+        async_job_end (directory, ASYNC_JOB_DIRECTORY_COUNT);
         caja_directory_async_state_changed (directory);
 
         directory_count_state_free (state);
@@ -2772,8 +3490,12 @@ count_more_files_callback (GObject *source_object,
     }
     else
     {
+        state->items_per_callback = next_batch_size (state->items_per_callback,
+                                                     state->request_time,
+                                                     g_list_length (files));
+        state->request_time = g_get_monotonic_time ();
         g_file_enumerator_next_files_async (state->enumerator,
-                                            DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
+                                            state->items_per_callback,
                                             G_PRIORITY_DEFAULT,
                                             state->cancellable,
                                             count_more_files_callback,
@@ -2806,7 +3528,7 @@ count_children_callback (GObject *source_object,
         directory = state->directory;
         directory->details->count_in_progress = NULL;
 
-        async_job_end (directory, "directory count");
+        async_job_end (directory, ASYNC_JOB_DIRECTORY_COUNT);
         caja_directory_async_state_changed (directory);
 
         directory_count_state_free (state);
@@ -2830,8 +3552,9 @@ count_children_callback (GObject *source_object,
     else
     {
         state->enumerator = enumerator;
+        state->request_time = g_get_monotonic_time ();
         g_file_enumerator_next_files_async (state->enumerator,
-                                            DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
+                                            state->items_per_callback,
                                             G_PRIORITY_DEFAULT,
                                             state->cancellable,
                                             count_more_files_callback,
@@ -2871,7 +3594,7 @@ directory_count_start (CajaDirectory *directory,
         return;
     }
 
-    if (!async_job_start (directory, "directory count"))
+    if (!async_job_start (directory, ASYNC_JOB_DIRECTORY_COUNT))
     {
         return;
     }
@@ -2881,6 +3604,7 @@ directory_count_start (CajaDirectory *directory,
     state->count_file = file;
     state->directory = caja_directory_ref (directory);
     state->cancellable = g_cancellable_new ();
+    state->items_per_callback = DIRECTORY_LOAD_ITEMS_PER_CALLBACK;
 
     directory->details->count_in_progress = state;
 
@@ -3055,7 +3779,7 @@ deep_count_next_dir (DeepCountState *state)
     if (done)
     {
         caja_file_changed (file);
-        async_job_end (directory, "deep count");
+        async_job_end (directory, ASYNC_JOB_DEEP_COUNT);
         caja_directory_async_state_changed (directory);
     }
 }
@@ -3069,6 +3793,7 @@ deep_count_more_files_callback (GObject *source_object,
     CajaDirectory *directory;
     GList *files, *l;
     GFileInfo *info;
+    int count;
 
     state = user_data;
 
@@ -3086,12 +3811,14 @@ deep_count_more_files_callback (GObject *source_object,
 
     files = g_file_enumerator_next_files_finish (state->enumerator,
             res, NULL);
+    count = 0;
 
     for (l = files; l != NULL; l = l->next)
     {
         info = l->data;
         deep_count_one (state, info);
         g_object_unref (info);
+        count++;
     }
 
     if (files == NULL)
@@ -3104,8 +3831,12 @@ deep_count_more_files_callback (GObject *source_object,
     }
     else
     {
+        state->items_per_callback = next_batch_size (state->items_per_callback,
+                                                     state->request_time,
+                                                     count);
+        state->request_time = g_get_monotonic_time ();
         g_file_enumerator_next_files_async (state->enumerator,
-                                            DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
+                                            state->items_per_callback,
                                             G_PRIORITY_LOW,
                                             state->cancellable,
                                             deep_count_more_files_callback,
@@ -3148,8 +3879,9 @@ deep_count_callback (GObject *source_object,
     else
     {
         state->enumerator = enumerator;
+        state->request_time = g_get_monotonic_time ();
         g_file_enumerator_next_files_async (state->enumerator,
-                                            DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
+                                            state->items_per_callback,
                                             G_PRIORITY_LOW,
                                             state->cancellable,
                                             deep_count_more_files_callback,
@@ -3256,7 +3988,7 @@ deep_count_start (CajaDirectory *directory,
         return;
     }
 
-    if (!async_job_start (directory, "deep count"))
+    if (!async_job_start (directory, ASYNC_JOB_DEEP_COUNT))
     {
         return;
     }
@@ -3274,6 +4006,7 @@ deep_count_start (CajaDirectory *directory,
     state->cancellable = g_cancellable_new ();
     state->seen_deep_count_inodes = g_array_new (FALSE, TRUE, sizeof (guint64));
     state->fs_id = NULL;
+    state->items_per_callback = DIRECTORY_LOAD_ITEMS_PER_CALLBACK;
 
     directory->details->deep_count_in_progress = state;
 
@@ -3364,7 +4097,7 @@ mime_list_done (MimeListState *state, gboolean success)
     caja_file_changed (file);
 
     /* Start up the next one. */
-    async_job_end (directory, "MIME list");
+    async_job_end (directory, ASYNC_JOB_MIME_LIST);
     caja_directory_async_state_changed (directory);
 }
 
@@ -3397,6 +4130,7 @@ mime_list_callback (GObject *source_object,
     GError *error;
     GList *files, *l;
     GFileInfo *info;
+    int count;
 
     state = user_data;
     directory = state->directory;
@@ -3406,7 +4140,7 @@ mime_list_callback (GObject *source_object,
         /* Operation was cancelled. Bail out */
         directory->details->mime_list_in_progress = NULL;
 
-        async_job_end (directory, "MIME list");
+        async_job_end (directory, ASYNC_JOB_MIME_LIST);
         caja_directory_async_state_changed (directory);
 
         mime_list_state_free (state);
@@ -3420,12 +4154,14 @@ mime_list_callback (GObject *source_object,
     error = NULL;
     files = g_file_enumerator_next_files_finish (state->enumerator,
             res, &error);
+    count = 0;
 
     for (l = files; l != NULL; l = l->next)
     {
         info = l->data;
         mime_list_one (state, info);
         g_object_unref (info);
+        count++;
     }
 
     if (files == NULL)
@@ -3435,8 +4171,12 @@ mime_list_callback (GObject *source_object,
     }
     else
     {
+        state->items_per_callback = next_batch_size (state->items_per_callback,
+                                                     state->request_time,
+                                                     count);
+        state->request_time = g_get_monotonic_time ();
         g_file_enumerator_next_files_async (state->enumerator,
-                                            DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
+                                            state->items_per_callback,
                                             G_PRIORITY_DEFAULT,
                                             state->cancellable,
                                             mime_list_callback,
@@ -3469,7 +4209,7 @@ list_mime_enum_callback (GObject *source_object,
         directory = state->directory;
         directory->details->mime_list_in_progress = NULL;
 
-        async_job_end (directory, "MIME list");
+        async_job_end (directory, ASYNC_JOB_MIME_LIST);
         caja_directory_async_state_changed (directory);
 
         mime_list_state_free (state);
@@ -3491,8 +4231,9 @@ list_mime_enum_callback (GObject *source_object,
     else
     {
         state->enumerator = enumerator;
+        state->request_time = g_get_monotonic_time ();
         g_file_enumerator_next_files_async (state->enumerator,
-                                            DIRECTORY_LOAD_ITEMS_PER_CALLBACK,
+                                            state->items_per_callback,
                                             G_PRIORITY_DEFAULT,
                                             state->cancellable,
                                             mime_list_callback,
@@ -3536,7 +4277,7 @@ mime_list_start (CajaDirectory *directory,
         return;
     }
 
-    if (!async_job_start (directory, "MIME list"))
+    if (!async_job_start (directory, ASYNC_JOB_MIME_LIST))
     {
         return;
     }
@@ -3547,6 +4288,7 @@ mime_list_start (CajaDirectory *directory,
     state->directory = caja_directory_ref (directory);
     state->cancellable = g_cancellable_new ();
     state->mime_list_hash = istr_set_new ();
+    state->items_per_callback = DIRECTORY_LOAD_ITEMS_PER_CALLBACK;
 
     directory->details->mime_list_in_progress = state;
 
@@ -3652,7 +4394,7 @@ top_left_read_callback (GObject *source_object,
     caja_file_changed (state->file);
 
     directory->details->top_left_read_state = NULL;
-    async_job_end (directory, "top left");
+    async_job_end (directory, ASYNC_JOB_TOP_LEFT);
 
     top_left_read_state_free (state);
 
@@ -3742,7 +4484,7 @@ top_left_start (CajaDirectory *directory,
         return;
     }
 
-    if (!async_job_start (directory, "top left"))
+    if (!async_job_start (directory, ASYNC_JOB_TOP_LEFT))
     {
         return;
     }
@@ -3794,11 +4536,10 @@ query_info_callback (GObject *source_object,
 
     directory = caja_directory_ref (state->directory);
 
-    get_info_file = directory->details->get_info_file;
+    get_info_file = state->file;
     g_assert (CAJA_IS_FILE (get_info_file));
 
-    directory->details->get_info_file = NULL;
-    directory->details->get_info_in_progress = NULL;
+    g_hash_table_remove (directory->details->get_info_in_progress, get_info_file);
 
     /* ref here because we might be removing the last ref when we
      * mark the file gone below, but we need to keep a ref at
@@ -3830,7 +4571,7 @@ query_info_callback (GObject *source_object,
     caja_file_changed (get_info_file);
     caja_file_unref (get_info_file);
 
-    async_job_end (directory, "file info");
+    async_job_end (directory, ASYNC_JOB_FILE_INFO);
     caja_directory_async_state_changed (directory);
 
     caja_directory_unref (directory);
@@ -3841,24 +4582,30 @@ query_info_callback (GObject *source_object,
 static void
 file_info_stop (CajaDirectory *directory)
 {
-    CajaFile *file;
+    GList *states, *l;
+    GetInfoState *state;
 
-    if (directory->details->get_info_in_progress != NULL)
+    if (g_hash_table_size (directory->details->get_info_in_progress) == 0)
     {
-        file = directory->details->get_info_file;
-        if (file != NULL)
+        return;
+    }
+
+    states = g_hash_table_get_values (directory->details->get_info_in_progress);
+    for (l = states; l != NULL; l = l->next)
+    {
+        state = l->data;
+
+        g_assert (CAJA_IS_FILE (state->file));
+        g_assert (state->file->details->directory == directory);
+        if (is_needy (state->file, lacks_info, REQUEST_FILE_INFO))
         {
-            g_assert (CAJA_IS_FILE (file));
-            g_assert (file->details->directory == directory);
-            if (is_needy (file, lacks_info, REQUEST_FILE_INFO))
-            {
-                return;
-            }
+            continue;
         }
 
         /* The info is not wanted, so stop it. */
-        file_info_cancel (directory);
+        file_info_cancel_state (directory, state);
     }
+    g_list_free (states);
 }
 
 static void
@@ -3869,9 +4616,7 @@ file_info_start (CajaDirectory *directory,
     GFile *location;
     GetInfoState *state;
 
-    file_info_stop (directory);
-
-    if (directory->details->get_info_in_progress != NULL)
+    if (g_hash_table_lookup (directory->details->get_info_in_progress, file) != NULL)
     {
         *doing_io = TRUE;
         return;
@@ -3883,12 +4628,11 @@ file_info_start (CajaDirectory *directory,
     }
     *doing_io = TRUE;
 
-    if (!async_job_start (directory, "file info"))
+    if (!async_job_start (directory, ASYNC_JOB_FILE_INFO))
     {
         return;
     }
 
-    directory->details->get_info_file = file;
     file->details->get_info_failed = FALSE;
     if (file->details->get_info_error)
     {
@@ -3898,9 +4642,10 @@ file_info_start (CajaDirectory *directory,
 
     state = g_new (GetInfoState, 1);
     state->directory = directory;
+    state->file = file;
     state->cancellable = g_cancellable_new ();
 
-    directory->details->get_info_in_progress = state;
+    g_hash_table_insert (directory->details->get_info_in_progress, file, state);
 
     location = caja_file_get_location (file);
     g_file_query_info_async (location,
@@ -3911,6 +4656,51 @@ file_info_start (CajaDirectory *directory,
     g_object_unref (location);
 }
 
+typedef struct
+{
+    CajaDirectory *directory;
+    int lookahead;
+} FileInfoPipeline;
+
+static gboolean
+file_info_pipeline_start_one (CajaFile *file,
+                              gpointer callback_data)
+{
+    FileInfoPipeline *pipeline;
+    gboolean doing_io;
+
+    pipeline = callback_data;
+
+    if (pipeline->lookahead-- <= 0)
+    {
+        return FALSE;
+    }
+
+    doing_io = FALSE;
+    file_info_start (pipeline->directory, file, &doing_io);
+
+    /* Keep going until the scheduler runs out of slots for us. */
+    return !doing_io ||
+           g_hash_table_lookup (pipeline->directory->details->get_info_in_progress, file) != NULL;
+}
+
+/* Start file info requests for the files near the head of the high
+ * priority queue, so that several round trips are in flight at once
+ * instead of waiting for each file in turn.
+ */
+static void
+file_info_fill_pipeline (CajaDirectory *directory)
+{
+    FileInfoPipeline pipeline;
+
+    pipeline.directory = directory;
+    pipeline.lookahead = FILE_INFO_PIPELINE_LOOKAHEAD;
+
+    caja_file_queue_foreach (directory->details->high_priority_queue,
+                             file_info_pipeline_start_one,
+                             &pipeline);
+}
+
 static gboolean
 is_link_trusted (CajaFile *file,
                  gboolean is_launcher)
@@ -4100,7 +4890,7 @@ link_info_caja_link_read_callback (GObject *source_object,
                                           NULL, NULL);
 
     state->directory->details->link_info_read_state = NULL;
-    async_job_end (state->directory, "link info");
+    async_job_end (state->directory, ASYNC_JOB_LINK_INFO);
 
     link_info_got_data (state->directory, state->file, result, file_size, file_contents);
 
@@ -4157,7 +4947,7 @@ link_info_start (CajaDirectory *directory,
     }
     else
     {
-        if (!async_job_start (directory, "link info"))
+        if (!async_job_start (directory, ASYNC_JOB_LINK_INFO))
         {
             g_object_unref (location);
             return;
@@ -4406,7 +5196,7 @@ thumbnail_read_callback (GObject *source_object,
     else
     {
         state->directory->details->thumbnail_state = NULL;
-        async_job_end (state->directory, "thumbnail");
+        async_job_end (state->directory, ASYNC_JOB_THUMBNAIL);
 
         thumbnail_got_pixbuf (state->directory, state->file, pixbuf, state->tried_original);
 
@@ -4438,7 +5228,7 @@ thumbnail_start (CajaDirectory *directory,
     }
     *doing_io = TRUE;
 
-    if (!async_job_start (directory, "thumbnail"))
+    if (!async_job_start (directory, ASYNC_JOB_THUMBNAIL))
     {
         return;
     }
@@ -4510,7 +5300,7 @@ got_mount (MountState *state, GMount *mount)
     directory = caja_directory_ref (state->directory);
 
     state->directory->details->mount_state = NULL;
-    async_job_end (state->directory, "mount");
+    async_job_end (state->directory, ASYNC_JOB_MOUNT);
 
     file = caja_file_ref (state->file);
 
@@ -4628,7 +5418,7 @@ mount_start (CajaDirectory *directory,
     }
     *doing_io = TRUE;
 
-    if (!async_job_start (directory, "mount"))
+    if (!async_job_start (directory, ASYNC_JOB_MOUNT))
     {
         return;
     }
@@ -4681,7 +5471,7 @@ filesystem_info_cancel (CajaDirectory *directory)
         g_cancellable_cancel (directory->details->filesystem_info_state->cancellable);
         directory->details->filesystem_info_state->directory = NULL;
         directory->details->filesystem_info_state = NULL;
-        async_job_end (directory, "filesystem info");
+        async_job_end (directory, ASYNC_JOB_FILESYSTEM_INFO);
     }
 }
 
@@ -4718,6 +5508,85 @@ filesystem_info_state_free (FilesystemInfoState *state)
     g_free (state);
 }
 
+/* The file system info is the same for all files on one file system,
+ * so it is read once per file system id and shared between all
+ * directories. Entries are dropped when a mount goes away or changes,
+ * since the id may then be reused or the file system remounted with
+ * other options.
+ */
+typedef struct
+{
+    gboolean readonly;
+    guint use_preview;
+} FilesystemInfoCacheEntry;
+
+static GHashTable *filesystem_info_cache;
+
+static void
+filesystem_info_cache_clear (void)
+{
+    g_hash_table_remove_all (filesystem_info_cache);
+}
+
+static GHashTable *
+filesystem_info_cache_get (void)
+{
+    GVolumeMonitor *monitor;
+
+    if (filesystem_info_cache == NULL)
+    {
+        filesystem_info_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                g_free, g_free);
+
+        /* The monitor is kept alive for as long as we listen to it. */
+        monitor = g_volume_monitor_get ();
+        g_signal_connect_swapped (monitor, "mount-removed",
+                                  G_CALLBACK (filesystem_info_cache_clear), NULL);
+        g_signal_connect_swapped (monitor, "mount-changed",
+                                  G_CALLBACK (filesystem_info_cache_clear), NULL);
+    }
+
+    return filesystem_info_cache;
+}
+
+static void
+filesystem_info_cache_insert (CajaFile *file)
+{
+    GHashTable *cache;
+    FilesystemInfoCacheEntry *entry;
+    const char *id;
+
+    if (file->details->filesystem_id == NULL ||
+            file->details->is_mountpoint)
+    {
+        return;
+    }
+
+    cache = filesystem_info_cache_get ();
+    id = eel_ref_str_peek (file->details->filesystem_id);
+    entry = g_hash_table_lookup (cache, id);
+    if (entry == NULL)
+    {
+        entry = g_new0 (FilesystemInfoCacheEntry, 1);
+        g_hash_table_insert (cache, g_strdup (id), entry);
+    }
+    entry->readonly = file->details->filesystem_readonly;
+    entry->use_preview = file->details->filesystem_use_preview;
+}
+
+static FilesystemInfoCacheEntry *
+filesystem_info_cache_lookup (CajaFile *file)
+{
+    if (file->details->filesystem_id == NULL ||
+            file->details->is_mountpoint)
+    {
+        return NULL;
+    }
+
+    return g_hash_table_lookup (filesystem_info_cache_get (),
+                                eel_ref_str_peek (file->details->filesystem_id));
+}
+
 static void
 got_filesystem_info (FilesystemInfoState *state, GFileInfo *info)
 {
@@ -4729,7 +5598,7 @@ got_filesystem_info (FilesystemInfoState *state, GFileInfo *info)
     directory = caja_directory_ref (state->directory);
 
     state->directory->details->filesystem_info_state = NULL;
-    async_job_end (state->directory, "filesystem info");
+    async_job_end (state->directory, ASYNC_JOB_FILESYSTEM_INFO);
 
     file = caja_file_ref (state->file);
 
@@ -4740,6 +5609,9 @@ got_filesystem_info (FilesystemInfoState *state, GFileInfo *info)
             g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_FILESYSTEM_USE_PREVIEW);
         file->details->filesystem_readonly =
             g_file_info_get_attribute_boolean (info, G_FILE_ATTRIBUTE_FILESYSTEM_READONLY);
+
+        /* Remember it for the other files on the same file system. */
+        filesystem_info_cache_insert (file);
     }
 
     caja_directory_async_state_changed (directory);
@@ -4778,6 +5650,115 @@ query_filesystem_info_callback (GObject *source_object,
     }
 }
 
+static gboolean
+filesystem_info_changed_idle_callback (gpointer callback_data)
+{
+    CajaDirectory *directory;
+    GList *files, *changed, *node;
+    CajaFile *file;
+
+    directory = callback_data;
+    directory->details->filesystem_info_changed_idle = 0;
+
+    files = g_list_reverse (directory->details->filesystem_info_changed_files);
+    directory->details->filesystem_info_changed_files = NULL;
+
+    changed = NULL;
+    for (node = files; node != NULL; node = node->next)
+    {
+        file = node->data;
+        if (file->details->is_gone)
+        {
+            continue;
+        }
+        if (caja_file_is_self_owned (file))
+        {
+            caja_file_changed (file);
+        }
+        else if (file->details->directory == directory)
+        {
+            changed = g_list_prepend (changed, file);
+        }
+    }
+    changed = g_list_reverse (changed);
+
+    if (changed != NULL)
+    {
+        caja_directory_emit_change_signals (directory, changed);
+    }
+
+    g_list_free (changed);
+    caja_file_list_free (files);
+    caja_directory_unref (directory);
+
+    return FALSE;
+}
+
+/* All files on the same file system share its file system info, so
+ * there is no need to query it for each of them. Fill in every file of
+ * the directory we already know the answer for in one go. This runs
+ * from start_or_stop_io, so the change notifications are sent from an
+ * idle rather than re-entering the scheduler.
+ */
+static gboolean
+filesystem_info_from_cache (CajaDirectory *directory,
+                            CajaFile *file)
+{
+    FilesystemInfoCacheEntry *entry;
+    CajaFile *other;
+    GList *node;
+
+    if (filesystem_info_cache_lookup (file) == NULL)
+    {
+        return FALSE;
+    }
+
+    for (node = directory->details->file_list; node != NULL; node = node->next)
+    {
+        other = node->data;
+        if (other->details->filesystem_info_is_up_to_date)
+        {
+            continue;
+        }
+
+        entry = filesystem_info_cache_lookup (other);
+        if (entry == NULL)
+        {
+            continue;
+        }
+
+        other->details->filesystem_info_is_up_to_date = TRUE;
+        other->details->filesystem_readonly = entry->readonly;
+        other->details->filesystem_use_preview = entry->use_preview;
+
+        directory->details->filesystem_info_changed_files =
+            g_list_prepend (directory->details->filesystem_info_changed_files,
+                            caja_file_ref (other));
+    }
+
+    /* A self-owned file is not in the directory's file list. */
+    if (!file->details->filesystem_info_is_up_to_date)
+    {
+        entry = filesystem_info_cache_lookup (file);
+        file->details->filesystem_info_is_up_to_date = TRUE;
+        file->details->filesystem_readonly = entry->readonly;
+        file->details->filesystem_use_preview = entry->use_preview;
+
+        directory->details->filesystem_info_changed_files =
+            g_list_prepend (directory->details->filesystem_info_changed_files,
+                            caja_file_ref (file));
+    }
+
+    if (directory->details->filesystem_info_changed_idle == 0)
+    {
+        directory->details->filesystem_info_changed_idle =
+            g_idle_add (filesystem_info_changed_idle_callback,
+                        caja_directory_ref (directory));
+    }
+
+    return TRUE;
+}
+
 static void
 filesystem_info_start (CajaDirectory *directory,
                        CajaFile *file,
@@ -4798,9 +5779,14 @@ filesystem_info_start (CajaDirectory *directory,
     {
         return;
     }
+
+    if (filesystem_info_from_cache (directory, file))
+    {
+        return;
+    }
     *doing_io = TRUE;
 
-    if (!async_job_start (directory, "filesystem info"))
+    if (!async_job_start (directory, ASYNC_JOB_FILESYSTEM_INFO))
     {
         return;
     }
@@ -4845,7 +5831,7 @@ extension_info_cancel (CajaDirectory *directory)
         directory->details->extension_info_provider = NULL;
         directory->details->extension_info_idle = 0;
 
-        async_job_end (directory, "extension info");
+        async_job_end (directory, ASYNC_JOB_EXTENSION_INFO);
     }
 }
 
@@ -4908,7 +5894,7 @@ info_provider_idle_callback (gpointer user_data)
     else
     {
         CajaFile *file;
-        async_job_end (directory, "extension info");
+        async_job_end (directory, ASYNC_JOB_EXTENSION_INFO);
 
         file = directory->details->extension_info_file;
 
@@ -4965,7 +5951,7 @@ extension_info_start (CajaDirectory *directory,
     }
     *doing_io = TRUE;
 
-    if (!async_job_start (directory, "extension info"))
+    if (!async_job_start (directory, ASYNC_JOB_EXTENSION_INFO))
     {
         return;
     }
@@ -4990,7 +5976,7 @@ extension_info_start (CajaDirectory *directory,
             result == CAJA_OPERATION_FAILED)
     {
         finish_info_provider (directory, file, provider);
-        async_job_end (directory, "extension info");
+        async_job_end (directory, ASYNC_JOB_EXTENSION_INFO);
     }
     else
     {
@@ -5021,6 +6007,8 @@ start_or_stop_io (CajaDirectory *directory)
     thumbnail_stop (directory);
     filesystem_info_stop (directory);
 
+    file_info_fill_pipeline (directory);
+
     doing_io = FALSE;
     /* Take files that are all done off the queue. */
     while (!caja_file_queue_is_empty (directory->details->high_priority_queue))
@@ -5133,10 +6121,7 @@ caja_directory_cancel (CajaDirectory *directory)
     filesystem_info_cancel (directory);
 
     /* We aren't waiting for anything any more. */
-    if (waiting_directories != NULL)
-    {
-        g_hash_table_remove (waiting_directories, directory);
-    }
+    async_job_stop_waiting (directory);
 
     /* Check if any directories should wake up. */
     async_job_wake_up ();
@@ -5189,9 +6174,12 @@ static void
 cancel_file_info_for_file (CajaDirectory *directory,
                            CajaFile      *file)
 {
-    if (directory->details->get_info_file == file)
+    GetInfoState *state;
+
+    state = g_hash_table_lookup (directory->details->get_info_in_progress, file);
+    if (state != NULL)
     {
-        file_info_cancel (directory);
+        file_info_cancel_state (directory, state);
     }
 }
 
@@ -5383,6 +6371,21 @@ caja_directory_remove_file_from_work_queue (CajaDirectory *directory,
                             file);
 }
 
+/* Move a file to the front of whichever work queue it is in, so its
+ * attributes are fetched before those of the other files.
+ */
+void
+caja_directory_prioritize_file_in_work_queue (CajaDirectory *directory,
+        CajaFile *file)
+{
+    caja_file_queue_prioritize (directory->details->high_priority_queue,
+                                file);
+    caja_file_queue_prioritize (directory->details->low_priority_queue,
+                                file);
+    caja_file_queue_prioritize (directory->details->extension_queue,
+                                file);
+}
+
 
 static void
 move_file_to_low_priority_queue (CajaDirectory *directory,
@@ -0,0 +1,521 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   caja-directory-cache.c: On-disk snapshots of directory listings.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/* A snapshot is a single file that can be mapped and read in place:
+ * a header, an array of fixed size entries and a table of NUL
+ * terminated strings the entries point into. It is only ever read
+ * back on the machine that wrote it, so everything is in host byte
+ * order.
+ *
+ * Snapshots are kept in least recently used order by their
+ * modification time, which is bumped whenever one is read. After each
+ * write the oldest ones are deleted until the cache is back under
+ * CACHE_MAX_FILES snapshots and CACHE_MAX_SIZE bytes.
+ */
+
+#include <config.h>
+#include "caja-directory-cache.h"
+
+#include "caja-file-private.h"
+#include <glib/gstdio.h>
+#include <string.h>
+
+#define CACHE_MAGIC 0x434a4443 /* "CJDC" */
+#define CACHE_VERSION 2
+
+#define CACHE_MAX_FILES 256
+#define CACHE_MAX_SIZE (64 * 1024 * 1024)
+
+#define CACHE_ENTRY_HIDDEN          (1 << 0)
+#define CACHE_ENTRY_SYMLINK         (1 << 1)
+#define CACHE_ENTRY_HAS_PERMISSIONS (1 << 2)
+#define CACHE_ENTRY_CAN_READ        (1 << 3)
+#define CACHE_ENTRY_CAN_WRITE       (1 << 4)
+#define CACHE_ENTRY_CAN_EXECUTE     (1 << 5)
+
+typedef struct
+{
+    guint32 magic;
+    guint32 version;
+    gint64 directory_mtime;
+    guint32 n_entries;
+    guint32 strings_length;
+} CacheHeader;
+
+typedef struct
+{
+    gint64 size;
+    gint64 mtime;
+    guint32 name;      /* offsets into the string table, */
+    guint32 mime_type; /* 0 is the empty string */
+    guint32 icon_name;
+    guint32 owner;
+    guint32 group;
+    guint32 permissions;
+    gint32 uid;        /* -1 is none */
+    gint32 gid;        /* -1 is none */
+    guint16 type;
+    guint16 flags;
+} CacheEntry;
+
+static char *
+get_cache_dir (void)
+{
+    return g_build_filename (g_get_user_cache_dir (),
+                             "caja", "listings", NULL);
+}
+
+static char *
+get_cache_path (GFile *location)
+{
+    char *uri, *md5, *dir, *path;
+
+    uri = g_file_get_uri (location);
+    md5 = g_compute_checksum_for_string (G_CHECKSUM_MD5, uri, -1);
+    dir = get_cache_dir ();
+    path = g_build_filename (dir, md5, NULL);
+    g_free (dir);
+    g_free (md5);
+    g_free (uri);
+
+    return path;
+}
+
+static GFileInfo *
+file_info_from_entry (const CacheEntry *entry,
+                      const char *strings)
+{
+    GFileInfo *info;
+    GIcon *icon;
+    const char *name;
+    char *display_name;
+
+    info = g_file_info_new ();
+    g_file_info_set_attribute_boolean (info, CAJA_DIRECTORY_CACHE_ATTRIBUTE, TRUE);
+
+    name = strings + entry->name;
+    g_file_info_set_name (info, name);
+    display_name = g_filename_display_name (name);
+    g_file_info_set_display_name (info, display_name);
+    g_free (display_name);
+
+    g_file_info_set_file_type (info, entry->type);
+    g_file_info_set_size (info, entry->size);
+    g_file_info_set_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                                      entry->mtime);
+    g_file_info_set_is_hidden (info, (entry->flags & CACHE_ENTRY_HIDDEN) != 0);
+    g_file_info_set_is_symlink (info, (entry->flags & CACHE_ENTRY_SYMLINK) != 0);
+
+    if (entry->flags & CACHE_ENTRY_HAS_PERMISSIONS)
+    {
+        g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_MODE,
+                                          entry->permissions);
+    }
+    if (entry->uid >= 0)
+    {
+        g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_UID,
+                                          entry->uid);
+    }
+    if (entry->gid >= 0)
+    {
+        g_file_info_set_attribute_uint32 (info, G_FILE_ATTRIBUTE_UNIX_GID,
+                                          entry->gid);
+    }
+    if (strings[entry->owner] != '\0')
+    {
+        g_file_info_set_attribute_string (info, G_FILE_ATTRIBUTE_OWNER_USER,
+                                          strings + entry->owner);
+    }
+    if (strings[entry->group] != '\0')
+    {
+        g_file_info_set_attribute_string (info, G_FILE_ATTRIBUTE_OWNER_GROUP,
+                                          strings + entry->group);
+    }
+    g_file_info_set_attribute_boolean (info, G_FILE_ATTRIBUTE_ACCESS_CAN_READ,
+                                       (entry->flags & CACHE_ENTRY_CAN_READ) != 0);
+    g_file_info_set_attribute_boolean (info, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE,
+                                       (entry->flags & CACHE_ENTRY_CAN_WRITE) != 0);
+    g_file_info_set_attribute_boolean (info, G_FILE_ATTRIBUTE_ACCESS_CAN_EXECUTE,
+                                       (entry->flags & CACHE_ENTRY_CAN_EXECUTE) != 0);
+
+    if (strings[entry->mime_type] != '\0')
+    {
+        g_file_info_set_content_type (info, strings + entry->mime_type);
+    }
+
+    if (strings[entry->icon_name] != '\0')
+    {
+        icon = g_themed_icon_new (strings + entry->icon_name);
+        g_file_info_set_icon (info, icon);
+        g_object_unref (icon);
+    }
+
+    return info;
+}
+
+GList *
+caja_directory_cache_load (GFile *location,
+                           time_t directory_mtime)
+{
+    GMappedFile *mapped;
+    const char *contents, *strings;
+    const CacheHeader *header;
+    const CacheEntry *entries;
+    gsize length, entries_length;
+    char *path;
+    GList *infos;
+    guint32 i;
+
+    if (directory_mtime == 0)
+    {
+        return NULL;
+    }
+
+    path = get_cache_path (location);
+    mapped = g_mapped_file_new (path, FALSE, NULL);
+    g_free (path);
+
+    if (mapped == NULL)
+    {
+        return NULL;
+    }
+
+    infos = NULL;
+    contents = g_mapped_file_get_contents (mapped);
+    length = g_mapped_file_get_length (mapped);
+
+    if (length < sizeof (CacheHeader))
+    {
+        goto out;
+    }
+
+    header = (const CacheHeader *) contents;
+    if (header->magic != CACHE_MAGIC ||
+            header->version != CACHE_VERSION ||
+            header->directory_mtime != (gint64) directory_mtime ||
+            header->strings_length == 0)
+    {
+        goto out;
+    }
+
+    entries_length = (gsize) header->n_entries * sizeof (CacheEntry);
+    if (entries_length / sizeof (CacheEntry) != header->n_entries ||
+            length != sizeof (CacheHeader) + entries_length + header->strings_length)
+    {
+        goto out;
+    }
+
+    entries = (const CacheEntry *) (contents + sizeof (CacheHeader));
+    strings = contents + sizeof (CacheHeader) + entries_length;
+    if (strings[header->strings_length - 1] != '\0')
+    {
+        goto out;
+    }
+
+    for (i = 0; i < header->n_entries; i++)
+    {
+        if (entries[i].name >= header->strings_length ||
+                entries[i].mime_type >= header->strings_length ||
+                entries[i].icon_name >= header->strings_length ||
+                entries[i].owner >= header->strings_length ||
+                entries[i].group >= header->strings_length ||
+                strings[entries[i].name] == '\0')
+        {
+            g_list_free_full (infos, g_object_unref);
+            infos = NULL;
+            goto out;
+        }
+
+        infos = g_list_prepend (infos, file_info_from_entry (&entries[i], strings));
+    }
+    infos = g_list_reverse (infos);
+
+out:
+    g_mapped_file_unref (mapped);
+
+    if (infos != NULL)
+    {
+        /* Mark the snapshot as recently used. */
+        path = get_cache_path (location);
+        g_utime (path, NULL);
+        g_free (path);
+    }
+
+    return infos;
+}
+
+static guint32
+add_string (GString *strings,
+            GHashTable *offsets,
+            const char *string)
+{
+    gpointer offset;
+
+    if (string == NULL || string[0] == '\0')
+    {
+        return 0;
+    }
+
+    if (g_hash_table_lookup_extended (offsets, string, NULL, &offset))
+    {
+        return GPOINTER_TO_UINT (offset);
+    }
+
+    offset = GUINT_TO_POINTER (strings->len);
+    g_string_append_len (strings, string, strlen (string) + 1);
+    g_hash_table_insert (offsets, g_strdup (string), offset);
+
+    return GPOINTER_TO_UINT (offset);
+}
+
+static const char *
+get_icon_name (CajaFile *file)
+{
+    const char * const *names;
+
+    if (file->details->icon == NULL || !G_IS_THEMED_ICON (file->details->icon))
+    {
+        return NULL;
+    }
+
+    names = g_themed_icon_get_names (G_THEMED_ICON (file->details->icon));
+
+    return names != NULL ? names[0] : NULL;
+}
+
+typedef struct
+{
+    char *path;
+    gint64 mtime;
+    goffset size;
+} CacheFile;
+
+static int
+compare_cache_files_newest_first (gconstpointer a,
+                                  gconstpointer b)
+{
+    const CacheFile *file_a = a, *file_b = b;
+
+    if (file_a->mtime != file_b->mtime)
+    {
+        return file_a->mtime > file_b->mtime ? -1 : 1;
+    }
+
+    return strcmp (file_a->path, file_b->path);
+}
+
+/* Delete the least recently used snapshots until the cache fits in
+ * its limits again. Runs in a worker thread.
+ */
+static void
+prune_cache_thread (GTask *task,
+                    gpointer source_object,
+                    gpointer task_data,
+                    GCancellable *cancellable)
+{
+    GDir *dir;
+    GList *files, *l;
+    CacheFile *file;
+    GStatBuf statbuf;
+    const char *name;
+    char *cache_dir;
+    goffset total_size;
+    int n_files;
+
+    cache_dir = get_cache_dir ();
+    dir = g_dir_open (cache_dir, 0, NULL);
+    if (dir == NULL)
+    {
+        g_free (cache_dir);
+        return;
+    }
+
+    files = NULL;
+    while ((name = g_dir_read_name (dir)) != NULL)
+    {
+        file = g_new0 (CacheFile, 1);
+        file->path = g_build_filename (cache_dir, name, NULL);
+        if (g_stat (file->path, &statbuf) != 0)
+        {
+            g_free (file->path);
+            g_free (file);
+            continue;
+        }
+        file->mtime = statbuf.st_mtime;
+        file->size = statbuf.st_size;
+        files = g_list_prepend (files, file);
+    }
+    g_dir_close (dir);
+    g_free (cache_dir);
+
+    files = g_list_sort (files, compare_cache_files_newest_first);
+
+    n_files = 0;
+    total_size = 0;
+    for (l = files; l != NULL; l = l->next)
+    {
+        file = l->data;
+
+        n_files += 1;
+        total_size += file->size;
+        if (n_files > CACHE_MAX_FILES || total_size > CACHE_MAX_SIZE)
+        {
+            g_unlink (file->path);
+        }
+
+        g_free (file->path);
+        g_free (file);
+    }
+    g_list_free (files);
+}
+
+static void
+cache_written_callback (GObject *source_object,
+                        GAsyncResult *res,
+                        gpointer user_data)
+{
+    GTask *task;
+
+    g_file_replace_contents_finish (G_FILE (source_object), res, NULL, NULL);
+    g_free (user_data);
+
+    task = g_task_new (NULL, NULL, NULL, NULL);
+    g_task_run_in_thread (task, prune_cache_thread);
+    g_object_unref (task);
+}
+
+void
+caja_directory_cache_save (GFile *location,
+                           time_t directory_mtime,
+                           GList *files)
+{
+    CacheHeader header;
+    CacheEntry entry;
+    GArray *entries;
+    GString *strings;
+    GHashTable *offsets;
+    CajaFile *file;
+    GFile *cache_file;
+    char *path, *dir, *contents;
+    gsize length;
+    GList *l;
+
+    if (directory_mtime == 0)
+    {
+        return;
+    }
+
+    entries = g_array_new (FALSE, FALSE, sizeof (CacheEntry));
+    strings = g_string_new (NULL);
+    g_string_append_c (strings, '\0');
+    offsets = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+    for (l = files; l != NULL; l = l->next)
+    {
+        file = CAJA_FILE (l->data);
+
+        if (file->details->is_gone ||
+                file->details->name == NULL ||
+                !file->details->got_file_info)
+        {
+            continue;
+        }
+
+        memset (&entry, 0, sizeof (entry));
+        entry.size = file->details->size;
+        entry.mtime = file->details->mtime;
+        entry.type = file->details->type;
+        if (file->details->is_hidden)
+        {
+            entry.flags |= CACHE_ENTRY_HIDDEN;
+        }
+        if (file->details->is_symlink)
+        {
+            entry.flags |= CACHE_ENTRY_SYMLINK;
+        }
+        if (file->details->has_permissions)
+        {
+            entry.flags |= CACHE_ENTRY_HAS_PERMISSIONS;
+            entry.permissions = file->details->permissions;
+        }
+        if (file->details->can_read)
+        {
+            entry.flags |= CACHE_ENTRY_CAN_READ;
+        }
+        if (file->details->can_write)
+        {
+            entry.flags |= CACHE_ENTRY_CAN_WRITE;
+        }
+        if (file->details->can_execute)
+        {
+            entry.flags |= CACHE_ENTRY_CAN_EXECUTE;
+        }
+        entry.uid = file->details->uid;
+        entry.gid = file->details->gid;
+
+        /* Names are unique, don't bother looking them up. */
+        entry.name = strings->len;
+        g_string_append_len (strings, eel_ref_str_peek (file->details->name),
+                             strlen (eel_ref_str_peek (file->details->name)) + 1);
+        entry.mime_type = add_string (strings, offsets,
+                                      eel_ref_str_peek (file->details->mime_type));
+        entry.icon_name = add_string (strings, offsets, get_icon_name (file));
+        entry.owner = add_string (strings, offsets,
+                                  eel_ref_str_peek (file->details->owner));
+        entry.group = add_string (strings, offsets,
+                                  eel_ref_str_peek (file->details->group));
+
+        g_array_append_val (entries, entry);
+    }
+    g_hash_table_destroy (offsets);
+
+    memset (&header, 0, sizeof (header));
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    header.directory_mtime = directory_mtime;
+    header.n_entries = entries->len;
+    header.strings_length = strings->len;
+
+    length = sizeof (header) + entries->len * sizeof (CacheEntry) + strings->len;
+    contents = g_malloc (length);
+    memcpy (contents, &header, sizeof (header));
+    memcpy (contents + sizeof (header), entries->data,
+            entries->len * sizeof (CacheEntry));
+    memcpy (contents + sizeof (header) + entries->len * sizeof (CacheEntry),
+            strings->str, strings->len);
+
+    g_array_free (entries, TRUE);
+    g_string_free (strings, TRUE);
+
+    path = get_cache_path (location);
+    dir = g_path_get_dirname (path);
+    g_mkdir_with_parents (dir, 0700);
+    g_free (dir);
+
+    /* The contents are freed when the write is done. */
+    cache_file = g_file_new_for_path (path);
+    g_file_replace_contents_async (cache_file, contents, length,
+                                   NULL, FALSE,
+                                   G_FILE_CREATE_PRIVATE | G_FILE_CREATE_REPLACE_DESTINATION,
+                                   NULL,
+                                   cache_written_callback, contents);
+    g_object_unref (cache_file);
+    g_free (path);
+}
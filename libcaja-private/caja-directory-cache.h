@@ -0,0 +1,53 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   caja-directory-cache.h: On-disk snapshots of directory listings.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef CAJA_DIRECTORY_CACHE_H
+#define CAJA_DIRECTORY_CACHE_H
+
+#include <gio/gio.h>
+#include <time.h>
+
+/* Directories with fewer files than this are quick enough to list
+ * that they are not worth a snapshot.
+ */
+#define CAJA_DIRECTORY_CACHE_MIN_FILES 500
+
+/* Set on the GFileInfos that come from a snapshot rather than from
+ * the file system.
+ */
+#define CAJA_DIRECTORY_CACHE_ATTRIBUTE "caja::from-cache"
+
+/* Returns a list of GFileInfo objects with the name, type, size,
+ * modification time, content type, icon, permissions and owner of each
+ * file the directory had when the snapshot was taken, or NULL if there
+ * is no snapshot for this directory at this modification time.
+ */
+GList *caja_directory_cache_load (GFile  *location,
+                                  time_t  directory_mtime);
+
+/* Write a snapshot of a list of CajaFile objects in the background,
+ * replacing any previous snapshot of the directory, and prune the
+ * least recently used snapshots if the cache has grown too large.
+ */
+void   caja_directory_cache_save (GFile  *location,
+                                  time_t  directory_mtime,
+                                  GList  *files);
+
+#endif /* CAJA_DIRECTORY_CACHE_H */
@@ -106,6 +106,7 @@ struct CajaDirectoryDetails
     GList *pending_file_info; /* list of MateVFSFileInfo's that are pending */
     int confirmed_file_count;
     guint dequeue_pending_idle_id;
+    guint drop_snapshot_files_idle_id;
 
     GList *new_files_in_progress; /* list of NewFilesState * */
 
@@ -116,8 +117,7 @@ struct CajaDirectoryDetails
 
     MimeListState *mime_list_in_progress;
 
-    CajaFile *get_info_file;
-    GetInfoState *get_info_in_progress;
+    GHashTable *get_info_in_progress; /* CajaFile * -> GetInfoState * */
 
     CajaFile *extension_info_file;
     CajaInfoProvider *extension_info_provider;
@@ -130,6 +130,12 @@ struct CajaDirectoryDetails
 
     FilesystemInfoState *filesystem_info_state;
 
+    /* Files filled in from the file system info cache, waiting for
+     * their change notification.
+     */
+    GList *filesystem_info_changed_files;
+    guint filesystem_info_changed_idle;
+
     TopLeftTextReadState *top_left_read_state;
 
     LinkInfoReadState *link_info_read_state;
@@ -140,6 +146,14 @@ struct CajaDirectoryDetails
 
     guint64 free_space; /* (guint)-1 for unknown */
     time_t free_space_read; /* The time free_space was updated, or 0 for never */
+
+    /* Async. job scheduling. */
+    char *async_job_filesystem; /* key for the per file system job limit */
+    int async_job_count;
+    gboolean async_job_waiting;
+
+    /* Cancels the thumbnails of files in here once nobody shows it */
+    guint thumbnail_cancel_timeout_id;
 };
 
 CajaDirectory *caja_directory_get_existing                    (GFile                     *location);
@@ -236,6 +250,8 @@ void               caja_directory_add_file_to_work_queue          (CajaDirectory
         CajaFile *file);
 void               caja_directory_remove_file_from_work_queue     (CajaDirectory *directory,
         CajaFile *file);
+void               caja_directory_prioritize_file_in_work_queue   (CajaDirectory *directory,
+        CajaFile *file);
 
 /* KDE compatibility hacks */
 
@@ -243,3 +259,6 @@ void               caja_set_kde_trash_name                        (const char *t
 
 /* debugging functions */
 int                caja_directory_number_outstanding              (void);
+
+/* Async. job scheduler queue depths, for tuning the job limits. */
+void               caja_directory_async_log_queue_depths          (void);
@@ -129,6 +129,7 @@ caja_directory_init (gpointer object, gpointer klass)
     directory->details->high_priority_queue = caja_file_queue_new ();
     directory->details->low_priority_queue = caja_file_queue_new ();
     directory->details->extension_queue = caja_file_queue_new ();
+    directory->details->get_info_in_progress = g_hash_table_new (NULL, NULL);
     directory->details->free_space = (guint64)-1;
 }
 
@@ -209,6 +210,9 @@ caja_directory_finalize (GObject *object)
     caja_file_queue_destroy (directory->details->high_priority_queue);
     caja_file_queue_destroy (directory->details->low_priority_queue);
     caja_file_queue_destroy (directory->details->extension_queue);
+    g_hash_table_destroy (directory->details->get_info_in_progress);
+    g_free (directory->details->async_job_filesystem);
+    g_assert (directory->details->filesystem_info_changed_idle == 0);
     g_assert (directory->details->directory_load_in_progress == NULL);
     g_assert (directory->details->count_in_progress == NULL);
     g_assert (directory->details->dequeue_pending_idle_id == 0);
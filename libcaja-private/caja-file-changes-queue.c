@@ -24,6 +24,7 @@
 #include "caja-file-changes-queue.h"
 
 #include "caja-directory-notify.h"
+#include "caja-search-engine-index.h"
 
 typedef enum
 {
@@ -45,10 +46,20 @@ typedef struct
     int screen;
 } CajaFileChange;
 
+/* Changes are kept in the order they came in, but the additions,
+ * changes and removals of a file are merged into the one that is
+ * still waiting for it, as long as no move came in between. That
+ * way a file added, changed and removed again by a bulk operation
+ * costs a single notification. What can't be merged is a removal
+ * followed by an addition or change, which is right as long as
+ * removals are sent first, or a change followed by an addition,
+ * which can go in either order. So they can all be sent in one
+ * batch per kind.
+ */
 typedef struct
 {
-    GList *head;
-    GList *tail;
+    GQueue changes;
+    GHashTable *pending; /* GFile -> mergeable CajaFileChange */
     GMutex mutex;
 } CajaFileChangesQueue;
 
@@ -59,6 +70,8 @@ caja_file_changes_queue_new (void)
 
     result = g_new0 (CajaFileChangesQueue, 1);
 
+    g_queue_init (&result->changes);
+    result->pending = g_hash_table_new (g_file_hash, (GEqualFunc) g_file_equal);
     g_mutex_init (&result->mutex);
 
     return result;
@@ -69,9 +82,10 @@ caja_file_changes_queue_get (void)
 {
     static CajaFileChangesQueue *file_changes_queue;
 
-    if (file_changes_queue == NULL)
+    /* File operations may queue changes from several threads at once */
+    if (g_once_init_enter (&file_changes_queue))
     {
-        file_changes_queue = caja_file_changes_queue_new ();
+        g_once_init_leave (&file_changes_queue, caja_file_changes_queue_new ());
     }
 
     return file_changes_queue;
@@ -84,53 +98,78 @@ caja_file_changes_queue_add_common (CajaFileChangesQueue *queue,
     /* enqueue the new queue item while locking down the list */
     g_mutex_lock (&queue->mutex);
 
-    queue->head = g_list_prepend (queue->head, new_item);
-    if (queue->tail == NULL)
-        queue->tail = queue->head;
+    g_queue_push_tail (&queue->changes, new_item);
+
+    /* Nothing queued before a move may be merged with what comes after it */
+    if (new_item->kind == CHANGE_FILE_MOVED)
+    {
+        g_hash_table_remove_all (queue->pending);
+    }
 
     g_mutex_unlock (&queue->mutex);
 }
 
-void
-caja_file_changes_queue_file_added (GFile *location)
+static gboolean
+can_merge_change (CajaFileChangeKind pending,
+                  CajaFileChangeKind kind)
 {
-    CajaFileChange *new_item;
+    /* Anything followed by a removal is a removal, and adding a file
+     * fetches all of its info anyway. A removal followed by anything
+     * else, or a change followed by an addition, must stay as it is.
+     */
+    return kind == CHANGE_FILE_REMOVED ||
+           (pending == CHANGE_FILE_ADDED && kind == CHANGE_FILE_ADDED) ||
+           (pending == CHANGE_FILE_ADDED && kind == CHANGE_FILE_CHANGED) ||
+           (pending == CHANGE_FILE_CHANGED && kind == CHANGE_FILE_CHANGED);
+}
+
+static void
+caja_file_changes_queue_add_file_change (CajaFileChangeKind kind,
+                                         GFile *location)
+{
+    CajaFileChange *change;
     CajaFileChangesQueue *queue;
 
-    queue = caja_file_changes_queue_get();
+    queue = caja_file_changes_queue_get ();
 
-    new_item = g_new0 (CajaFileChange, 1);
-    new_item->kind = CHANGE_FILE_ADDED;
-    new_item->from = g_object_ref (location);
-    caja_file_changes_queue_add_common (queue, new_item);
+    g_mutex_lock (&queue->mutex);
+
+    change = g_hash_table_lookup (queue->pending, location);
+    if (change != NULL && can_merge_change (change->kind, kind))
+    {
+        if (kind == CHANGE_FILE_REMOVED)
+        {
+            change->kind = kind;
+        }
+    }
+    else
+    {
+        change = g_new0 (CajaFileChange, 1);
+        change->kind = kind;
+        change->from = g_object_ref (location);
+        g_queue_push_tail (&queue->changes, change);
+        g_hash_table_replace (queue->pending, change->from, change);
+    }
+
+    g_mutex_unlock (&queue->mutex);
 }
 
 void
-caja_file_changes_queue_file_changed (GFile *location)
+caja_file_changes_queue_file_added (GFile *location)
 {
-    CajaFileChange *new_item;
-    CajaFileChangesQueue *queue;
-
-    queue = caja_file_changes_queue_get();
+    caja_file_changes_queue_add_file_change (CHANGE_FILE_ADDED, location);
+}
 
-    new_item = g_new0 (CajaFileChange, 1);
-    new_item->kind = CHANGE_FILE_CHANGED;
-    new_item->from = g_object_ref (location);
-    caja_file_changes_queue_add_common (queue, new_item);
+void
+caja_file_changes_queue_file_changed (GFile *location)
+{
+    caja_file_changes_queue_add_file_change (CHANGE_FILE_CHANGED, location);
 }
 
 void
 caja_file_changes_queue_file_removed (GFile *location)
 {
-    CajaFileChange *new_item;
-    CajaFileChangesQueue *queue;
-
-    queue = caja_file_changes_queue_get();
-
-    new_item = g_new0 (CajaFileChange, 1);
-    new_item->kind = CHANGE_FILE_REMOVED;
-    new_item->from = g_object_ref (location);
-    caja_file_changes_queue_add_common (queue, new_item);
+    caja_file_changes_queue_add_file_change (CHANGE_FILE_REMOVED, location);
 }
 
 void
@@ -181,29 +220,40 @@ caja_file_changes_queue_schedule_position_remove (GFile *location)
     caja_file_changes_queue_add_common (queue, new_item);
 }
 
-static CajaFileChange *
-caja_file_changes_queue_get_change (CajaFileChangesQueue *queue)
+/* Takes up to max_changes changes off the queue, all of them if it is
+ * 0, and returns them oldest first.
+ */
+static GList *
+caja_file_changes_queue_take_changes (CajaFileChangesQueue *queue,
+                                      guint max_changes)
 {
-    GList *new_tail;
-    CajaFileChange *result;
+    CajaFileChange *change;
+    GList *result;
+    guint i;
 
     g_assert (queue != NULL);
 
-    /* dequeue the tail item while locking down the list */
     g_mutex_lock (&queue->mutex);
 
-    if (queue->tail == NULL)
+    if (max_changes == 0 || max_changes >= queue->changes.length)
     {
-        result = NULL;
+        result = queue->changes.head;
+        g_queue_init (&queue->changes);
+        g_hash_table_remove_all (queue->pending);
     }
     else
     {
-        new_tail = queue->tail->prev;
-        result = queue->tail->data;
-        queue->head = g_list_remove_link (queue->head,
-                                          queue->tail);
-        g_list_free_1 (queue->tail);
-        queue->tail = new_tail;
+        result = NULL;
+        for (i = 0; i < max_changes; i++)
+        {
+            change = g_queue_pop_head (&queue->changes);
+            if (g_hash_table_lookup (queue->pending, change->from) == change)
+            {
+                g_hash_table_remove (queue->pending, change->from);
+            }
+            result = g_list_prepend (result, change);
+        }
+        result = g_list_reverse (result);
     }
 
     g_mutex_unlock (&queue->mutex);
@@ -251,8 +301,9 @@ position_set_list_free (GList *list)
     g_list_free_full (list, g_free);
 }
 
-/* go through changes in the change queue, send ones with the same kind
- * in a list to the different caja_directory_notify calls
+/* go through changes in the change queue, send them in one list per
+ * kind to the different caja_directory_notify calls, which group them
+ * by directory
  */
 void
 caja_file_changes_consume_changes (gboolean consume_all)
@@ -260,10 +311,9 @@ caja_file_changes_consume_changes (gboolean consume_all)
     CajaFileChange *change;
     GList *additions, *changes, *deletions, *moves;
     GList *position_set_requests;
+    GList *taken, *l;
     GFilePair *pair;
     CajaFileChangesQueuePosition *position_set;
-    guint chunk_count;
-    CajaFileChangesQueue *queue;
     gboolean flush_needed;
 
 
@@ -273,16 +323,15 @@ caja_file_changes_consume_changes (gboolean consume_all)
     moves = NULL;
     position_set_requests = NULL;
 
-    queue = caja_file_changes_queue_get();
+    taken = caja_file_changes_queue_take_changes (caja_file_changes_queue_get (),
+                                                  consume_all ? 0 : CONSUME_CHANGES_MAX_CHUNK);
 
-    /* Consume changes from the queue, stuffing them into one of three lists,
-     * keep doing it while the changes are of the same kind, then send them off.
-     * This is to ensure that the changes get sent off in the same order that they
-     * arrived.
+    /* Moves can't be reordered with the rest, so the changes are sent
+     * off whenever the queue goes from moves to other changes or back.
      */
-    for (chunk_count = 0; ; chunk_count++)
+    for (l = taken; ; l = l->next)
     {
-        change = caja_file_changes_queue_get_change (queue);
+        change = l != NULL ? l->data : NULL;
 
         /* figure out if we need to flush the pending changes that we collected sofar */
 
@@ -291,44 +340,25 @@ caja_file_changes_consume_changes (gboolean consume_all)
             flush_needed = TRUE;
             /* no changes left, flush everything */
         }
+        else if (change->kind == CHANGE_FILE_MOVED)
+        {
+            flush_needed = additions != NULL || changes != NULL || deletions != NULL;
+        }
         else
         {
-            flush_needed = additions != NULL
-                           && change->kind != CHANGE_FILE_ADDED
+            flush_needed = moves != NULL
                            && change->kind != CHANGE_POSITION_SET
                            && change->kind != CHANGE_POSITION_REMOVE;
-
-            flush_needed |= changes != NULL
-                            && change->kind != CHANGE_FILE_CHANGED;
-
-            flush_needed |= moves != NULL
-                            && change->kind != CHANGE_FILE_MOVED
-                            && change->kind != CHANGE_POSITION_SET
-                            && change->kind != CHANGE_POSITION_REMOVE;
-
-            flush_needed |= deletions != NULL
-                            && change->kind != CHANGE_FILE_REMOVED;
-
-            flush_needed |= position_set_requests != NULL
-                            && change->kind != CHANGE_POSITION_SET
-                            && change->kind != CHANGE_POSITION_REMOVE
-                            && change->kind != CHANGE_FILE_ADDED
-                            && change->kind != CHANGE_FILE_MOVED;
-
-            flush_needed |= !consume_all && chunk_count >= CONSUME_CHANGES_MAX_CHUNK;
-            /* we have reached the chunk maximum */
         }
 
         if (flush_needed)
         {
-            /* Send changes we collected off.
-             * At one time we may only have one of the lists
-             * contain changes.
-             */
+            /* Send changes we collected off. */
 
             if (deletions != NULL)
             {
                 deletions = g_list_reverse (deletions);
+                caja_search_engine_index_files_removed (deletions);
                 caja_directory_notify_files_removed (deletions);
     		g_list_free_full (deletions, g_object_unref);
                 deletions = NULL;
@@ -336,6 +366,7 @@ caja_file_changes_consume_changes (gboolean consume_all)
             if (moves != NULL)
             {
                 moves = g_list_reverse (moves);
+                caja_search_engine_index_files_moved (moves);
                 caja_directory_notify_files_moved (moves);
                 pairs_list_free (moves);
                 moves = NULL;
@@ -343,6 +374,7 @@ caja_file_changes_consume_changes (gboolean consume_all)
             if (additions != NULL)
             {
                 additions = g_list_reverse (additions);
+                caja_search_engine_index_files_added (additions);
                 caja_directory_notify_files_added (additions);
     		g_list_free_full (additions, g_object_unref);
                 additions = NULL;
@@ -366,6 +398,7 @@ caja_file_changes_consume_changes (gboolean consume_all)
         if (change == NULL)
         {
             /* we are done */
+            g_list_free (taken);
             return;
         }
 
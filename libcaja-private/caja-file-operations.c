@@ -33,8 +33,22 @@
 #include <locale.h>
 #include <math.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
 #include <stdlib.h>
+#ifdef HAVE_LINUX_FS_H
+#include <linux/fs.h>
+#endif
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
 
 #include "caja-file-operations.h"
 
@@ -62,6 +76,7 @@
 #include "caja-desktop-link-monitor.h"
 #include "caja-global-preferences.h"
 #include "caja-link.h"
+#include "caja-operation-journal.h"
 #include "caja-autorun.h"
 #include "caja-trash-monitor.h"
 #include "caja-file-utilities.h"
@@ -88,6 +103,38 @@ typedef struct {
 	CajaUndoStackActionData* undo_redo_data;
 } CommonJob;
 
+/* Files inside a folder being copied are handed to a pool of threads,
+ * so that copying many small files is not bound by per-file latency.
+ * Everything but the g_file_copy() itself happens on the job thread. */
+#define MAX_COPY_THREADS 8
+#define MAX_COPIES_IN_FLIGHT (MAX_COPY_THREADS * 2)
+
+/* The sources of a copy are counted by a thread of their own while
+ * the copy is already running, so that a large tree doesn't have to
+ * be walked twice before the first byte moves. */
+#define STREAMING_SCAN_WAIT (1 * G_TIME_SPAN_SECOND)
+
+typedef struct {
+	GList *files;
+	GCancellable *cancellable; /* stops the scan, and the job stops it too */
+	GCancellable *job_cancellable;
+	gulong job_cancelled_id;
+	GThread *thread;
+	GMutex lock;
+	GCond done_cond;
+	int num_files; /* protected by lock */
+	goffset num_bytes;
+	gboolean done;
+} StreamingScan;
+
+typedef struct {
+	GThreadPool *pool;
+	GAsyncQueue *done;
+	GMutex lock;
+	goffset num_bytes; /* copied, but not yet added to the transfer info */
+	int n_in_flight;
+} CopyPipeline;
+
 typedef struct {
 	CommonJob common;
 	gboolean is_move;
@@ -97,6 +144,13 @@ typedef struct {
 	GdkPoint *icon_positions;
 	int n_icon_positions;
 	GHashTable *debuting_files;
+	CopyPipeline *pipeline;
+	StreamingScan *scan;
+	gboolean free_space_checked;
+	CajaOperationJournal *journal;
+	gboolean verify;
+	volatile gint n_unverified; /* copies that couldn't be read back */
+	gboolean direct_io;
 	CajaCopyCallback  done_callback;
 	gpointer done_callback_data;
 } CopyMoveJob;
@@ -173,9 +227,13 @@ typedef struct {
 	OpKind op;
 	guint64 last_report_time;
 	int last_reported_files_left;
+	goffset last_report_bytes;
+	double transfer_rate;
 } TransferInfo;
 
 #define SECONDS_NEEDED_FOR_RELIABLE_TRANSFER_RATE 15
+/* The transfer rate is averaged over roughly this many seconds */
+#define TRANSFER_RATE_WINDOW 5.0
 #define NSEC_PER_MICROSEC 1000
 
 #define MAXIMUM_DISPLAYED_FILE_NAME_LENGTH 50
@@ -1397,6 +1455,71 @@ confirm_delete_directly (CommonJob *job,
 	return response == 1;
 }
 
+/* Tells the progress info which devices the job works on, so that
+ * jobs on other devices can run at the same time. Only the folders
+ * holding the toplevel items are looked at.
+ */
+static void
+set_job_devices (CommonJob *job,
+		 GList *files,
+		 const char *dest_fs_id)
+{
+	GHashTable *dirs, *ids;
+	GHashTableIter iter;
+	gpointer key;
+	GPtrArray *devices;
+	GFileInfo *info;
+	GFile *dir;
+	const char *id;
+	GList *l;
+
+	dirs = g_hash_table_new_full (g_file_hash, (GEqualFunc)g_file_equal, g_object_unref, NULL);
+	ids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	devices = g_ptr_array_new ();
+
+	if (dest_fs_id != NULL) {
+		g_hash_table_add (ids, g_strdup (dest_fs_id));
+	}
+
+	for (l = files; l != NULL && !job_aborted (job); l = l->next) {
+		dir = g_file_get_parent (l->data);
+		if (dir == NULL) {
+			dir = g_object_ref (l->data);
+		}
+		if (g_hash_table_contains (dirs, dir)) {
+			g_object_unref (dir);
+			continue;
+		}
+		g_hash_table_add (dirs, dir);
+
+		info = g_file_query_info (dir,
+					  G_FILE_ATTRIBUTE_ID_FILESYSTEM,
+					  0, job->cancellable, NULL);
+		if (info == NULL) {
+			continue;
+		}
+		id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILESYSTEM);
+		if (id != NULL && !g_hash_table_contains (ids, id)) {
+			g_hash_table_add (ids, g_strdup (id));
+		}
+		g_object_unref (info);
+	}
+
+	if (!job_aborted (job)) {
+		g_hash_table_iter_init (&iter, ids);
+		while (g_hash_table_iter_next (&iter, &key, NULL)) {
+			g_ptr_array_add (devices, key);
+		}
+		g_ptr_array_add (devices, NULL);
+		caja_progress_info_set_devices (job->progress,
+						(const char * const *) devices->pdata);
+	}
+
+	g_ptr_array_free (devices, TRUE);
+	g_hash_table_destroy (ids);
+	g_hash_table_destroy (dirs);
+}
+
 static void
 report_delete_progress (CommonJob *job,
 			SourceInfo *source_info,
@@ -1687,6 +1810,346 @@ delete_file (CommonJob *job, GFile *file,
 	*skipped_file = TRUE;
 }
 
+/* Trees are deleted by a pool of threads. Each folder is listed by
+ * one of them, which removes its files right away and hands the
+ * subfolders back to the pool. A folder is removed by whichever thread
+ * finishes the last of its subfolders. The threads never ask the user
+ * anything; whatever they fail to remove is left in place and goes
+ * through delete_file() afterwards, which reports it.
+ */
+#define MAX_DELETE_THREADS 8
+
+/* Local folders are emptied with unlinkat() on the open folder, and
+ * the counters are only bumped once per this many entries. */
+#define DELETE_BATCH_SIZE 64
+
+typedef struct {
+	CommonJob *job;
+	GThreadPool *pool;
+	GMutex lock;
+	GCond done_cond;
+	int n_toplevel_pending; /* protected by lock */
+	volatile gint num_found;
+	volatile gint num_removed;
+} DeleteEngine;
+
+typedef struct DeleteDir DeleteDir;
+
+struct DeleteDir {
+	DeleteEngine *engine;
+	GFile *dir;
+	DeleteDir *parent;
+	gboolean *toplevel_removed;
+	volatile gint pending; /* subfolders left, plus one while listing */
+	volatile gint failed;
+};
+
+static DeleteDir *
+delete_dir_new (DeleteEngine *engine,
+		GFile *dir,
+		DeleteDir *parent)
+{
+	DeleteDir *d;
+
+	d = g_new0 (DeleteDir, 1);
+	d->engine = engine;
+	d->dir = g_object_ref (dir);
+	d->parent = parent;
+	d->pending = 1;
+
+	return d;
+}
+
+static void
+delete_engine_file_removed (DeleteEngine *engine,
+			    GFile *file)
+{
+	caja_file_changes_queue_file_removed (file);
+	g_atomic_int_inc (&engine->num_removed);
+}
+
+static void
+delete_engine_toplevel_done (DeleteEngine *engine,
+			     DeleteDir *d,
+			     gboolean removed)
+{
+	g_mutex_lock (&engine->lock);
+	*d->toplevel_removed = removed;
+	engine->n_toplevel_pending--;
+	g_cond_signal (&engine->done_cond);
+	g_mutex_unlock (&engine->lock);
+}
+
+/* Drops one of the pending references of d. The last one removes the
+ * folder and goes on with its parent, so folders go bottom-up.
+ */
+static void
+delete_dir_unref (DeleteDir *d,
+		  gboolean removed)
+{
+	DeleteEngine *engine;
+	DeleteDir *parent;
+
+	engine = d->engine;
+
+	while (d != NULL && g_atomic_int_dec_and_test (&d->pending)) {
+		parent = d->parent;
+
+		if (!removed) {
+			if (!g_atomic_int_get (&d->failed) &&
+			    g_file_delete (d->dir, engine->job->cancellable, NULL)) {
+				delete_engine_file_removed (engine, d->dir);
+				removed = TRUE;
+			} else if (parent != NULL) {
+				g_atomic_int_set (&parent->failed, TRUE);
+			}
+		}
+
+		if (parent == NULL) {
+			delete_engine_toplevel_done (engine, d, removed);
+		}
+
+		g_object_unref (d->dir);
+		g_free (d);
+
+		d = parent;
+		removed = FALSE;
+	}
+}
+
+static void
+delete_engine_count (DeleteEngine *engine,
+		     int *n_found,
+		     int *n_removed)
+{
+	g_atomic_int_add (&engine->num_found, *n_found);
+	g_atomic_int_add (&engine->num_removed, *n_removed);
+	*n_found = 0;
+	*n_removed = 0;
+}
+
+/* Empties a local folder below GIO, which saves resolving the path of
+ * every file. Returns FALSE if the folder can't be opened that way, in
+ * which case it is left to GIO.
+ */
+static gboolean
+delete_engine_list_native (DeleteDir *d)
+{
+	DeleteEngine *engine;
+	DeleteDir *subdir;
+	GFile *child;
+	char *path;
+	DIR *dir;
+	struct dirent *entry;
+	struct stat statbuf;
+	gboolean is_dir;
+	int fd, n_found, n_removed;
+
+	engine = d->engine;
+
+	path = g_file_get_path (d->dir);
+	if (path == NULL) {
+		return FALSE;
+	}
+	fd = open (path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	g_free (path);
+	if (fd < 0) {
+		return FALSE;
+	}
+	dir = fdopendir (fd);
+	if (dir == NULL) {
+		close (fd);
+		return FALSE;
+	}
+
+	n_found = 0;
+	n_removed = 0;
+	while (!job_aborted (engine->job)) {
+		errno = 0;
+		entry = readdir (dir);
+		if (entry == NULL) {
+			if (errno != 0) {
+				g_atomic_int_set (&d->failed, TRUE);
+			}
+			break;
+		}
+
+		if (strcmp (entry->d_name, ".") == 0 ||
+		    strcmp (entry->d_name, "..") == 0) {
+			continue;
+		}
+
+		is_dir = entry->d_type == DT_DIR;
+		if (entry->d_type == DT_UNKNOWN) {
+			is_dir = fstatat (fd, entry->d_name, &statbuf, AT_SYMLINK_NOFOLLOW) == 0 &&
+				S_ISDIR (statbuf.st_mode);
+		}
+
+		n_found++;
+		child = g_file_get_child (d->dir, entry->d_name);
+		if (is_dir) {
+			g_atomic_int_inc (&d->pending);
+			subdir = delete_dir_new (engine, child, d);
+			g_thread_pool_push (engine->pool, subdir, NULL);
+		} else if (unlinkat (fd, entry->d_name, 0) == 0) {
+			caja_file_changes_queue_file_removed (child);
+			n_removed++;
+		} else {
+			g_atomic_int_set (&d->failed, TRUE);
+		}
+		g_object_unref (child);
+
+		if (n_found == DELETE_BATCH_SIZE) {
+			delete_engine_count (engine, &n_found, &n_removed);
+		}
+	}
+	delete_engine_count (engine, &n_found, &n_removed);
+
+	closedir (dir);
+
+	return TRUE;
+}
+
+static void
+delete_engine_thread (gpointer data,
+		      gpointer user_data)
+{
+	DeleteDir *d, *subdir;
+	DeleteEngine *engine;
+	CommonJob *job;
+	GFileEnumerator *enumerator;
+	GFileInfo *info;
+	GFile *child;
+	GError *error;
+
+	d = data;
+	engine = d->engine;
+	job = engine->job;
+
+	caja_progress_info_get_ready (job->progress);
+
+	error = NULL;
+	/* Most toplevel items are files or empty folders */
+	if (d->parent == NULL &&
+	    g_file_delete (d->dir, job->cancellable, &error)) {
+		delete_engine_file_removed (engine, d->dir);
+		delete_dir_unref (d, TRUE);
+		return;
+	}
+
+	if (error != NULL && !IS_IO_ERROR (error, NOT_EMPTY)) {
+		g_error_free (error);
+		g_atomic_int_set (&d->failed, TRUE);
+		delete_dir_unref (d, FALSE);
+		return;
+	}
+	g_clear_error (&error);
+
+	if (delete_engine_list_native (d)) {
+		if (job_aborted (job)) {
+			g_atomic_int_set (&d->failed, TRUE);
+		}
+		delete_dir_unref (d, FALSE);
+		return;
+	}
+
+	enumerator = g_file_enumerate_children (d->dir,
+						G_FILE_ATTRIBUTE_STANDARD_NAME","
+						G_FILE_ATTRIBUTE_STANDARD_TYPE,
+						G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+						job->cancellable,
+						&error);
+	if (enumerator != NULL) {
+		while (!job_aborted (job) &&
+		       (info = g_file_enumerator_next_file (enumerator, job->cancellable, &error)) != NULL) {
+			g_atomic_int_inc (&engine->num_found);
+			child = g_file_get_child (d->dir, g_file_info_get_name (info));
+
+			if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
+				g_atomic_int_inc (&d->pending);
+				subdir = delete_dir_new (engine, child, d);
+				g_thread_pool_push (engine->pool, subdir, NULL);
+			} else if (g_file_delete (child, job->cancellable, NULL)) {
+				delete_engine_file_removed (engine, child);
+			} else {
+				g_atomic_int_set (&d->failed, TRUE);
+			}
+
+			g_object_unref (child);
+			g_object_unref (info);
+		}
+		g_file_enumerator_close (enumerator, job->cancellable, NULL);
+		g_object_unref (enumerator);
+	}
+
+	if (error != NULL || job_aborted (job)) {
+		g_clear_error (&error);
+		g_atomic_int_set (&d->failed, TRUE);
+	}
+
+	delete_dir_unref (d, FALSE);
+}
+
+/* Deletes what it can of files, setting removed[i] for each toplevel
+ * item that is gone. Progress is reported from here, the threads only
+ * bump the counters.
+ */
+static void
+delete_files_in_parallel (CommonJob *job,
+			  GList *files,
+			  gboolean *removed,
+			  SourceInfo *source_info,
+			  TransferInfo *transfer_info)
+{
+	DeleteEngine engine;
+	GList *l;
+	int i;
+	DeleteDir *d;
+	gint64 end_time;
+
+	memset (&engine, 0, sizeof (engine));
+	engine.job = job;
+	g_mutex_init (&engine.lock);
+	g_cond_init (&engine.done_cond);
+	engine.pool = g_thread_pool_new (delete_engine_thread, NULL,
+					 CLAMP (g_get_num_processors (), 2, MAX_DELETE_THREADS),
+					 FALSE, NULL);
+
+	g_mutex_lock (&engine.lock);
+	for (l = files, i = 0; l != NULL; l = l->next, i++) {
+		if (should_skip_file (job, l->data)) {
+			continue;
+		}
+
+		d = delete_dir_new (&engine, l->data, NULL);
+		d->toplevel_removed = &removed[i];
+		engine.n_toplevel_pending++;
+		engine.num_found++;
+		g_thread_pool_push (engine.pool, d, NULL);
+	}
+
+	while (engine.n_toplevel_pending > 0) {
+		end_time = g_get_monotonic_time () + 100 * NSEC_PER_MICROSEC;
+		g_cond_wait_until (&engine.done_cond, &engine.lock, end_time);
+
+		/* The total grows as folders are listed */
+		source_info->num_files = g_atomic_int_get (&engine.num_found);
+		transfer_info->num_files = g_atomic_int_get (&engine.num_removed);
+		g_mutex_unlock (&engine.lock);
+		report_delete_progress (job, source_info, transfer_info);
+		g_mutex_lock (&engine.lock);
+	}
+	g_mutex_unlock (&engine.lock);
+
+	/* Let the threads return before the engine goes away */
+	g_thread_pool_free (engine.pool, FALSE, TRUE);
+	source_info->num_files = engine.num_found;
+	transfer_info->num_files = engine.num_removed;
+
+	g_mutex_clear (&engine.lock);
+	g_cond_clear (&engine.done_cond);
+}
+
 static void
 delete_files (CommonJob *job, GList *files, int *files_skipped)
 {
@@ -1695,29 +2158,35 @@ delete_files (CommonJob *job, GList *files, int *files_skipped)
 	SourceInfo source_info;
 	TransferInfo transfer_info;
 	gboolean skipped_file;
+	gboolean *removed;
+	int i;
 
 	if (job_aborted (job)) {
 		return;
 	}
 
-	scan_sources (files,
-		      &source_info,
-		      job,
-		      OP_KIND_DELETE);
-	if (job_aborted (job)) {
-		return;
-	}
-
 	g_timer_start (job->time);
 
+	memset (&source_info, 0, sizeof (source_info));
+	source_info.op = OP_KIND_DELETE;
 	memset (&transfer_info, 0, sizeof (transfer_info));
 	report_delete_progress (job, &source_info, &transfer_info);
 
-	for (l = files;
+	removed = g_new0 (gboolean, g_list_length (files));
+	delete_files_in_parallel (job, files, removed,
+				  &source_info, &transfer_info);
+
+	/* Whatever is left failed to be deleted, go over it again
+	 * so that the errors are reported. */
+	for (l = files, i = 0;
 	     l != NULL && !job_aborted (job);
-	     l = l->next) {
+	     l = l->next, i++) {
 		file = l->data;
 
+		if (removed[i]) {
+			continue;
+		}
+
 		skipped_file = FALSE;
 		delete_file (job, file,
 			     &skipped_file,
@@ -1727,6 +2196,8 @@ delete_files (CommonJob *job, GList *files, int *files_skipped)
 			(*files_skipped)++;
 		}
 	}
+
+	g_free (removed);
 }
 
 static void
@@ -1754,6 +2225,39 @@ report_trash_progress (CommonJob *job,
 }
 
 
+typedef struct {
+	CommonJob *job;
+	GFile *file;
+	guint64 mtime;
+	gboolean res;
+	GError *error;
+	GAsyncQueue *done;
+} TrashItem;
+
+/* Items are trashed by a pool of threads, and handed back to the
+ * job thread to be reported. */
+static void
+trash_file_thread (gpointer data,
+		   gpointer user_data)
+{
+	TrashItem *item;
+
+	item = data;
+
+	caja_progress_info_get_ready (item->job->progress);
+
+	/* Items still queued when the job is cancelled are left alone */
+	if (g_cancellable_set_error_if_cancelled (item->job->cancellable, &item->error)) {
+		g_async_queue_push (item->done, item);
+		return;
+	}
+
+	item->mtime = caja_undostack_manager_get_file_modification_time (item->file);
+	item->res = g_file_trash (item->file, item->job->cancellable, &item->error);
+
+	g_async_queue_push (item->done, item);
+}
+
 static void
 trash_files (CommonJob *job, GList *files, int *files_skipped)
 {
@@ -1764,8 +2268,10 @@ trash_files (CommonJob *job, GList *files, int *files_skipped)
 	int total_files, files_trashed;
 	char *primary, *secondary, *details;
 	int response;
-
-	guint64 mtime;
+	GThreadPool *pool;
+	GAsyncQueue *done;
+	TrashItem *item;
+	int n_pending;
 
 	if (job_aborted (job)) {
 		return;
@@ -1776,19 +2282,28 @@ trash_files (CommonJob *job, GList *files, int *files_skipped)
 
 	report_trash_progress (job, files_trashed, total_files);
 
-	to_delete = NULL;
-	for (l = files;
-	     l != NULL && !job_aborted (job);
-	     l = l->next) {
-        caja_progress_info_get_ready (job->progress);
-
-		file = l->data;
+	done = g_async_queue_new ();
+	pool = g_thread_pool_new (trash_file_thread, NULL,
+				  CLAMP (g_get_num_processors (), 2, MAX_DELETE_THREADS),
+				  FALSE, NULL);
 
-		error = NULL;
+	for (l = files; l != NULL; l = l->next) {
+		item = g_new0 (TrashItem, 1);
+		item->job = job;
+		item->file = l->data;
+		item->done = done;
+		g_thread_pool_push (pool, item, NULL);
+	}
 
-		mtime = caja_undostack_manager_get_file_modification_time (file);
+	to_delete = NULL;
+	for (n_pending = total_files; n_pending > 0; n_pending--) {
+		item = g_async_queue_pop (done);
+		file = item->file;
+		error = item->error;
 
-		if (!g_file_trash (file, job->cancellable, &error)) {
+		if (!item->res && job_aborted (job)) {
+			g_error_free (error);
+		} else if (!item->res) {
 			if (job->skip_all_error) {
 				(*files_skipped)++;
 				goto skip;
@@ -1836,14 +2351,19 @@ trash_files (CommonJob *job, GList *files, int *files_skipped)
 			caja_file_changes_queue_file_removed (file);
 
 			// Start UNDO-REDO
-			caja_undostack_manager_data_add_trashed_file (job->undo_redo_data, file, mtime);
+			caja_undostack_manager_data_add_trashed_file (job->undo_redo_data, file, item->mtime);
 			// End UNDO-REDO
 
 			files_trashed++;
 			report_trash_progress (job, files_trashed, total_files);
 		}
+
+		g_free (item);
 	}
 
+	g_thread_pool_free (pool, FALSE, TRUE);
+	g_async_queue_unref (done);
+
 	if (to_delete) {
 		to_delete = g_list_reverse (to_delete);
 		delete_files (job, to_delete, files_skipped);
@@ -1894,6 +2414,7 @@ delete_job (GIOSchedulerJob *io_job,
 	common->io_job = io_job;
 
 	caja_progress_info_start (job->common.progress);
+	set_job_devices (common, job->files, NULL);
 
 	to_trash_files = NULL;
 	to_delete_files = NULL;
@@ -2707,35 +3228,212 @@ scan_sources (GList *files,
 }
 
 static void
-verify_destination (CommonJob *job,
-		    GFile *dest,
-		    char **dest_fs_id,
-		    goffset required_size)
+streaming_scan_add (StreamingScan *scan,
+		    int *num_files,
+		    goffset *num_bytes)
 {
-	GFileInfo *info, *fsinfo;
-	GError *error;
-	guint64 free_size;
-	char *primary, *secondary, *details;
-	int response;
-	GFileType file_type;
+	g_mutex_lock (&scan->lock);
+	scan->num_files += *num_files;
+	scan->num_bytes += *num_bytes;
+	g_mutex_unlock (&scan->lock);
 
-	if (dest_fs_id) {
-		*dest_fs_id = NULL;
-	}
+	*num_files = 0;
+	*num_bytes = 0;
+}
 
- retry:
+/* Unlike scan_file() this never asks the user anything. Whatever
+ * can't be read here will fail again when it is copied, and is
+ * reported then.
+ */
+static gpointer
+streaming_scan_thread (gpointer user_data)
+{
+	StreamingScan *scan;
+	GFileEnumerator *enumerator;
+	GFileInfo *info;
+	GQueue *dirs;
+	GFile *dir;
+	GList *l;
+	int num_files;
+	goffset num_bytes;
 
-	error = NULL;
-	info = g_file_query_info (dest,
-				  G_FILE_ATTRIBUTE_STANDARD_TYPE","
-				  G_FILE_ATTRIBUTE_ID_FILESYSTEM,
-				  0,
-				  job->cancellable,
-				  &error);
+	scan = user_data;
+	dirs = g_queue_new ();
+	num_files = 0;
+	num_bytes = 0;
 
-	if (info == NULL) {
-		if (IS_IO_ERROR (error, CANCELLED)) {
-			g_error_free (error);
+	for (l = scan->files;
+	     l != NULL && !g_cancellable_is_cancelled (scan->cancellable);
+	     l = l->next) {
+		info = g_file_query_info (l->data,
+					  G_FILE_ATTRIBUTE_STANDARD_TYPE","
+					  G_FILE_ATTRIBUTE_STANDARD_SIZE,
+					  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+					  scan->cancellable,
+					  NULL);
+		if (info == NULL) {
+			continue;
+		}
+
+		num_files++;
+		num_bytes += g_file_info_get_size (info);
+		if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
+			g_queue_push_head (dirs, g_object_ref (l->data));
+		}
+		g_object_unref (info);
+
+		/* Depth-first, in the same order as the copy */
+		while (!g_cancellable_is_cancelled (scan->cancellable) &&
+		       (dir = g_queue_pop_head (dirs)) != NULL) {
+			enumerator = g_file_enumerate_children (dir,
+								G_FILE_ATTRIBUTE_STANDARD_NAME","
+								G_FILE_ATTRIBUTE_STANDARD_TYPE","
+								G_FILE_ATTRIBUTE_STANDARD_SIZE,
+								G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+								scan->cancellable,
+								NULL);
+			if (enumerator != NULL) {
+				while ((info = g_file_enumerator_next_file (enumerator, scan->cancellable, NULL)) != NULL) {
+					num_files++;
+					num_bytes += g_file_info_get_size (info);
+					if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY) {
+						g_queue_push_head (dirs, g_file_get_child (dir, g_file_info_get_name (info)));
+					}
+					g_object_unref (info);
+
+					if (num_files >= 100) {
+						streaming_scan_add (scan, &num_files, &num_bytes);
+					}
+				}
+				g_file_enumerator_close (enumerator, scan->cancellable, NULL);
+				g_object_unref (enumerator);
+			}
+			g_object_unref (dir);
+		}
+	}
+
+	g_queue_free_full (dirs, g_object_unref);
+
+	streaming_scan_add (scan, &num_files, &num_bytes);
+
+	g_mutex_lock (&scan->lock);
+	scan->done = TRUE;
+	g_cond_broadcast (&scan->done_cond);
+	g_mutex_unlock (&scan->lock);
+
+	return NULL;
+}
+
+static void
+streaming_scan_job_cancelled (GCancellable *job_cancellable,
+			      gpointer user_data)
+{
+	g_cancellable_cancel (G_CANCELLABLE (user_data));
+}
+
+static StreamingScan *
+streaming_scan_new (GList *files,
+		    CommonJob *job)
+{
+	StreamingScan *scan;
+
+	scan = g_new0 (StreamingScan, 1);
+	scan->files = eel_g_object_list_copy (files);
+	scan->cancellable = g_cancellable_new ();
+	scan->job_cancellable = g_object_ref (job->cancellable);
+	scan->job_cancelled_id = g_cancellable_connect (scan->job_cancellable,
+							G_CALLBACK (streaming_scan_job_cancelled),
+							g_object_ref (scan->cancellable),
+							g_object_unref);
+	g_mutex_init (&scan->lock);
+	g_cond_init (&scan->done_cond);
+	scan->thread = g_thread_new ("caja-copy-scan", streaming_scan_thread, scan);
+
+	return scan;
+}
+
+/* Stops the scan if it is still running, the copy may be done
+ * long before a huge tree is counted.
+ */
+static void
+streaming_scan_free (StreamingScan *scan)
+{
+	g_cancellable_cancel (scan->cancellable);
+	g_thread_join (scan->thread);
+	g_cancellable_disconnect (scan->job_cancellable, scan->job_cancelled_id);
+	g_object_unref (scan->job_cancellable);
+	g_mutex_clear (&scan->lock);
+	g_cond_clear (&scan->done_cond);
+	g_object_unref (scan->cancellable);
+	g_list_free_full (scan->files, g_object_unref);
+	g_free (scan);
+}
+
+/* Updates source_info with what has been counted so far.
+ * Returns TRUE once the totals are final.
+ */
+static gboolean
+streaming_scan_get_info (StreamingScan *scan,
+			 SourceInfo *source_info)
+{
+	gboolean done;
+
+	g_mutex_lock (&scan->lock);
+	source_info->num_files = scan->num_files;
+	source_info->num_bytes = scan->num_bytes;
+	done = scan->done;
+	g_mutex_unlock (&scan->lock);
+
+	return done;
+}
+
+/* Waits until the scan is done or end_time has passed */
+static gboolean
+streaming_scan_wait (StreamingScan *scan,
+		     gint64 end_time)
+{
+	gboolean done;
+
+	g_mutex_lock (&scan->lock);
+	while (!scan->done &&
+	       g_cond_wait_until (&scan->done_cond, &scan->lock, end_time)) {
+	}
+	done = scan->done;
+	g_mutex_unlock (&scan->lock);
+
+	return done;
+}
+
+static void
+verify_destination (CommonJob *job,
+		    GFile *dest,
+		    char **dest_fs_id,
+		    goffset required_size)
+{
+	GFileInfo *info, *fsinfo;
+	GError *error;
+	guint64 free_size;
+	char *primary, *secondary, *details;
+	int response;
+	GFileType file_type;
+
+	if (dest_fs_id) {
+		*dest_fs_id = NULL;
+	}
+
+ retry:
+
+	error = NULL;
+	info = g_file_query_info (dest,
+				  G_FILE_ATTRIBUTE_STANDARD_TYPE","
+				  G_FILE_ATTRIBUTE_ID_FILESYSTEM,
+				  0,
+				  job->cancellable,
+				  &error);
+
+	if (info == NULL) {
+		if (IS_IO_ERROR (error, CANCELLED)) {
+			g_error_free (error);
 			return;
 		}
 
@@ -2875,6 +3573,7 @@ report_copy_progress (CopyMoveJob *copy_job,
 	guint64 now;
 	CommonJob *job;
 	gboolean is_move;
+	gboolean scanning;
 
 	job = (CommonJob *)copy_job;
 
@@ -2886,7 +3585,28 @@ report_copy_progress (CopyMoveJob *copy_job,
 	    ABS ((gint64)(transfer_info->last_report_time - now)) < 100 * NSEC_PER_MICROSEC) {
 		return;
 	}
+
+	if (transfer_info->last_report_time != 0) {
+		double interval, rate;
+
+		/* Keep a moving average, so the estimate follows changes
+		 * in speed and totals that grow while scanning. */
+		interval = (now - transfer_info->last_report_time) / (double) G_USEC_PER_SEC;
+		rate = (transfer_info->num_bytes - transfer_info->last_report_bytes) / interval;
+		if (transfer_info->transfer_rate == 0) {
+			transfer_info->transfer_rate = rate;
+		} else {
+			transfer_info->transfer_rate += MIN (interval / TRANSFER_RATE_WINDOW, 1.0) *
+				(rate - transfer_info->transfer_rate);
+		}
+	}
 	transfer_info->last_report_time = now;
+	transfer_info->last_report_bytes = transfer_info->num_bytes;
+
+	scanning = FALSE;
+	if (copy_job->scan != NULL) {
+		scanning = !streaming_scan_get_info (copy_job->scan, source_info);
+	}
 
 	files_left = source_info->num_files - transfer_info->num_files;
 
@@ -2961,13 +3681,13 @@ report_copy_progress (CopyMoveJob *copy_job,
 	total_size = MAX (source_info->num_bytes, transfer_info->num_bytes);
 
 	elapsed = g_timer_elapsed (job->time, NULL);
-	transfer_rate = 0;
-	if (elapsed > 0) {
-		transfer_rate = transfer_info->num_bytes / elapsed;
-	}
+	transfer_rate = transfer_info->transfer_rate;
 
-	if (elapsed < SECONDS_NEEDED_FOR_RELIABLE_TRANSFER_RATE &&
-	    transfer_rate > 0) {
+	/* While the sources are still being counted the total is only a
+	 * lower bound, so there's no point in estimating the time left. */
+	if (scanning ||
+	    elapsed < SECONDS_NEEDED_FOR_RELIABLE_TRANSFER_RATE ||
+	    transfer_rate <= 0) {
 		char *s;
 		/* To translators: %S will expand to a size like "2 bytes" or "3 MB", so something like "4 kb of 4 MB" */
 		s = f (_("%S of %S"), transfer_info->num_bytes, total_size);
@@ -3301,6 +4021,22 @@ static void copy_move_file (CopyMoveJob *job,
 			    gboolean readonly_source_fs,
 			    gboolean last_item);
 
+static void copy_pipeline_push (CopyMoveJob *copy_job,
+				GFile *src,
+				GFile *dest_dir,
+				gboolean same_fs,
+				char **dest_fs_type,
+				SourceInfo *source_info,
+				TransferInfo *transfer_info,
+				gboolean *skipped_file,
+				gboolean readonly_source_fs,
+				gboolean last_item);
+
+static void copy_pipeline_collect (CopyMoveJob *copy_job,
+				   int max_in_flight,
+				   SourceInfo *source_info,
+				   TransferInfo *transfer_info);
+
 typedef enum {
 	CREATE_DEST_DIR_RETRY,
 	CREATE_DEST_DIR_FAILED,
@@ -3452,6 +4188,10 @@ copy_move_directory (CopyMoveJob *copy_job,
 			g_hash_table_replace (debuting_files, g_object_ref (*dest), GINT_TO_POINTER (TRUE));
 		}
 
+		/* So that a resumed operation merges into it without asking */
+		if (copy_job->journal != NULL) {
+			caja_operation_journal_file_started (copy_job->journal, src);
+		}
 	}
 
 	local_skipped_file = FALSE;
@@ -3461,7 +4201,8 @@ copy_move_directory (CopyMoveJob *copy_job,
  retry:
 	error = NULL;
 	enumerator = g_file_enumerate_children (src,
-						G_FILE_ATTRIBUTE_STANDARD_NAME,
+						G_FILE_ATTRIBUTE_STANDARD_NAME","
+						G_FILE_ATTRIBUTE_STANDARD_TYPE,
 						G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
 						job->cancellable,
 						&error);
@@ -3478,15 +4219,32 @@ copy_move_directory (CopyMoveJob *copy_job,
 						     g_file_info_get_name (info));
 
 			last_item = (last_item_above) && (!nextinfo);
-			copy_move_file (copy_job, src_file, *dest, same_fs, FALSE, &dest_fs_type,
-					source_info, transfer_info, NULL, NULL, FALSE, &local_skipped_file,
-					readonly_source_fs, last_item);
+			if (copy_job->pipeline != NULL &&
+			    (g_file_info_get_file_type (info) == G_FILE_TYPE_REGULAR ||
+			     g_file_info_get_file_type (info) == G_FILE_TYPE_SYMBOLIC_LINK) &&
+			    !should_skip_file (job, src_file)) {
+				copy_pipeline_push (copy_job, src_file, *dest, same_fs, &dest_fs_type,
+						    source_info, transfer_info, &local_skipped_file,
+						    readonly_source_fs, last_item);
+			} else {
+				copy_move_file (copy_job, src_file, *dest, same_fs, FALSE, &dest_fs_type,
+						source_info, transfer_info, NULL, NULL, FALSE, &local_skipped_file,
+						readonly_source_fs, last_item);
+			}
 			g_object_unref (src_file);
 			g_object_unref (info);
 		}
 		if (nextinfo)
 			g_object_unref (nextinfo);
 
+		/* The children have to be in place before the folder's
+		 * attributes are copied and the source is removed, and
+		 * dest_fs_type and local_skipped_file must outlive them.
+		 */
+		if (copy_job->pipeline != NULL) {
+			copy_pipeline_collect (copy_job, 0, source_info, transfer_info);
+		}
+
 		g_file_enumerator_close (enumerator, job->cancellable, NULL);
 		g_object_unref (enumerator);
 
@@ -3756,11 +4514,27 @@ remove_target_recursively (CommonJob *job,
 
 typedef struct {
 	CopyMoveJob *job;
+	GFile *src;
+	gboolean journaled;
 	goffset last_size;
 	SourceInfo *source_info;
 	TransferInfo *transfer_info;
 } ProgressData;
 
+/* Progress is only reported once the destination has been created,
+ * which is when the journal can say that it is ours.
+ */
+static void
+journal_file_started (CopyMoveJob *job,
+		      GFile *src,
+		      gboolean *journaled)
+{
+	if (!*journaled && job->journal != NULL) {
+		caja_operation_journal_file_started (job->journal, src);
+	}
+	*journaled = TRUE;
+}
+
 static void
 copy_file_progress_callback (goffset current_num_bytes,
 			     goffset total_num_bytes,
@@ -3771,6 +4545,8 @@ copy_file_progress_callback (goffset current_num_bytes,
 
 	pdata = user_data;
 
+	journal_file_started (pdata->job, pdata->src, &pdata->journaled);
+
 	new_size = current_num_bytes - pdata->last_size;
 
 	if (new_size > 0) {
@@ -3977,137 +4753,1728 @@ get_target_file_for_display_name (GFile *dir,
 	return dest;
 }
 
-/* Debuting files is non-NULL only for toplevel items */
-static void
-copy_move_file (CopyMoveJob *copy_job,
-		GFile *src,
-		GFile *dest_dir,
-		gboolean same_fs,
-		gboolean unique_names,
-		char **dest_fs_type,
-		SourceInfo *source_info,
-		TransferInfo *transfer_info,
-		GHashTable *debuting_files,
-		GdkPoint *position,
-		gboolean overwrite,
-		gboolean *skipped_file,
-		gboolean readonly_source_fs,
-		gboolean last_item)
-{
-	GFile *dest, *new_dest;
-	GError *error;
-	GFileCopyFlags flags;
-	char *primary, *secondary, *details;
-	int response;
-	ProgressData pdata;
-	gboolean would_recurse, is_merge;
-	CommonJob *job;
-	gboolean res;
-	int unique_name_nr;
-	gboolean handled_invalid_filename;
+/* How much to hand to the kernel at a time, so that we can
+ * report progress and notice cancellation in between. */
+#define KERNEL_COPY_CHUNK_SIZE (8 * 1024 * 1024)
 
-	job = (CommonJob *)copy_job;
+typedef enum {
+	KERNEL_COPY_REFLINK,
+	KERNEL_COPY_FILE_RANGE,
+	KERNEL_COPY_SENDFILE,
+	KERNEL_COPY_LARGE_BUFFERS
+} KernelCopyMethod;
+
+static gssize
+kernel_copy_chunk (KernelCopyMethod method,
+		   int src_fd,
+		   int dest_fd,
+		   gsize count)
+{
+	gssize n;
+
+	do {
+		errno = ENOSYS;
+		n = -1;
+
+		if (method == KERNEL_COPY_FILE_RANGE) {
+#if defined (HAVE_SYS_SYSCALL_H) && defined (__NR_copy_file_range)
+			n = syscall (__NR_copy_file_range, src_fd, NULL, dest_fd, NULL, count, 0);
+#endif
+		} else if (method == KERNEL_COPY_SENDFILE) {
+#ifdef HAVE_SYS_SENDFILE_H
+			n = sendfile (dest_fd, src_fd, NULL, count);
+#endif
+		}
+	} while (n < 0 && errno == EINTR);
 
-	if (should_skip_file (job, src)) {
-		*skipped_file = TRUE;
-		return;
-	}
+	return n;
+}
 
-	unique_name_nr = 1;
+/* Files at least this big that can't be reflinked are copied through
+ * a pair of large buffers, one being read by a thread of its own while
+ * the other is written. Both files are kept out of the page cache, so
+ * that copying a huge file doesn't push everything else out of memory,
+ * which copy_file_range() would not do. Verified copies of all but
+ * small files go through them too, so that they can be checksummed on
+ * the way.
+ */
+#define LARGE_COPY_FILE_SIZE (256 * 1024 * 1024)
+#define LARGE_COPY_BUFFER_SIZE (8 * 1024 * 1024)
+#define LARGE_COPY_ALIGNMENT 4096
+/* How much may be written before it is flushed and dropped from the cache */
+#define LARGE_COPY_FLUSH_SIZE (64 * 1024 * 1024)
 
-	// TODO: Here we should get the previous file name UNDO
+typedef struct {
+	char *data;
+	gsize length;
+	int error;
+	gboolean last;
+} LargeCopyBuffer;
 
-	/* another file in the same directory might have handled the invalid
-	 * filename condition for us
-	 */
-	handled_invalid_filename = *dest_fs_type != NULL;
+typedef struct {
+	int src_fd;
+	LargeCopyBuffer buffers[2];
+	GAsyncQueue *free_buffers;
+	GAsyncQueue *full_buffers;
+	volatile gint stop;
+} LargeCopy;
+
+/* Returns 0 or ENOMEM, large_copy_clear() is needed either way */
+static int
+large_copy_init (LargeCopy *copy,
+		 int src_fd)
+{
+	guint i;
 
-	if (unique_names) {
-		dest = get_unique_target_file (src, dest_dir, same_fs, *dest_fs_type, unique_name_nr++);
-	} else {
-		dest = get_target_file (src, dest_dir, *dest_fs_type, same_fs);
+	memset (copy, 0, sizeof (*copy));
+	copy->src_fd = src_fd;
+	copy->free_buffers = g_async_queue_new ();
+	copy->full_buffers = g_async_queue_new ();
+
+	for (i = 0; i < G_N_ELEMENTS (copy->buffers); i++) {
+		if (posix_memalign ((void **) &copy->buffers[i].data, LARGE_COPY_ALIGNMENT,
+				    LARGE_COPY_BUFFER_SIZE) != 0) {
+			copy->buffers[i].data = NULL;
+			return ENOMEM;
+		}
+		g_async_queue_push (copy->free_buffers, &copy->buffers[i]);
 	}
 
+	return 0;
+}
 
-	/* Don't allow recursive move/copy into itself.
-	 * (We would get a file system error if we proceeded but it is nicer to
-	 * detect and report it at this level) */
-	if (test_dir_is_parent (dest_dir, src)) {
-		if (job->skip_all_error) {
-			goto out;
+static void
+large_copy_clear (LargeCopy *copy)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (copy->buffers); i++) {
+		free (copy->buffers[i].data);
+	}
+	g_async_queue_unref (copy->free_buffers);
+	g_async_queue_unref (copy->full_buffers);
+}
+
+static gpointer
+large_copy_read_thread (gpointer user_data)
+{
+	LargeCopy *copy;
+	LargeCopyBuffer *buffer;
+	goffset offset;
+	gssize n;
+
+	copy = user_data;
+	offset = 0;
+
+	do {
+		buffer = g_async_queue_pop (copy->free_buffers);
+		buffer->length = 0;
+		buffer->error = 0;
+
+		/* Fill the buffer completely, so that all but the last
+		 * chunk stay aligned for O_DIRECT */
+		while (buffer->length < LARGE_COPY_BUFFER_SIZE &&
+		       !g_atomic_int_get (&copy->stop)) {
+			n = read (copy->src_fd, buffer->data + buffer->length,
+				  LARGE_COPY_BUFFER_SIZE - buffer->length);
+			if (n < 0 && errno == EINTR) {
+				continue;
+			} else if (n < 0) {
+				buffer->error = errno;
+				break;
+			} else if (n == 0) {
+				break;
+			}
+			buffer->length += n;
 		}
 
-		/*  the run_warning() frees all strings passed in automatically  */
-		primary = copy_job->is_move ? g_strdup (_("You cannot move a folder into itself."))
-					    : g_strdup (_("You cannot copy a folder into itself."));
-		secondary = g_strdup (_("The destination folder is inside the source folder."));
+#ifdef POSIX_FADV_DONTNEED
+		posix_fadvise (copy->src_fd, offset, buffer->length, POSIX_FADV_DONTNEED);
+#endif
+		offset += buffer->length;
 
-		response = run_warning (job,
-					primary,
-					secondary,
-					NULL,
-					(source_info->num_files - transfer_info->num_files) > 1,
-					GTK_STOCK_CANCEL, SKIP_ALL, SKIP,
-					NULL);
+		buffer->last = buffer->error != 0 ||
+			buffer->length < LARGE_COPY_BUFFER_SIZE ||
+			g_atomic_int_get (&copy->stop);
 
-		if (response == 0 || response == GTK_RESPONSE_DELETE_EVENT) {
-			abort_job (job);
-		} else if (response == 1) { /* skip all */
-			job->skip_all_error = TRUE;
-		} else if (response == 2) { /* skip */
-			/* do nothing */
-		} else {
-			g_assert_not_reached ();
-		}
+		g_async_queue_push (copy->full_buffers, buffer);
+	} while (!buffer->last);
 
-		goto out;
-	}
+	return NULL;
+}
 
-	/* Don't allow copying over the source or one of the parents of the source.
-	 */
-	if (test_dir_is_parent (src, dest)) {
-		if (job->skip_all_error) {
-			goto out;
-		}
+static gboolean
+should_copy_large_files_directly (void)
+{
+	GSettings *prefs;
+	gboolean direct;
 
-		/*  the run_warning() frees all strings passed in automatically  */
-		primary = copy_job->is_move ? g_strdup (_("You cannot move a file over itself."))
-					    : g_strdup (_("You cannot copy a file over itself."));
-		secondary = g_strdup (_("The source file would be overwritten by the destination."));
+	/* Since this happens on a thread we can't use the global prefs object */
+	prefs = g_settings_new ("org.mate.caja.preferences");
+	direct = g_settings_get_boolean (prefs, CAJA_PREFERENCES_LARGE_FILE_DIRECT_IO);
+	g_object_unref (prefs);
 
-		response = run_warning (job,
-					primary,
-					secondary,
-					NULL,
-					(source_info->num_files - transfer_info->num_files) > 1,
-					GTK_STOCK_CANCEL, SKIP_ALL, SKIP,
-					NULL);
+	return direct;
+}
 
-		if (response == 0 || response == GTK_RESPONSE_DELETE_EVENT) {
-			abort_job (job);
-		} else if (response == 1) { /* skip all */
-			job->skip_all_error = TRUE;
-		} else if (response == 2) { /* skip */
-			/* do nothing */
-		} else {
-			g_assert_not_reached ();
-		}
+static gboolean
+set_direct_io (int fd,
+	       gboolean direct)
+{
+#ifdef O_DIRECT
+	int fl;
 
-		goto out;
+	fl = fcntl (fd, F_GETFL);
+	if (fl < 0) {
+		return FALSE;
 	}
+	fl = direct ? fl | O_DIRECT : fl & ~O_DIRECT;
 
+	return fcntl (fd, F_SETFL, fl) == 0;
+#else
+	return FALSE;
+#endif
+}
 
- retry:
-	error = NULL;
-	flags = G_FILE_COPY_NOFOLLOW_SYMLINKS;
-	if (overwrite) {
-		flags |= G_FILE_COPY_OVERWRITE;
-	}
-	if (readonly_source_fs) {
-		flags |= G_FILE_COPY_TARGET_DEFAULT_PERMS;
+/* Adds what is written to checksum, if there is one. Both files are
+ * opened for O_DIRECT when direct_io is set and they allow it. Returns
+ * 0 or an errno value, ECANCELED if cancelled.
+ */
+static int
+copy_large_file (int src_fd,
+		 int dest_fd,
+		 goffset size,
+		 gboolean direct_io,
+		 GCancellable *cancellable,
+		 GFileProgressCallback progress_callback,
+		 gpointer progress_callback_data,
+		 GChecksum *checksum,
+		 goffset *copied)
+{
+	LargeCopy copy;
+	LargeCopyBuffer *buffer;
+	GThread *thread;
+	gboolean direct, done;
+	goffset flushed;
+	gsize written;
+	gssize n;
+	int errsv;
+
+	errsv = large_copy_init (&copy, src_fd);
+	if (errsv != 0) {
+		goto out;
+	}
+
+	direct = FALSE;
+	if (direct_io && size >= LARGE_COPY_FILE_SIZE) {
+		/* Not every file system supports it, and that's fine */
+		direct = set_direct_io (dest_fd, TRUE);
+		if (direct && !set_direct_io (src_fd, TRUE)) {
+			set_direct_io (dest_fd, FALSE);
+			direct = FALSE;
+		}
+	}
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise (src_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	thread = g_thread_new ("caja-large-copy", large_copy_read_thread, &copy);
+
+	errsv = 0;
+	flushed = 0;
+	do {
+		buffer = g_async_queue_pop (copy.full_buffers);
+		done = buffer->last;
+
+		if (errsv == 0 && buffer->error != 0) {
+			errsv = buffer->error;
+		}
+
+		/* The last chunk is usually not a whole number of blocks */
+		if (errsv == 0 && direct &&
+		    buffer->length % LARGE_COPY_ALIGNMENT != 0) {
+			set_direct_io (dest_fd, FALSE);
+			direct = FALSE;
+		}
+
+		if (errsv == 0 && checksum != NULL) {
+			g_checksum_update (checksum, (const guchar *) buffer->data, buffer->length);
+		}
+
+		for (written = 0; errsv == 0 && written < buffer->length; written += n) {
+			n = write (dest_fd, buffer->data + written, buffer->length - written);
+			if (n < 0) {
+				if (errno != EINTR) {
+					errsv = errno;
+				}
+				n = 0;
+			}
+		}
+
+		if (errsv == 0) {
+			*copied += buffer->length;
+
+			if (!direct && *copied - flushed >= LARGE_COPY_FLUSH_SIZE) {
+				if (fdatasync (dest_fd) != 0) {
+					errsv = errno;
+				}
+#ifdef POSIX_FADV_DONTNEED
+				posix_fadvise (dest_fd, flushed, *copied - flushed, POSIX_FADV_DONTNEED);
+#endif
+				flushed = *copied;
+			}
+
+			if (progress_callback) {
+				progress_callback (*copied, size, progress_callback_data);
+			}
+			if (g_cancellable_is_cancelled (cancellable)) {
+				errsv = ECANCELED;
+			}
+		}
+
+		if (errsv != 0) {
+			/* Let the reader stop, but keep going until it has */
+			g_atomic_int_set (&copy.stop, TRUE);
+		}
+
+		g_async_queue_push (copy.free_buffers, buffer);
+	} while (!done);
+
+	g_thread_join (thread);
+
+#ifdef POSIX_FADV_DONTNEED
+	if (errsv == 0 && !direct && fdatasync (dest_fd) == 0) {
+		posix_fadvise (dest_fd, flushed, 0, POSIX_FADV_DONTNEED);
+	}
+#endif
+
+ out:
+	large_copy_clear (&copy);
+
+	return errsv;
+}
+
+/* Files smaller than this are checksummed on the calling thread, with
+ * a small buffer, and are read back without flushing the whole file
+ * system when they can be read directly from the disk.
+ */
+#define VERIFY_INLINE_SIZE (1024 * 1024)
+#define VERIFY_INLINE_BUFFER_SIZE (64 * 1024)
+
+static int
+checksum_fd_inline (int fd,
+		    GCancellable *cancellable,
+		    GChecksum *checksum)
+{
+	char *buffer;
+	gssize n;
+	int errsv;
+
+	/* Aligned, in case fd is open for O_DIRECT */
+	if (posix_memalign ((void **) &buffer, LARGE_COPY_ALIGNMENT,
+			    VERIFY_INLINE_BUFFER_SIZE) != 0) {
+		return ENOMEM;
+	}
+
+	errsv = 0;
+	while (errsv == 0 &&
+	       (n = read (fd, buffer, VERIFY_INLINE_BUFFER_SIZE)) != 0) {
+		if (n < 0) {
+			if (errno != EINTR) {
+				errsv = errno;
+			}
+			continue;
+		}
+		g_checksum_update (checksum, (const guchar *) buffer, n);
+		if (g_cancellable_is_cancelled (cancellable)) {
+			errsv = ECANCELED;
+		}
+	}
+
+	free (buffer);
+
+	return errsv;
+}
+
+/* copy_large_file() for verified copies of files smaller than
+ * VERIFY_INLINE_SIZE, which are not worth a thread and large buffers.
+ */
+static int
+copy_small_file (int src_fd,
+		 int dest_fd,
+		 goffset size,
+		 GCancellable *cancellable,
+		 GFileProgressCallback progress_callback,
+		 gpointer progress_callback_data,
+		 GChecksum *checksum,
+		 goffset *copied)
+{
+	char *buffer;
+	gsize written;
+	gssize n, w;
+	int errsv;
+
+	buffer = g_malloc (VERIFY_INLINE_BUFFER_SIZE);
+
+	errsv = 0;
+	while (errsv == 0 &&
+	       (n = read (src_fd, buffer, VERIFY_INLINE_BUFFER_SIZE)) != 0) {
+		if (n < 0) {
+			if (errno != EINTR) {
+				errsv = errno;
+			}
+			continue;
+		}
+
+		g_checksum_update (checksum, (const guchar *) buffer, n);
+
+		for (written = 0; errsv == 0 && written < (gsize) n; written += w) {
+			w = write (dest_fd, buffer + written, n - written);
+			if (w < 0) {
+				if (errno != EINTR) {
+					errsv = errno;
+				}
+				w = 0;
+			}
+		}
+
+		if (errsv == 0) {
+			*copied += n;
+			if (progress_callback) {
+				progress_callback (*copied, size, progress_callback_data);
+			}
+			if (g_cancellable_is_cancelled (cancellable)) {
+				errsv = ECANCELED;
+			}
+		}
+	}
+
+	g_free (buffer);
+
+	return errsv;
+}
+
+/* Adds everything from the current offset of fd to its end to
+ * checksum. Returns 0 or an errno value, ECANCELED if cancelled.
+ */
+static int
+checksum_fd (int fd,
+	     GCancellable *cancellable,
+	     GChecksum *checksum)
+{
+	LargeCopy copy;
+	LargeCopyBuffer *buffer;
+	GThread *thread;
+	struct stat statbuf;
+	gboolean done;
+	int errsv;
+
+	if (fstat (fd, &statbuf) == 0 &&
+	    statbuf.st_size < VERIFY_INLINE_SIZE) {
+		return checksum_fd_inline (fd, cancellable, checksum);
+	}
+
+	errsv = large_copy_init (&copy, fd);
+	if (errsv != 0) {
+		goto out;
+	}
+
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	thread = g_thread_new ("caja-checksum", large_copy_read_thread, &copy);
+
+	do {
+		buffer = g_async_queue_pop (copy.full_buffers);
+		done = buffer->last;
+
+		if (errsv == 0 && buffer->error != 0) {
+			errsv = buffer->error;
+		}
+		if (errsv == 0) {
+			g_checksum_update (checksum, (const guchar *) buffer->data, buffer->length);
+			if (g_cancellable_is_cancelled (cancellable)) {
+				errsv = ECANCELED;
+			}
+		}
+		if (errsv != 0) {
+			g_atomic_int_set (&copy.stop, TRUE);
+		}
+
+		g_async_queue_push (copy.free_buffers, buffer);
+	} while (!done);
+
+	g_thread_join (thread);
+
+ out:
+	large_copy_clear (&copy);
+
+	return errsv;
+}
+
+/* Reads a copy back and compares it with the checksum of what was
+ * written to it. The copy is flushed and dropped from the page cache
+ * first, so that what is read back is what made it to the disk. A
+ * small copy is read with O_DIRECT instead when the file system
+ * allows it, which writes back just that file.
+ * Returns 0 or an errno value, *identical tells if they matched.
+ */
+static int
+verify_copy (int dest_fd,
+	     const char *dest_path,
+	     GChecksum *written,
+	     GCancellable *cancellable,
+	     gboolean *identical)
+{
+	GChecksum *checksum;
+	struct stat statbuf;
+	int read_fd, errsv;
+
+	*identical = FALSE;
+	checksum = g_checksum_new (G_CHECKSUM_MD5);
+	errsv = EINVAL;
+
+#ifdef O_DIRECT
+	if (fstat (dest_fd, &statbuf) == 0 &&
+	    statbuf.st_size < VERIFY_INLINE_SIZE) {
+		read_fd = open (dest_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC | O_DIRECT);
+		if (read_fd >= 0) {
+			errsv = checksum_fd (read_fd, cancellable, checksum);
+			close (read_fd);
+		}
+	}
+#endif
+
+	/* Some file systems only refuse O_DIRECT once reading */
+	if (errsv == EINVAL) {
+		g_checksum_reset (checksum);
+
+		if (fdatasync (dest_fd) != 0) {
+			errsv = errno;
+			goto out;
+		}
+#ifdef POSIX_FADV_DONTNEED
+		posix_fadvise (dest_fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+
+		read_fd = open (dest_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+		if (read_fd < 0) {
+			errsv = errno;
+			goto out;
+		}
+		errsv = checksum_fd (read_fd, cancellable, checksum);
+		close (read_fd);
+	}
+
+	*identical = errsv == 0 &&
+		strcmp (g_checksum_get_string (checksum),
+			g_checksum_get_string (written)) == 0;
+
+ out:
+	g_checksum_free (checksum);
+
+	return errsv;
+}
+
+/* For a copy that failed with errsv, or that is different from the
+ * original if errsv is 0.
+ */
+static void
+set_copy_error (int errsv,
+		GError **error)
+{
+	if (errsv == ECANCELED) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+				     _("Operation was cancelled"));
+	} else if (errsv == 0) {
+		g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+				     _("The copy read back from the disk is different from the original."));
+	} else {
+		g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+			     _("Error writing to file: %s"), g_strerror (errsv));
+	}
+}
+
+/* Checks a copy that was not checksummed while it was made, like a
+ * resumed one, reading back both files. Returns FALSE with error set if they are
+ * different or reading them fails; *verified is FALSE if it wasn't
+ * possible to check, like for files that aren't local.
+ */
+static gboolean
+verify_file_copy (GFile *src,
+		  GFile *dest,
+		  GCancellable *cancellable,
+		  gboolean *verified,
+		  GError **error)
+{
+	char *src_path, *dest_path;
+	struct stat statbuf;
+	GChecksum *checksum;
+	int src_fd, dest_fd, errsv;
+	gboolean identical;
+
+	src_path = g_file_get_path (src);
+	dest_path = g_file_get_path (dest);
+	src_fd = dest_fd = -1;
+	*verified = FALSE;
+	errsv = 0;
+	identical = TRUE;
+
+	if (src_path == NULL || dest_path == NULL) {
+		goto out;
+	}
+
+	/* Only the contents of regular files are checked */
+	if (g_lstat (src_path, &statbuf) == 0 && !S_ISREG (statbuf.st_mode)) {
+		*verified = TRUE;
+		goto out;
+	}
+
+	/* A copy that can't be read, like that of a write-only file,
+	 * can't be verified but is not an error */
+	src_fd = open (src_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	dest_fd = open (dest_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (src_fd < 0 || dest_fd < 0) {
+		goto out;
+	}
+
+	checksum = g_checksum_new (G_CHECKSUM_MD5);
+	errsv = checksum_fd (src_fd, cancellable, checksum);
+	if (errsv == 0) {
+		errsv = verify_copy (dest_fd, dest_path, checksum,
+				     cancellable, &identical);
+	}
+	g_checksum_free (checksum);
+	*verified = errsv == 0;
+
+ out:
+	if (dest_fd >= 0) {
+		close (dest_fd);
+	}
+	if (src_fd >= 0) {
+		close (src_fd);
+	}
+	g_free (src_path);
+	g_free (dest_path);
+
+	if (errsv != 0 || !identical) {
+		set_copy_error (errsv, error);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Copies from the current offsets to the end of the source, adding
+ * what was copied to *copied. The methods are tried in order. Returns
+ * 0 or an errno value, or -1 if the kernel can't copy all of size
+ * between these files; what was written then has to be thrown away.
+ */
+static int
+kernel_copy_fds (int src_fd,
+		 int dest_fd,
+		 goffset size,
+		 GCancellable *cancellable,
+		 GFileProgressCallback progress_callback,
+		 gpointer progress_callback_data,
+		 KernelCopyMethod *method,
+		 goffset *copied)
+{
+	goffset start;
+	gssize n;
+	int errsv;
+
+	for (*method = KERNEL_COPY_FILE_RANGE; *method <= KERNEL_COPY_SENDFILE; (*method)++) {
+		start = *copied;
+		while ((n = kernel_copy_chunk (*method, src_fd, dest_fd,
+					       KERNEL_COPY_CHUNK_SIZE)) > 0) {
+			*copied += n;
+			if (progress_callback) {
+				progress_callback (*copied, size,
+						   progress_callback_data);
+			}
+			if (g_cancellable_is_cancelled (cancellable)) {
+				return ECANCELED;
+			}
+		}
+
+		if (n == 0) {
+			if (*copied >= size) {
+				return 0;
+			}
+			/* Some file systems report the end of the file
+			 * rather than fail when they can't do this, the
+			 * next method goes on from where this one stopped.
+			 */
+			continue;
+		}
+
+		errsv = errno;
+		if (*copied > start ||
+		    !(errsv == ENOSYS || errsv == EXDEV || errsv == EINVAL ||
+		      errsv == EOPNOTSUPP || errsv == EBADF)) {
+			/* A real I/O error, not a missing feature */
+			return errsv;
+		}
+	}
+
+	return -1;
+}
+
+/* Copies a local regular file with whatever the kernel offers: a
+ * reflink, then copy_file_range(), then sendfile(). Huge files go
+ * through the large buffers if they can't be reflinked, and so do
+ * verified copies, which are checksummed on the way. Returns
+ * FALSE, leaving nothing behind, if none of them can be used for this
+ * file and the caller should use g_file_copy(). Otherwise *res and
+ * *error tell how it went. Unless it is a reflink, a verified copy is
+ * read back from the disk and checked against the source.
+ */
+static gboolean
+copy_file_with_kernel (GFile *src,
+		       GFile *dest,
+		       GFileCopyFlags flags,
+		       gboolean verify,
+		       gboolean direct_io,
+		       GCancellable *cancellable,
+		       GFileProgressCallback progress_callback,
+		       gpointer progress_callback_data,
+		       KernelCopyMethod *method,
+		       gboolean *res,
+		       GError **error)
+{
+	char *src_path, *dest_path;
+	struct stat statbuf, dest_statbuf;
+	int src_fd, dest_fd;
+	goffset copied;
+	int errsv;
+	gboolean handled, identical, large;
+	GChecksum *checksum;
+
+	/* Replacing has too many corner cases, leave it to gio */
+	if (flags & (G_FILE_COPY_OVERWRITE | G_FILE_COPY_BACKUP)) {
+		return FALSE;
+	}
+
+	src_path = g_file_get_path (src);
+	dest_path = g_file_get_path (dest);
+	src_fd = dest_fd = -1;
+	handled = FALSE;
+
+	if (src_path == NULL || dest_path == NULL) {
+		goto out;
+	}
+
+	src_fd = open (src_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (src_fd < 0 ||
+	    fstat (src_fd, &statbuf) != 0 ||
+	    !S_ISREG (statbuf.st_mode)) {
+		goto out;
+	}
+
+	/* Anything but a fresh file, including EEXIST, is reported by gio */
+	dest_fd = open (dest_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+			(flags & G_FILE_COPY_TARGET_DEFAULT_PERMS) ? 0666 : statbuf.st_mode & 0777);
+	if (dest_fd < 0) {
+		goto out;
+	}
+
+	/* Like gio, report progress once dest is known to be ours */
+	if (progress_callback) {
+		progress_callback (0, statbuf.st_size, progress_callback_data);
+	}
+
+	copied = 0;
+	errsv = 0;
+	identical = TRUE;
+
+#ifdef FICLONE
+	if (ioctl (dest_fd, FICLONE, src_fd) == 0) {
+		*method = KERNEL_COPY_REFLINK;
+		copied = statbuf.st_size;
+		goto done;
+	}
+#endif
+
+	large = statbuf.st_size >= LARGE_COPY_FILE_SIZE;
+
+	/* The kernel copies without the data coming through here, so a
+	 * verified copy would have to read the source once more.
+	 */
+	if (!large && !verify) {
+		errsv = kernel_copy_fds (src_fd, dest_fd, statbuf.st_size,
+					 cancellable,
+					 progress_callback, progress_callback_data,
+					 method, &copied);
+		if (errsv < 0) {
+			goto unsupported;
+		}
+		goto done;
+	}
+
+	*method = KERNEL_COPY_LARGE_BUFFERS;
+	checksum = verify ? g_checksum_new (G_CHECKSUM_MD5) : NULL;
+	if (verify && statbuf.st_size < VERIFY_INLINE_SIZE) {
+		errsv = copy_small_file (src_fd, dest_fd, statbuf.st_size,
+					 cancellable,
+					 progress_callback, progress_callback_data,
+					 checksum, &copied);
+	} else {
+		errsv = copy_large_file (src_fd, dest_fd, statbuf.st_size,
+					 direct_io,
+					 cancellable,
+					 progress_callback, progress_callback_data,
+					 checksum, &copied);
+	}
+	if (errsv == 0 && checksum != NULL) {
+		errsv = verify_copy (dest_fd, dest_path, checksum,
+				     cancellable, &identical);
+	}
+	if (checksum != NULL) {
+		g_checksum_free (checksum);
+	}
+
+ done:
+	/* Never take a short copy for a good one, whatever the kernel said */
+	if (errsv == 0 &&
+	    (fstat (dest_fd, &dest_statbuf) != 0 ||
+	     dest_statbuf.st_size != copied ||
+	     copied < statbuf.st_size)) {
+		goto unsupported;
+	}
+
+	handled = TRUE;
+
+	if (close (dest_fd) != 0 && errsv == 0) {
+		errsv = errno;
+	}
+	dest_fd = -1;
+
+	if (errsv != 0 || !identical) {
+		g_unlink (dest_path);
+		*res = FALSE;
+		set_copy_error (errsv, error);
+	} else {
+		*res = TRUE;
+		if (progress_callback) {
+			progress_callback (copied, statbuf.st_size,
+					   progress_callback_data);
+		}
+		/* Same as what g_file_copy() copies, failing is not fatal */
+		g_file_copy_attributes (src, dest,
+					flags & (G_FILE_COPY_NOFOLLOW_SYMLINKS |
+						 G_FILE_COPY_ALL_METADATA |
+						 G_FILE_COPY_TARGET_DEFAULT_PERMS),
+					cancellable, NULL);
+	}
+	goto out;
+
+ unsupported:
+	/* Throw away whatever was written, gio starts over */
+	close (dest_fd);
+	dest_fd = -1;
+	g_unlink (dest_path);
+
+ out:
+	if (dest_fd >= 0) {
+		close (dest_fd);
+	}
+	if (src_fd >= 0) {
+		close (src_fd);
+	}
+	g_free (src_path);
+	g_free (dest_path);
+
+	return handled;
+}
+
+/* Buffer for verified copies through gio streams */
+#define VERIFY_STREAM_BUFFER_SIZE (256 * 1024)
+
+/* A verified copy that copy_file_with_kernel() can't make, like one
+ * replacing a file or one from a remote location. The source is
+ * streamed through here and checksummed on the way, so only the copy
+ * is read back. Other than regular files copied to a local file, which
+ * g_file_copy() copies, can't be checked; *verified tells whether it
+ * was.
+ */
+static gboolean
+copy_file_verified_with_gio (GFile *src,
+			     GFile *dest,
+			     GFileCopyFlags flags,
+			     GCancellable *cancellable,
+			     GFileProgressCallback progress_callback,
+			     gpointer progress_callback_data,
+			     gboolean *verified,
+			     GError **error)
+{
+	GFileInfo *info;
+	GFileInputStream *in;
+	GFileOutputStream *out;
+	GChecksum *checksum;
+	char *dest_path, *buffer;
+	goffset size, copied;
+	gssize n;
+	gboolean res, identical, known, regular;
+	int dest_fd, errsv;
+
+	*verified = FALSE;
+
+	info = g_file_query_info (src,
+				  G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+				  G_FILE_ATTRIBUTE_STANDARD_SIZE,
+				  (flags & G_FILE_COPY_NOFOLLOW_SYMLINKS) ?
+				  G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS : 0,
+				  cancellable, NULL);
+	known = info != NULL;
+	regular = known &&
+		g_file_info_get_file_type (info) == G_FILE_TYPE_REGULAR;
+	size = regular ? g_file_info_get_size (info) : 0;
+	if (info != NULL) {
+		g_object_unref (info);
+	}
+
+	dest_path = g_file_get_path (dest);
+	if (!regular || dest_path == NULL) {
+		g_free (dest_path);
+		res = g_file_copy (src, dest, flags, cancellable,
+				   progress_callback, progress_callback_data,
+				   error);
+		/* Only the contents of regular files are checked */
+		*verified = res && known && !regular;
+		return res;
+	}
+
+	in = g_file_read (src, cancellable, error);
+	if (in == NULL) {
+		g_free (dest_path);
+		return FALSE;
+	}
+
+	if (flags & G_FILE_COPY_OVERWRITE) {
+		out = g_file_replace (dest, NULL,
+				      (flags & G_FILE_COPY_BACKUP) != 0,
+				      G_FILE_CREATE_REPLACE_DESTINATION,
+				      cancellable, error);
+	} else {
+		out = g_file_create (dest, G_FILE_CREATE_NONE, cancellable, error);
+	}
+	if (out == NULL) {
+		g_object_unref (in);
+		g_free (dest_path);
+		return FALSE;
+	}
+
+	if (progress_callback) {
+		progress_callback (0, size, progress_callback_data);
+	}
+
+	buffer = g_malloc (VERIFY_STREAM_BUFFER_SIZE);
+	checksum = g_checksum_new (G_CHECKSUM_MD5);
+	copied = 0;
+	res = TRUE;
+
+	while (res) {
+		n = g_input_stream_read (G_INPUT_STREAM (in), buffer,
+					 VERIFY_STREAM_BUFFER_SIZE,
+					 cancellable, error);
+		if (n <= 0) {
+			res = n == 0;
+			break;
+		}
+
+		g_checksum_update (checksum, (const guchar *) buffer, n);
+		res = g_output_stream_write_all (G_OUTPUT_STREAM (out), buffer, n,
+						 NULL, cancellable, error);
+		copied += n;
+		if (res && progress_callback) {
+			progress_callback (copied, size, progress_callback_data);
+		}
+	}
+
+	g_input_stream_close (G_INPUT_STREAM (in), NULL, NULL);
+	if (res) {
+		res = g_output_stream_close (G_OUTPUT_STREAM (out), cancellable, error);
+	} else {
+		g_output_stream_close (G_OUTPUT_STREAM (out), NULL, NULL);
+	}
+	g_object_unref (in);
+	g_object_unref (out);
+	g_free (buffer);
+
+	if (res) {
+		/* Same as what g_file_copy() copies, failing is not fatal */
+		g_file_copy_attributes (src, dest,
+					flags & (G_FILE_COPY_NOFOLLOW_SYMLINKS |
+						 G_FILE_COPY_ALL_METADATA |
+						 G_FILE_COPY_TARGET_DEFAULT_PERMS),
+					cancellable, NULL);
+
+		/* A copy that can't be read, like that of a write-only
+		 * file, can't be verified but is not an error */
+		dest_fd = open (dest_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+		if (dest_fd >= 0) {
+			errsv = verify_copy (dest_fd, dest_path, checksum,
+					     cancellable, &identical);
+			close (dest_fd);
+
+			if (errsv != 0 || !identical) {
+				set_copy_error (errsv, error);
+				res = FALSE;
+			} else {
+				*verified = TRUE;
+			}
+		}
+	}
+
+	if (!res) {
+		g_file_delete (dest, NULL, NULL);
+	}
+
+	g_checksum_free (checksum);
+	g_free (dest_path);
+
+	return res;
+}
+
+/* g_file_copy() with the kernel's fast paths tried first. A verified
+ * copy that has to be made by gio is streamed through here instead,
+ * and *verified tells whether it could be checked.
+ */
+static gboolean
+copy_file (GFile *src,
+	   GFile *dest,
+	   GFileCopyFlags flags,
+	   gboolean verify,
+	   gboolean direct_io,
+	   GCancellable *cancellable,
+	   GFileProgressCallback progress_callback,
+	   gpointer progress_callback_data,
+	   gboolean *verified,
+	   GError **error)
+{
+	static const char *method_names[] = { "reflink", "copy_file_range", "sendfile", "buffers" };
+	KernelCopyMethod method;
+	const char *used;
+	gboolean res;
+	char *src_uri, *dest_uri;
+
+	if (copy_file_with_kernel (src, dest, flags, verify, direct_io, cancellable,
+				   progress_callback, progress_callback_data,
+				   &method, &res, error)) {
+		used = method_names[method];
+		*verified = verify;
+	} else if (verify) {
+		used = "gio streams";
+		res = copy_file_verified_with_gio (src, dest, flags, cancellable,
+						   progress_callback, progress_callback_data,
+						   verified, error);
+	} else {
+		used = "gio";
+		*verified = FALSE;
+		res = g_file_copy (src, dest, flags, cancellable,
+				   progress_callback, progress_callback_data,
+				   error);
+	}
+
+	if (res && caja_debug_log_is_domain_enabled (CAJA_DEBUG_LOG_DOMAIN_COPY)) {
+		src_uri = g_file_get_uri (src);
+		dest_uri = g_file_get_uri (dest);
+		caja_debug_log (FALSE, CAJA_DEBUG_LOG_DOMAIN_COPY,
+				"copied %s to %s using %s", src_uri, dest_uri, used);
+		g_free (src_uri);
+		g_free (dest_uri);
+	}
+
+	return res;
+}
+
+/* A resumed copy backs off this far from where the partial copy
+ * ends, since its last blocks may not have made it to the disk.
+ */
+#define RESUME_COPY_BACKOFF (1024 * 1024)
+
+/* Completes a partial copy of a local file that an interrupted
+ * operation left at dest. Returns FALSE if that's not possible or
+ * fails, the copy then has to start over.
+ */
+static gboolean
+resume_copy_file (GFile *src,
+		  GFile *dest,
+		  GFileCopyFlags flags,
+		  GCancellable *cancellable,
+		  GFileProgressCallback progress_callback,
+		  gpointer progress_callback_data)
+{
+	char *src_path, *dest_path;
+	struct stat src_statbuf, dest_statbuf;
+	KernelCopyMethod method;
+	int src_fd, dest_fd;
+	goffset offset, copied;
+	int errsv;
+
+	src_path = g_file_get_path (src);
+	dest_path = g_file_get_path (dest);
+	src_fd = dest_fd = -1;
+	errsv = -1;
+
+	if (src_path == NULL || dest_path == NULL) {
+		goto out;
+	}
+
+	src_fd = open (src_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	dest_fd = open (dest_path, O_WRONLY | O_NOFOLLOW | O_CLOEXEC);
+	if (src_fd < 0 || dest_fd < 0 ||
+	    fstat (src_fd, &src_statbuf) != 0 ||
+	    fstat (dest_fd, &dest_statbuf) != 0 ||
+	    !S_ISREG (src_statbuf.st_mode) ||
+	    !S_ISREG (dest_statbuf.st_mode) ||
+	    dest_statbuf.st_size > src_statbuf.st_size) {
+		goto out;
+	}
+
+	offset = dest_statbuf.st_size - dest_statbuf.st_size % RESUME_COPY_BACKOFF;
+	offset = MAX (offset - RESUME_COPY_BACKOFF, 0);
+
+	if (ftruncate (dest_fd, offset) != 0 ||
+	    lseek (src_fd, offset, SEEK_SET) != offset ||
+	    lseek (dest_fd, offset, SEEK_SET) != offset) {
+		goto out;
+	}
+
+	copied = offset;
+	errsv = kernel_copy_fds (src_fd, dest_fd, src_statbuf.st_size,
+				 cancellable,
+				 progress_callback, progress_callback_data,
+				 &method, &copied);
+
+	if (errsv == 0 &&
+	    (fstat (dest_fd, &dest_statbuf) != 0 ||
+	     dest_statbuf.st_size != copied)) {
+		errsv = -1;
+	}
+
+	if (close (dest_fd) != 0 && errsv == 0) {
+		errsv = errno;
+	}
+	dest_fd = -1;
+
+	if (errsv == 0) {
+		g_file_copy_attributes (src, dest,
+					flags & (G_FILE_COPY_NOFOLLOW_SYMLINKS |
+						 G_FILE_COPY_ALL_METADATA |
+						 G_FILE_COPY_TARGET_DEFAULT_PERMS),
+					cancellable, NULL);
+		caja_debug_log (FALSE, CAJA_DEBUG_LOG_DOMAIN_COPY,
+				"resumed copying %s at %" G_GOFFSET_FORMAT,
+				src_path, offset);
+	}
+
+ out:
+	if (dest_fd >= 0) {
+		close (dest_fd);
+	}
+	if (src_fd >= 0) {
+		close (src_fd);
+	}
+	g_free (src_path);
+	g_free (dest_path);
+
+	return errsv == 0;
+}
+
+/* Whether dest is a finished copy of src, as the journal of the
+ * interrupted operation says, and src hasn't changed since.
+ */
+static gboolean
+journaled_copy_is_complete (CopyMoveJob *job,
+			    GFile *src,
+			    GFile *dest,
+			    goffset *size)
+{
+	GFileInfo *src_info, *dest_info;
+	guint64 mtime;
+	gboolean complete;
+
+	src_info = g_file_query_info (src,
+				      G_FILE_ATTRIBUTE_STANDARD_SIZE","
+				      G_FILE_ATTRIBUTE_TIME_MODIFIED,
+				      G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+				      job->common.cancellable,
+				      NULL);
+	dest_info = g_file_query_info (dest,
+				       G_FILE_ATTRIBUTE_STANDARD_SIZE,
+				       G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+				       job->common.cancellable,
+				       NULL);
+
+	complete = FALSE;
+	if (src_info != NULL && dest_info != NULL) {
+		mtime = g_file_info_get_attribute_uint64 (src_info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+		*size = g_file_info_get_size (src_info);
+		complete = *size == g_file_info_get_size (dest_info) &&
+			mtime < caja_operation_journal_get_start_time (job->journal) / G_USEC_PER_SEC;
+	}
+
+	if (src_info != NULL) {
+		g_object_unref (src_info);
+	}
+	if (dest_info != NULL) {
+		g_object_unref (dest_info);
+	}
+
+	return complete;
+}
+
+/* Whether dest can be the partial copy of src that the interrupted
+ * operation was making: written to after the operation started, with
+ * src not modified since. Anything else may well be somebody else's
+ * file, and is a conflict like any other.
+ */
+static gboolean
+journaled_copy_is_partial (CopyMoveJob *job,
+			   GFile *src,
+			   GFile *dest)
+{
+	GFileInfo *src_info, *dest_info;
+	guint64 start_time;
+	gboolean partial;
+
+	src_info = g_file_query_info (src,
+				      G_FILE_ATTRIBUTE_STANDARD_SIZE","
+				      G_FILE_ATTRIBUTE_TIME_MODIFIED,
+				      G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+				      job->common.cancellable,
+				      NULL);
+	dest_info = g_file_query_info (dest,
+				       G_FILE_ATTRIBUTE_STANDARD_SIZE","
+				       G_FILE_ATTRIBUTE_TIME_MODIFIED,
+				       G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+				       job->common.cancellable,
+				       NULL);
+
+	partial = FALSE;
+	if (src_info != NULL && dest_info != NULL) {
+		start_time = caja_operation_journal_get_start_time (job->journal) / G_USEC_PER_SEC;
+		partial = g_file_info_get_size (dest_info) <= g_file_info_get_size (src_info) &&
+			g_file_info_get_attribute_uint64 (src_info, G_FILE_ATTRIBUTE_TIME_MODIFIED) < start_time &&
+			g_file_info_get_attribute_uint64 (dest_info, G_FILE_ATTRIBUTE_TIME_MODIFIED) >= start_time;
+	}
+
+	if (src_info != NULL) {
+		g_object_unref (src_info);
+	}
+	if (dest_info != NULL) {
+		g_object_unref (dest_info);
+	}
+
+	return partial;
+}
+
+static void
+file_transferred (CopyMoveJob *copy_job,
+		  GFile *src,
+		  GFile *dest,
+		  GFile *dest_dir,
+		  SourceInfo *source_info,
+		  TransferInfo *transfer_info,
+		  GHashTable *debuting_files,
+		  GdkPoint *position)
+{
+	CommonJob *job;
+
+	job = (CommonJob *)copy_job;
+
+	transfer_info->num_files ++;
+	report_copy_progress (copy_job, source_info, transfer_info);
+
+	if (debuting_files) {
+		if (position) {
+			caja_file_changes_queue_schedule_position_set (dest, *position, job->screen_num);
+		} else {
+			caja_file_changes_queue_schedule_position_remove (dest);
+		}
+
+		g_hash_table_replace (debuting_files, g_object_ref (dest), GINT_TO_POINTER (TRUE));
+	}
+	if (copy_job->is_move) {
+		caja_file_changes_queue_file_moved (src, dest);
+	} else {
+		caja_file_changes_queue_file_added (dest);
+	}
+
+	/* If copying a trusted desktop file to the desktop,
+	   mark it as trusted. */
+	if (copy_job->desktop_location != NULL &&
+	    g_file_equal (copy_job->desktop_location, dest_dir) &&
+	    is_trusted_desktop_file (src, job->cancellable)) {
+		mark_desktop_file_trusted (job,
+					   job->cancellable,
+					   dest,
+					   FALSE);
+	}
+
+	if (copy_job->journal != NULL) {
+		caja_operation_journal_file_done (copy_job->journal, src);
+	}
+
+	// Start UNDO-REDO
+	caja_undostack_manager_data_add_origin_target_pair (job->undo_redo_data, src, dest);
+	// End UNDO-REDO
+}
+
+typedef struct {
+	CopyMoveJob *job;
+	GFile *src;
+	GFile *dest;
+	GFile *dest_dir;
+	gboolean same_fs;
+	char **dest_fs_type;
+	gboolean *skipped_file;
+	gboolean readonly_source_fs;
+	gboolean last_item;
+	gboolean journaled;
+	goffset last_size;
+	gboolean res;
+	GError *error;
+} CopyPipelineItem;
+
+static void
+copy_pipeline_progress_callback (goffset current_num_bytes,
+				 goffset total_num_bytes,
+				 gpointer user_data)
+{
+	CopyPipelineItem *item;
+	CopyPipeline *pipeline;
+	goffset new_size;
+
+	item = user_data;
+	pipeline = item->job->pipeline;
+
+	journal_file_started (item->job, item->src, &item->journaled);
+
+	new_size = current_num_bytes - item->last_size;
+
+	if (new_size > 0) {
+		g_mutex_lock (&pipeline->lock);
+		pipeline->num_bytes += new_size;
+		g_mutex_unlock (&pipeline->lock);
+		item->last_size = current_num_bytes;
+	}
+}
+
+/* May be called from any thread */
+static void
+count_unverified_copy (CopyMoveJob *job,
+		       gboolean verified)
+{
+	if (job->verify && !verified) {
+		g_atomic_int_inc (&job->n_unverified);
+	}
+}
+
+static void
+report_unverified_copies (CopyMoveJob *job)
+{
+	int n;
+
+	n = g_atomic_int_get (&job->n_unverified);
+	if (n == 0 || job_aborted (&job->common)) {
+		return;
+	}
+
+	run_warning (&job->common,
+		     f (ngettext ("%'d file could not be verified.",
+				  "%'d files could not be verified.",
+				  n), n),
+		     f (_("Only copies of files that can be read on local disks can be read back and checked.")),
+		     NULL,
+		     FALSE,
+		     GTK_STOCK_OK,
+		     NULL);
+}
+
+/* A resumed copy is read back as a whole, when copies are verified */
+static gboolean
+resumed_copy_is_good (CopyMoveJob *job,
+		      GFile *src,
+		      GFile *dest)
+{
+	gboolean verified;
+
+	if (!job->verify) {
+		return TRUE;
+	}
+	if (!verify_file_copy (src, dest, job->common.cancellable, &verified, NULL)) {
+		return FALSE;
+	}
+	count_unverified_copy (job, verified);
+
+	return TRUE;
+}
+
+static void
+copy_pipeline_thread (gpointer data,
+		      gpointer user_data)
+{
+	CopyPipelineItem *item;
+	CommonJob *job;
+	GFileCopyFlags flags;
+	gboolean verified;
+
+	item = data;
+	job = (CommonJob *)item->job;
+
+	flags = G_FILE_COPY_NOFOLLOW_SYMLINKS;
+	if (item->readonly_source_fs) {
+		flags |= G_FILE_COPY_TARGET_DEFAULT_PERMS;
+	}
+
+	item->res = copy_file (item->src, item->dest,
+			       flags,
+			       item->job->verify,
+			       item->job->direct_io,
+			       job->cancellable,
+			       copy_pipeline_progress_callback,
+			       item,
+			       &verified,
+			       &item->error);
+	if (item->res) {
+		count_unverified_copy (item->job, verified);
+	}
+
+	/* We never overwrite, so whatever is at the destination now
+	 * is a partial copy of our own. Remove it so that a retry on
+	 * the job thread does not mistake it for a conflict.
+	 */
+	if (!item->res && !IS_IO_ERROR (item->error, EXISTS)) {
+		g_file_delete (item->dest, NULL, NULL);
+	}
+
+	g_async_queue_push (item->job->pipeline->done, item);
+}
+
+static CopyPipeline *
+copy_pipeline_new (void)
+{
+	CopyPipeline *pipeline;
+
+	pipeline = g_new0 (CopyPipeline, 1);
+	g_mutex_init (&pipeline->lock);
+	pipeline->done = g_async_queue_new ();
+	pipeline->pool = g_thread_pool_new (copy_pipeline_thread, NULL,
+					    MAX_COPY_THREADS, FALSE, NULL);
+
+	return pipeline;
+}
+
+static void
+copy_pipeline_free (CopyPipeline *pipeline)
+{
+	g_assert (pipeline->n_in_flight == 0);
+
+	g_thread_pool_free (pipeline->pool, FALSE, TRUE);
+	g_async_queue_unref (pipeline->done);
+	g_mutex_clear (&pipeline->lock);
+	g_free (pipeline);
+}
+
+static void
+copy_pipeline_update_progress (CopyMoveJob *copy_job,
+			       SourceInfo *source_info,
+			       TransferInfo *transfer_info)
+{
+	CopyPipeline *pipeline;
+
+	pipeline = copy_job->pipeline;
+
+	g_mutex_lock (&pipeline->lock);
+	transfer_info->num_bytes += pipeline->num_bytes;
+	pipeline->num_bytes = 0;
+	g_mutex_unlock (&pipeline->lock);
+
+	report_copy_progress (copy_job, source_info, transfer_info);
+}
+
+static void
+copy_pipeline_finish_item (CopyPipelineItem *item,
+			   SourceInfo *source_info,
+			   TransferInfo *transfer_info)
+{
+	if (item->res) {
+		file_transferred (item->job, item->src, item->dest, item->dest_dir,
+				  source_info, transfer_info, NULL, NULL);
+	} else if (IS_IO_ERROR (item->error, CANCELLED)) {
+		*item->skipped_file = TRUE;
+	} else {
+		/* Conflicts and errors go through the serial path, so
+		 * their dialogs are still shown one at a time.
+		 */
+		transfer_info->num_bytes -= item->last_size;
+		copy_move_file (item->job, item->src, item->dest_dir,
+				item->same_fs, FALSE, item->dest_fs_type,
+				source_info, transfer_info, NULL, NULL, FALSE,
+				item->skipped_file, item->readonly_source_fs,
+				item->last_item);
+	}
+
+	if (item->error != NULL) {
+		g_error_free (item->error);
+	}
+	g_object_unref (item->src);
+	g_object_unref (item->dest);
+	g_object_unref (item->dest_dir);
+	g_free (item);
+}
+
+/* Handles the copies that are done, waiting until no more than
+ * max_in_flight are left.
+ */
+static void
+copy_pipeline_collect (CopyMoveJob *copy_job,
+		       int max_in_flight,
+		       SourceInfo *source_info,
+		       TransferInfo *transfer_info)
+{
+	CopyPipeline *pipeline;
+	CopyPipelineItem *item;
+
+	pipeline = copy_job->pipeline;
+
+	while (pipeline->n_in_flight > 0) {
+		if (pipeline->n_in_flight > max_in_flight) {
+			/* Wake up now and then to report the bytes copied so far */
+			item = g_async_queue_timeout_pop (pipeline->done, 100 * 1000);
+		} else {
+			item = g_async_queue_try_pop (pipeline->done);
+		}
+
+		copy_pipeline_update_progress (copy_job, source_info, transfer_info);
+
+		if (item == NULL) {
+			if (pipeline->n_in_flight > max_in_flight) {
+				continue;
+			}
+			break;
+		}
+
+		/* Finishing an item may push new ones */
+		pipeline->n_in_flight--;
+		copy_pipeline_finish_item (item, source_info, transfer_info);
+	}
+}
+
+static void
+copy_pipeline_push (CopyMoveJob *copy_job,
+		    GFile *src,
+		    GFile *dest_dir,
+		    gboolean same_fs,
+		    char **dest_fs_type,
+		    SourceInfo *source_info,
+		    TransferInfo *transfer_info,
+		    gboolean *skipped_file,
+		    gboolean readonly_source_fs,
+		    gboolean last_item)
+{
+	CopyPipeline *pipeline;
+	CopyPipelineItem *item;
+
+	pipeline = copy_job->pipeline;
+
+	copy_pipeline_collect (copy_job, MAX_COPIES_IN_FLIGHT - 1,
+			       source_info, transfer_info);
+
+	item = g_new0 (CopyPipelineItem, 1);
+	item->job = copy_job;
+	item->src = g_object_ref (src);
+	item->dest_dir = g_object_ref (dest_dir);
+	item->dest = get_target_file (src, dest_dir, *dest_fs_type, same_fs);
+	item->same_fs = same_fs;
+	item->dest_fs_type = dest_fs_type;
+	item->skipped_file = skipped_file;
+	item->readonly_source_fs = readonly_source_fs;
+	item->last_item = last_item;
+
+	if (last_item) {
+		/* this is the last file for this operation, cannot pause anymore */
+		caja_progress_info_disable_pause (((CommonJob *)copy_job)->progress);
+	}
+
+	pipeline->n_in_flight++;
+	g_thread_pool_push (pipeline->pool, item, NULL);
+}
+
+/* Checks the free space against what is left to copy, as soon as the
+ * scan that was still running when the copy started is done.
+ */
+static void
+check_free_space_after_scan (CopyMoveJob *copy_job,
+			     SourceInfo *source_info,
+			     TransferInfo *transfer_info)
+{
+	GFile *dest;
+
+	if (copy_job->free_space_checked ||
+	    copy_job->scan == NULL ||
+	    job_aborted (&copy_job->common) ||
+	    !streaming_scan_get_info (copy_job->scan, source_info)) {
+		return;
+	}
+	copy_job->free_space_checked = TRUE;
+
+	if (copy_job->destination) {
+		dest = g_object_ref (copy_job->destination);
+	} else {
+		dest = g_file_get_parent (copy_job->files->data);
+	}
+	verify_destination (&copy_job->common,
+			    dest,
+			    NULL,
+			    MAX (source_info->num_bytes - transfer_info->num_bytes, 0));
+	g_object_unref (dest);
+}
+
+/* Debuting files is non-NULL only for toplevel items */
+static void
+copy_move_file (CopyMoveJob *copy_job,
+		GFile *src,
+		GFile *dest_dir,
+		gboolean same_fs,
+		gboolean unique_names,
+		char **dest_fs_type,
+		SourceInfo *source_info,
+		TransferInfo *transfer_info,
+		GHashTable *debuting_files,
+		GdkPoint *position,
+		gboolean overwrite,
+		gboolean *skipped_file,
+		gboolean readonly_source_fs,
+		gboolean last_item)
+{
+	GFile *dest, *new_dest;
+	GError *error;
+	GFileCopyFlags flags;
+	char *primary, *secondary, *details;
+	int response;
+	ProgressData pdata;
+	gboolean would_recurse, is_merge;
+	CommonJob *job;
+	gboolean res;
+	int unique_name_nr;
+	gboolean handled_invalid_filename;
+	gboolean verified;
+	goffset size;
+
+	job = (CommonJob *)copy_job;
+
+	check_free_space_after_scan (copy_job, source_info, transfer_info);
+	if (job_aborted (job)) {
+		return;
+	}
+
+	if (should_skip_file (job, src)) {
+		*skipped_file = TRUE;
+		return;
+	}
+
+	unique_name_nr = 1;
+
+	// TODO: Here we should get the previous file name UNDO
+
+	/* another file in the same directory might have handled the invalid
+	 * filename condition for us
+	 */
+	handled_invalid_filename = *dest_fs_type != NULL;
+
+	if (unique_names) {
+		dest = get_unique_target_file (src, dest_dir, same_fs, *dest_fs_type, unique_name_nr++);
+	} else {
+		dest = get_target_file (src, dest_dir, *dest_fs_type, same_fs);
+	}
+
+
+	/* Don't allow recursive move/copy into itself.
+	 * (We would get a file system error if we proceeded but it is nicer to
+	 * detect and report it at this level) */
+	if (test_dir_is_parent (dest_dir, src)) {
+		if (job->skip_all_error) {
+			goto out;
+		}
+
+		/*  the run_warning() frees all strings passed in automatically  */
+		primary = copy_job->is_move ? g_strdup (_("You cannot move a folder into itself."))
+					    : g_strdup (_("You cannot copy a folder into itself."));
+		secondary = g_strdup (_("The destination folder is inside the source folder."));
+
+		response = run_warning (job,
+					primary,
+					secondary,
+					NULL,
+					(source_info->num_files - transfer_info->num_files) > 1,
+					GTK_STOCK_CANCEL, SKIP_ALL, SKIP,
+					NULL);
+
+		if (response == 0 || response == GTK_RESPONSE_DELETE_EVENT) {
+			abort_job (job);
+		} else if (response == 1) { /* skip all */
+			job->skip_all_error = TRUE;
+		} else if (response == 2) { /* skip */
+			/* do nothing */
+		} else {
+			g_assert_not_reached ();
+		}
+
+		goto out;
+	}
+
+	/* Don't allow copying over the source or one of the parents of the source.
+	 */
+	if (test_dir_is_parent (src, dest)) {
+		if (job->skip_all_error) {
+			goto out;
+		}
+
+		/*  the run_warning() frees all strings passed in automatically  */
+		primary = copy_job->is_move ? g_strdup (_("You cannot move a file over itself."))
+					    : g_strdup (_("You cannot copy a file over itself."));
+		secondary = g_strdup (_("The source file would be overwritten by the destination."));
+
+		response = run_warning (job,
+					primary,
+					secondary,
+					NULL,
+					(source_info->num_files - transfer_info->num_files) > 1,
+					GTK_STOCK_CANCEL, SKIP_ALL, SKIP,
+					NULL);
+
+		if (response == 0 || response == GTK_RESPONSE_DELETE_EVENT) {
+			abort_job (job);
+		} else if (response == 1) { /* skip all */
+			job->skip_all_error = TRUE;
+		} else if (response == 2) { /* skip */
+			/* do nothing */
+		} else {
+			g_assert_not_reached ();
+		}
+
+		goto out;
+	}
+
+ retry:
+	error = NULL;
+	flags = G_FILE_COPY_NOFOLLOW_SYMLINKS;
+	if (overwrite) {
+		flags |= G_FILE_COPY_OVERWRITE;
+	}
+	if (readonly_source_fs) {
+		flags |= G_FILE_COPY_TARGET_DEFAULT_PERMS;
 	}
 
 	pdata.job = copy_job;
+	pdata.src = src;
+	pdata.journaled = FALSE;
 	pdata.last_size = 0;
 	pdata.source_info = source_info;
 	pdata.transfer_info = transfer_info;
@@ -4116,7 +6483,7 @@ copy_move_file (CopyMoveJob *copy_job,
 		/* this is the last file for this operation, cannot pause anymore */
 		caja_progress_info_disable_pause (job->progress);
 
-	if (copy_job->is_move) {
+	if (copy_job->is_move && !copy_job->verify) {
 		res = g_file_move (src, dest,
 				   flags,
 				   job->cancellable,
@@ -4124,48 +6491,29 @@ copy_move_file (CopyMoveJob *copy_job,
 				   &pdata,
 				   &error);
 	} else {
-		res = g_file_copy (src, dest,
-				   flags,
-				   job->cancellable,
-				   copy_file_progress_callback,
-				   &pdata,
-				   &error);
-	}
-
-	if (res) {
-		transfer_info->num_files ++;
-		report_copy_progress (copy_job, source_info, transfer_info);
-
-		if (debuting_files) {
-			if (position) {
-				caja_file_changes_queue_schedule_position_set (dest, *position, job->screen_num);
-			} else {
-				caja_file_changes_queue_schedule_position_remove (dest);
-			}
-
-			g_hash_table_replace (debuting_files, g_object_ref (dest), GINT_TO_POINTER (TRUE));
-		}
-		if (copy_job->is_move) {
-			caja_file_changes_queue_file_moved (src, dest);
-		} else {
-			caja_file_changes_queue_file_added (dest);
+		/* A verified move only deletes the source once the copy
+		 * has been checked, g_file_move() would delete it first */
+		res = copy_file (src, dest,
+				 copy_job->is_move ? flags | G_FILE_COPY_ALL_METADATA : flags,
+				 copy_job->verify,
+				 copy_job->direct_io,
+				 job->cancellable,
+				 copy_file_progress_callback,
+				 &pdata,
+				 &verified,
+				 &error);
+		if (res) {
+			count_unverified_copy (copy_job, verified);
 		}
-
-		/* If copying a trusted desktop file to the desktop,
-		   mark it as trusted. */
-		if (copy_job->desktop_location != NULL &&
-		    g_file_equal (copy_job->desktop_location, dest_dir) &&
-		    is_trusted_desktop_file (src, job->cancellable)) {
-			mark_desktop_file_trusted (job,
-						   job->cancellable,
-						   dest,
-						   FALSE);
+		if (res && copy_job->is_move) {
+			res = g_file_delete (src, job->cancellable, &error);
 		}
+	}
 
-		// Start UNDO-REDO
-		caja_undostack_manager_data_add_origin_target_pair (job->undo_redo_data, src, dest);
-		// End UNDO-REDO
-
+	if (res) {
+		file_transferred (copy_job, src, dest, dest_dir,
+				  source_info, transfer_info,
+				  debuting_files, position);
 		g_object_unref (dest);
 		return;
 	}
@@ -4220,6 +6568,53 @@ copy_move_file (CopyMoveJob *copy_job,
 			goto retry;
 		}
 
+		/* Resuming an interrupted operation, dest may be our own */
+		if (is_merge && copy_job->journal != NULL &&
+		    caja_operation_journal_get_file_state (copy_job->journal, src) != CAJA_OPERATION_JOURNAL_FILE_UNKNOWN) {
+			overwrite = TRUE;
+			goto retry;
+		}
+		if (!is_merge && copy_job->journal != NULL) {
+			switch (caja_operation_journal_get_file_state (copy_job->journal, src)) {
+			case CAJA_OPERATION_JOURNAL_FILE_DONE:
+				if (journaled_copy_is_complete (copy_job, src, dest, &size)) {
+					transfer_info->num_bytes += size;
+					file_transferred (copy_job, src, dest, dest_dir,
+							  source_info, transfer_info,
+							  debuting_files, position);
+					g_object_unref (dest);
+					return;
+				}
+				break;
+			case CAJA_OPERATION_JOURNAL_FILE_STARTED:
+				if (!journaled_copy_is_partial (copy_job, src, dest)) {
+					break;
+				}
+				if (resume_copy_file (src, dest, flags,
+						      job->cancellable,
+						      copy_file_progress_callback,
+						      &pdata) &&
+				    resumed_copy_is_good (copy_job, src, dest) &&
+				    (!copy_job->is_move ||
+				     g_file_delete (src, job->cancellable, NULL))) {
+					file_transferred (copy_job, src, dest, dest_dir,
+							  source_info, transfer_info,
+							  debuting_files, position);
+					g_object_unref (dest);
+					return;
+				}
+				if (job_aborted (job)) {
+					goto out;
+				}
+				/* Start over, replacing the partial copy */
+				transfer_info->num_bytes -= pdata.last_size;
+				overwrite = TRUE;
+				goto retry;
+			default:
+				break;
+			}
+		}
+
 		if (job->skip_all_conflict) {
 			goto out;
 		}
@@ -4427,6 +6822,7 @@ copy_files (CopyMoveJob *job,
 	}
 
 	unique_names = (job->destination == NULL);
+	job->pipeline = copy_pipeline_new ();
 	i = 0;
 	for (l = job->files;
 	     l != NULL && !job_aborted (common);
@@ -4469,9 +6865,30 @@ copy_files (CopyMoveJob *job,
 		i++;
 	}
 
+	copy_pipeline_collect (job, 0, source_info, transfer_info);
+	copy_pipeline_free (job->pipeline);
+	job->pipeline = NULL;
+
 	g_free (dest_fs_type);
 }
 
+/* When resuming an interrupted operation, the sources that are gone
+ * were moved already, or deleted since.
+ */
+static void
+remove_missing_sources (CopyMoveJob *job)
+{
+	GList *l, *next;
+
+	for (l = job->files; l != NULL; l = next) {
+		next = l->next;
+		if (!g_file_query_exists (l->data, job->common.cancellable)) {
+			g_object_unref (l->data);
+			job->files = g_list_delete_link (job->files, l);
+		}
+	}
+}
+
 static gboolean
 copy_job_done (gpointer user_data)
 {
@@ -4498,6 +6915,20 @@ copy_job_done (gpointer user_data)
 	return FALSE;
 }
 
+static gboolean
+should_verify_copies (void)
+{
+	GSettings *prefs;
+	gboolean verify;
+
+	/* Since this happens on a thread we can't use the global prefs object */
+	prefs = g_settings_new ("org.mate.caja.preferences");
+	verify = g_settings_get_boolean (prefs, CAJA_PREFERENCES_VERIFY_COPIES);
+	g_object_unref (prefs);
+
+	return verify;
+}
+
 static gboolean
 copy_job (GIOSchedulerJob *io_job,
 	  GCancellable *cancellable,
@@ -4509,6 +6940,8 @@ copy_job (GIOSchedulerJob *io_job,
 	TransferInfo transfer_info;
 	char *dest_fs_id;
 	GFile *dest;
+	gint64 end_time;
+	gboolean scan_done;
 
 	job = user_data;
 	common = &job->common;
@@ -4518,10 +6951,27 @@ copy_job (GIOSchedulerJob *io_job,
 
 	caja_progress_info_start (job->common.progress);
 
-	scan_sources (job->files,
-		      &source_info,
-		      common,
-		      OP_KIND_COPY);
+	if (job->journal != NULL) {
+		remove_missing_sources (job);
+		if (job->files == NULL) {
+			goto aborted;
+		}
+	}
+
+	/* Only wait for the sources to be counted when that is quick,
+	 * otherwise start copying with a total that is still growing.
+	 */
+	memset (&source_info, 0, sizeof (source_info));
+	source_info.op = OP_KIND_COPY;
+	job->scan = streaming_scan_new (job->files, common);
+	end_time = g_get_monotonic_time () + STREAMING_SCAN_WAIT;
+	do {
+		scan_done = streaming_scan_wait (job->scan,
+						 MIN (end_time, g_get_monotonic_time () + 100 * NSEC_PER_MICROSEC));
+		streaming_scan_get_info (job->scan, &source_info);
+		report_count_progress (common, &source_info);
+	} while (!scan_done && !job_aborted (common) &&
+		 g_get_monotonic_time () < end_time);
 	if (job_aborted (common)) {
 		goto aborted;
 	}
@@ -4535,24 +6985,49 @@ copy_job (GIOSchedulerJob *io_job,
 		dest = g_file_get_parent (job->files->data);
 	}
 
+	/* Without the final size the free space can't be checked up
+	 * front, it is checked once the scan is done instead. */
 	verify_destination (&job->common,
 			    dest,
 			    &dest_fs_id,
-			    source_info.num_bytes);
+			    scan_done ? source_info.num_bytes : 0);
 	g_object_unref (dest);
+	job->free_space_checked = scan_done;
 	if (job_aborted (common)) {
 		goto aborted;
 	}
 
+	set_job_devices (common, job->files, dest_fs_id);
+
+	/* Duplicates are quick to redo, and have no destination to resume to */
+	if (job->journal == NULL && job->destination != NULL) {
+		job->journal = caja_operation_journal_new (FALSE, job->files, job->destination);
+	}
+
+	job->verify = should_verify_copies ();
+	job->direct_io = should_copy_large_files_directly ();
+
 	g_timer_start (job->common.time);
 
 	memset (&transfer_info, 0, sizeof (transfer_info));
 	copy_files (job,
 		    dest_fs_id,
 		    &source_info, &transfer_info);
+	report_unverified_copies (job);
 
  aborted:
 
+	if (job->scan != NULL) {
+		streaming_scan_free (job->scan);
+		job->scan = NULL;
+	}
+
+	/* Finished or cancelled, either way there is nothing to resume */
+	if (job->journal != NULL) {
+		caja_operation_journal_finish (job->journal);
+		job->journal = NULL;
+	}
+
 	g_free (dest_fs_id);
 
 	g_io_scheduler_job_send_to_mainloop_async (io_job,
@@ -4685,6 +7160,34 @@ get_files_from_fallbacks (GList *fallbacks)
 	return g_list_reverse (res);
 }
 
+static void
+file_moved (CopyMoveJob *move_job,
+	    GFile *src,
+	    GFile *dest,
+	    GHashTable *debuting_files,
+	    GdkPoint *position)
+{
+	CommonJob *job;
+
+	job = (CommonJob *)move_job;
+
+	if (debuting_files) {
+		g_hash_table_replace (debuting_files, g_object_ref (dest), GINT_TO_POINTER (TRUE));
+	}
+
+	caja_file_changes_queue_file_moved (src, dest);
+
+	if (position) {
+		caja_file_changes_queue_schedule_position_set (dest, *position, job->screen_num);
+	} else {
+		caja_file_changes_queue_schedule_position_remove (dest);
+	}
+
+	// Start UNDO-REDO
+	caja_undostack_manager_data_add_origin_target_pair (job->undo_redo_data, src, dest);
+	// End UNDO-REDO
+}
+
 static void
 move_file_prepare (CopyMoveJob *move_job,
 		   GFile *src,
@@ -4763,23 +7266,8 @@ move_file_prepare (CopyMoveJob *move_job,
 			 NULL,
 			 NULL,
 			 &error)) {
-
-		if (debuting_files) {
-			g_hash_table_replace (debuting_files, g_object_ref (dest), GINT_TO_POINTER (TRUE));
-		}
-
-		caja_file_changes_queue_file_moved (src, dest);
-
-		if (position) {
-			caja_file_changes_queue_schedule_position_set (dest, *position, job->screen_num);
-		} else {
-			caja_file_changes_queue_schedule_position_remove (dest);
-		}
-
-		// Start UNDO-REDO
-		caja_undostack_manager_data_add_origin_target_pair (job->undo_redo_data, src, dest);
-		// End UNDO-REDO
-
+		file_moved (move_job, src, dest, debuting_files, position);
+		g_object_unref (dest);
 		return;
 	}
 
@@ -4819,6 +7307,25 @@ move_file_prepare (CopyMoveJob *move_job,
 			goto retry;
 		}
 
+		/* Resuming an interrupted move, dest may be our own. A folder
+		 * it made is merged into, a partial copy is left to the copy
+		 * fallback, which goes on from where it stopped. */
+		if (move_job->journal != NULL &&
+		    caja_operation_journal_get_file_state (move_job->journal, src) != CAJA_OPERATION_JOURNAL_FILE_UNKNOWN) {
+			if (is_merge) {
+				overwrite = TRUE;
+				goto retry;
+			}
+			if (caja_operation_journal_get_file_state (move_job->journal, src) == CAJA_OPERATION_JOURNAL_FILE_STARTED &&
+			    journaled_copy_is_partial (move_job, src, dest)) {
+				fallback = move_copy_file_callback_new (src,
+									FALSE,
+									position);
+				*fallback_files = g_list_prepend (*fallback_files, fallback);
+				goto out;
+			}
+		}
+
 		if (job->skip_all_conflict) {
 			goto out;
 		}
@@ -4906,6 +7413,119 @@ move_file_prepare (CopyMoveJob *move_job,
 	g_object_unref (dest);
 }
 
+#if defined (SYS_renameat2) && defined (RENAME_NOREPLACE)
+#define HAVE_PARALLEL_RENAME 1
+
+/* Moving within a file system is a single rename() per file, but for
+ * many files the latency of each call adds up. They are renamed on a
+ * pool of threads first, with the same name at the destination and
+ * without replacing anything; whatever fails, conflicts included, goes
+ * through move_file_prepare() afterwards.
+ */
+#define MAX_RENAME_THREADS 8
+#define MIN_FILES_FOR_RENAME_THREADS 16
+
+typedef struct {
+	GFile *src;
+	GFile *dest;
+	GCancellable *cancellable;
+	int index;
+	gboolean res;
+} RenameItem;
+
+static void
+rename_file_thread (gpointer data,
+		    gpointer user_data)
+{
+	RenameItem *item;
+	GAsyncQueue *done;
+	char *src_path, *dest_path;
+
+	item = data;
+	done = user_data;
+
+	src_path = g_file_get_path (item->src);
+	dest_path = g_file_get_path (item->dest);
+
+	item->res = src_path != NULL && dest_path != NULL &&
+		!g_cancellable_is_cancelled (item->cancellable) &&
+		syscall (SYS_renameat2, AT_FDCWD, src_path,
+			 AT_FDCWD, dest_path, RENAME_NOREPLACE) == 0;
+
+	g_free (src_path);
+	g_free (dest_path);
+
+	g_async_queue_push (done, item);
+}
+
+static void
+rename_files_in_parallel (CopyMoveJob *job,
+			  gboolean *renamed,
+			  int total,
+			  int *left)
+{
+	CommonJob *common;
+	GThreadPool *pool;
+	GAsyncQueue *done;
+	RenameItem *item;
+	GdkPoint *point;
+	GList *l;
+	gint64 last_report, now;
+	int i, n_pending;
+
+	common = &job->common;
+
+	done = g_async_queue_new ();
+	pool = g_thread_pool_new (rename_file_thread, done,
+				  MAX_RENAME_THREADS, FALSE, NULL);
+
+	n_pending = 0;
+	for (l = job->files, i = 0; l != NULL; l = l->next, i++) {
+		item = g_new0 (RenameItem, 1);
+		item->src = g_object_ref (l->data);
+		item->dest = get_target_file (item->src, job->destination, NULL, TRUE);
+		item->cancellable = common->cancellable;
+		item->index = i;
+
+		g_thread_pool_push (pool, item, NULL);
+		n_pending++;
+	}
+
+	last_report = 0;
+	for (; n_pending > 0; n_pending--) {
+		item = g_async_queue_pop (done);
+
+		if (item->res) {
+			renamed[item->index] = TRUE;
+
+			if (item->index < job->n_icon_positions) {
+				point = &job->icon_positions[item->index];
+			} else {
+				point = NULL;
+			}
+			file_moved (job, item->src, item->dest,
+				    job->debuting_files, point);
+
+			--*left;
+			now = g_get_monotonic_time ();
+			if (now - last_report > 100 * 1000) {
+				report_move_progress (job, total, *left);
+				last_report = now;
+			}
+		}
+
+		g_object_unref (item->src);
+		g_object_unref (item->dest);
+		g_free (item);
+	}
+
+	g_thread_pool_free (pool, FALSE, TRUE);
+	g_async_queue_unref (done);
+
+	report_move_progress (job, total, *left);
+}
+#endif
+
 static void
 move_files_prepare (CopyMoveJob *job,
 		    const char *dest_fs_id,
@@ -4920,6 +7540,7 @@ move_files_prepare (CopyMoveJob *job,
 	int i;
 	GdkPoint *point;
 	int total, left;
+	gboolean *renamed;
 
 	common = &job->common;
 
@@ -4928,10 +7549,21 @@ move_files_prepare (CopyMoveJob *job,
 	caja_progress_info_get_ready (common->progress);
 	report_move_progress (job, total, left);
 
+	renamed = g_new0 (gboolean, total);
+#ifdef HAVE_PARALLEL_RENAME
+	if (total >= MIN_FILES_FOR_RENAME_THREADS) {
+		rename_files_in_parallel (job, renamed, total, &left);
+	}
+#endif
+
 	i = 0;
 	for (l = job->files;
 	     l != NULL && !job_aborted (common);
-	     l = l->next) {
+	     l = l->next, i++) {
+		if (renamed[i]) {
+			continue;
+		}
+
 		src = l->data;
 
 		last_item = (!l->next) && (!is_dir(src)) && (!(*fallbacks));
@@ -4958,9 +7590,10 @@ move_files_prepare (CopyMoveJob *job,
 				   fallbacks,
 				   left);
 		report_move_progress (job, total, --left);
-		i++;
 	}
 
+	g_free (renamed);
+
 	*fallbacks = g_list_reverse (*fallbacks);
 
 
@@ -5066,6 +7699,13 @@ move_job (GIOSchedulerJob *io_job,
 
 	caja_progress_info_start (job->common.progress);
 
+	if (job->journal != NULL) {
+		remove_missing_sources (job);
+		if (job->files == NULL) {
+			goto aborted;
+		}
+	}
+
 	verify_destination (&job->common,
 			    job->destination,
 			    &dest_fs_id,
@@ -5074,6 +7714,8 @@ move_job (GIOSchedulerJob *io_job,
 		goto aborted;
 	}
 
+	set_job_devices (common, job->files, dest_fs_id);
+
 	/* This moves all files that we can do without copy + delete */
 	move_files_prepare (job, dest_fs_id, &dest_fs_type, &fallbacks);
 	if (job_aborted (common)) {
@@ -5089,6 +7731,11 @@ move_job (GIOSchedulerJob *io_job,
 		      common,
 		      OP_KIND_MOVE);
 
+	/* Only copying and deleting takes long enough to be worth resuming */
+	if (job->journal == NULL && fallback_files != NULL && !job_aborted (common)) {
+		job->journal = caja_operation_journal_new (TRUE, fallback_files, job->destination);
+	}
+
 	g_list_free (fallback_files);
 
 	if (job_aborted (common)) {
@@ -5103,13 +7750,22 @@ move_job (GIOSchedulerJob *io_job,
 		goto aborted;
 	}
 
+	job->verify = should_verify_copies ();
+	job->direct_io = should_copy_large_files_directly ();
+
 	memset (&transfer_info, 0, sizeof (transfer_info));
 	move_files (job,
 		    fallbacks,
 		    dest_fs_id, &dest_fs_type,
 		    &source_info, &transfer_info);
+	report_unverified_copies (job);
 
  aborted:
+	if (job->journal != NULL) {
+		caja_operation_journal_finish (job->journal);
+		job->journal = NULL;
+	}
+
     	g_list_free_full (fallbacks, g_free);
 
 	g_free (dest_fs_id);
@@ -5171,6 +7827,83 @@ caja_file_operations_move (GList *files,
 				 job->common.cancellable);
 }
 
+static void
+resume_operation (CajaOperationJournal *journal)
+{
+	CopyMoveJob *job;
+	gboolean is_move;
+
+	is_move = caja_operation_journal_is_move (journal);
+
+	job = op_job_new (CopyMoveJob, NULL, FALSE, TRUE);
+	job->is_move = is_move;
+	job->files = eel_g_object_list_copy (caja_operation_journal_get_sources (journal));
+	job->destination = g_object_ref (caja_operation_journal_get_destination (journal));
+	job->debuting_files = g_hash_table_new_full (g_file_hash, (GEqualFunc)g_file_equal, g_object_unref, NULL);
+	job->journal = journal;
+	if (!is_move) {
+		job->desktop_location = caja_get_desktop_location ();
+	}
+
+	inhibit_power_manager ((CommonJob *)job,
+			       is_move ? _("Moving Files") : _("Copying Files"));
+
+	g_io_scheduler_push_job (is_move ? move_job : copy_job,
+				 job,
+				 NULL, /* destroy notify */
+				 0,
+				 job->common.cancellable);
+}
+
+static void
+resume_dialog_response_callback (GtkDialog *dialog,
+				 int response_id,
+				 CajaOperationJournal *journal)
+{
+	if (response_id == GTK_RESPONSE_YES) {
+		resume_operation (journal);
+	} else {
+		caja_operation_journal_finish (journal);
+	}
+
+	gtk_widget_destroy (GTK_WIDGET (dialog));
+}
+
+void
+caja_file_operations_resume_interrupted (void)
+{
+	CajaOperationJournal *journal;
+	GtkDialog *dialog;
+	GList *journals, *l;
+	char *primary;
+
+	journals = caja_operation_journal_list_interrupted ();
+
+	for (l = journals; l != NULL; l = l->next) {
+		journal = l->data;
+
+		if (caja_operation_journal_is_move (journal)) {
+			primary = f (_("Moving files to \"%B\" was interrupted."),
+				     caja_operation_journal_get_destination (journal));
+		} else {
+			primary = f (_("Copying files to \"%B\" was interrupted."),
+				     caja_operation_journal_get_destination (journal));
+		}
+
+		dialog = eel_show_yes_no_dialog (primary,
+						 _("You can continue where it stopped. Files that "
+						   "were already done are not copied again."),
+						 _("_Resume"), _("_Discard"),
+						 NULL);
+		g_signal_connect (dialog, "response",
+				  G_CALLBACK (resume_dialog_response_callback),
+				  journal);
+		g_free (primary);
+	}
+
+	g_list_free (journals);
+}
+
 static void
 report_link_progress (CopyMoveJob *link_job, int total, int left)
 {
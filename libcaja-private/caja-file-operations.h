@@ -132,6 +132,8 @@ void caja_file_operations_link      (GList                *files,
                                      GtkWindow            *parent_window,
                                      CajaCopyCallback  done_callback,
                                      gpointer              done_callback_data);
+/* Offer to resume the copies and moves that caja didn't get to finish */
+void caja_file_operations_resume_interrupted (void);
 void caja_file_mark_desktop_file_trusted (GFile           *file,
         GtkWindow        *parent_window,
         gboolean          interactive,
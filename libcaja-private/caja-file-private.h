@@ -53,10 +53,7 @@ typedef enum
     UNKNOWN
 } Knowledge;
 
-typedef struct
-{
-    char emblem_keywords[1];
-} CajaFileSortByEmblemCache;
+#define CAJA_FILE_N_SORT_TYPES (CAJA_FILE_SORT_BY_TRASHED_TIME + 1)
 
 struct CajaFileDetails
 {
@@ -130,9 +127,11 @@ struct CajaFileDetails
      */
     GList *operations_in_progress;
 
-    /* We use this to cache automatic emblems and emblem keywords
-       to speed up compare_by_emblems. */
-    CajaFileSortByEmblemCache *compare_by_emblem_cache;
+    /* Packed keys for caja_file_compare_for_sort, one per sort
+       type, built when first needed. */
+    GBytes **sort_keys;
+    /* Breaks ties with files of other directories */
+    GBytes *directory_sort_key;
 
     /* CajaInfoProviders that need to be run for this file */
     GList *pending_info_providers;
@@ -154,6 +153,10 @@ struct CajaFileDetails
            many CajaFile objects. */
 
     eel_boolean_bit unconfirmed                   : 1;
+    /* Created from a directory snapshot and not seen by the
+     * enumeration of the directory yet.
+     */
+    eel_boolean_bit from_directory_snapshot       : 1;
     eel_boolean_bit is_gone                       : 1;
     /* Set when emitting files_added on the directory to make sure we
        add a file, and only once */
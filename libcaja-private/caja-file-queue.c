@@ -131,3 +131,42 @@ caja_file_queue_is_empty (CajaFileQueue *queue)
 {
     return (queue->head == NULL);
 }
+
+void
+caja_file_queue_prioritize (CajaFileQueue *queue,
+                            CajaFile *file)
+{
+    GList *link;
+
+    link = g_hash_table_lookup (queue->item_to_link_map, file);
+
+    if (link == NULL || link == queue->head)
+    {
+        /* It's not on the queue, or already first */
+        return;
+    }
+
+    if (link == queue->tail)
+    {
+        queue->tail = queue->tail->prev;
+    }
+
+    queue->head = g_list_remove_link (queue->head, link);
+    queue->head = g_list_concat (link, queue->head);
+}
+
+void
+caja_file_queue_foreach (CajaFileQueue *queue,
+                         CajaFileQueueFunc func,
+                         gpointer callback_data)
+{
+    GList *node;
+
+    for (node = queue->head; node != NULL; node = node->next)
+    {
+        if (!(* func) (CAJA_FILE (node->data), callback_data))
+        {
+            break;
+        }
+    }
+}
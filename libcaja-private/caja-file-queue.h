@@ -27,6 +27,9 @@
 
 typedef struct CajaFileQueue CajaFileQueue;
 
+typedef gboolean (* CajaFileQueueFunc) (CajaFile *file,
+                                        gpointer  callback_data);
+
 CajaFileQueue *caja_file_queue_new      (void);
 void               caja_file_queue_destroy  (CajaFileQueue *queue);
 
@@ -49,4 +52,15 @@ CajaFile *     caja_file_queue_head     (CajaFileQueue *queue);
 
 gboolean           caja_file_queue_is_empty (CajaFileQueue *queue);
 
+/* Move a file that is already in the queue to its head in constant time. */
+void               caja_file_queue_prioritize (CajaFileQueue *queue,
+        CajaFile      *file);
+
+/* Call func on the files in queue order, starting at the head, until it
+ * returns FALSE. func must not modify the queue.
+ */
+void               caja_file_queue_foreach  (CajaFileQueue     *queue,
+        CajaFileQueueFunc  func,
+        gpointer           callback_data);
+
 #endif /* CAJA_FILE_CHANGES_QUEUE_H */
@@ -156,6 +156,7 @@ static const char * caja_file_peek_display_name (CajaFile *file);
 static const char * caja_file_peek_display_name_collation_key (CajaFile *file);
 static void file_mount_unmounted (GMount *mount,  gpointer data);
 static void metadata_hash_free (GHashTable *hash);
+static void invalidate_sort_keys (CajaFile *file);
 
 G_DEFINE_TYPE_WITH_CODE (CajaFile, caja_file, G_TYPE_OBJECT,
 			 G_IMPLEMENT_INTERFACE (CAJA_TYPE_FILE_INFO,
@@ -804,7 +805,7 @@ finalize (GObject *object)
 	g_free (file->details->top_left_text);
 	g_free (file->details->custom_icon);
 	g_free (file->details->activation_uri);
-	g_free (file->details->compare_by_emblem_cache);
+	invalidate_sort_keys (file);
 
 	if (file->details->thumbnail) {
 		g_object_unref (file->details->thumbnail);
@@ -2121,6 +2122,9 @@ update_info_internal (CajaFile *file,
 
 	file->details->file_info_is_up_to_date = TRUE;
 
+	/* Any of the attributes we sort by could be changing. */
+	invalidate_sort_keys (file);
+
 	/* FIXME bugzilla.gnome.org 42044: Need to let links that
 	 * point to the old name know that the file has been renamed.
 	 */
@@ -2740,119 +2744,6 @@ get_time (CajaFile *file,
 	return KNOWN;
 }
 
-static int
-compare_directories_by_count (CajaFile *file_1, CajaFile *file_2)
-{
-	/* Sort order:
-	 *   Directories with unknown # of items
-	 *   Directories with "unknowable" # of items
-	 *   Directories with 0 items
-	 *   Directories with n items
-	 */
-
-	Knowledge count_known_1, count_known_2;
-	guint count_1, count_2;
-
-	count_known_1 = get_item_count (file_1, &count_1);
-	count_known_2 = get_item_count (file_2, &count_2);
-
-	if (count_known_1 > count_known_2) {
-		return -1;
-	}
-	if (count_known_1 < count_known_2) {
-		return +1;
-	}
-
-	/* count_known_1 and count_known_2 are equal now. Check if count
-	 * details are UNKNOWABLE or UNKNOWN.
-	 */
-	if (count_known_1 == UNKNOWABLE || count_known_1 == UNKNOWN) {
-		return 0;
-	}
-
-	if (count_1 < count_2) {
-		return -1;
-	}
-	if (count_1 > count_2) {
-		return +1;
-	}
-
-	return 0;
-}
-
-static int
-compare_files_by_size (CajaFile *file_1, CajaFile *file_2)
-{
-	/* Sort order:
-	 *   Files with unknown size.
-	 *   Files with "unknowable" size.
-	 *   Files with smaller sizes.
-	 *   Files with large sizes.
-	 */
-
-	Knowledge size_known_1, size_known_2;
-	goffset size_1 = 0, size_2 = 0;
-
-	size_known_1 = get_size (file_1, &size_1);
-	size_known_2 = get_size (file_2, &size_2);
-
-	if (size_known_1 > size_known_2) {
-		return -1;
-	}
-	if (size_known_1 < size_known_2) {
-		return +1;
-	}
-
-	/* size_known_1 and size_known_2 are equal now. Check if size
-	 * details are UNKNOWABLE or UNKNOWN
-	 */
-	if (size_known_1 == UNKNOWABLE || size_known_1 == UNKNOWN) {
-		return 0;
-	}
-
-	if (size_1 < size_2) {
-		return -1;
-	}
-	if (size_1 > size_2) {
-		return +1;
-	}
-
-	return 0;
-}
-
-static int
-compare_by_size (CajaFile *file_1, CajaFile *file_2)
-{
-	/* Sort order:
-	 *   Directories with n items
-	 *   Directories with 0 items
-	 *   Directories with "unknowable" # of items
-	 *   Directories with unknown # of items
-	 *   Files with large sizes.
-	 *   Files with smaller sizes.
-	 *   Files with "unknowable" size.
-	 *   Files with unknown size.
-	 */
-
-	gboolean is_directory_1, is_directory_2;
-
-	is_directory_1 = caja_file_is_directory (file_1);
-	is_directory_2 = caja_file_is_directory (file_2);
-
-	if (is_directory_1 && !is_directory_2) {
-		return -1;
-	}
-	if (is_directory_2 && !is_directory_1) {
-		return +1;
-	}
-
-	if (is_directory_1) {
-		return compare_directories_by_count (file_1, file_2);
-	} else {
-		return compare_files_by_size (file_1, file_2);
-	}
-}
-
 static int
 compare_by_display_name (CajaFile *file_1, CajaFile *file_2)
 {
@@ -2880,27 +2771,6 @@ compare_by_display_name (CajaFile *file_1, CajaFile *file_2)
 	return compare;
 }
 
-static int
-compare_by_directory_name (CajaFile *file_1, CajaFile *file_2)
-{
-	char *directory_1, *directory_2;
-	int compare;
-
-	if (file_1->details->directory == file_2->details->directory) {
-		return 0;
-	}
-
-	directory_1 = caja_file_get_parent_uri_for_display (file_1);
-	directory_2 = caja_file_get_parent_uri_for_display (file_2);
-
-	compare = g_utf8_collate (directory_1, directory_2);
-
-	g_free (directory_1);
-	g_free (directory_2);
-
-	return compare;
-}
-
 static gboolean
 file_has_note (CajaFile *file)
 {
@@ -2959,130 +2829,142 @@ prepend_automatic_keywords (CajaFile *file,
 	return names;
 }
 
+/* A sort key packs everything caja_file_compare_for_sort looks at
+ * for one sort type, so that comparing two files is a memcmp. Numbers
+ * are stored big endian with their sign bit flipped where they can be
+ * negative, and strings as collation keys with their terminating nul.
+ * Keys are compared with g_bytes_compare, a memcmp that puts a key
+ * before any longer one it is a prefix of. Knowledge is stored as
+ * UNKNOWN - knowledge, unknown values coming first, followed by a zero
+ * value when it isn't KNOWN.
+ *
+ * The parent directory is left out of the keys, all the files of a
+ * directory view share it. Only files of different directories, as
+ * in search results, are told apart by a separate directory key.
+ */
+#define SORT_KEY_SIGN_BIT G_GUINT64_CONSTANT (0x8000000000000000)
+
 static void
-fill_emblem_cache_if_needed (CajaFile *file)
+append_byte (GByteArray *key, guint8 value)
 {
-	GList *node, *keywords;
-	char *scanner;
-	size_t length;
+	g_byte_array_append (key, &value, 1);
+}
 
-	if (file->details->compare_by_emblem_cache != NULL) {
-		/* Got a cache already. */
-		return;
-	}
+static void
+append_uint32 (GByteArray *key, guint32 value)
+{
+	value = GUINT32_TO_BE (value);
+	g_byte_array_append (key, (const guint8 *) &value, sizeof (value));
+}
 
-	keywords = caja_file_get_keywords (file);
+static void
+append_uint64 (GByteArray *key, guint64 value)
+{
+	value = GUINT64_TO_BE (value);
+	g_byte_array_append (key, (const guint8 *) &value, sizeof (value));
+}
 
-	/* Add up the keyword string lengths */
-	length = 1;
-	for (node = keywords; node != NULL; node = node->next) {
-		length += strlen ((const char *) node->data) + 1;
-	}
+static void
+append_string (GByteArray *key, const char *string)
+{
+	g_byte_array_append (key, (const guint8 *) string, strlen (string) + 1);
+}
 
-	/* Now that we know how large the cache struct needs to be, allocate it. */
-	file->details->compare_by_emblem_cache = g_malloc (sizeof(CajaFileSortByEmblemCache) + length);
+static void
+append_collation_key (GByteArray *key, const char *string)
+{
+	char *collation_key;
 
-	/* Copy them into the cache. */
-	scanner = file->details->compare_by_emblem_cache->emblem_keywords;
-	for (node = keywords; node != NULL; node = node->next) {
-		length = strlen ((const char *) node->data) + 1;
-		memcpy (scanner, (const char *) node->data, length);
-		scanner += length;
-	}
+	collation_key = g_utf8_collate_key (string, -1);
+	append_string (key, collation_key);
+	g_free (collation_key);
+}
 
-	/* Zero-terminate so we can tell where the list ends. */
-	*scanner = 0;
+static void
+append_display_name_key (GByteArray *key, CajaFile *file)
+{
+	const char *name;
 
-        g_list_free_full (keywords, g_free);
+	name = caja_file_peek_display_name (file);
+	append_byte (key, name[0] == SORT_LAST_CHAR1 || name[0] == SORT_LAST_CHAR2);
+	append_string (key, caja_file_peek_display_name_collation_key (file));
 }
 
-static int
-compare_by_emblems (CajaFile *file_1, CajaFile *file_2)
-{
-	const char *keyword_cache_1, *keyword_cache_2;
-	size_t length;
-	int compare_result;
-
-	fill_emblem_cache_if_needed (file_1);
-	fill_emblem_cache_if_needed (file_2);
-
-	/* We ignore automatic emblems, and only sort by user-added keywords. */
-	compare_result = 0;
-	keyword_cache_1 = file_1->details->compare_by_emblem_cache->emblem_keywords;
-	keyword_cache_2 = file_2->details->compare_by_emblem_cache->emblem_keywords;
-	for (; *keyword_cache_1 != '\0' && *keyword_cache_2 != '\0';) {
-		compare_result = g_utf8_collate (keyword_cache_1, keyword_cache_2);
-		if (compare_result != 0) {
-			return compare_result;
-		}
+static void
+append_directory_name_key (GByteArray *key, CajaFile *file)
+{
+	char *directory;
 
-		/* Advance to the next keyword */
-		length = strlen (keyword_cache_1);
-		keyword_cache_1 += length + 1;
-		keyword_cache_2 += length + 1;
-	}
+	directory = caja_file_get_parent_uri_for_display (file);
+	append_collation_key (key, directory);
+	g_free (directory);
+}
 
+static GBytes *
+get_directory_sort_key (CajaFile *file)
+{
+	GByteArray *key;
 
-	/* One or both is now NULL. */
-	if (*keyword_cache_1 != '\0') {
-		g_assert (*keyword_cache_2 == '\0');
-		return -1;
-	} else if (*keyword_cache_2 != '\0') {
-		return +1;
+	if (file->details->directory_sort_key == NULL) {
+		key = g_byte_array_new ();
+		append_directory_name_key (key, file);
+		file->details->directory_sort_key = g_byte_array_free_to_bytes (key);
 	}
 
-	return 0;
+	return file->details->directory_sort_key;
 }
 
-static int
-compare_by_type (CajaFile *file_1, CajaFile *file_2)
+static void
+append_size_key (GByteArray *key, CajaFile *file)
 {
-	gboolean is_directory_1;
-	gboolean is_directory_2;
-	char *type_string_1;
-	char *type_string_2;
-	int result;
-
-	/* Directories go first. Then, if mime types are identical,
-	 * don't bother getting strings (for speed). This assumes
-	 * that the string is dependent entirely on the mime type,
-	 * which is true now but might not be later.
+	/* Sort order:
+	 *   Directories with unknown # of items
+	 *   Directories with "unknowable" # of items
+	 *   Directories with fewer items
+	 *   Directories with more items
+	 *   Files with unknown size.
+	 *   Files with "unknowable" size.
+	 *   Files with smaller sizes.
+	 *   Files with larger sizes.
 	 */
-	is_directory_1 = caja_file_is_directory (file_1);
-	is_directory_2 = caja_file_is_directory (file_2);
-
-	if (is_directory_1 && is_directory_2) {
-		return 0;
-	}
+	Knowledge known;
+	guint count;
+	goffset size;
 
-	if (is_directory_1) {
-		return -1;
+	if (caja_file_is_directory (file)) {
+		count = 0;
+		known = get_item_count (file, &count);
+		append_byte (key, 0);
+		append_byte (key, UNKNOWN - known);
+		append_uint64 (key, known == KNOWN ? count : 0);
+	} else {
+		size = 0;
+		known = get_size (file, &size);
+		append_byte (key, 1);
+		append_byte (key, UNKNOWN - known);
+		append_uint64 (key, known == KNOWN ? (guint64) size ^ SORT_KEY_SIGN_BIT : 0);
 	}
+}
 
-	if (is_directory_2) {
-		return +1;
-	}
+static void
+append_type_key (GByteArray *key, CajaFile *file)
+{
+	char *type_string;
 
-	if (file_1->details->mime_type != NULL &&
-	    file_2->details->mime_type != NULL &&
-	    strcmp (eel_ref_str_peek (file_1->details->mime_type),
-		    eel_ref_str_peek (file_2->details->mime_type)) == 0) {
-		return 0;
+	/* Directories go first, all of them equal. */
+	if (caja_file_is_directory (file)) {
+		append_byte (key, 0);
+		return;
 	}
 
-	type_string_1 = caja_file_get_type_as_string (file_1);
-	type_string_2 = caja_file_get_type_as_string (file_2);
-
-	result = g_utf8_collate (type_string_1, type_string_2);
-
-	g_free (type_string_1);
-	g_free (type_string_2);
-
-	return result;
+	append_byte (key, 1);
+	type_string = caja_file_get_type_as_string (file);
+	append_collation_key (key, type_string);
+	g_free (type_string);
 }
 
-static int
-compare_by_time (CajaFile *file_1, CajaFile *file_2, CajaDateType type)
+static void
+append_time_key (GByteArray *key, CajaFile *file, CajaDateType type)
 {
 	/* Sort order:
 	 *   Files with unknown times.
@@ -3090,50 +2972,133 @@ compare_by_time (CajaFile *file_1, CajaFile *file_2, CajaDateType type)
 	 *   Files with older times.
 	 *   Files with newer times.
 	 */
+	Knowledge known;
+	time_t time;
 
-	Knowledge time_known_1, time_known_2;
-	time_t time_1, time_2;
+	time = 0;
+	known = get_time (file, &time, type);
+	append_byte (key, UNKNOWN - known);
+	append_uint64 (key, known == KNOWN ? (guint64) time ^ SORT_KEY_SIGN_BIT : 0);
+}
 
-	time_1 = 0;
-	time_2 = 0;
+static void
+append_emblems_key (GByteArray *key, CajaFile *file)
+{
+	GList *keywords, *node;
 
-	time_known_1 = get_time (file_1, &time_1, type);
-	time_known_2 = get_time (file_2, &time_2, type);
+	/* We ignore automatic emblems, and only sort by user-added
+	 * keywords. Where one list of keywords is a prefix of the
+	 * other, the longer one goes first.
+	 */
+	keywords = caja_file_get_keywords (file);
+	for (node = keywords; node != NULL; node = node->next) {
+		append_byte (key, 1);
+		append_collation_key (key, node->data);
+	}
+	append_byte (key, 2);
+	g_list_free_full (keywords, g_free);
+}
+
+static GBytes *
+make_sort_key (CajaFile *file, CajaFileSortType sort_type)
+{
+	GByteArray *key;
 
-	if (time_known_1 > time_known_2) {
-		return -1;
+	key = g_byte_array_new ();
+
+	append_uint32 (key, (guint32) file->details->sort_order ^ 0x80000000);
+
+	switch (sort_type) {
+	case CAJA_FILE_SORT_BY_DISPLAY_NAME:
+		append_display_name_key (key, file);
+		break;
+	case CAJA_FILE_SORT_BY_DIRECTORY:
+		append_directory_name_key (key, file);
+		break;
+	case CAJA_FILE_SORT_BY_SIZE:
+		append_size_key (key, file);
+		break;
+	case CAJA_FILE_SORT_BY_TYPE:
+		append_type_key (key, file);
+		break;
+	case CAJA_FILE_SORT_BY_MTIME:
+		append_time_key (key, file, CAJA_DATE_TYPE_MODIFIED);
+		break;
+	case CAJA_FILE_SORT_BY_ATIME:
+		append_time_key (key, file, CAJA_DATE_TYPE_ACCESSED);
+		break;
+	case CAJA_FILE_SORT_BY_TRASHED_TIME:
+		append_time_key (key, file, CAJA_DATE_TYPE_TRASHED);
+		break;
+	case CAJA_FILE_SORT_BY_EMBLEMS:
+		append_emblems_key (key, file);
+		break;
+	default:
+		g_assert_not_reached ();
 	}
-	if (time_known_1 < time_known_2) {
-		return +1;
+
+	/* Everything but names breaks ties by name, then directory. */
+	if (sort_type != CAJA_FILE_SORT_BY_DISPLAY_NAME) {
+		append_display_name_key (key, file);
 	}
 
-	/* Now time_known_1 is equal to time_known_2. Check whether
-	 * we failed to get modification times for files
-	 */
-	if(time_known_1 == UNKNOWABLE || time_known_1 == UNKNOWN) {
-		return 0;
+	return g_byte_array_free_to_bytes (key);
+}
+
+static GBytes *
+get_sort_key (CajaFile *file, CajaFileSortType sort_type)
+{
+	if (file->details->sort_keys == NULL) {
+		file->details->sort_keys = g_new0 (GBytes *, CAJA_FILE_N_SORT_TYPES);
 	}
 
-	if (time_1 < time_2) {
-		return -1;
+	if (file->details->sort_keys[sort_type] == NULL) {
+		file->details->sort_keys[sort_type] = make_sort_key (file, sort_type);
 	}
-	if (time_1 > time_2) {
-		return +1;
+
+	return file->details->sort_keys[sort_type];
+}
+
+static void
+invalidate_sort_keys (CajaFile *file)
+{
+	int i;
+
+	if (file->details->directory_sort_key != NULL) {
+		g_bytes_unref (file->details->directory_sort_key);
+		file->details->directory_sort_key = NULL;
 	}
 
-	return 0;
+	if (file->details->sort_keys == NULL) {
+		return;
+	}
+
+	for (i = 0; i < CAJA_FILE_N_SORT_TYPES; i++) {
+		if (file->details->sort_keys[i] != NULL) {
+			g_bytes_unref (file->details->sort_keys[i]);
+		}
+	}
+	g_free (file->details->sort_keys);
+	file->details->sort_keys = NULL;
 }
 
 static int
-compare_by_full_path (CajaFile *file_1, CajaFile *file_2)
+compare_sort_keys (CajaFile *file_1,
+		   CajaFile *file_2,
+		   CajaFileSortType sort_type)
 {
-	int compare;
+	int result;
 
-	compare = compare_by_directory_name (file_1, file_2);
-	if (compare != 0) {
-		return compare;
+	result = g_bytes_compare (get_sort_key (file_1, sort_type),
+				  get_sort_key (file_2, sort_type));
+
+	if (result == 0 &&
+	    file_1->details->directory != file_2->details->directory) {
+		result = g_bytes_compare (get_directory_sort_key (file_1),
+					  get_directory_sort_key (file_2));
 	}
-	return compare_by_display_name (file_1, file_2);
+
+	return result;
 }
 
 static int
@@ -3166,6 +3131,119 @@ caja_file_compare_for_sort_internal (CajaFile *file_1,
 	return 0;
 }
 
+/**
+ * caja_file_get_sort_key:
+ * @file: A file object
+ * @sort_type: Sort criterion
+ *
+ * Return value: The key caja_file_compare_for_sort compares @file by,
+ * with g_bytes_compare, before reversing the result if needed. The
+ * directories_first flag is not part of it, and neither is the parent
+ * directory, see caja_file_get_directory_sort_key. Only call this from
+ * the main thread, the returned reference can then be used anywhere.
+ **/
+GBytes *
+caja_file_get_sort_key (CajaFile *file,
+			CajaFileSortType sort_type)
+{
+	g_return_val_if_fail (CAJA_IS_FILE (file), NULL);
+	g_return_val_if_fail (sort_type > CAJA_FILE_SORT_NONE &&
+			      sort_type < CAJA_FILE_N_SORT_TYPES, NULL);
+
+	return g_bytes_ref (get_sort_key (file, sort_type));
+}
+
+/**
+ * caja_file_get_directory_sort_key:
+ * @file: A file object
+ *
+ * Return value: The key caja_file_compare_for_sort breaks ties by
+ * when two files are not in the same directory. Only call this from
+ * the main thread, the returned reference can then be used anywhere.
+ **/
+GBytes *
+caja_file_get_directory_sort_key (CajaFile *file)
+{
+	g_return_val_if_fail (CAJA_IS_FILE (file), NULL);
+
+	return g_bytes_ref (get_directory_sort_key (file));
+}
+
+gboolean
+caja_file_is_in_same_directory (CajaFile *file_1,
+				CajaFile *file_2)
+{
+	g_return_val_if_fail (CAJA_IS_FILE (file_1), FALSE);
+	g_return_val_if_fail (CAJA_IS_FILE (file_2), FALSE);
+
+	return file_1->details->directory == file_2->details->directory;
+}
+
+/**
+ * caja_file_prepare_sort_keys:
+ * @files: A list of file objects
+ * @sort_type: Sort criterion
+ *
+ * Builds everything caja_file_compare_for_sort needs to compare these
+ * files, which can then be compared from other threads. Directory keys
+ * are only built when the files are in more than one directory.
+ **/
+void
+caja_file_prepare_sort_keys (GList *files,
+			     CajaFileSortType sort_type)
+{
+	GList *l;
+	gboolean one_directory;
+
+	g_return_if_fail (sort_type > CAJA_FILE_SORT_NONE &&
+			  sort_type < CAJA_FILE_N_SORT_TYPES);
+
+	one_directory = TRUE;
+	for (l = files; l != NULL; l = l->next) {
+		get_sort_key (l->data, sort_type);
+		one_directory = one_directory &&
+			caja_file_is_in_same_directory (l->data, files->data);
+	}
+
+	if (one_directory) {
+		return;
+	}
+
+	for (l = files; l != NULL; l = l->next) {
+		get_directory_sort_key (l->data);
+	}
+}
+
+/**
+ * caja_file_get_sort_type_for_attribute_q:
+ * @attribute: An attribute name quark
+ *
+ * Return value: The sort criterion caja_file_compare_for_sort_by_attribute_q
+ * uses for @attribute, or CAJA_FILE_SORT_NONE if it compares the
+ * attribute's string values.
+ **/
+CajaFileSortType
+caja_file_get_sort_type_for_attribute_q (GQuark attribute)
+{
+	if (attribute == 0 || attribute == attribute_name_q) {
+		return CAJA_FILE_SORT_BY_DISPLAY_NAME;
+	} else if (attribute == attribute_size_q) {
+		return CAJA_FILE_SORT_BY_SIZE;
+	} else if (attribute == attribute_type_q) {
+		return CAJA_FILE_SORT_BY_TYPE;
+	} else if (attribute == attribute_modification_date_q || attribute == attribute_date_modified_q) {
+		return CAJA_FILE_SORT_BY_MTIME;
+	} else if (attribute == attribute_accessed_date_q || attribute == attribute_date_accessed_q) {
+		return CAJA_FILE_SORT_BY_ATIME;
+	} else if (attribute == attribute_trashed_on_q) {
+		return CAJA_FILE_SORT_BY_TRASHED_TIME;
+	} else if (attribute == attribute_emblems_q) {
+		return CAJA_FILE_SORT_BY_EMBLEMS;
+	}
+
+	return CAJA_FILE_SORT_NONE;
+}
+
 /**
  * caja_file_compare_for_sort:
  * @file_1: A file object
@@ -3188,81 +3266,32 @@ caja_file_compare_for_sort (CajaFile *file_1,
 				gboolean directories_first,
 				gboolean reversed)
 {
+	gboolean is_directory_1, is_directory_2;
 	int result;
 
 	if (file_1 == file_2) {
 		return 0;
 	}
 
-	result = caja_file_compare_for_sort_internal (file_1, file_2, directories_first, reversed);
+	g_return_val_if_fail (sort_type > CAJA_FILE_SORT_NONE &&
+			      sort_type < CAJA_FILE_N_SORT_TYPES, 0);
 
-	if (result == 0) {
-		switch (sort_type) {
-		case CAJA_FILE_SORT_BY_DISPLAY_NAME:
-			result = compare_by_display_name (file_1, file_2);
-			if (result == 0) {
-				result = compare_by_directory_name (file_1, file_2);
-			}
-			break;
-		case CAJA_FILE_SORT_BY_DIRECTORY:
-			result = compare_by_full_path (file_1, file_2);
-			break;
-		case CAJA_FILE_SORT_BY_SIZE:
-			/* Compare directory sizes ourselves, then if necessary
-			 * use MateVFS to compare file sizes.
-			 */
-			result = compare_by_size (file_1, file_2);
-			if (result == 0) {
-				result = compare_by_full_path (file_1, file_2);
-			}
-			break;
-		case CAJA_FILE_SORT_BY_TYPE:
-			/* MateVFS doesn't know about our special text for certain
-			 * mime types, so we handle the mime-type sorting ourselves.
-			 */
-			result = compare_by_type (file_1, file_2);
-			if (result == 0) {
-				result = compare_by_full_path (file_1, file_2);
-			}
-			break;
-		case CAJA_FILE_SORT_BY_MTIME:
-			result = compare_by_time (file_1, file_2, CAJA_DATE_TYPE_MODIFIED);
-			if (result == 0) {
-				result = compare_by_full_path (file_1, file_2);
-			}
-			break;
-		case CAJA_FILE_SORT_BY_ATIME:
-			result = compare_by_time (file_1, file_2, CAJA_DATE_TYPE_ACCESSED);
-			if (result == 0) {
-				result = compare_by_full_path (file_1, file_2);
-			}
-			break;
-		case CAJA_FILE_SORT_BY_TRASHED_TIME:
-			result = compare_by_time (file_1, file_2, CAJA_DATE_TYPE_TRASHED);
-			if (result == 0) {
-				result = compare_by_full_path (file_1, file_2);
-			}
-			break;
-		case CAJA_FILE_SORT_BY_EMBLEMS:
-			/* MateVFS doesn't know squat about our emblems, so
-			 * we handle comparing them here, before falling back
-			 * to tie-breakers.
-			 */
-			result = compare_by_emblems (file_1, file_2);
-			if (result == 0) {
-				result = compare_by_full_path (file_1, file_2);
-			}
-			break;
-		default:
-			g_return_val_if_reached (0);
+	if (directories_first) {
+		is_directory_1 = caja_file_is_directory (file_1);
+		is_directory_2 = caja_file_is_directory (file_2);
+
+		if (is_directory_1 && !is_directory_2) {
+			return -1;
 		}
 
-		if (reversed) {
-			result = -result;
+		if (is_directory_2 && !is_directory_1) {
+			return +1;
 		}
 	}
 
-	return result;
+	result = compare_sort_keys (file_1, file_2, sort_type);
+
+	return reversed ? -result : result;
 }
 
 int
@@ -3272,6 +3301,7 @@ caja_file_compare_for_sort_by_attribute_q   (CajaFile                   *file_1,
 						 gboolean                        directories_first,
 						 gboolean                        reversed)
 {
+	CajaFileSortType sort_type;
 	int result;
 
 	if (file_1 == file_2) {
@@ -3281,39 +3311,10 @@ caja_file_compare_for_sort_by_attribute_q   (CajaFile                   *file_1,
 	/* Convert certain attributes into CajaFileSortTypes and use
 	 * caja_file_compare_for_sort()
 	 */
-	if (attribute == 0 || attribute == attribute_name_q) {
-		return caja_file_compare_for_sort (file_1, file_2,
-						       CAJA_FILE_SORT_BY_DISPLAY_NAME,
-						       directories_first,
-						       reversed);
-	} else if (attribute == attribute_size_q) {
-		return caja_file_compare_for_sort (file_1, file_2,
-						       CAJA_FILE_SORT_BY_SIZE,
-						       directories_first,
-						       reversed);
-	} else if (attribute == attribute_type_q) {
-		return caja_file_compare_for_sort (file_1, file_2,
-						       CAJA_FILE_SORT_BY_TYPE,
-						       directories_first,
-						       reversed);
-	} else if (attribute == attribute_modification_date_q || attribute == attribute_date_modified_q) {
-		return caja_file_compare_for_sort (file_1, file_2,
-						       CAJA_FILE_SORT_BY_MTIME,
-						       directories_first,
-						       reversed);
-        } else if (attribute == attribute_accessed_date_q || attribute == attribute_date_accessed_q) {
+	sort_type = caja_file_get_sort_type_for_attribute_q (attribute);
+	if (sort_type != CAJA_FILE_SORT_NONE) {
 		return caja_file_compare_for_sort (file_1, file_2,
-						       CAJA_FILE_SORT_BY_ATIME,
-						       directories_first,
-						       reversed);
-        } else if (attribute == attribute_trashed_on_q) {
-		return caja_file_compare_for_sort (file_1, file_2,
-						       CAJA_FILE_SORT_BY_TRASHED_TIME,
-						       directories_first,
-						       reversed);
-	} else if (attribute == attribute_emblems_q) {
-		return caja_file_compare_for_sort (file_1, file_2,
-						       CAJA_FILE_SORT_BY_EMBLEMS,
+						       sort_type,
 						       directories_first,
 						       reversed);
 	}
@@ -6690,9 +6691,8 @@ caja_file_set_keywords (CajaFile *file, GList *keywords)
 {
 	GList *canonical_keywords;
 
-	/* Invalidate the emblem compare cache */
-	g_free (file->details->compare_by_emblem_cache);
-	file->details->compare_by_emblem_cache = NULL;
+	/* Invalidate the emblem sort key */
+	invalidate_sort_keys (file);
 
 	g_return_if_fail (CAJA_IS_FILE (file));
 
@@ -7357,12 +7357,11 @@ caja_file_emit_changed (CajaFile *file)
 	g_assert (CAJA_IS_FILE (file));
 
 
-	/* Invalidate the emblem compare cache. -- This is not the cleanest
+	/* Invalidate the sort keys. -- This is not the cleanest
 	 * place to do it but it is the one guaranteed bottleneck through
 	 * which all change notifications pass.
 	 */
-	g_free (file->details->compare_by_emblem_cache);
-	file->details->compare_by_emblem_cache = NULL;
+	invalidate_sort_keys (file);
 
 	/* Send out a signal. */
 	g_signal_emit (file, signals[CHANGED], 0, file);
@@ -7616,6 +7615,16 @@ caja_file_is_thumbnailing (CajaFile *file)
 	return file->details->is_thumbnailing;
 }
 
+void
+caja_file_prioritize_io (CajaFile *file)
+{
+	g_return_if_fail (CAJA_IS_FILE (file));
+
+	if (file->details->directory != NULL) {
+		caja_directory_prioritize_file_in_work_queue (file->details->directory, file);
+	}
+}
+
 void
 caja_file_set_is_thumbnailing (CajaFile *file,
 				   gboolean is_thumbnailing)
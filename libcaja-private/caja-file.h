@@ -415,6 +415,14 @@ int                     caja_file_compare_for_sort_by_attribute_q   (CajaFile
         gboolean                        directories_first,
         gboolean                        reversed);
 gboolean                caja_file_is_date_sort_attribute_q          (GQuark                          attribute);
+CajaFileSortType        caja_file_get_sort_type_for_attribute_q     (GQuark                          attribute);
+GBytes *                caja_file_get_sort_key                      (CajaFile                   *file,
+        CajaFileSortType            sort_type);
+GBytes *                caja_file_get_directory_sort_key            (CajaFile                   *file);
+gboolean                caja_file_is_in_same_directory              (CajaFile                   *file_1,
+        CajaFile                   *file_2);
+void                    caja_file_prepare_sort_keys                 (GList                      *files,
+        CajaFileSortType            sort_type);
 
 int                     caja_file_compare_display_name              (CajaFile                   *file_1,
         const char                     *pattern);
@@ -463,6 +471,9 @@ void                    caja_file_set_has_open_window               (CajaFile
 /* Thumbnailing handling */
 gboolean                caja_file_is_thumbnailing                   (CajaFile                   *file);
 
+/* Fetch the attributes of a file that is visible in a view before the others */
+void                    caja_file_prioritize_io                     (CajaFile                   *file);
+
 /* Convenience functions for dealing with a list of CajaFile objects that each have a ref.
  * These are just convenient names for functions that work on lists of GtkObject *.
  */
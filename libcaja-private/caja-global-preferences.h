@@ -57,6 +57,10 @@ G_BEGIN_DECLS
 #define CAJA_PREFERENCES_CONFIRM_TRASH			"confirm-trash"
 #define CAJA_PREFERENCES_ENABLE_DELETE			"enable-delete"
 
+/* Copy options */
+#define CAJA_PREFERENCES_LARGE_FILE_DIRECT_IO		"large-file-direct-io"
+#define CAJA_PREFERENCES_VERIFY_COPIES			"verify-copies"
+
 /* Desktop options */
 #define CAJA_PREFERENCES_DESKTOP_IS_HOME_DIR		"desktop-is-home-dir"
 
@@ -66,6 +70,13 @@ G_BEGIN_DECLS
 #define CAJA_PREFERENCES_DATE_FORMAT			"date-format"
 #define CAJA_PREFERENCES_USE_IEC_UNITS			"use-iec-units"
 
+/* Concurrency of the async. attribute loading in folders */
+#define CAJA_PREFERENCES_ASYNC_JOBS_PER_KIND		"async-jobs-per-kind"
+#define CAJA_PREFERENCES_ASYNC_JOBS_PER_FILESYSTEM	"async-jobs-per-filesystem"
+
+/* Built-in search index */
+#define CAJA_PREFERENCES_SEARCH_INDEX_ROOTS		"search-index-roots"
+
 /* Mouse */
 #define CAJA_PREFERENCES_MOUSE_USE_EXTRA_BUTTONS 	"mouse-use-extra-buttons"
 #define CAJA_PREFERENCES_MOUSE_FORWARD_BUTTON		"mouse-forward-button"
@@ -1765,6 +1765,46 @@ caja_icon_canvas_item_invalidate_label (CajaIconCanvasItem     *item)
     }
 }
 
+/* Used by virtualized icon containers, which hand the same items to
+ * different icons as they scroll. The images and texts are released
+ * until the item gets its next icon.
+ */
+void
+caja_icon_canvas_item_recycle (CajaIconCanvasItem *item)
+{
+    CajaIconCanvasItemDetails *details;
+
+    g_return_if_fail (CAJA_IS_ICON_CANVAS_ITEM (item));
+
+    details = item->details;
+
+    caja_icon_canvas_item_set_image (item, NULL);
+    caja_icon_canvas_item_set_emblems (item, NULL);
+    caja_icon_canvas_item_set_attach_points (item, NULL, 0);
+    caja_icon_canvas_item_set_embedded_text (item, NULL);
+    eel_canvas_item_set (EEL_CANVAS_ITEM (item),
+                         "editable_text", NULL,
+                         "additional_text", NULL,
+                         "highlighted_for_selection", FALSE,
+                         "highlighted_as_keyboard_focus", FALSE,
+                         "highlighted_for_drop", FALSE,
+                         "highlighted-for-clipboard", FALSE,
+                         NULL);
+
+    details->is_prelit = FALSE;
+    details->is_active = FALSE;
+    details->show_stretch_handles = FALSE;
+    details->entire_text = FALSE;
+    details->is_renaming = FALSE;
+    details->is_visible = FALSE;
+
+    /* Back to the origin, the container moves it to its next icon */
+    details->x = 0;
+    details->y = 0;
+
+    caja_icon_canvas_item_invalidate_label (item);
+}
+
 
 static GdkPixbuf *
 get_knob_pixbuf (void)
@@ -3385,6 +3425,11 @@ caja_icon_canvas_item_accessible_idle_do_action (gpointer data)
         item = ctx->item;
         g_free (ctx);
         icon = item->user_data;
+        if (icon == NULL)
+        {
+            /* The item was recycled meanwhile */
+            continue;
+        }
 
         switch (action_number)
         {
@@ -3634,6 +3679,10 @@ static const gchar* caja_icon_canvas_item_accessible_get_image_description(AtkIm
         }
 
         icon = item->user_data;
+        if (icon == NULL)
+        {
+            return NULL;
+        }
         container = CAJA_ICON_CONTAINER(EEL_CANVAS_ITEM(item)->canvas);
         description = caja_icon_container_get_icon_description(container, icon->data);
         g_free(priv->description);
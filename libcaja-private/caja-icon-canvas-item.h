@@ -119,6 +119,8 @@ extern "C" {
     /* whether the entire label text must be visible at all times */
     void        caja_icon_canvas_item_set_entire_text          (CajaIconCanvasItem       *icon_item,
             gboolean                      entire_text);
+    /* drop everything about the current icon before reusing the item */
+    void        caja_icon_canvas_item_recycle                  (CajaIconCanvasItem       *item);
 
 #ifdef __cplusplus
 }
@@ -39,6 +39,7 @@
 #include <eel/eel-background.h>
 #include <eel/eel-vfs-extensions.h>
 #include <eel/eel-gdk-pixbuf-extensions.h>
+#include <eel/eel-glib-extensions.h>
 #include <eel/eel-mate-extensions.h>
 #include <eel/eel-gtk-extensions.h>
 #include <eel/eel-art-extensions.h>
@@ -90,6 +91,21 @@
  */
 #define MAX_CLICK_TIME 1500
 
+/* Sort on several threads from this many icons on, if the subclass allows it. */
+#define PARALLEL_SORT_MIN_ICONS 10000
+
+/* Only give the icons near the visible area a canvas item from this many
+ * icons on, see should_virtualize(). The container goes back to normal
+ * below half of it, so that it doesn't switch back and forth.
+ */
+#define VIRTUALIZE_MIN_ICONS 5000
+
+/* Icons measured up front to find the cell size of a virtualized layout */
+#define VIRTUAL_SAMPLE_ICONS 64
+
+/* Unused canvas items a virtualized container keeps for reuse */
+#define VIRTUAL_ITEM_POOL_SIZE 256
+
 /* Button assignments. */
 #define DRAG_BUTTON 1
 #define RUBBERBAND_BUTTON 1
@@ -181,6 +197,7 @@ typedef struct
 {
     GList *selection;
     char *action_descriptions[LAST_ACTION];
+    GHashTable *icon_accessibles; /* of the icons without an item */
 } CajaIconContainerAccessiblePrivate;
 
 static GType         caja_icon_container_accessible_get_type (void);
@@ -266,6 +283,11 @@ static int compare_icons_vertical (CajaIconContainer *container,
 
 static void store_layout_timestamps_now (CajaIconContainer *container);
 
+static void schedule_redo_layout (CajaIconContainer *container);
+static int item_event_callback (EelCanvasItem *item,
+                                GdkEvent *event,
+                                gpointer data);
+
 static gpointer accessible_parent_class;
 
 static GQuark accessible_private_data_quark = 0;
@@ -341,7 +363,10 @@ static void
 icon_free (CajaIcon *icon)
 {
     /* Destroy this canvas item; the parent will unref it. */
-    eel_canvas_item_destroy (EEL_CANVAS_ITEM (icon->item));
+    if (icon->item != NULL)
+    {
+        eel_canvas_item_destroy (EEL_CANVAS_ITEM (icon->item));
+    }
     g_free (icon);
 }
 
@@ -372,6 +397,14 @@ icon_set_position (CajaIcon *icon,
         return;
     }
 
+    if (icon->item == NULL)
+    {
+        /* Virtualized, the item is moved there when it is created */
+        icon->x = x;
+        icon->y = y;
+        return;
+    }
+
     container = CAJA_ICON_CONTAINER (EEL_CANVAS_ITEM (icon->item)->canvas);
 
     if (icon == get_icon_being_renamed (container))
@@ -493,6 +526,11 @@ icon_raise (CajaIcon *icon)
 {
     EelCanvasItem *item, *band;
 
+    if (icon->item == NULL)
+    {
+        return;
+    }
+
     item = EEL_CANVAS_ITEM (icon->item);
     band = CAJA_ICON_CONTAINER (item->canvas)->details->rubberband_info.selection_rectangle;
 
@@ -522,9 +560,12 @@ icon_toggle_selected (CajaIconContainer *container,
     end_renaming_mode (container, TRUE);
 
     icon->is_selected = !icon->is_selected;
-    eel_canvas_item_set (EEL_CANVAS_ITEM (icon->item),
-                         "highlighted_for_selection", (gboolean) icon->is_selected,
-                         NULL);
+    if (icon->item != NULL)
+    {
+        eel_canvas_item_set (EEL_CANVAS_ITEM (icon->item),
+                             "highlighted_for_selection", (gboolean) icon->is_selected,
+                             NULL);
+    }
 
     /* If the icon is deselected, then get rid of the stretch handles.
      * No harm in doing the same if the item is newly selected.
@@ -621,6 +662,88 @@ icon_get_bounding_box (CajaIcon *icon,
     }
 }
 
+/* Size of the image of an icon that has no canvas item, in world units. */
+static double
+icon_get_virtual_image_size (CajaIconContainer *container,
+                             CajaIcon *icon)
+{
+    guint icon_size;
+
+    if (container->details->forced_icon_size > 0)
+    {
+        icon_size = container->details->forced_icon_size;
+    }
+    else
+    {
+        icon_get_size (container, icon, &icon_size);
+    }
+
+    return icon_size / EEL_CANVAS (container)->pixels_per_unit;
+}
+
+EelDRect
+caja_icon_container_get_icon_rectangle (CajaIconContainer *container,
+                                        CajaIcon *icon)
+{
+    EelDRect rect;
+    double size;
+
+    if (icon->item != NULL)
+    {
+        return caja_icon_canvas_item_get_icon_rectangle (icon->item);
+    }
+
+    size = icon_get_virtual_image_size (container, icon);
+    rect.x0 = icon->x;
+    rect.y0 = icon->y;
+    rect.x1 = icon->x + size;
+    rect.y1 = icon->y + size;
+
+    return rect;
+}
+
+static double
+get_virtual_cell_width (CajaIconContainer *container)
+{
+    if (container->details->virtual_cell_width > 0)
+    {
+        return container->details->virtual_cell_width;
+    }
+
+    return STANDARD_ICON_GRID_WIDTH;
+}
+
+/* The whole icon in world coordinates: the bounds of its canvas item
+ * or, if it has none, its cell.
+ */
+static EelDRect
+icon_get_world_bounds (CajaIconContainer *container,
+                       CajaIcon *icon)
+{
+    EelDRect bounds;
+
+    if (icon->item != NULL)
+    {
+        eel_canvas_item_get_bounds (EEL_CANVAS_ITEM (icon->item),
+                                    &bounds.x0, &bounds.y0,
+                                    &bounds.x1, &bounds.y1);
+    }
+    else if (icon->has_cell)
+    {
+        bounds.x0 = icon->cell_x;
+        bounds.y0 = icon->cell_y;
+        bounds.x1 = icon->cell_x + get_virtual_cell_width (container);
+        bounds.y1 = icon->cell_y + container->details->virtual_cell_above
+                    + container->details->virtual_cell_below;
+    }
+    else
+    {
+        bounds = caja_icon_container_get_icon_rectangle (container, icon);
+    }
+
+    return bounds;
+}
+
 /* Utility functions for CajaIconContainer.  */
 
 gboolean
@@ -690,14 +813,15 @@ set_pending_icon_to_reveal (CajaIconContainer *container, CajaIcon *icon)
          container);
     }
 
+    container->details->pending_icon_to_reveal = icon;
+
     if (icon != NULL)
     {
+        caja_icon_container_ensure_item (container, icon);
         g_signal_connect (icon->item, "destroy",
                           G_CALLBACK (pending_icon_to_reveal_destroy_callback),
                           container);
     }
-
-    container->details->pending_icon_to_reveal = icon;
 }
 
 static void
@@ -748,6 +872,32 @@ icon_get_row_and_column_bounds (CajaIconContainer *container,
     GList *p;
     CajaIcon *one_icon;
     EelIRect one_bounds;
+    EelDRect world_rect;
+
+    if (container->details->virtualized && icon->has_cell)
+    {
+        /* The cells of a row or column all have the same size */
+        world_rect.x0 = icon->cell_x;
+        world_rect.y0 = icon->cell_y;
+        world_rect.x1 = icon->cell_x + get_virtual_cell_width (container);
+        world_rect.y1 = icon->cell_y + container->details->virtual_cell_above
+                        + container->details->virtual_cell_below;
+        if (safety_pad)
+        {
+            world_rect.x0 -= ICON_PAD_LEFT + ICON_PAD_RIGHT;
+            world_rect.x1 += ICON_PAD_LEFT + ICON_PAD_RIGHT;
+
+            world_rect.y0 -= ICON_PAD_TOP + ICON_PAD_BOTTOM;
+            world_rect.y1 += ICON_PAD_TOP + ICON_PAD_BOTTOM;
+        }
+        eel_canvas_w2c (EEL_CANVAS (container),
+                        world_rect.x0, world_rect.y0,
+                        &bounds->x0, &bounds->y0);
+        eel_canvas_w2c (EEL_CANVAS (container),
+                        world_rect.x1, world_rect.y1,
+                        &bounds->x1, &bounds->y1);
+        return;
+    }
 
     item_get_canvas_bounds (EEL_CANVAS_ITEM (icon->item), bounds, safety_pad);
 
@@ -935,6 +1085,7 @@ set_keyboard_focus (CajaIconContainer *container,
     clear_keyboard_focus (container);
 
     container->details->keyboard_focus = icon;
+    caja_icon_container_ensure_item (container, icon);
 
     eel_canvas_item_set (EEL_CANVAS_ITEM (container->details->keyboard_focus->item),
                          "highlighted_as_keyboard_focus", 1,
@@ -1097,11 +1248,52 @@ get_all_icon_bounds (CajaIconContainer *container,
                      double *x2, double *y2,
                      CajaIconCanvasItemBoundsUsage usage)
 {
+    CajaIconContainerDetails *details;
+    CajaIcon *first, *last, *row_end;
+    EelDRect bounds, cells;
+
     /* FIXME bugzilla.gnome.org 42477: Do we have to do something about the rubberband
      * here? Any other non-icon items?
      */
     get_icon_bounds_for_canvas_bounds (EEL_CANVAS_GROUP (EEL_CANVAS (container)->root),
-                                       x1, y1, x2, y2, usage);
+                                       &bounds.x0, &bounds.y0, &bounds.x1, &bounds.y1,
+                                       usage);
+
+    details = container->details;
+    if (details->virtualized
+            && details->virtual_icons != NULL
+            && details->virtual_icons->len > 0)
+    {
+        /* Most icons have no item, the cells tell where they are */
+        first = g_ptr_array_index (details->virtual_icons, 0);
+        last = g_ptr_array_index (details->virtual_icons, details->virtual_icons->len - 1);
+        row_end = g_ptr_array_index (details->virtual_icons,
+                                     MIN (details->virtual_columns, (int) details->virtual_icons->len) - 1);
+
+        cells.x0 = MIN (first->cell_x, row_end->cell_x);
+        cells.y0 = first->cell_y;
+        cells.x1 = MAX (first->cell_x, row_end->cell_x) + get_virtual_cell_width (container);
+        cells.y1 = last->cell_y + details->virtual_cell_above + details->virtual_cell_below;
+
+        eel_drect_union (&bounds, &bounds, &cells);
+    }
+
+    if (x1 != NULL)
+    {
+        *x1 = bounds.x0;
+    }
+    if (y1 != NULL)
+    {
+        *y1 = bounds.y0;
+    }
+    if (x2 != NULL)
+    {
+        *x2 = bounds.x1;
+    }
+    if (y2 != NULL)
+    {
+        *y2 = bounds.y1;
+    }
 }
 
 /* Don't preserve visible white space the next time the scroll region
@@ -1290,16 +1482,65 @@ compare_icons (gconstpointer a, gconstpointer b, gpointer icon_container)
     return klass->compare_icons (icon_container, icon_a->data, icon_b->data);
 }
 
+static gboolean
+can_sort_in_parallel (CajaIconContainer *container,
+                      GList *icons,
+                      guint length)
+{
+    CajaIconContainerClass *klass;
+    GList *icon_data, *l;
+    gboolean result;
+
+    klass = CAJA_ICON_CONTAINER_GET_CLASS (container);
+    if (length < PARALLEL_SORT_MIN_ICONS || klass->prepare_to_sort == NULL)
+    {
+        return FALSE;
+    }
+
+    icon_data = NULL;
+    for (l = icons; l != NULL; l = l->next)
+    {
+        icon_data = g_list_prepend (icon_data, ((CajaIcon *) l->data)->data);
+    }
+    result = klass->prepare_to_sort (container, icon_data);
+    g_list_free (icon_data);
+
+    return result;
+}
+
 static void
 sort_icons (CajaIconContainer *container,
             GList                **icons)
 {
     CajaIconContainerClass *klass;
+    gpointer *array;
+    GList *l;
+    guint length, i;
 
     klass = CAJA_ICON_CONTAINER_GET_CLASS (container);
     g_assert (klass->compare_icons != NULL);
 
-    *icons = g_list_sort_with_data (*icons, compare_icons, container);
+    length = g_list_length (*icons);
+    if (!can_sort_in_parallel (container, *icons, length))
+    {
+        *icons = g_list_sort_with_data (*icons, compare_icons, container);
+        return;
+    }
+
+    /* Both sorts are stable, so the result is the same */
+    array = g_new (gpointer, length);
+    for (l = *icons, i = 0; l != NULL; l = l->next, i++)
+    {
+        array[i] = l->data;
+    }
+
+    eel_sort_in_parallel (array, length, compare_icons, container);
+
+    for (l = *icons, i = 0; l != NULL; l = l->next, i++)
+    {
+        l->data = array[i];
+    }
+    g_free (array);
 }
 
 static void
@@ -2152,7 +2393,7 @@ get_mirror_x_position (CajaIconContainer *container, CajaIcon *icon, double x)
     GtkAllocation allocation;
 
     gtk_widget_get_allocation (GTK_WIDGET (container), &allocation);
-    icon_bounds = caja_icon_canvas_item_get_icon_rectangle (icon->item);
+    icon_bounds = caja_icon_container_get_icon_rectangle (container, icon);
 
     return CANVAS_WIDTH(container, allocation) - x - (icon_bounds.x1 - icon_bounds.x0);
 }
@@ -2377,6 +2618,383 @@ lay_down_icons_vertical_desktop (CajaIconContainer *container, GList *icons)
 }
 
 
+/* Virtualized layout.
+ *
+ * Directories with very many icons are laid out in cells of the same
+ * size, so the position of every icon is known without measuring its
+ * label, and only the icons in and around the visible area get a
+ * canvas item. The items of the icons that scroll away are recycled
+ * for the ones that scroll into view.
+ */
+
+static gboolean
+should_virtualize (CajaIconContainer *container)
+{
+    CajaIconContainerDetails *details;
+    guint threshold;
+
+    details = container->details;
+
+    threshold = details->virtualized ? VIRTUALIZE_MIN_ICONS / 2 : VIRTUALIZE_MIN_ICONS;
+    if (g_hash_table_size (details->icon_set) < threshold)
+    {
+        return FALSE;
+    }
+
+    /* Only the gridded layout with labels under the icons has cells
+     * that are all the same size.
+     */
+    return details->auto_layout
+           && !caja_icon_container_get_is_fixed_size (container)
+           && !caja_icon_container_get_is_desktop (container)
+           && !caja_icon_container_is_layout_vertical (container)
+           && details->label_position == CAJA_ICON_LABEL_POSITION_UNDER
+           && !caja_icon_container_is_tighter_layout (container);
+}
+
+static CajaIconCanvasItem *
+new_icon_item (CajaIconContainer *container)
+{
+    CajaIconCanvasItem *item;
+
+    item = CAJA_ICON_CANVAS_ITEM
+           (eel_canvas_item_new (EEL_CANVAS_GROUP (EEL_CANVAS (container)->root),
+                                 caja_icon_canvas_item_get_type (),
+                                 "visible", FALSE,
+                                 NULL));
+    g_signal_connect_object (item, "event",
+                             G_CALLBACK (item_event_callback), container, 0);
+
+    return item;
+}
+
+static CajaIconCanvasItem *
+take_icon_item (CajaIconContainer *container)
+{
+    CajaIconContainerDetails *details;
+    CajaIconCanvasItem *item;
+    EelCanvasItem *band;
+
+    details = container->details;
+
+    if (details->item_pool != NULL)
+    {
+        item = details->item_pool->data;
+        details->item_pool = g_list_delete_link (details->item_pool, details->item_pool);
+        details->item_pool_length--;
+
+        return item;
+    }
+
+    item = new_icon_item (container);
+
+    /* Make sure the icon is under the selection_rectangle */
+    band = details->rubberband_info.selection_rectangle;
+    if (band)
+    {
+        eel_canvas_item_send_behind (EEL_CANVAS_ITEM (item), band);
+    }
+
+    return item;
+}
+
+static void
+drain_item_pool (CajaIconContainer *container)
+{
+    g_list_free_full (container->details->item_pool,
+                      (GDestroyNotify) eel_canvas_item_destroy);
+    container->details->item_pool = NULL;
+    container->details->item_pool_length = 0;
+}
+
+/* Icons whose item is in use for something else than just showing
+ * them, these keep it when they scroll away.
+ */
+static gboolean
+icon_is_pinned (CajaIconContainer *container,
+                CajaIcon *icon)
+{
+    CajaIconContainerDetails *details;
+
+    details = container->details;
+
+    return icon == details->keyboard_focus
+           || icon == details->stretch_icon
+           || icon == details->drop_target
+           || icon == details->drag_icon
+           || icon == details->pending_icon_to_reveal
+           || icon == details->pending_icon_to_rename
+           || icon == get_icon_being_renamed (container);
+}
+
+static void
+note_virtual_cell_size (CajaIconContainer *container,
+                        CajaIcon *icon)
+{
+    CajaIconContainerDetails *details;
+    EelDRect bounds, icon_rect;
+    double height_above, height_below, label_width, width;
+
+    details = container->details;
+
+    caja_icon_canvas_item_get_bounds_for_layout (icon->item,
+            &bounds.x0, &bounds.y0,
+            &bounds.x1, &bounds.y1);
+    icon_rect = caja_icon_canvas_item_get_icon_rectangle (icon->item);
+
+    /* Size above/below the baseline, like in lay_down_icons_horizontal */
+    height_above = icon_rect.y1 - bounds.y0;
+    height_below = bounds.y1 - icon_rect.y1;
+
+    /* Wide enough for the widest label the zoom level allows, not just
+     * this one, in whole grid cells like lay_down_icons_horizontal.
+     */
+    label_width = caja_icon_canvas_item_get_max_text_width (icon->item)
+                  / EEL_CANVAS (container)->pixels_per_unit;
+    width = MAX (bounds.x1 - bounds.x0, label_width) + ICON_PAD_LEFT + ICON_PAD_RIGHT;
+    width = ceil (width / STANDARD_ICON_GRID_WIDTH) * STANDARD_ICON_GRID_WIDTH;
+
+    if (height_above > details->virtual_cell_above
+            || height_below > details->virtual_cell_below
+            || width > details->virtual_cell_width)
+    {
+        details->virtual_cell_above = MAX (details->virtual_cell_above, height_above);
+        details->virtual_cell_below = MAX (details->virtual_cell_below, height_below);
+        details->virtual_cell_width = MAX (details->virtual_cell_width, width);
+
+        /* All the cells have to grow */
+        details->virtual_cell_grew = TRUE;
+        schedule_redo_layout (container);
+    }
+}
+
+static void
+place_icon_in_cell (CajaIconContainer *container,
+                    CajaIcon *icon)
+{
+    EelDRect icon_rect;
+    double width, height;
+
+    icon_rect = caja_icon_container_get_icon_rectangle (container, icon);
+    width = icon_rect.x1 - icon_rect.x0;
+    height = icon_rect.y1 - icon_rect.y0;
+
+    /* Centered, on the baseline of the row */
+    icon_set_position (icon,
+                       icon->cell_x + (get_virtual_cell_width (container) - width) / 2,
+                       icon->cell_y + container->details->virtual_cell_above - height);
+
+    icon->saved_ltr_x = caja_icon_container_is_layout_rtl (container) ?
+                        get_mirror_x_position (container, icon, icon->x) : icon->x;
+}
+
+void
+caja_icon_container_ensure_item (CajaIconContainer *container,
+                                 CajaIcon *icon)
+{
+    CajaIconContainerDetails *details;
+    CajaIconCanvasItem *item;
+
+    if (icon->item != NULL)
+    {
+        return;
+    }
+
+    details = container->details;
+
+    item = take_icon_item (container);
+    item->user_data = icon;
+    icon->item = item;
+
+    if (icon_is_positioned (icon))
+    {
+        eel_canvas_item_move (EEL_CANVAS_ITEM (item), icon->x, icon->y);
+    }
+
+    eel_canvas_item_set (EEL_CANVAS_ITEM (item),
+                         "highlighted_for_selection", (gboolean) icon->is_selected,
+                         "highlighted_as_keyboard_focus", icon == details->keyboard_focus,
+                         "highlighted-for-clipboard", (gboolean) icon->is_highlighted_for_clipboard,
+                         NULL);
+    caja_icon_container_update_icon (container, icon);
+
+    if (details->virtualized && icon->has_cell)
+    {
+        /* The real image may not be the size the cell was laid out for */
+        note_virtual_cell_size (container, icon);
+        place_icon_in_cell (container, icon);
+    }
+
+    eel_canvas_item_show (EEL_CANVAS_ITEM (item));
+}
+
+static void
+release_icon_item (CajaIconContainer *container,
+                   CajaIcon *icon)
+{
+    CajaIconContainerDetails *details;
+    CajaIconCanvasItem *item;
+
+    details = container->details;
+    item = icon->item;
+
+    if (icon->is_monitored)
+    {
+        caja_icon_container_stop_monitor_top_left (container,
+                icon->data,
+                icon);
+        icon->is_monitored = FALSE;
+    }
+
+    eel_canvas_item_hide (EEL_CANVAS_ITEM (item));
+    caja_icon_canvas_item_recycle (item);
+    item->user_data = NULL;
+    icon->item = NULL;
+
+    if (details->item_pool_length < VIRTUAL_ITEM_POOL_SIZE)
+    {
+        details->item_pool = g_list_prepend (details->item_pool, item);
+        details->item_pool_length++;
+    }
+    else
+    {
+        eel_canvas_item_destroy (EEL_CANVAS_ITEM (item));
+    }
+}
+
+static void
+stop_virtualizing (CajaIconContainer *container)
+{
+    CajaIconContainerDetails *details;
+    CajaIcon *icon;
+    GList *p;
+
+    details = container->details;
+
+    details->virtualized = FALSE;
+    g_clear_pointer (&details->virtual_icons, g_ptr_array_unref);
+
+    for (p = details->icons; p != NULL; p = p->next)
+    {
+        icon = p->data;
+
+        icon->has_cell = FALSE;
+        caja_icon_container_ensure_item (container, icon);
+    }
+
+    drain_item_pool (container);
+}
+
+static void
+update_virtualization (CajaIconContainer *container)
+{
+    gboolean virtualize;
+
+    virtualize = should_virtualize (container);
+    if (virtualize == container->details->virtualized)
+    {
+        return;
+    }
+
+    if (virtualize)
+    {
+        /* The items of the icons that are out of view go away
+         * in caja_icon_container_update_visible_icons().
+         */
+        container->details->virtualized = TRUE;
+    }
+    else
+    {
+        stop_virtualizing (container);
+    }
+}
+
+static void
+invalidate_virtual_cells (CajaIconContainer *container)
+{
+    container->details->virtual_cell_above = 0;
+    container->details->virtual_cell_below = 0;
+    container->details->virtual_cell_width = 0;
+}
+
+static void
+measure_virtual_cells (CajaIconContainer *container,
+                       GList *icons)
+{
+    CajaIconContainerDetails *details;
+    CajaIcon *icon;
+    GList *p;
+    int i;
+
+    details = container->details;
+
+    if (details->virtual_cell_width > 0)
+    {
+        return;
+    }
+
+    /* The cells grow later on if an icon turns out not to fit */
+    for (p = icons, i = 0; p != NULL && i < VIRTUAL_SAMPLE_ICONS; p = p->next, i++)
+    {
+        icon = p->data;
+
+        caja_icon_container_ensure_item (container, icon);
+        note_virtual_cell_size (container, icon);
+    }
+}
+
+static void
+lay_down_icons_virtualized (CajaIconContainer *container,
+                            GList *icons,
+                            double start_y)
+{
+    CajaIconContainerDetails *details;
+    GList *p;
+    CajaIcon *icon;
+    double canvas_width, cell_width, row_height, x;
+    int columns, i;
+    gboolean is_rtl;
+    GtkAllocation allocation;
+
+    details = container->details;
+
+    measure_virtual_cells (container, icons);
+    details->virtual_cell_grew = FALSE;
+
+    gtk_widget_get_allocation (GTK_WIDGET (container), &allocation);
+    canvas_width = CANVAS_WIDTH(container, allocation);
+
+    /* As many cells as lay_down_icons_horizontal puts on a line */
+    cell_width = get_virtual_cell_width (container);
+    columns = MAX (1, (int) ceil (canvas_width / cell_width) - 1);
+    row_height = ICON_PAD_TOP + details->virtual_cell_above
+                 + details->virtual_cell_below + ICON_PAD_BOTTOM;
+    is_rtl = caja_icon_container_is_layout_rtl (container);
+
+    if (details->virtual_icons != NULL)
+    {
+        g_ptr_array_unref (details->virtual_icons);
+    }
+    details->virtual_icons = g_ptr_array_sized_new (g_hash_table_size (details->icon_set));
+    details->virtual_columns = columns;
+    details->virtual_start_y = start_y;
+    details->virtual_row_height = row_height;
+
+    for (p = icons, i = 0; p != NULL; p = p->next, i++)
+    {
+        icon = p->data;
+
+        g_ptr_array_add (details->virtual_icons, icon);
+
+        x = ICON_PAD_LEFT + (i % columns) * cell_width;
+        icon->cell_x = is_rtl ? canvas_width - x - cell_width : x;
+        icon->cell_y = start_y + CONTAINER_PAD_TOP + (i / columns) * row_height + ICON_PAD_TOP;
+        icon->has_cell = TRUE;
+
+        place_icon_in_cell (container, icon);
+    }
+}
+
 static void
 lay_down_icons (CajaIconContainer *container, GList *icons, double start_y)
 {
@@ -2384,7 +3002,14 @@ lay_down_icons (CajaIconContainer *container, GList *icons, double start_y)
     {
     case CAJA_ICON_LAYOUT_L_R_T_B:
     case CAJA_ICON_LAYOUT_R_L_T_B:
-        lay_down_icons_horizontal (container, icons, start_y);
+        if (container->details->virtualized)
+        {
+            lay_down_icons_virtualized (container, icons, start_y);
+        }
+        else
+        {
+            lay_down_icons_horizontal (container, icons, start_y);
+        }
         break;
 
     case CAJA_ICON_LAYOUT_T_B_L_R:
@@ -2407,6 +3032,7 @@ lay_down_icons (CajaIconContainer *container, GList *icons, double start_y)
 static void
 redo_layout_internal (CajaIconContainer *container)
 {
+    update_virtualization (container);
     finish_adding_new_icons (container);
 
     /* Don't do any re-laying-out during stretching. Later we
@@ -2442,6 +3068,13 @@ redo_layout_callback (gpointer callback_data)
     redo_layout_internal (container);
     container->details->idle_id = 0;
 
+    /* Icons that got their item meanwhile didn't fit in their cell */
+    if (container->details->virtual_cell_grew)
+    {
+        container->details->virtual_cell_grew = FALSE;
+        schedule_redo_layout (container);
+    }
+
     return FALSE;
 }
 
@@ -2486,6 +3119,7 @@ reload_icon_positions (CajaIconContainer *container)
 
     g_assert (!container->details->auto_layout);
 
+    update_virtualization (container);
     resort (container);
 
     no_position_icons = NULL;
@@ -2549,11 +3183,16 @@ invalidate_label_sizes (CajaIconContainer *container)
     GList *p;
     CajaIcon *icon;
 
+    invalidate_virtual_cells (container);
+
     for (p = container->details->icons; p != NULL; p = p->next)
     {
         icon = p->data;
 
-        caja_icon_canvas_item_invalidate_label_size (icon->item);
+        if (icon->item != NULL)
+        {
+            caja_icon_canvas_item_invalidate_label_size (icon->item);
+        }
     }
 }
 
@@ -2564,11 +3203,16 @@ invalidate_labels (CajaIconContainer *container)
     GList *p;
     CajaIcon *icon;
 
+    invalidate_virtual_cells (container);
+
     for (p = container->details->icons; p != NULL; p = p->next)
     {
         icon = p->data;
 
-        caja_icon_canvas_item_invalidate_label (icon->item);
+        if (icon->item != NULL)
+        {
+            caja_icon_canvas_item_invalidate_label (icon->item);
+        }
     }
 }
 
@@ -2741,11 +3385,13 @@ rubberband_select (CajaIconContainer *container,
     GList *p;
     gboolean selection_changed, is_in, canvas_rect_calculated;
     CajaIcon *icon;
-    EelIRect canvas_rect;
+    EelIRect canvas_rect, icon_rect;
+    EelDRect world_rect;
     EelCanvas *canvas;
 
     selection_changed = FALSE;
     canvas_rect_calculated = FALSE;
+    canvas = EEL_CANVAS (container);
 
     for (p = container->details->icons; p != NULL; p = p->next)
     {
@@ -2756,7 +3402,6 @@ rubberband_select (CajaIconContainer *container,
             /* Only do this calculation once, since all the canvas items
              * we are interating are in the same coordinate space
              */
-            canvas = EEL_CANVAS_ITEM (icon->item)->canvas;
             eel_canvas_w2c (canvas,
                             current_rect->x0,
                             current_rect->y0,
@@ -2770,7 +3415,20 @@ rubberband_select (CajaIconContainer *container,
             canvas_rect_calculated = TRUE;
         }
 
-        is_in = caja_icon_canvas_item_hit_test_rectangle (icon->item, canvas_rect);
+        if (icon->item != NULL)
+        {
+            is_in = caja_icon_canvas_item_hit_test_rectangle (icon->item, canvas_rect);
+        }
+        else
+        {
+            /* Out of view in a virtualized container, the image will do */
+            world_rect = caja_icon_container_get_icon_rectangle (container, icon);
+            eel_canvas_w2c (canvas, world_rect.x0, world_rect.y0,
+                            &icon_rect.x0, &icon_rect.y0);
+            eel_canvas_w2c (canvas, world_rect.x1, world_rect.y1,
+                            &icon_rect.x1, &icon_rect.y1);
+            is_in = eel_irect_hits_irect (icon_rect, canvas_rect);
+        }
 
         selection_changed |= icon_set_selected
                              (container, icon,
@@ -3276,14 +3934,14 @@ compare_icons_horizontal (CajaIconContainer *container,
     EelDRect world_rect;
     int ax, bx;
 
-    world_rect = caja_icon_canvas_item_get_icon_rectangle (icon_a->item);
+    world_rect = caja_icon_container_get_icon_rectangle (container, icon_a);
     eel_canvas_w2c
     (EEL_CANVAS (container),
      get_cmp_point_x (container, world_rect),
      get_cmp_point_y (container, world_rect),
      &ax,
      NULL);
-    world_rect = caja_icon_canvas_item_get_icon_rectangle (icon_b->item);
+    world_rect = caja_icon_container_get_icon_rectangle (container, icon_b);
     eel_canvas_w2c
     (EEL_CANVAS (container),
      get_cmp_point_x (container, world_rect),
@@ -3310,14 +3968,14 @@ compare_icons_vertical (CajaIconContainer *container,
     EelDRect world_rect;
     int ay, by;
 
-    world_rect = caja_icon_canvas_item_get_icon_rectangle (icon_a->item);
+    world_rect = caja_icon_container_get_icon_rectangle (container, icon_a);
     eel_canvas_w2c
     (EEL_CANVAS (container),
      get_cmp_point_x (container, world_rect),
      get_cmp_point_y (container, world_rect),
      NULL,
      &ay);
-    world_rect = caja_icon_canvas_item_get_icon_rectangle (icon_b->item);
+    world_rect = caja_icon_container_get_icon_rectangle (container, icon_b);
     eel_canvas_w2c
     (EEL_CANVAS (container),
      get_cmp_point_x (container, world_rect),
@@ -3344,14 +4002,14 @@ compare_icons_horizontal_first (CajaIconContainer *container,
     EelDRect world_rect;
     int ax, ay, bx, by;
 
-    world_rect = caja_icon_canvas_item_get_icon_rectangle (icon_a->item);
+    world_rect = caja_icon_container_get_icon_rectangle (container, icon_a);
     eel_canvas_w2c
     (EEL_CANVAS (container),
      get_cmp_point_x (container, world_rect),
      get_cmp_point_y (container, world_rect),
      &ax,
      &ay);
-    world_rect = caja_icon_canvas_item_get_icon_rectangle (icon_b->item);
+    world_rect = caja_icon_container_get_icon_rectangle (container, icon_b);
     eel_canvas_w2c
     (EEL_CANVAS (container),
      get_cmp_point_x (container, world_rect),
@@ -3386,14 +4044,14 @@ compare_icons_vertical_first (CajaIconContainer *container,
     EelDRect world_rect;
     int ax, ay, bx, by;
 
-    world_rect = caja_icon_canvas_item_get_icon_rectangle (icon_a->item);
+    world_rect = caja_icon_container_get_icon_rectangle (container, icon_a);
     eel_canvas_w2c
     (EEL_CANVAS (container),
      get_cmp_point_x (container, world_rect),
      get_cmp_point_y (container, world_rect),
      &ax,
      &ay);
-    world_rect = caja_icon_canvas_item_get_icon_rectangle (icon_b->item);
+    world_rect = caja_icon_container_get_icon_rectangle (container, icon_b);
     eel_canvas_w2c
     (EEL_CANVAS (container),
      get_cmp_point_x (container, world_rect),
@@ -3463,19 +4121,52 @@ rightmost_in_bottom_row (CajaIconContainer *container,
     return compare_icons_vertical_first (container, best_so_far, candidate) < 0;
 }
 
+/* The canvas bounds of the item, or of where it would be */
+static EelDRect
+icon_get_canvas_bounds (CajaIconContainer *container,
+                        CajaIcon *icon)
+{
+    EelCanvasItem *item;
+    EelDRect world_rect, bounds;
+    int x0, y0, x1, y1;
+
+    if (icon->item != NULL)
+    {
+        item = EEL_CANVAS_ITEM (icon->item);
+        bounds.x0 = item->x1;
+        bounds.y0 = item->y1;
+        bounds.x1 = item->x2;
+        bounds.y1 = item->y2;
+
+        return bounds;
+    }
+
+    world_rect = icon_get_world_bounds (container, icon);
+    eel_canvas_w2c (EEL_CANVAS (container),
+                    world_rect.x0, world_rect.y0, &x0, &y0);
+    eel_canvas_w2c (EEL_CANVAS (container),
+                    world_rect.x1, world_rect.y1, &x1, &y1);
+    bounds.x0 = x0;
+    bounds.y0 = y0;
+    bounds.x1 = x1;
+    bounds.y1 = y1;
+
+    return bounds;
+}
+
 static int
 compare_with_start_row (CajaIconContainer *container,
                         CajaIcon *icon)
 {
-    EelCanvasItem *item;
+    EelDRect bounds;
 
-    item = EEL_CANVAS_ITEM (icon->item);
+    bounds = icon_get_canvas_bounds (container, icon);
 
-    if (container->details->arrow_key_start_y < item->y1)
+    if (container->details->arrow_key_start_y < bounds.y0)
     {
         return -1;
     }
-    if (container->details->arrow_key_start_y > item->y2)
+    if (container->details->arrow_key_start_y > bounds.y1)
     {
         return +1;
     }
@@ -3486,15 +4177,15 @@ static int
 compare_with_start_column (CajaIconContainer *container,
                            CajaIcon *icon)
 {
-    EelCanvasItem *item;
+    EelDRect bounds;
 
-    item = EEL_CANVAS_ITEM (icon->item);
+    bounds = icon_get_canvas_bounds (container, icon);
 
-    if (container->details->arrow_key_start_x < item->x1)
+    if (container->details->arrow_key_start_x < bounds.x0)
     {
         return -1;
     }
-    if (container->details->arrow_key_start_x > item->x2)
+    if (container->details->arrow_key_start_x > bounds.x1)
     {
         return +1;
     }
@@ -3908,7 +4599,7 @@ closest_in_90_degrees (CajaIconContainer *container,
     int *best_dist;
 
 
-    world_rect = caja_icon_canvas_item_get_icon_rectangle (candidate->item);
+    world_rect = caja_icon_container_get_icon_rectangle (container, candidate);
     eel_canvas_w2c
     (EEL_CANVAS (container),
      get_cmp_point_x (container, world_rect),
@@ -3972,19 +4663,16 @@ closest_in_90_degrees (CajaIconContainer *container,
 }
 
 static EelDRect
-get_rubberband (CajaIcon *icon1,
+get_rubberband (CajaIconContainer *container,
+                CajaIcon *icon1,
                 CajaIcon *icon2)
 {
     EelDRect rect1;
     EelDRect rect2;
     EelDRect ret;
 
-    eel_canvas_item_get_bounds (EEL_CANVAS_ITEM (icon1->item),
-                                &rect1.x0, &rect1.y0,
-                                &rect1.x1, &rect1.y1);
-    eel_canvas_item_get_bounds (EEL_CANVAS_ITEM (icon2->item),
-                                &rect2.x0, &rect2.y0,
-                                &rect2.x1, &rect2.y1);
+    rect1 = icon_get_world_bounds (container, icon1);
+    rect2 = icon_get_world_bounds (container, icon2);
 
     eel_drect_union (&ret, &rect1, &rect2);
 
@@ -4029,7 +4717,8 @@ keyboard_move_to (CajaIconContainer *container,
 
         if (icon && container->details->keyboard_rubberband_start)
         {
-            rect = get_rubberband (container->details->keyboard_rubberband_start,
+            rect = get_rubberband (container,
+                                   container->details->keyboard_rubberband_start,
                                    icon);
             rubberband_select (container, NULL, &rect);
         }
@@ -4120,7 +4809,7 @@ record_arrow_key_start (CajaIconContainer *container,
 {
     EelDRect world_rect;
 
-    world_rect = caja_icon_canvas_item_get_icon_rectangle (icon->item);
+    world_rect = caja_icon_container_get_icon_rectangle (container, icon);
     eel_canvas_w2c
     (EEL_CANVAS (container),
      get_cmp_point_x (container, world_rect),
@@ -6972,7 +7661,7 @@ update_selected (CajaIconContainer *container)
     for (node = container->details->icons; node != NULL; node = node->next)
     {
         icon = node->data;
-        if (icon->is_selected)
+        if (icon->is_selected && icon->item != NULL)
         {
             eel_canvas_item_request_update (EEL_CANVAS_ITEM (icon->item));
         }
@@ -7368,6 +8057,11 @@ caja_icon_container_clear (CajaIconContainer *container)
     details->layout_timestamp = UNDEFINED_TIME;
     details->store_layout_timestamps_when_finishing_new_icons = FALSE;
 
+    details->virtualized = FALSE;
+    g_clear_pointer (&details->virtual_icons, g_ptr_array_unref);
+    invalidate_virtual_cells (container);
+    drain_item_pool (container);
+
     if (details->icons == NULL)
     {
         return;
@@ -7401,6 +8095,8 @@ caja_icon_container_clear (CajaIconContainer *container)
     g_hash_table_destroy (details->icon_set);
     details->icon_set = g_hash_table_new (g_direct_hash, g_direct_equal);
 
+    g_signal_emit (container, signals[CLEARED], 0);
+
     caja_icon_container_update_scroll_region (container);
 }
 
@@ -7417,6 +8113,7 @@ caja_icon_container_get_first_visible_icon (CajaIconContainer *container)
     CajaIcon *icon, *best_icon;
     double x, y;
     double x1, y1, x2, y2;
+    EelDRect bounds;
     double *pos, best_pos;
     double hadj_v, vadj_v, h_page_size;
     gboolean better_icon;
@@ -7450,8 +8147,11 @@ caja_icon_container_get_first_visible_icon (CajaIconContainer *container)
 
         if (icon_is_positioned (icon))
         {
-            eel_canvas_item_get_bounds (EEL_CANVAS_ITEM (icon->item),
-                                        &x1, &y1, &x2, &y2);
+            bounds = icon_get_world_bounds (container, icon);
+            x1 = bounds.x0;
+            y1 = bounds.y0;
+            x2 = bounds.x1;
+            y2 = bounds.y1;
 
             compare_lt = FALSE;
             if (caja_icon_container_is_layout_vertical (container))
@@ -7627,6 +8327,9 @@ icon_destroy (CajaIconContainer *container,
     details->new_icons = g_list_remove (details->new_icons, icon);
     g_hash_table_remove (details->icon_set, icon->data);
 
+    /* Rebuilt by the next layout */
+    g_clear_pointer (&details->virtual_icons, g_ptr_array_unref);
+
     was_selected = icon->is_selected;
 
     if (details->keyboard_focus == icon ||
@@ -7829,16 +8532,118 @@ caja_icon_container_prioritize_thumbnailing (CajaIconContainer *container,
     klass->prioritize_thumbnailing (container, icon->data);
 }
 
+/* Gives the icons in and around the visible area their item and
+ * takes it from the others.
+ */
+static void
+update_virtual_items (CajaIconContainer *container,
+                      double min_y,
+                      double max_y,
+                      double page_y,
+                      GList **visible_data,
+                      GList **next_page_data)
+{
+    CajaIconContainerDetails *details;
+    EelCanvasGroup *root;
+    GList *node, *next;
+    CajaIcon *icon;
+    double row_height, rows_y, keep_y0, keep_y1, cell_height;
+    int first, last, i;
+    gboolean visible, next_page;
+
+    details = container->details;
+
+    if (details->virtual_icons == NULL || details->virtual_icons->len == 0)
+    {
+        /* Not laid out yet */
+        return;
+    }
+
+    /* The cells may have grown since, but they are still where
+     * they were laid out.
+     */
+    row_height = details->virtual_row_height;
+    cell_height = row_height - ICON_PAD_TOP - ICON_PAD_BOTTOM;
+    rows_y = details->virtual_start_y + CONTAINER_PAD_TOP;
+
+    /* Keep the items of the previous page too, for scrolling back */
+    keep_y0 = min_y - (max_y - min_y);
+    keep_y1 = page_y;
+
+    root = EEL_CANVAS_GROUP (EEL_CANVAS (container)->root);
+    for (node = root->item_list; node != NULL; node = next)
+    {
+        next = node->next;
+
+        if (!CAJA_IS_ICON_CANVAS_ITEM (node->data))
+        {
+            continue;
+        }
+
+        icon = CAJA_ICON_CANVAS_ITEM (node->data)->user_data;
+        if (icon == NULL || !icon->has_cell || icon_is_pinned (container, icon))
+        {
+            continue;
+        }
+
+        if (icon->cell_y + cell_height < keep_y0 || icon->cell_y > keep_y1)
+        {
+            release_icon_item (container, icon);
+        }
+    }
+
+    first = MAX (0, (int) floor ((keep_y0 - rows_y) / row_height)) * details->virtual_columns;
+    last = ((int) floor ((keep_y1 - rows_y) / row_height) + 1) * details->virtual_columns - 1;
+    last = MIN (last, (int) details->virtual_icons->len - 1);
+
+    /* In reverse, like caja_icon_container_update_visible_icons, so
+     * that prepending gives lists from top to bottom.
+     */
+    for (i = last; i >= first; i--)
+    {
+        icon = g_ptr_array_index (details->virtual_icons, i);
+
+        if (icon->cell_y + cell_height < keep_y0 || icon->cell_y > keep_y1)
+        {
+            continue;
+        }
+
+        caja_icon_container_ensure_item (container, icon);
+
+        visible = icon->cell_y + cell_height >= min_y && icon->cell_y <= max_y;
+        next_page = !visible && icon->cell_y > max_y && icon->cell_y <= page_y;
+
+        if (visible)
+        {
+            caja_icon_canvas_item_set_is_visible (icon->item, TRUE);
+            caja_icon_container_prioritize_thumbnailing (container,
+                    icon);
+            *visible_data = g_list_prepend (*visible_data, icon->data);
+        }
+        else
+        {
+            caja_icon_canvas_item_set_is_visible (icon->item, FALSE);
+            if (next_page)
+            {
+                *next_page_data = g_list_prepend (*next_page_data, icon->data);
+            }
+        }
+    }
+}
+
 static void
 caja_icon_container_update_visible_icons (CajaIconContainer *container)
 {
+    CajaIconContainerClass *klass;
     GtkAdjustment *vadj, *hadj;
     double min_y, max_y;
     double min_x, max_x;
+    double page_x, page_y;
     double x0, y0, x1, y1;
     GList *node;
+    GList *visible_data, *next_page_data;
     CajaIcon *icon;
-    gboolean visible;
+    gboolean visible, next_page;
     GtkAllocation allocation;
 
     hadj = gtk_scrollable_get_hadjustment (GTK_SCROLLABLE (container));
@@ -7856,48 +8661,81 @@ caja_icon_container_update_visible_icons (CajaIconContainer *container)
     eel_canvas_c2w (EEL_CANVAS (container),
                     max_x, max_y, &max_x, &max_y);
 
-    /* Do the iteration in reverse to get the render-order from top to
-     * bottom for the prioritized thumbnails.
+    /* The page after the visible one, to have its thumbnails ready
+     * when the user scrolls on.
      */
-    for (node = g_list_last (container->details->icons); node != NULL; node = node->prev)
-    {
-        icon = node->data;
+    page_x = max_x + (max_x - min_x);
+    page_y = max_y + (max_y - min_y);
 
-        if (icon_is_positioned (icon))
+    visible_data = NULL;
+    next_page_data = NULL;
+
+    if (container->details->virtualized)
+    {
+        update_virtual_items (container, min_y, max_y, page_y,
+                              &visible_data, &next_page_data);
+    }
+    else
+    {
+        /* Do the iteration in reverse to get the render-order from top to
+         * bottom for the prioritized thumbnails.
+         */
+        for (node = g_list_last (container->details->icons); node != NULL; node = node->prev)
         {
-            eel_canvas_item_get_bounds (EEL_CANVAS_ITEM (icon->item),
-                                        &x0,
-                                        &y0,
-                                        &x1,
-                                        &y1);
-            eel_canvas_item_i2w (EEL_CANVAS_ITEM (icon->item)->parent,
-                                 &x0,
-                                 &y0);
-            eel_canvas_item_i2w (EEL_CANVAS_ITEM (icon->item)->parent,
-                                 &x1,
-                                 &y1);
+            icon = node->data;
 
-            if (caja_icon_container_is_layout_vertical (container))
-            {
-                visible = x1 >= min_x && x0 <= max_x;
-            }
-            else
+            if (icon_is_positioned (icon))
             {
-                visible = y1 >= min_y && y0 <= max_y;
-            }
+                eel_canvas_item_get_bounds (EEL_CANVAS_ITEM (icon->item),
+                                            &x0,
+                                            &y0,
+                                            &x1,
+                                            &y1);
+                eel_canvas_item_i2w (EEL_CANVAS_ITEM (icon->item)->parent,
+                                     &x0,
+                                     &y0);
+                eel_canvas_item_i2w (EEL_CANVAS_ITEM (icon->item)->parent,
+                                     &x1,
+                                     &y1);
+
+                if (caja_icon_container_is_layout_vertical (container))
+                {
+                    visible = x1 >= min_x && x0 <= max_x;
+                    next_page = !visible && x0 > max_x && x0 <= page_x;
+                }
+                else
+                {
+                    visible = y1 >= min_y && y0 <= max_y;
+                    next_page = !visible && y0 > max_y && y0 <= page_y;
+                }
 
-            if (visible)
-            {
-                caja_icon_canvas_item_set_is_visible (icon->item, TRUE);
-                caja_icon_container_prioritize_thumbnailing (container,
-                        icon);
-            }
-            else
-            {
-                caja_icon_canvas_item_set_is_visible (icon->item, FALSE);
+                if (visible)
+                {
+                    caja_icon_canvas_item_set_is_visible (icon->item, TRUE);
+                    caja_icon_container_prioritize_thumbnailing (container,
+                            icon);
+                    visible_data = g_list_prepend (visible_data, icon->data);
+                }
+                else
+                {
+                    caja_icon_canvas_item_set_is_visible (icon->item, FALSE);
+                    if (next_page)
+                    {
+                        next_page_data = g_list_prepend (next_page_data, icon->data);
+                    }
+                }
             }
         }
     }
+
+    klass = CAJA_ICON_CONTAINER_GET_CLASS (container);
+    if (klass->update_visible_icons != NULL)
+    {
+        /* Both lists are top to bottom already */
+        klass->update_visible_icons (container, visible_data, next_page_data);
+    }
+    g_list_free (visible_data);
+    g_list_free (next_page_data);
 }
 
 static void
@@ -7941,7 +8779,7 @@ caja_icon_container_update_icon (CajaIconContainer *container,
     gboolean embedded_text_needs_loading;
     gboolean has_open_window;
 
-    if (icon == NULL)
+    if (icon == NULL || icon->item == NULL)
     {
         return;
     }
@@ -8067,11 +8905,11 @@ static void
 finish_adding_icon (CajaIconContainer *container,
                     CajaIcon *icon)
 {
-    caja_icon_container_update_icon (container, icon);
-    eel_canvas_item_show (EEL_CANVAS_ITEM (icon->item));
-
-    g_signal_connect_object (icon->item, "event",
-                             G_CALLBACK (item_event_callback), container, 0);
+    if (icon->item != NULL)
+    {
+        caja_icon_container_update_icon (container, icon);
+        eel_canvas_item_show (EEL_CANVAS_ITEM (icon->item));
+    }
 
     g_signal_emit (container, signals[ICON_ADDED], 0, icon->data);
 }
@@ -8210,30 +9048,18 @@ is_old_or_unknown_icon_data (CajaIconContainer *container,
     return (!success || timestamp < container->details->layout_timestamp);
 }
 
-/**
- * caja_icon_container_add:
- * @container: A CajaIconContainer
- * @data: Icon data.
- *
- * Add icon to represent @data to container.
- * Returns FALSE if there was already such an icon.
- **/
-gboolean
-caja_icon_container_add (CajaIconContainer *container,
-                         CajaIconData *data)
+static CajaIcon *
+add_icon (CajaIconContainer *container,
+          CajaIconData *data)
 {
     CajaIconContainerDetails *details;
     CajaIcon *icon;
-    EelCanvasItem *band, *item;
-
-    g_return_val_if_fail (CAJA_IS_ICON_CONTAINER (container), FALSE);
-    g_return_val_if_fail (data != NULL, FALSE);
 
     details = container->details;
 
     if (g_hash_table_lookup (details->icon_set, data) != NULL)
     {
-        return FALSE;
+        return NULL;
     }
 
     /* Create the new icon, including the canvas item. */
@@ -8248,20 +9074,6 @@ caja_icon_container_add (CajaIconContainer *container,
      */
     icon->has_lazy_position = is_old_or_unknown_icon_data (container, data);
     icon->scale = 1.0;
-    icon->item = CAJA_ICON_CANVAS_ITEM
-                 (eel_canvas_item_new (EEL_CANVAS_GROUP (EEL_CANVAS (container)->root),
-                                       caja_icon_canvas_item_get_type (),
-                                       "visible", FALSE,
-                                       NULL));
-    icon->item->user_data = icon;
-
-    /* Make sure the icon is under the selection_rectangle */
-    item = EEL_CANVAS_ITEM (icon->item);
-    band = CAJA_ICON_CONTAINER (item->canvas)->details->rubberband_info.selection_rectangle;
-    if (band)
-    {
-        eel_canvas_item_send_behind (item, band);
-    }
 
     /* Put it on both lists. */
     details->icons = g_list_prepend (details->icons, icon);
@@ -8269,12 +9081,106 @@ caja_icon_container_add (CajaIconContainer *container,
 
     g_hash_table_insert (details->icon_set, data, icon);
 
+    /* With very many icons, the canvas items are only created
+     * for the visible ones once they are laid out.
+     */
+    if (!details->virtualized && should_virtualize (container))
+    {
+        details->virtualized = TRUE;
+    }
+    if (!details->virtualized)
+    {
+        icon->item = new_icon_item (container);
+        icon->item->user_data = icon;
+    }
+
+    return icon;
+}
+
+/**
+ * caja_icon_container_add:
+ * @container: A CajaIconContainer
+ * @data: Icon data.
+ *
+ * Add icon to represent @data to container.
+ * Returns FALSE if there was already such an icon.
+ **/
+gboolean
+caja_icon_container_add (CajaIconContainer *container,
+                         CajaIconData *data)
+{
+    CajaIcon *icon;
+    EelCanvasItem *band;
+
+    g_return_val_if_fail (CAJA_IS_ICON_CONTAINER (container), FALSE);
+    g_return_val_if_fail (data != NULL, FALSE);
+
+    icon = add_icon (container, data);
+    if (icon == NULL)
+    {
+        return FALSE;
+    }
+
+    /* Make sure the icon is under the selection_rectangle */
+    band = container->details->rubberband_info.selection_rectangle;
+    if (band && icon->item != NULL)
+    {
+        eel_canvas_item_send_behind (EEL_CANVAS_ITEM (icon->item), band);
+    }
+
     /* Run an idle function to add the icons. */
     schedule_redo_layout (container);
 
     return TRUE;
 }
 
+/**
+ * caja_icon_container_add_list:
+ * @container: A CajaIconContainer
+ * @data_list: A list of icon data.
+ *
+ * Add icons to represent all of @data_list to container, which is
+ * much cheaper than adding them one at a time when there are many.
+ * Returns the icon data for which there was no icon yet, the list
+ * should be freed with g_list_free().
+ **/
+GList *
+caja_icon_container_add_list (CajaIconContainer *container,
+                              GList *data_list)
+{
+    GList *added, *l;
+    EelCanvasItem *band;
+
+    g_return_val_if_fail (CAJA_IS_ICON_CONTAINER (container), NULL);
+
+    added = NULL;
+    for (l = data_list; l != NULL; l = l->next)
+    {
+        if (add_icon (container, l->data) != NULL)
+        {
+            added = g_list_prepend (added, l->data);
+        }
+    }
+
+    if (added == NULL)
+    {
+        return NULL;
+    }
+
+    /* Keep the icons under the selection rectangle. Raising it once
+     * is linear, sending every icon behind it would be quadratic.
+     */
+    band = container->details->rubberband_info.selection_rectangle;
+    if (band)
+    {
+        eel_canvas_item_raise_to_top (band);
+    }
+
+    schedule_redo_layout (container);
+
+    return g_list_reverse (added);
+}
+
 void
 caja_icon_container_layout_now (CajaIconContainer *container)
 {
@@ -8348,6 +9254,41 @@ caja_icon_container_request_update (CajaIconContainer *container,
     }
 }
 
+/**
+ * caja_icon_container_request_update_list:
+ * @container: A CajaIconContainer.
+ * @data_list: A list of icon data.
+ *
+ * Update the icons with the data in @data_list, and lay them out
+ * again once for all of them.
+ **/
+void
+caja_icon_container_request_update_list (CajaIconContainer *container,
+                                         GList *data_list)
+{
+    CajaIcon *icon;
+    GList *l;
+    gboolean updated;
+
+    g_return_if_fail (CAJA_IS_ICON_CONTAINER (container));
+
+    updated = FALSE;
+    for (l = data_list; l != NULL; l = l->next)
+    {
+        icon = g_hash_table_lookup (container->details->icon_set, l->data);
+        if (icon != NULL)
+        {
+            caja_icon_container_update_icon (container, icon);
+            updated = TRUE;
+        }
+    }
+
+    if (updated)
+    {
+        schedule_redo_layout (container);
+    }
+}
+
 /* zooming */
 
 CajaZoomLevel
@@ -8831,8 +9772,9 @@ caja_icon_container_show_stretch_handles (CajaIconContainer *container)
         ungrab_stretch_icon (container);
         emit_stretch_ended (container, details->stretch_icon);
     }
-    caja_icon_canvas_item_set_show_stretch_handles (icon->item, TRUE);
     details->stretch_icon = icon;
+    caja_icon_container_ensure_item (container, icon);
+    caja_icon_canvas_item_set_show_stretch_handles (icon->item, TRUE);
 
     icon_get_size (container, icon, &initial_size);
 
@@ -9245,13 +10187,14 @@ set_pending_icon_to_rename (CajaIconContainer *container, CajaIcon *icon)
          container);
     }
 
+    container->details->pending_icon_to_rename = icon;
+
     if (icon != NULL)
     {
+        caja_icon_container_ensure_item (container, icon);
         g_signal_connect (icon->item, "destroy",
                           G_CALLBACK (pending_icon_to_rename_destroy_callback), container);
     }
-
-    container->details->pending_icon_to_rename = icon;
 }
 
 static void
@@ -9335,6 +10278,7 @@ caja_icon_container_start_renaming_selected_item (CajaIconContainer *container,
     }
 
     set_pending_icon_to_rename (container, NULL);
+    caja_icon_container_ensure_item (container, icon);
 
     /* Make a copy of the original editable text for a later compare */
     editable_text = caja_icon_canvas_item_get_editable_text (icon->item);
@@ -10071,9 +11015,13 @@ caja_icon_container_set_highlighted_for_clipboard (CajaIconContainer *container,
         icon = l->data;
         highlighted_for_clipboard = (g_list_find (clipboard_icon_data, icon->data) != NULL);
 
-        eel_canvas_item_set (EEL_CANVAS_ITEM (icon->item),
-                             "highlighted-for-clipboard", highlighted_for_clipboard,
-                             NULL);
+        icon->is_highlighted_for_clipboard = highlighted_for_clipboard;
+        if (icon->item != NULL)
+        {
+            eel_canvas_item_set (EEL_CANVAS_ITEM (icon->item),
+                                 "highlighted-for-clipboard", highlighted_for_clipboard,
+                                 NULL);
+        }
     }
 
 }
@@ -10091,6 +11039,56 @@ accessible_get_priv (AtkObject *accessible)
     return priv;
 }
 
+/* Icons out of view in a virtualized container have no item, they get
+ * a plain accessible with their name and role instead, so that walking
+ * the children does not create an item for every one of them.
+ */
+static AtkObject *
+caja_icon_container_accessible_ref_icon (AtkObject *accessible,
+        CajaIcon *icon)
+{
+    CajaIconContainerAccessiblePrivate *priv;
+    CajaIconContainer *container;
+    AtkObject *atk_object;
+    char *name, *description;
+
+    priv = accessible_get_priv (accessible);
+
+    if (icon->item != NULL)
+    {
+        g_hash_table_remove (priv->icon_accessibles, icon);
+
+        atk_object = atk_gobject_accessible_for_object (G_OBJECT (icon->item));
+        if (atk_object)
+        {
+            g_object_ref (atk_object);
+        }
+
+        return atk_object;
+    }
+
+    atk_object = g_hash_table_lookup (priv->icon_accessibles, icon);
+    if (atk_object == NULL)
+    {
+        atk_object = g_object_new (ATK_TYPE_OBJECT, NULL);
+        atk_object_set_role (atk_object, ATK_ROLE_ICON);
+        atk_object_set_parent (atk_object, accessible);
+        g_hash_table_insert (priv->icon_accessibles, icon, atk_object);
+    }
+
+    /* The icon may have been renamed since */
+    container = CAJA_ICON_CONTAINER (gtk_accessible_get_widget (GTK_ACCESSIBLE (accessible)));
+    name = NULL;
+    description = NULL;
+    caja_icon_container_get_icon_text (container, icon->data, &name, &description, FALSE);
+    atk_object_set_name (atk_object, name != NULL ? name : "");
+    atk_object_set_description (atk_object, description != NULL ? description : "");
+    g_free (name);
+    g_free (description);
+
+    return g_object_ref (atk_object);
+}
+
 /* AtkAction interface */
 
 static gboolean
@@ -10258,8 +11256,9 @@ caja_icon_container_accessible_icon_added_cb (CajaIconContainer *container,
     if (icon)
     {
         atk_parent = ATK_OBJECT (data);
-        atk_child = atk_gobject_accessible_for_object
-                    (G_OBJECT (icon->item));
+        /* Icons out of view in a virtualized container have no item */
+        atk_child = icon->item != NULL ?
+                    atk_gobject_accessible_for_object (G_OBJECT (icon->item)) : NULL;
         index = g_list_index (container->details->icons, icon);
 
         g_signal_emit_by_name (atk_parent, "children_changed::add",
@@ -10281,12 +11280,15 @@ caja_icon_container_accessible_icon_removed_cb (CajaIconContainer *container,
     if (icon)
     {
         atk_parent = ATK_OBJECT (data);
-        atk_child = atk_gobject_accessible_for_object
-                    (G_OBJECT (icon->item));
+        /* Icons out of view in a virtualized container have no item */
+        atk_child = icon->item != NULL ?
+                    atk_gobject_accessible_for_object (G_OBJECT (icon->item)) : NULL;
         index = g_list_index (container->details->icons, icon);
 
         g_signal_emit_by_name (atk_parent, "children_changed::remove",
                                index, atk_child, NULL);
+
+        g_hash_table_remove (accessible_get_priv (atk_parent)->icon_accessibles, icon);
     }
 }
 
@@ -10294,6 +11296,8 @@ static void
 caja_icon_container_accessible_cleared_cb (CajaIconContainer *container,
         gpointer data)
 {
+    g_hash_table_remove_all (accessible_get_priv (ATK_OBJECT (data))->icon_accessibles);
+
     g_signal_emit_by_name (data, "children_changed", 0, NULL, NULL);
 }
 
@@ -10353,7 +11357,6 @@ static AtkObject *
 caja_icon_container_accessible_ref_selection (AtkSelection *accessible,
         int i)
 {
-    AtkObject *atk_object;
     CajaIconContainerAccessiblePrivate *priv;
     CajaIcon *icon;
 
@@ -10363,13 +11366,7 @@ caja_icon_container_accessible_ref_selection (AtkSelection *accessible,
     icon = g_list_nth_data (priv->selection, i);
     if (icon)
     {
-        atk_object = atk_gobject_accessible_for_object (G_OBJECT (icon->item));
-        if (atk_object)
-        {
-            g_object_ref (atk_object);
-        }
-
-        return atk_object;
+        return caja_icon_container_accessible_ref_icon (ATK_OBJECT (accessible), icon);
     }
     else
     {
@@ -10541,10 +11538,7 @@ caja_icon_container_accessible_ref_child (AtkObject *accessible, int i)
     icon = g_list_nth_data (container->details->icons, i);
     if (icon)
     {
-        atk_object = atk_gobject_accessible_for_object (G_OBJECT (icon->item));
-        g_object_ref (atk_object);
-
-        return atk_object;
+        return caja_icon_container_accessible_ref_icon (accessible, icon);
     }
     else
     {
@@ -10575,6 +11569,7 @@ caja_icon_container_accessible_initialize (AtkObject *accessible,
     }
 
     priv = g_new0 (CajaIconContainerAccessiblePrivate, 1);
+    priv->icon_accessibles = g_hash_table_new_full (NULL, NULL, NULL, g_object_unref);
     g_object_set_qdata (G_OBJECT (accessible),
                         accessible_private_data_quark,
                         priv);
@@ -10612,6 +11607,8 @@ caja_icon_container_accessible_finalize (GObject *object)
         g_list_free (priv->selection);
     }
 
+    g_hash_table_destroy (priv->icon_accessibles);
+
     for (i = 0; i < LAST_ACTION; i++)
     {
         if (priv->action_descriptions[i])
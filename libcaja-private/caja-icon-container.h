@@ -165,6 +165,11 @@ typedef struct
     int          (* compare_icons_by_name)    (CajaIconContainer *container,
             CajaIconData *icon_a,
             CajaIconData *icon_b);
+    /* Optional. Called before sorting many icons, returns TRUE if
+     * compare_icons can then be called from other threads.
+     */
+    gboolean     (* prepare_to_sort)          (CajaIconContainer *container,
+            GList *icon_data);
     void         (* freeze_updates)           (CajaIconContainer *container);
     void         (* unfreeze_updates)         (CajaIconContainer *container);
     void         (* start_monitor_top_left)   (CajaIconContainer *container,
@@ -176,6 +181,12 @@ typedef struct
             gconstpointer client);
     void         (* prioritize_thumbnailing)  (CajaIconContainer *container,
             CajaIconData *data);
+    /* Lists of the data of the icons on screen and of those on the
+     * next page, in drawing order.
+     */
+    void         (* update_visible_icons)     (CajaIconContainer *container,
+            GList *visible_data,
+            GList *next_page_data);
 
     /* Queries on icons for subclass/client.
      * These must be implemented => These are signals !
@@ -249,6 +260,8 @@ GtkWidget *       caja_icon_container_new                           (void);
 void              caja_icon_container_clear                         (CajaIconContainer  *view);
 gboolean          caja_icon_container_add                           (CajaIconContainer  *view,
         CajaIconData       *data);
+GList *           caja_icon_container_add_list                      (CajaIconContainer  *view,
+        GList              *data_list);
 void              caja_icon_container_layout_now                    (CajaIconContainer *container);
 gboolean          caja_icon_container_remove                        (CajaIconContainer  *view,
         CajaIconData       *data);
@@ -257,6 +270,8 @@ void              caja_icon_container_for_each                      (CajaIconCon
         gpointer                callback_data);
 void              caja_icon_container_request_update                (CajaIconContainer  *view,
         CajaIconData       *data);
+void              caja_icon_container_request_update_list           (CajaIconContainer  *container,
+        GList              *data_list);
 void              caja_icon_container_request_update_all            (CajaIconContainer  *container);
 void              caja_icon_container_reveal                        (CajaIconContainer  *container,
         CajaIconData       *data);
@@ -253,7 +253,7 @@ icon_get_data_binder (CajaIcon *icon, gpointer data)
 
     container = CAJA_ICON_CONTAINER (context->iterator_context);
 
-    world_rect = caja_icon_canvas_item_get_icon_rectangle (icon->item);
+    world_rect = caja_icon_container_get_icon_rectangle (container, icon);
 
     canvas_rect_world_to_widget (EEL_CANVAS (container), &world_rect, &widget_rect);
 
@@ -593,6 +593,12 @@ caja_icon_container_item_at (CajaIconContainer *container,
         CajaIcon *icon;
         icon = p->data;
 
+        if (icon->item == NULL)
+        {
+            /* Out of view, it can't be under the pointer */
+            continue;
+        }
+
         eel_canvas_w2c (EEL_CANVAS (container),
                         point.x0,
                         point.y0,
@@ -37,12 +37,17 @@ typedef struct
     /* Object represented by this icon. */
     CajaIconData *data;
 
-    /* Canvas item for the icon. */
+    /* Canvas item for the icon. In a virtualized container only the
+     * icons near the visible area have one, it is NULL for the others.
+     */
     CajaIconCanvasItem *item;
 
     /* X/Y coordinates. */
     double x, y;
 
+    /* Top left corner of the icon's cell in a virtualized layout. */
+    double cell_x, cell_y;
+
     /*
      * In RTL mode x is RTL x position, we use saved_ltr_x for
      * keeping track of x value before it gets converted into
@@ -67,6 +72,12 @@ typedef struct
     eel_boolean_bit is_monitored : 1;
 
     eel_boolean_bit has_lazy_position : 1;
+
+    /* Whether cell_x and cell_y are set. */
+    eel_boolean_bit has_cell : 1;
+
+    /* Kept here for icons that have no canvas item. */
+    eel_boolean_bit is_highlighted_for_clipboard : 1;
 } CajaIcon;
 
 
@@ -131,6 +142,22 @@ struct CajaIconContainerDetails
     GList *new_icons;
     GHashTable *icon_set;
 
+    /* Virtualized mode, for containers with very many icons: the
+     * icons are laid out in cells of the same size, and only those
+     * near the visible area get a canvas item, taken from item_pool.
+     */
+    gboolean virtualized;
+    GPtrArray *virtual_icons; /* in layout order */
+    int virtual_columns;
+    double virtual_start_y;
+    double virtual_row_height; /* as the icons were laid out */
+    double virtual_cell_above; /* cell height above and below the */
+    double virtual_cell_below; /* baseline, 0 until measured */
+    double virtual_cell_width; /* whole grid cells, 0 until measured */
+    gboolean virtual_cell_grew; /* since the icons were laid out */
+    GList *item_pool;
+    int item_pool_length;
+
     /* Current icon for keyboard navigation. */
     CajaIcon *keyboard_focus;
     CajaIcon *keyboard_rubberband_start;
@@ -318,6 +345,10 @@ char *        caja_icon_container_get_icon_drop_target_uri    (CajaIconContainer
         CajaIcon          *icon);
 void          caja_icon_container_update_icon                 (CajaIconContainer *container,
         CajaIcon          *icon);
+void          caja_icon_container_ensure_item                 (CajaIconContainer *container,
+        CajaIcon          *icon);
+EelDRect      caja_icon_container_get_icon_rectangle          (CajaIconContainer *container,
+        CajaIcon          *icon);
 gboolean      caja_icon_container_has_stored_icon_positions   (CajaIconContainer *container);
 gboolean      caja_icon_container_emit_preview_signal         (CajaIconContainer *view,
         CajaIcon          *icon,
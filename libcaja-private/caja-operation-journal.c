@@ -0,0 +1,370 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   caja-operation-journal.c: On-disk record of running copies and moves.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/* A journal is a text file with one record per line. It starts with
+ * a header describing the operation:
+ *
+ *   caja-operation-journal 1
+ *   copy | move
+ *   time <start time>
+ *   destination <uri>
+ *   source <uri>
+ *   ...
+ *
+ * followed by records appended as the operation goes: "started <uri>"
+ * once the destination of a source file or folder has been created,
+ * and "done <uri>" once it is complete. Every record is a single
+ * write(), so a journal cut short by a crash only loses its last
+ * records.
+ *
+ * The running operation holds a lock on its journal, which goes away
+ * with the process; a journal that can be locked is an interrupted
+ * one.
+ */
+
+#include <config.h>
+#include "caja-operation-journal.h"
+
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#define JOURNAL_MAGIC "caja-operation-journal 1"
+#define JOURNAL_PREFIX "operation-"
+
+struct CajaOperationJournal {
+	char *path;
+	int fd;
+	gboolean is_move;
+	GList *sources;
+	GFile *destination;
+	gint64 start_time;
+	GMutex lock; /* for fd, records come from the copy threads too */
+	GHashTable *files; /* source uri -> CajaOperationJournalFileState,
+			    * as it was when the journal was loaded */
+};
+
+static char *
+get_journal_directory (void)
+{
+	return g_build_filename (g_get_user_config_dir (),
+				 "caja", "operations", NULL);
+}
+
+static void
+write_record (CajaOperationJournal *journal,
+	      const char *record)
+{
+	gsize length, written;
+	gssize n;
+
+	g_mutex_lock (&journal->lock);
+
+	if (journal->fd < 0) {
+		g_mutex_unlock (&journal->lock);
+		return;
+	}
+
+	length = strlen (record);
+	for (written = 0; written < length; written += n) {
+		n = write (journal->fd, record + written, length - written);
+		if (n < 0 && errno == EINTR) {
+			n = 0;
+		} else if (n < 0) {
+			/* Keep going without a journal, it can't be trusted anymore */
+			g_warning ("Could not write to %s: %s",
+				   journal->path, g_strerror (errno));
+			close (journal->fd);
+			journal->fd = -1;
+			break;
+		}
+	}
+
+	g_mutex_unlock (&journal->lock);
+}
+
+static CajaOperationJournal *
+journal_new (char *path,
+	     int fd)
+{
+	CajaOperationJournal *journal;
+
+	journal = g_new0 (CajaOperationJournal, 1);
+	journal->path = path;
+	journal->fd = fd;
+	g_mutex_init (&journal->lock);
+	journal->files = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	return journal;
+}
+
+CajaOperationJournal *
+caja_operation_journal_new (gboolean is_move,
+			    GList *sources,
+			    GFile *destination)
+{
+	CajaOperationJournal *journal;
+	GString *header;
+	GList *l;
+	char *dir, *path, *uri;
+	int fd;
+
+	dir = get_journal_directory ();
+	g_mkdir_with_parents (dir, 0700);
+	path = g_build_filename (dir, JOURNAL_PREFIX "XXXXXX", NULL);
+	g_free (dir);
+
+	fd = g_mkstemp_full (path, O_WRONLY | O_APPEND | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		g_free (path);
+		return NULL;
+	}
+
+	if (flock (fd, LOCK_EX | LOCK_NB) != 0) {
+		close (fd);
+		g_unlink (path);
+		g_free (path);
+		return NULL;
+	}
+
+	journal = journal_new (path, fd);
+	journal->is_move = is_move;
+	journal->sources = g_list_copy_deep (sources, (GCopyFunc) g_object_ref, NULL);
+	journal->destination = g_object_ref (destination);
+	journal->start_time = g_get_real_time ();
+
+	header = g_string_new (JOURNAL_MAGIC "\n");
+	g_string_append (header, is_move ? "move\n" : "copy\n");
+	g_string_append_printf (header, "time %" G_GINT64_FORMAT "\n",
+				journal->start_time);
+	uri = g_file_get_uri (destination);
+	g_string_append_printf (header, "destination %s\n", uri);
+	g_free (uri);
+	for (l = sources; l != NULL; l = l->next) {
+		uri = g_file_get_uri (l->data);
+		g_string_append_printf (header, "source %s\n", uri);
+		g_free (uri);
+	}
+
+	write_record (journal, header->str);
+	g_string_free (header, TRUE);
+
+	if (journal->fd < 0) {
+		caja_operation_journal_finish (journal);
+		return NULL;
+	}
+
+	return journal;
+}
+
+static gboolean
+parse_journal (CajaOperationJournal *journal,
+	       const char *contents)
+{
+	char **lines;
+	const char *line;
+	int i;
+
+	lines = g_strsplit (contents, "\n", -1);
+
+	if (g_strv_length (lines) < 5 ||
+	    strcmp (lines[0], JOURNAL_MAGIC) != 0 ||
+	    (strcmp (lines[1], "copy") != 0 && strcmp (lines[1], "move") != 0) ||
+	    !g_str_has_prefix (lines[2], "time ") ||
+	    !g_str_has_prefix (lines[3], "destination ")) {
+		g_strfreev (lines);
+		return FALSE;
+	}
+
+	journal->is_move = strcmp (lines[1], "move") == 0;
+	journal->start_time = g_ascii_strtoll (lines[2] + strlen ("time "), NULL, 10);
+	journal->destination = g_file_new_for_uri (lines[3] + strlen ("destination "));
+
+	/* The last line is either empty or a record that was cut short */
+	for (i = 4; lines[i] != NULL && lines[i + 1] != NULL; i++) {
+		line = lines[i];
+
+		if (g_str_has_prefix (line, "source ")) {
+			journal->sources = g_list_prepend (journal->sources,
+							   g_file_new_for_uri (line + strlen ("source ")));
+		} else if (g_str_has_prefix (line, "started ")) {
+			g_hash_table_replace (journal->files, g_strdup (line + strlen ("started ")),
+					      GINT_TO_POINTER (CAJA_OPERATION_JOURNAL_FILE_STARTED));
+		} else if (g_str_has_prefix (line, "done ")) {
+			g_hash_table_replace (journal->files, g_strdup (line + strlen ("done ")),
+					      GINT_TO_POINTER (CAJA_OPERATION_JOURNAL_FILE_DONE));
+		}
+	}
+	journal->sources = g_list_reverse (journal->sources);
+
+	g_strfreev (lines);
+
+	return journal->sources != NULL;
+}
+
+GList *
+caja_operation_journal_list_interrupted (void)
+{
+	CajaOperationJournal *journal;
+	GDir *dir;
+	const char *name;
+	char *dir_path, *path, *contents;
+	GList *journals;
+	int fd;
+
+	dir_path = get_journal_directory ();
+	dir = g_dir_open (dir_path, 0, NULL);
+	if (dir == NULL) {
+		g_free (dir_path);
+		return NULL;
+	}
+
+	journals = NULL;
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		if (!g_str_has_prefix (name, JOURNAL_PREFIX)) {
+			continue;
+		}
+
+		path = g_build_filename (dir_path, name, NULL);
+
+		fd = g_open (path, O_WRONLY | O_APPEND | O_CLOEXEC, 0);
+		if (fd < 0) {
+			g_free (path);
+			continue;
+		}
+		if (flock (fd, LOCK_EX | LOCK_NB) != 0) {
+			/* Still running */
+			close (fd);
+			g_free (path);
+			continue;
+		}
+
+		journal = journal_new (path, fd);
+		if (!g_file_get_contents (path, &contents, NULL, NULL)) {
+			caja_operation_journal_free (journal);
+			continue;
+		}
+
+		if (parse_journal (journal, contents)) {
+			journals = g_list_prepend (journals, journal);
+		} else {
+			caja_operation_journal_finish (journal);
+		}
+		g_free (contents);
+	}
+
+	g_dir_close (dir);
+	g_free (dir_path);
+
+	return g_list_reverse (journals);
+}
+
+gboolean
+caja_operation_journal_is_move (CajaOperationJournal *journal)
+{
+	return journal->is_move;
+}
+
+GList *
+caja_operation_journal_get_sources (CajaOperationJournal *journal)
+{
+	return journal->sources;
+}
+
+GFile *
+caja_operation_journal_get_destination (CajaOperationJournal *journal)
+{
+	return journal->destination;
+}
+
+gint64
+caja_operation_journal_get_start_time (CajaOperationJournal *journal)
+{
+	return journal->start_time;
+}
+
+static void
+write_file_record (CajaOperationJournal *journal,
+		   GFile *source,
+		   const char *record_name)
+{
+	char *uri, *record;
+
+	uri = g_file_get_uri (source);
+	record = g_strconcat (record_name, " ", uri, "\n", NULL);
+	write_record (journal, record);
+	g_free (record);
+	g_free (uri);
+}
+
+void
+caja_operation_journal_file_started (CajaOperationJournal *journal,
+				     GFile *source)
+{
+	write_file_record (journal, source, "started");
+}
+
+void
+caja_operation_journal_file_done (CajaOperationJournal *journal,
+				  GFile *source)
+{
+	write_file_record (journal, source, "done");
+}
+
+CajaOperationJournalFileState
+caja_operation_journal_get_file_state (CajaOperationJournal *journal,
+				       GFile *source)
+{
+	CajaOperationJournalFileState state;
+	char *uri;
+
+	uri = g_file_get_uri (source);
+	state = GPOINTER_TO_INT (g_hash_table_lookup (journal->files, uri));
+	g_free (uri);
+
+	return state;
+}
+
+void
+caja_operation_journal_finish (CajaOperationJournal *journal)
+{
+	/* Remove it while it is still locked */
+	g_unlink (journal->path);
+	caja_operation_journal_free (journal);
+}
+
+void
+caja_operation_journal_free (CajaOperationJournal *journal)
+{
+	if (journal->fd >= 0) {
+		close (journal->fd);
+	}
+	g_list_free_full (journal->sources, g_object_unref);
+	if (journal->destination != NULL) {
+		g_object_unref (journal->destination);
+	}
+	g_hash_table_destroy (journal->files);
+	g_mutex_clear (&journal->lock);
+	g_free (journal->path);
+	g_free (journal);
+}
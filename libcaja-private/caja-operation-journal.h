@@ -0,0 +1,70 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   caja-operation-journal.h: On-disk record of running copies and moves.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef CAJA_OPERATION_JOURNAL_H
+#define CAJA_OPERATION_JOURNAL_H
+
+#include <gio/gio.h>
+
+typedef struct CajaOperationJournal CajaOperationJournal;
+
+typedef enum {
+	CAJA_OPERATION_JOURNAL_FILE_UNKNOWN,
+	CAJA_OPERATION_JOURNAL_FILE_STARTED,
+	CAJA_OPERATION_JOURNAL_FILE_DONE
+} CajaOperationJournalFileState;
+
+/* Start a journal for a copy or move of the sources into destination.
+ * Returns NULL if the journal can't be written, the operation then
+ * simply can't be resumed.
+ */
+CajaOperationJournal *caja_operation_journal_new          (gboolean               is_move,
+                                                           GList                 *sources,
+                                                           GFile                 *destination);
+
+/* Returns the journals left behind by operations that never finished,
+ * for example because caja or the session was killed. Journals that
+ * are still in use by a running operation are not returned.
+ */
+GList *               caja_operation_journal_list_interrupted (void);
+
+gboolean              caja_operation_journal_is_move      (CajaOperationJournal  *journal);
+GList *               caja_operation_journal_get_sources  (CajaOperationJournal  *journal);
+GFile *               caja_operation_journal_get_destination (CajaOperationJournal *journal);
+/* In microseconds since the epoch, like g_get_real_time() */
+gint64                caja_operation_journal_get_start_time (CajaOperationJournal *journal);
+
+/* These may be called from any of the threads of the operation. */
+void                  caja_operation_journal_file_started (CajaOperationJournal  *journal,
+                                                           GFile                 *source);
+void                  caja_operation_journal_file_done    (CajaOperationJournal  *journal,
+                                                           GFile                 *source);
+/* Returns what the interrupted operation got to do with source,
+ * records added since the journal was loaded are not taken into account.
+ */
+CajaOperationJournalFileState caja_operation_journal_get_file_state (CajaOperationJournal *journal,
+                                                           GFile                 *source);
+
+/* The operation is over, successfully or not: delete the journal. */
+void                  caja_operation_journal_finish       (CajaOperationJournal  *journal);
+/* Forget about the journal, but leave it on disk. */
+void                  caja_operation_journal_free         (CajaOperationJournal  *journal);
+
+#endif /* CAJA_OPERATION_JOURNAL_H */
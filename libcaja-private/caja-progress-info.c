@@ -79,6 +79,10 @@ struct _CajaProgressInfo
     gboolean waiting;
     GCond waiting_c;
 
+    /* Filesystem ids of what the operation reads and writes,
+     * NULL until the job has found out. */
+    char **devices;
+
     GSource *idle_source;
     gboolean source_is_now;
 
@@ -126,6 +130,7 @@ caja_progress_info_finalize (GObject *object)
 
     g_free (info->status);
     g_free (info->details);
+    g_strfreev (info->devices);
     g_object_unref (info->cancellable);
 
     if (G_OBJECT_CLASS (caja_progress_info_parent_class)->finalize)
@@ -296,6 +301,7 @@ typedef struct _ProgressWidgetData
     GtkWidget *btstart;
     GtkWidget *btqueue;
     ProgressWidgetState state;
+    gboolean queued_by_user;
 } ProgressWidgetData;
 
 static void
@@ -399,6 +405,61 @@ get_first_queued_widget ()
     return out;
 }
 
+/* Operations that share a device would only slow each other down
+ * with seeks. Until an operation has told which devices it uses it
+ * is assumed to share one with everything.
+ */
+static gboolean
+progress_infos_share_device (CajaProgressInfo *a,
+                             CajaProgressInfo *b)
+{
+    gboolean res;
+    int i, j;
+
+    G_LOCK (progress_info);
+
+    res = a->devices == NULL || b->devices == NULL;
+    for (i = 0; !res && a->devices[i] != NULL; i++)
+    {
+        for (j = 0; !res && b->devices[j] != NULL; j++)
+        {
+            res = strcmp (a->devices[i], b->devices[j]) == 0;
+        }
+    }
+
+    G_UNLOCK (progress_info);
+
+    return res;
+}
+
+/* Whether the operation can run next to the ones that already do.
+ * Operations the user queued wait until nothing else runs, as before.
+ */
+static gboolean
+can_run_operation (ProgressWidgetData *data)
+{
+    ProgressWidgetData *other;
+    GList *children, *child;
+    gboolean res;
+
+    res = TRUE;
+    children = gtk_container_get_children (GTK_CONTAINER (get_widgets_container ()));
+    for (child = children; child != NULL && res; child = child->next)
+    {
+        other = (ProgressWidgetData*) g_object_get_data (
+                    G_OBJECT(child->data), "data");
+
+        if (other == data || is_op_paused (other->state))
+            continue;
+
+        res = !data->queued_by_user &&
+              !progress_infos_share_device (data->info, other->info);
+    }
+    g_list_free (children);
+
+    return res;
+}
+
 static void
 start_button_update_view (ProgressWidgetData *data)
 {
@@ -567,6 +628,7 @@ update_queue ()
 {
     GtkWidget *next;
     ProgressWidgetData *data;
+    GList *children, *child;
 
     if (get_running_operations () == 0) {
         next = get_first_queued_widget ();
@@ -577,6 +639,28 @@ update_queue ()
             widget_state_transit_to (data, STATE_RUNNING);
         }
     }
+
+    /* Start whatever else only uses devices that are idle, in order */
+    children = gtk_container_get_children (GTK_CONTAINER (get_widgets_container ()));
+    for (child = children; child != NULL; child = child->next) {
+        data = (ProgressWidgetData*) g_object_get_data (
+                G_OBJECT(child->data), "data");
+
+        if ((data->state == STATE_QUEUED || data->state == STATE_QUEUING) &&
+            can_run_operation (data)) {
+            widget_state_transit_to (data, STATE_RUNNING);
+        }
+    }
+    g_list_free (children);
+}
+
+static gboolean
+update_queue_idle (gpointer user_data)
+{
+    if (n_progress_ops > 0)
+        update_queue ();
+
+    return G_SOURCE_REMOVE;
 }
 
 static void
@@ -653,6 +737,20 @@ caja_progress_info_disable_pause (CajaProgressInfo *info)
     g_source_attach (source, NULL);
 }
 
+/* Lets queued operations that use other devices start. The devices
+ * are opaque strings, jobs use filesystem ids. */
+void
+caja_progress_info_set_devices (CajaProgressInfo *info,
+                                const char * const *devices)
+{
+    G_LOCK (progress_info);
+    g_strfreev (info->devices);
+    info->devices = g_strdupv ((char **) devices);
+    G_UNLOCK (progress_info);
+
+    g_idle_add (update_queue_idle, NULL);
+}
+
 static void
 cancel_clicked (GtkWidget *button,
                 ProgressWidgetData *data)
@@ -711,6 +809,7 @@ start_clicked (GtkWidget *startbt,
         case STATE_PAUSING:
         case STATE_PAUSED:
         case STATE_QUEUED:
+            data->queued_by_user = FALSE;
             widget_state_transit_to (data, STATE_RUNNING);
             break;
         default:
@@ -722,6 +821,8 @@ static void
 queue_clicked (GtkWidget *queuebt,
                ProgressWidgetData *data)
 {
+    data->queued_by_user = TRUE;
+
     switch (data->state) {
         case STATE_RUNNING:
         case STATE_PAUSING:
@@ -921,7 +1022,7 @@ handle_new_progress_info (CajaProgressInfo *info)
 
     n_progress_ops++;
 
-    if (info->waiting && get_running_operations () > 0)
+    if (info->waiting && !can_run_operation (info->widget))
         widget_state_transit_to (info->widget, STATE_QUEUED);
     else
         widget_state_transit_to (info->widget, STATE_RUNNING);
@@ -952,10 +1053,9 @@ new_op_started (CajaProgressInfo *info)
     if (!caja_progress_info_get_is_finished (info)) {
         handle_new_progress_info (info);
 
-        /* Start the job when no other job is running */
-        // TODO use user defined policies
+        /* Start the job when no other job is using its devices */
         if (info->waiting) {
-            if (get_running_operations () == 0)
+            if (can_run_operation (info->widget))
                 progress_info_set_waiting (info, FALSE);
         }
 
@@ -29,12 +29,38 @@
 #include "caja-file-private.h"
 #include "caja-file-utilities.h"
 #include "caja-search-engine.h"
+#include "caja-search-matcher.h"
 #include <eel/eel-glib-extensions.h>
 #include <gtk/gtk.h>
 #include <gio/gio.h>
 #include <string.h>
 #include <sys/time.h>
 
+/* Hits are not shown in the order the engine finds them, but best
+ * first: the engine gets a moment to come up with candidates, then
+ * the best ones are shown. The rest follow in order, a batch at a time
+ * as the view scrolls down to them.
+ */
+#define RANKING_DELAY 150 /* ms */
+#define RANKING_FIRST_BATCH 100
+#define RANKING_FILL_DELAY 50 /* ms */
+#define RANKING_FILL_BATCH 200
+
+/* Only this many of the best pending hits are kept ranked; the others
+ * are shown after them, in the order they were found.
+ */
+#define RANKING_MAX_HITS 1000
+
+/* Files modified this recently rank higher. */
+#define RANKING_RECENT_AGE (7 * 24 * 60 * 60)
+
+typedef struct
+{
+    char *uri;
+    int score; /* lower is better */
+    guint serial;
+} RankedHit;
+
 struct CajaSearchDirectoryDetails
 {
     CajaQuery *query;
@@ -49,6 +75,18 @@ struct CajaSearchDirectoryDetails
     GList *files;
     GHashTable *file_hash;
 
+    /* Hits not shown yet, best first */
+    GSequence *ranked_hits; /* RankedHit */
+    GHashTable *ranked_hash; /* uri -> GSequenceIter */
+    GQueue overflow_hits; /* uri, beyond the best RANKING_MAX_HITS */
+    GHashTable *overflow_hash; /* uri -> GList in overflow_hits */
+    guint ranked_serial;
+    guint ranking_timeout_id;
+    gboolean ranking_first_batch_sent;
+    gboolean ranking_wants_more; /* the view asked, nothing was pending */
+    char *ranking_location;
+    char **ranking_words;
+
     GList *monitor_list;
     GList *callback_list;
     GList *pending_callback_list;
@@ -84,6 +122,7 @@ static void search_engine_finished (CajaSearchEngine *engine, CajaSearchDirector
 static void search_engine_error (CajaSearchEngine *engine, const char *error, CajaSearchDirectory *search);
 static void search_callback_file_ready_callback (CajaFile *file, gpointer data);
 static void file_changed (CajaFile *file, CajaSearchDirectory *search);
+static void ranking_reset (CajaSearchDirectory *search);
 
 static void
 ensure_search_engine (CajaSearchDirectory *search)
@@ -132,6 +171,8 @@ reset_file_list (CajaSearchDirectory *search)
 
     caja_file_list_free (search->details->files);
     search->details->files = NULL;
+
+    ranking_reset (search);
 }
 
 static void
@@ -493,8 +534,7 @@ search_cancel_callback (CajaDirectory *directory,
 
 
 static void
-search_engine_hits_added (CajaSearchEngine *engine, GList *hits,
-                          CajaSearchDirectory *search)
+add_hits (CajaSearchDirectory *search, GList *hits)
 {
     GList *hit_list;
     GList *file_list;
@@ -539,6 +579,327 @@ search_engine_hits_added (CajaSearchEngine *engine, GList *hits,
     caja_file_unref (file);
 }
 
+static void
+ranked_hit_free (RankedHit *hit)
+{
+    g_free (hit->uri);
+    g_free (hit);
+}
+
+static int
+ranked_hit_compare (gconstpointer a,
+                    gconstpointer b,
+                    gpointer user_data)
+{
+    const RankedHit *hit_a = a;
+    const RankedHit *hit_b = b;
+
+    if (hit_a->score != hit_b->score)
+    {
+        return hit_a->score < hit_b->score ? -1 : 1;
+    }
+
+    return hit_a->serial < hit_b->serial ? -1 : hit_a->serial > hit_b->serial;
+}
+
+static void
+ranking_init (CajaSearchDirectory *search)
+{
+    char *text, *folded;
+    char **words;
+    int i, j;
+
+    search->details->ranked_hits = g_sequence_new ((GDestroyNotify) ranked_hit_free);
+    search->details->ranked_hash = g_hash_table_new (g_str_hash, g_str_equal);
+    g_queue_init (&search->details->overflow_hits);
+    search->details->overflow_hash = g_hash_table_new (g_str_hash, g_str_equal);
+
+    search->details->ranking_location = caja_query_get_location (search->details->query);
+
+    text = caja_query_get_text (search->details->query);
+    folded = caja_search_matcher_fold (text != NULL ? text : "");
+    words = g_strsplit (folded, " ", -1);
+    for (i = 0, j = 0; words[i] != NULL; i++)
+    {
+        if (words[i][0] == '\0')
+        {
+            g_free (words[i]);
+            continue;
+        }
+        words[j++] = words[i];
+    }
+    words[j] = NULL;
+    search->details->ranking_words = words;
+    g_free (folded);
+    g_free (text);
+}
+
+static void
+ranking_reset (CajaSearchDirectory *search)
+{
+    if (search->details->ranking_timeout_id != 0)
+    {
+        g_source_remove (search->details->ranking_timeout_id);
+        search->details->ranking_timeout_id = 0;
+    }
+
+    if (search->details->ranked_hits != NULL)
+    {
+        g_hash_table_destroy (search->details->ranked_hash);
+        search->details->ranked_hash = NULL;
+        g_sequence_free (search->details->ranked_hits);
+        search->details->ranked_hits = NULL;
+        g_hash_table_destroy (search->details->overflow_hash);
+        search->details->overflow_hash = NULL;
+        g_queue_foreach (&search->details->overflow_hits, (GFunc) g_free, NULL);
+        g_queue_clear (&search->details->overflow_hits);
+    }
+
+    g_free (search->details->ranking_location);
+    search->details->ranking_location = NULL;
+    g_strfreev (search->details->ranking_words);
+    search->details->ranking_words = NULL;
+
+    search->details->ranking_first_batch_sent = FALSE;
+    search->details->ranking_wants_more = FALSE;
+}
+
+static gboolean
+has_pending_hits (CajaSearchDirectory *search)
+{
+    return search->details->ranked_hits != NULL &&
+           (g_sequence_get_length (search->details->ranked_hits) > 0 ||
+            !g_queue_is_empty (&search->details->overflow_hits));
+}
+
+/* Nothing more will come to rank once everything found is shown. */
+static void
+ranking_reset_if_done (CajaSearchDirectory *search)
+{
+    if (search->details->search_finished &&
+            search->details->ranked_hits != NULL &&
+            !has_pending_hits (search) &&
+            search->details->ranking_timeout_id == 0)
+    {
+        ranking_reset (search);
+    }
+}
+
+static int
+score_hit (CajaSearchDirectory *search, const char *uri)
+{
+    const char *location, *p, *basename;
+    char *name, *folded;
+    CajaFile *file;
+    time_t mtime;
+    int score, i;
+
+    score = 0;
+
+    /* Each folder level between the search location and the hit
+     * costs a bit.
+     */
+    location = search->details->ranking_location;
+    p = uri;
+    if (location != NULL && g_str_has_prefix (uri, location))
+    {
+        p = uri + strlen (location);
+    }
+    for (; *p != '\0'; p++)
+    {
+        if (*p == '/' && p[1] != '\0')
+        {
+            score += 10;
+        }
+    }
+
+    /* Names starting with one of the words do better than names that
+     * only contain them.
+     */
+    basename = strrchr (uri, '/');
+    basename = basename != NULL ? basename + 1 : uri;
+    name = g_uri_unescape_string (basename, NULL);
+    if (name != NULL)
+    {
+        folded = caja_search_matcher_fold (name);
+        for (i = 0; folded != NULL && search->details->ranking_words[i] != NULL; i++)
+        {
+            if (g_str_has_prefix (folded, search->details->ranking_words[i]))
+            {
+                score -= 15;
+                break;
+            }
+        }
+        g_free (folded);
+        g_free (name);
+    }
+
+    /* Recently modified files are likely what the user is after; we
+     * only know that for files we already have information on.
+     */
+    file = caja_file_get_existing_by_uri (uri);
+    if (file != NULL)
+    {
+        mtime = caja_file_get_mtime (file);
+        if (mtime != 0 && time (NULL) - mtime < RANKING_RECENT_AGE)
+        {
+            score -= 10;
+        }
+        caja_file_unref (file);
+    }
+
+    return score;
+}
+
+/* Show up to max_hits of the best pending hits. */
+static void
+show_ranked_hits (CajaSearchDirectory *search, guint max_hits)
+{
+    GSequenceIter *iter;
+    RankedHit *hit;
+    GList *uris;
+    char *uri;
+    guint n_hits;
+
+    if (search->details->ranked_hits == NULL)
+    {
+        return;
+    }
+
+    uris = NULL;
+    n_hits = 0;
+    while (n_hits < max_hits &&
+            !g_sequence_iter_is_end (iter = g_sequence_get_begin_iter (search->details->ranked_hits)))
+    {
+        hit = g_sequence_get (iter);
+        g_hash_table_remove (search->details->ranked_hash, hit->uri);
+        uris = g_list_prepend (uris, hit->uri);
+        hit->uri = NULL;
+        g_sequence_remove (iter);
+        n_hits++;
+    }
+
+    while (n_hits < max_hits &&
+            !g_queue_is_empty (&search->details->overflow_hits))
+    {
+        uri = g_queue_pop_head (&search->details->overflow_hits);
+        g_hash_table_remove (search->details->overflow_hash, uri);
+        uris = g_list_prepend (uris, uri);
+        n_hits++;
+    }
+
+    if (uris != NULL)
+    {
+        uris = g_list_reverse (uris);
+        add_hits (search, uris);
+        g_list_free_full (uris, g_free);
+    }
+}
+
+static gboolean
+ranking_timeout_callback (gpointer data)
+{
+    CajaSearchDirectory *search;
+
+    search = CAJA_SEARCH_DIRECTORY (data);
+
+    search->details->ranking_timeout_id = 0;
+
+    if (!search->details->ranking_first_batch_sent)
+    {
+        search->details->ranking_first_batch_sent = TRUE;
+        show_ranked_hits (search, RANKING_FIRST_BATCH);
+    }
+    else
+    {
+        show_ranked_hits (search, RANKING_FILL_BATCH);
+    }
+
+    ranking_reset_if_done (search);
+
+    return FALSE;
+}
+
+static void
+add_overflow_hit (CajaSearchDirectory *search, char *uri)
+{
+    g_queue_push_tail (&search->details->overflow_hits, uri);
+    g_hash_table_insert (search->details->overflow_hash, uri,
+                         g_queue_peek_tail_link (&search->details->overflow_hits));
+}
+
+/* Keep the hit if it is among the best RANKING_MAX_HITS pending ones,
+ * pushing out the worst one if needed.
+ */
+static void
+add_ranked_hit (CajaSearchDirectory *search, RankedHit *hit)
+{
+    GSequenceIter *iter;
+    RankedHit *worst;
+
+    if (g_sequence_get_length (search->details->ranked_hits) >= RANKING_MAX_HITS)
+    {
+        iter = g_sequence_iter_prev (g_sequence_get_end_iter (search->details->ranked_hits));
+        worst = g_sequence_get (iter);
+        if (ranked_hit_compare (hit, worst, NULL) > 0)
+        {
+            add_overflow_hit (search, hit->uri);
+            hit->uri = NULL;
+            ranked_hit_free (hit);
+            return;
+        }
+
+        g_hash_table_remove (search->details->ranked_hash, worst->uri);
+        add_overflow_hit (search, worst->uri);
+        worst->uri = NULL;
+        g_sequence_remove (iter);
+    }
+
+    iter = g_sequence_insert_sorted (search->details->ranked_hits, hit,
+                                     ranked_hit_compare, NULL);
+    g_hash_table_insert (search->details->ranked_hash, hit->uri, iter);
+}
+
+static void
+search_engine_hits_added (CajaSearchEngine *engine, GList *hits,
+                          CajaSearchDirectory *search)
+{
+    RankedHit *hit;
+    GList *l;
+
+    if (search->details->ranked_hits == NULL)
+    {
+        ranking_init (search);
+    }
+
+    for (l = hits; l != NULL; l = l->next)
+    {
+        if (g_hash_table_lookup (search->details->ranked_hash, l->data) != NULL ||
+                g_hash_table_lookup (search->details->overflow_hash, l->data) != NULL)
+        {
+            continue;
+        }
+
+        hit = g_new (RankedHit, 1);
+        hit->uri = g_strdup (l->data);
+        hit->score = score_hit (search, hit->uri);
+        hit->serial = search->details->ranked_serial++;
+
+        add_ranked_hit (search, hit);
+    }
+
+    if (search->details->ranking_timeout_id == 0 &&
+            (!search->details->ranking_first_batch_sent ||
+             search->details->ranking_wants_more))
+    {
+        search->details->ranking_wants_more = FALSE;
+        search->details->ranking_timeout_id =
+            g_timeout_add (search->details->ranking_first_batch_sent ?
+                           RANKING_FILL_DELAY : RANKING_DELAY,
+                           ranking_timeout_callback, search);
+    }
+}
+
 static void
 search_engine_hits_subtracted (CajaSearchEngine *engine, GList *hits,
                                CajaSearchDirectory *search)
@@ -547,6 +908,8 @@ search_engine_hits_subtracted (CajaSearchEngine *engine, GList *hits,
     GList *monitor_list;
     SearchMonitor *monitor;
     GList *file_list;
+    GSequenceIter *iter;
+    GList *link;
     char *uri;
     CajaFile *file;
 
@@ -555,6 +918,28 @@ search_engine_hits_subtracted (CajaSearchEngine *engine, GList *hits,
     for (hit_list = hits; hit_list != NULL; hit_list = hit_list->next)
     {
         uri = hit_list->data;
+
+        /* Hits that were never shown just go away. */
+        if (search->details->ranked_hash != NULL)
+        {
+            iter = g_hash_table_lookup (search->details->ranked_hash, uri);
+            if (iter != NULL)
+            {
+                g_hash_table_remove (search->details->ranked_hash, uri);
+                g_sequence_remove (iter);
+                continue;
+            }
+
+            link = g_hash_table_lookup (search->details->overflow_hash, uri);
+            if (link != NULL)
+            {
+                g_hash_table_remove (search->details->overflow_hash, uri);
+                g_free (link->data);
+                g_queue_delete_link (&search->details->overflow_hits, link);
+                continue;
+            }
+        }
+
         file = caja_file_get_by_uri (uri);
 
         for (monitor_list = search->details->monitor_list; monitor_list;
@@ -605,7 +990,20 @@ search_engine_error (CajaSearchEngine *engine, const char *error_message, CajaSe
 static void
 search_engine_finished (CajaSearchEngine *engine, CajaSearchDirectory *search)
 {
+    /* Everything has been ranked now, so the best ones can go out
+     * right away. The rest still waits for the view to need them.
+     */
+    if (!search->details->ranking_first_batch_sent &&
+            search->details->ranking_timeout_id != 0)
+    {
+        g_source_remove (search->details->ranking_timeout_id);
+        search->details->ranking_timeout_id = 0;
+        search->details->ranking_first_batch_sent = TRUE;
+        show_ranked_hits (search, RANKING_FIRST_BATCH);
+    }
+
     search->details->search_finished = TRUE;
+    ranking_reset_if_done (search);
 
     caja_directory_emit_done_loading (CAJA_DIRECTORY (search));
 
@@ -897,6 +1295,32 @@ caja_search_directory_is_indexed (CajaSearchDirectory *search)
 }
 
 
+/* Called by the views when they are scrolled close to the last hit
+ * shown, or don't fill their window.
+ */
+void
+caja_search_directory_show_more_hits (CajaSearchDirectory *search)
+{
+    g_return_if_fail (CAJA_IS_SEARCH_DIRECTORY (search));
+
+    /* The first batch or the next one is on its way */
+    if (!search->details->ranking_first_batch_sent ||
+            search->details->ranking_timeout_id != 0)
+    {
+        return;
+    }
+
+    if (has_pending_hits (search))
+    {
+        search->details->ranking_timeout_id =
+            g_timeout_add (RANKING_FILL_DELAY, ranking_timeout_callback, search);
+    }
+    else if (!search->details->search_finished)
+    {
+        search->details->ranking_wants_more = TRUE;
+    }
+}
+
 void
 caja_search_directory_save_to_file (CajaSearchDirectory *search,
                                     const char              *save_file_uri)
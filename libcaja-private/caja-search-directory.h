@@ -62,6 +62,7 @@ CajaSearchDirectory *caja_search_directory_new_from_saved_search (const char *ur
 gboolean       caja_search_directory_is_saved_search (CajaSearchDirectory *search);
 gboolean       caja_search_directory_is_modified     (CajaSearchDirectory *search);
 gboolean       caja_search_directory_is_indexed      (CajaSearchDirectory *search);
+void           caja_search_directory_show_more_hits  (CajaSearchDirectory *search);
 void           caja_search_directory_save_search     (CajaSearchDirectory *search);
 void           caja_search_directory_save_to_file    (CajaSearchDirectory *search,
         const char              *save_file_uri);
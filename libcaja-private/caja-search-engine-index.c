@@ -0,0 +1,1717 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*- */
+/*
+ * Caja is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * Caja is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; see the file COPYING.  If not,
+ * write to the Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ *
+ */
+
+/* An in-memory index of the names of all files under the folders in
+ * the search-index-roots preference. Each file is an entry holding its
+ * parent's entry number and its (interned) name, so a path costs a few
+ * bytes per file. For each trigram of the folded names there is a list
+ * of the entries containing it; a search only looks at the entries of
+ * the rarest trigram of its words.
+ *
+ * The index is built by a background thread and then kept up to date
+ * from the file changes queue, which sees both what the directory
+ * monitors report and what our own file operations do. The changes are
+ * applied by a single worker thread, which also compacts the index
+ * once too many of its entries are removed or moved ones. Changes in
+ * folders nobody is looking at are picked up by rebuilding the index
+ * once it gets old.
+ *
+ * Searches hold a reference on the index and only take the lock for
+ * the short steps that follow parent links; matching the names is done
+ * without it.
+ */
+
+#include <config.h>
+#include "caja-search-engine-index.h"
+#include "caja-search-engine-simple.h"
+#include "caja-search-matcher.h"
+#include "caja-directory-notify.h"
+#include "caja-global-preferences.h"
+
+#include <string.h>
+#include <glib.h>
+
+#include <eel/eel-gtk-macros.h>
+#include <gio/gio.h>
+
+#define BATCH_SIZE 500
+
+/* A search finding the index older than this rebuilds it in the
+ * background (usec).
+ */
+#define INDEX_MAX_AGE (G_USEC_PER_SEC * 60 * 60)
+
+/* How many candidates a search checks per lock. */
+#define SEARCH_CHUNK_SIZE 4096
+
+/* The index is compacted when at least this many entries, and an
+ * eighth of all of them, are removed or stale.
+ */
+#define COMPACT_MIN_GARBAGE 4096
+
+#define NO_ENTRY G_MAXUINT32
+
+#define INDEX_ATTRIBUTES \
+	G_FILE_ATTRIBUTE_STANDARD_NAME "," \
+	G_FILE_ATTRIBUTE_STANDARD_TYPE "," \
+	G_FILE_ATTRIBUTE_ID_FILE
+
+typedef struct
+{
+    guint32 parent;
+    guint32 is_directory : 1;
+    guint32 removed : 1;
+    const char *name; /* the full path for roots */
+} IndexEntry;
+
+typedef struct
+{
+    guint32 parent;
+    const char *name;
+} ChildKey;
+
+typedef struct
+{
+    int ref_count;
+    GArray *entries; /* IndexEntry */
+    GStringChunk *names;
+    GHashTable *children; /* ChildKey -> entry + 1 */
+    GHashTable *trigrams; /* packed trigram -> GArray of entries */
+    gint64 build_time;
+    guint n_garbage; /* entries removed or moved since the build */
+} FileNameIndex;
+
+typedef enum
+{
+    INDEX_CHANGE_ADDED,
+    INDEX_CHANGE_REMOVED,
+    INDEX_CHANGE_MOVED
+} IndexChangeKind;
+
+typedef struct
+{
+    IndexChangeKind kind;
+    char *path;
+    char *to_path;
+    gboolean is_directory;
+} IndexChange;
+
+/* All of these are protected by index_lock. Only the change thread
+ * modifies the live index.
+ */
+static GMutex index_lock;
+static FileNameIndex *live_index;
+static char **index_roots;
+static gboolean index_building;
+static GList *index_journal; /* changes made during a rebuild, newest first */
+
+static GThreadPool *index_change_pool;
+
+typedef struct
+{
+    CajaSearchEngineIndex *engine;
+    GCancellable *cancellable;
+
+    CajaSearchMatcher *matcher;
+    GList *mime_types;
+    char *location;
+} SearchThreadData;
+
+struct CajaSearchEngineIndexDetails
+{
+    CajaQuery *query;
+
+    SearchThreadData *active_search;
+
+    /* Used for locations outside the index. */
+    CajaSearchEngine *fallback;
+};
+
+
+static void  caja_search_engine_index_class_init       (CajaSearchEngineIndexClass *class);
+static void  caja_search_engine_index_init             (CajaSearchEngineIndex      *engine);
+
+G_DEFINE_TYPE (CajaSearchEngineIndex,
+               caja_search_engine_index,
+               CAJA_TYPE_SEARCH_ENGINE);
+
+static CajaSearchEngineClass *parent_class = NULL;
+
+static guint
+child_key_hash (gconstpointer key)
+{
+    const ChildKey *child_key = key;
+
+    return child_key->parent * 31 + g_str_hash (child_key->name);
+}
+
+static gboolean
+child_key_equal (gconstpointer a,
+                 gconstpointer b)
+{
+    const ChildKey *key_a = a;
+    const ChildKey *key_b = b;
+
+    return key_a->parent == key_b->parent &&
+           strcmp (key_a->name, key_b->name) == 0;
+}
+
+static void
+posting_list_free (gpointer data)
+{
+    g_array_free (data, TRUE);
+}
+
+static FileNameIndex *
+file_name_index_new (void)
+{
+    FileNameIndex *index;
+
+    index = g_new0 (FileNameIndex, 1);
+    index->ref_count = 1;
+    index->entries = g_array_new (FALSE, FALSE, sizeof (IndexEntry));
+    index->names = g_string_chunk_new (64 * 1024);
+    index->children = g_hash_table_new_full (child_key_hash, child_key_equal,
+                                             g_free, NULL);
+    index->trigrams = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                             NULL, posting_list_free);
+
+    return index;
+}
+
+static FileNameIndex *
+file_name_index_ref (FileNameIndex *index)
+{
+    g_atomic_int_inc (&index->ref_count);
+
+    return index;
+}
+
+static void
+file_name_index_unref (FileNameIndex *index)
+{
+    if (!g_atomic_int_dec_and_test (&index->ref_count))
+    {
+        return;
+    }
+
+    g_array_free (index->entries, TRUE);
+    g_string_chunk_free (index->names);
+    g_hash_table_destroy (index->children);
+    g_hash_table_destroy (index->trigrams);
+    g_free (index);
+}
+
+static inline IndexEntry *
+get_entry (FileNameIndex *index,
+           guint32 id)
+{
+    return &g_array_index (index->entries, IndexEntry, id);
+}
+
+static inline guint32
+pack_trigram (const char *p)
+{
+    return ((guchar) p[0] << 16) | ((guchar) p[1] << 8) | (guchar) p[2];
+}
+
+/* Names on disk need not be valid UTF-8, searches match the name as
+ * it is shown. Returns NULL if that is @name itself.
+ */
+static char *
+get_display_name_if_different (const char *name)
+{
+    if (g_utf8_validate (name, -1, NULL))
+    {
+        return NULL;
+    }
+
+    return g_filename_display_name (name);
+}
+
+static void
+add_trigrams (FileNameIndex *index,
+              guint32 id,
+              const char *name)
+{
+    GArray *posting;
+    char *display_name, *folded;
+    gsize i, length;
+    guint32 trigram;
+
+    display_name = get_display_name_if_different (name);
+    folded = caja_search_matcher_fold (display_name != NULL ? display_name : name);
+    g_free (display_name);
+    if (folded == NULL)
+    {
+        return;
+    }
+    length = strlen (folded);
+
+    for (i = 0; i + 3 <= length; i++)
+    {
+        trigram = pack_trigram (folded + i);
+        posting = g_hash_table_lookup (index->trigrams, GUINT_TO_POINTER (trigram));
+        if (posting == NULL)
+        {
+            posting = g_array_new (FALSE, FALSE, sizeof (guint32));
+            g_hash_table_insert (index->trigrams, GUINT_TO_POINTER (trigram), posting);
+        }
+
+        /* Names are added in order, so a repeated trigram in one name
+         * is always at the end.
+         */
+        if (posting->len == 0 ||
+                g_array_index (posting, guint32, posting->len - 1) != id)
+        {
+            g_array_append_val (posting, id);
+        }
+    }
+
+    g_free (folded);
+}
+
+static void
+add_child_key (FileNameIndex *index,
+               guint32 id)
+{
+    IndexEntry *entry;
+    ChildKey *key;
+
+    entry = get_entry (index, id);
+    key = g_new (ChildKey, 1);
+    key->parent = entry->parent;
+    key->name = entry->name;
+    g_hash_table_replace (index->children, key, GUINT_TO_POINTER (id + 1));
+}
+
+static void
+remove_child_key (FileNameIndex *index,
+                  guint32 id)
+{
+    IndexEntry *entry;
+    ChildKey key;
+
+    entry = get_entry (index, id);
+    key.parent = entry->parent;
+    key.name = entry->name;
+    g_hash_table_remove (index->children, &key);
+}
+
+static guint32
+file_name_index_add (FileNameIndex *index,
+                     guint32 parent,
+                     const char *name,
+                     gboolean is_directory)
+{
+    IndexEntry entry;
+    guint32 id;
+
+    entry.parent = parent;
+    entry.is_directory = is_directory;
+    entry.removed = FALSE;
+    entry.name = g_string_chunk_insert_const (index->names, name);
+
+    id = index->entries->len;
+    g_array_append_val (index->entries, entry);
+
+    add_child_key (index, id);
+    if (parent != NO_ENTRY)
+    {
+        add_trigrams (index, id, name);
+    }
+
+    return id;
+}
+
+static guint32
+lookup_child (FileNameIndex *index,
+              guint32 parent,
+              const char *name)
+{
+    ChildKey key;
+
+    key.parent = parent;
+    key.name = name;
+
+    return GPOINTER_TO_UINT (g_hash_table_lookup (index->children, &key)) - 1;
+}
+
+/* Returns the root containing an absolute path, and where the path
+ * continues below it, or NULL.
+ */
+static const char *
+find_root (char **roots,
+           const char *path,
+           const char **rest)
+{
+    gsize length;
+    int i;
+
+    for (i = 0; roots != NULL && roots[i] != NULL; i++)
+    {
+        length = strlen (roots[i]);
+        if (strncmp (path, roots[i], length) == 0 &&
+                (path[length] == '/' || path[length] == '\0' ||
+                 roots[i][length - 1] == '/'))
+        {
+            *rest = path + length;
+            return roots[i];
+        }
+    }
+
+    return NULL;
+}
+
+static guint32
+file_name_index_lookup (FileNameIndex *index,
+                        const char *path)
+{
+    const char *root, *rest;
+    char **components;
+    guint32 id;
+    int i;
+
+    root = find_root (index_roots, path, &rest);
+    if (root == NULL)
+    {
+        return NO_ENTRY;
+    }
+
+    id = lookup_child (index, NO_ENTRY, root);
+
+    components = g_strsplit (rest, "/", -1);
+    for (i = 0; id != NO_ENTRY && components[i] != NULL; i++)
+    {
+        if (components[i][0] != '\0')
+        {
+            id = lookup_child (index, id, components[i]);
+        }
+    }
+    g_strfreev (components);
+
+    return id;
+}
+
+static char *
+file_name_index_get_path (FileNameIndex *index,
+                          guint32 id)
+{
+    GPtrArray *components;
+    IndexEntry *entry;
+    GString *path;
+    int i;
+
+    components = g_ptr_array_new ();
+    for (; id != NO_ENTRY; id = entry->parent)
+    {
+        entry = get_entry (index, id);
+        g_ptr_array_add (components, (gpointer) entry->name);
+    }
+
+    path = g_string_new (NULL);
+    for (i = components->len - 1; i >= 0; i--)
+    {
+        if (path->len > 0 && path->str[path->len - 1] != '/')
+        {
+            g_string_append_c (path, '/');
+        }
+        g_string_append (path, g_ptr_array_index (components, i));
+    }
+    g_ptr_array_free (components, TRUE);
+
+    return g_string_free (path, FALSE);
+}
+
+/* Whether an entry is still there and below another one. */
+static gboolean
+file_name_index_is_inside (FileNameIndex *index,
+                           guint32 id,
+                           guint32 ancestor)
+{
+    IndexEntry *entry;
+
+    entry = get_entry (index, id);
+    if (entry->removed)
+    {
+        return FALSE;
+    }
+
+    while (entry->parent != NO_ENTRY)
+    {
+        if (entry->parent == ancestor)
+        {
+            return TRUE;
+        }
+        entry = get_entry (index, entry->parent);
+        if (entry->removed)
+        {
+            return FALSE;
+        }
+    }
+
+    return FALSE;
+}
+
+static gboolean
+name_is_hidden (const char *name)
+{
+    return name[0] == '.' || g_str_has_suffix (name, "~");
+}
+
+static void
+file_name_index_apply (FileNameIndex *index,
+                       IndexChange *change)
+{
+    IndexEntry *entry;
+    guint32 id, parent;
+    char *dirname, *basename;
+
+    id = file_name_index_lookup (index, change->path);
+
+    switch (change->kind)
+    {
+    case INDEX_CHANGE_ADDED:
+        if (id != NO_ENTRY)
+        {
+            break;
+        }
+
+        dirname = g_path_get_dirname (change->path);
+        basename = g_path_get_basename (change->path);
+        parent = file_name_index_lookup (index, dirname);
+        if (parent != NO_ENTRY && !name_is_hidden (basename))
+        {
+            file_name_index_add (index, parent, basename, change->is_directory);
+        }
+        g_free (dirname);
+        g_free (basename);
+        break;
+
+    case INDEX_CHANGE_REMOVED:
+        if (id != NO_ENTRY && get_entry (index, id)->parent != NO_ENTRY)
+        {
+            remove_child_key (index, id);
+            get_entry (index, id)->removed = TRUE;
+            index->n_garbage += 1;
+        }
+        break;
+
+    case INDEX_CHANGE_MOVED:
+        if (id == NO_ENTRY || get_entry (index, id)->parent == NO_ENTRY)
+        {
+            break;
+        }
+
+        remove_child_key (index, id);
+
+        /* Either way the old name stays in the trigram lists. */
+        index->n_garbage += 1;
+
+        dirname = g_path_get_dirname (change->to_path);
+        basename = g_path_get_basename (change->to_path);
+        parent = file_name_index_lookup (index, dirname);
+
+        /* Moving keeps the entry, and so everything inside a folder. */
+        entry = get_entry (index, id);
+        if (parent == NO_ENTRY || name_is_hidden (basename))
+        {
+            entry->removed = TRUE;
+        }
+        else
+        {
+            entry->parent = parent;
+            entry->name = g_string_chunk_insert_const (index->names, basename);
+            add_child_key (index, id);
+            add_trigrams (index, id, basename);
+        }
+        g_free (dirname);
+        g_free (basename);
+        break;
+    }
+}
+
+static gboolean
+file_name_index_is_live (FileNameIndex *index,
+                         guint32 id)
+{
+    IndexEntry *entry;
+
+    for (; id != NO_ENTRY; id = entry->parent)
+    {
+        entry = get_entry (index, id);
+        if (entry->removed)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/* Copy an entry to the compacted index, after those of its parents
+ * that are not there yet.
+ */
+static void
+compact_copy_entry (FileNameIndex *index,
+                    FileNameIndex *compacted,
+                    guint32 *map,
+                    GArray *stack,
+                    guint32 id)
+{
+    IndexEntry *entry;
+    guint32 parent;
+
+    for (; id != NO_ENTRY && map[id] == NO_ENTRY; id = entry->parent)
+    {
+        entry = get_entry (index, id);
+        g_array_append_val (stack, id);
+    }
+
+    while (stack->len > 0)
+    {
+        id = g_array_index (stack, guint32, stack->len - 1);
+        g_array_set_size (stack, stack->len - 1);
+
+        entry = get_entry (index, id);
+        parent = entry->parent == NO_ENTRY ? NO_ENTRY : map[entry->parent];
+        map[id] = file_name_index_add (compacted, parent,
+                                       entry->name, entry->is_directory);
+    }
+}
+
+/* Returns a copy of the index without the removed entries and the
+ * stale trigrams of moved ones.
+ */
+static FileNameIndex *
+file_name_index_compact (FileNameIndex *index)
+{
+    FileNameIndex *compacted;
+    GArray *stack;
+    guint32 *map;
+    guint32 id;
+
+    compacted = file_name_index_new ();
+    compacted->build_time = index->build_time;
+
+    map = g_new (guint32, index->entries->len);
+    memset (map, 0xff, index->entries->len * sizeof (guint32));
+    stack = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+    for (id = 0; id < index->entries->len; id++)
+    {
+        if (map[id] == NO_ENTRY && file_name_index_is_live (index, id))
+        {
+            compact_copy_entry (index, compacted, map, stack, id);
+        }
+    }
+
+    g_array_free (stack, TRUE);
+    g_free (map);
+
+    return compacted;
+}
+
+static void
+index_change_free (IndexChange *change)
+{
+    g_free (change->path);
+    g_free (change->to_path);
+    g_free (change);
+}
+
+/* Returns whether a directory was already indexed, on another path.
+ * This happens with bind mounts and with roots inside other roots.
+ */
+static gboolean
+directory_seen (GHashTable *seen_directories,
+                GFileInfo *info)
+{
+    const char *id;
+
+    id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
+    if (id == NULL)
+    {
+        return FALSE;
+    }
+
+    if (g_hash_table_contains (seen_directories, id))
+    {
+        return TRUE;
+    }
+
+    g_hash_table_add (seen_directories, g_strdup (id));
+
+    return FALSE;
+}
+
+static FileNameIndex *
+file_name_index_build (char **roots)
+{
+    FileNameIndex *index;
+    GFileEnumerator *enumerator;
+    GFileInfo *info;
+    GQueue directories = G_QUEUE_INIT;
+    GHashTable *seen_directories;
+    GFile *dir, *child;
+    guint32 id, child_id;
+    gboolean is_directory;
+    int i;
+
+    index = file_name_index_new ();
+    seen_directories = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                              g_free, NULL);
+
+    for (i = 0; roots[i] != NULL; i++)
+    {
+        dir = g_file_new_for_path (roots[i]);
+        info = g_file_query_info (dir, G_FILE_ATTRIBUTE_ID_FILE,
+                                  G_FILE_QUERY_INFO_NONE, NULL, NULL);
+        if (info != NULL)
+        {
+            directory_seen (seen_directories, info);
+            g_object_unref (info);
+        }
+
+        id = file_name_index_add (index, NO_ENTRY, roots[i], TRUE);
+        g_queue_push_tail (&directories, dir);
+        g_queue_push_tail (&directories, GUINT_TO_POINTER (id));
+    }
+
+    while (!g_queue_is_empty (&directories))
+    {
+        dir = g_queue_pop_head (&directories);
+        id = GPOINTER_TO_UINT (g_queue_pop_head (&directories));
+
+        enumerator = g_file_enumerate_children (dir, INDEX_ATTRIBUTES,
+                                                G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS,
+                                                NULL, NULL);
+        if (enumerator == NULL)
+        {
+            g_object_unref (dir);
+            continue;
+        }
+
+        while ((info = g_file_enumerator_next_file (enumerator, NULL, NULL)) != NULL)
+        {
+            is_directory = g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY;
+            /* The same rule as for the changes, which only have a path */
+            if (!name_is_hidden (g_file_info_get_name (info)) &&
+                    !(is_directory && directory_seen (seen_directories, info)))
+            {
+                child_id = file_name_index_add (index, id,
+                                                g_file_info_get_name (info),
+                                                is_directory);
+                if (is_directory)
+                {
+                    child = g_file_get_child (dir, g_file_info_get_name (info));
+                    g_queue_push_tail (&directories, child);
+                    g_queue_push_tail (&directories, GUINT_TO_POINTER (child_id));
+                }
+            }
+            g_object_unref (info);
+        }
+
+        g_object_unref (enumerator);
+        g_object_unref (dir);
+    }
+
+    g_hash_table_destroy (seen_directories);
+
+    index->build_time = g_get_monotonic_time ();
+
+    return index;
+}
+
+static gboolean
+roots_equal (char **a,
+             char **b)
+{
+    int i;
+
+    if (a == NULL || b == NULL)
+    {
+        return a == b;
+    }
+
+    for (i = 0; a[i] != NULL && b[i] != NULL; i++)
+    {
+        if (strcmp (a[i], b[i]) != 0)
+        {
+            return FALSE;
+        }
+    }
+
+    return a[i] == b[i];
+}
+
+static gpointer
+index_build_thread_func (gpointer user_data)
+{
+    FileNameIndex *index, *old_index;
+    char **roots;
+    GList *l;
+
+    roots = user_data;
+    index = file_name_index_build (roots);
+
+    g_mutex_lock (&index_lock);
+
+    /* The roots changed while we were at it; the newer build wins. */
+    if (!roots_equal (roots, index_roots))
+    {
+        g_mutex_unlock (&index_lock);
+        file_name_index_unref (index);
+        g_strfreev (roots);
+        return NULL;
+    }
+
+    for (l = g_list_last (index_journal); l != NULL; l = l->prev)
+    {
+        file_name_index_apply (index, l->data);
+    }
+    g_list_free_full (index_journal, (GDestroyNotify) index_change_free);
+    index_journal = NULL;
+
+    old_index = live_index;
+    live_index = index;
+    index_building = FALSE;
+
+    g_mutex_unlock (&index_lock);
+
+    if (old_index != NULL)
+    {
+        file_name_index_unref (old_index);
+    }
+    g_strfreev (roots);
+
+    return NULL;
+}
+
+static gboolean
+root_is_nested (GPtrArray *roots,
+                int i)
+{
+    const char *root, *other;
+    gsize length;
+    int j;
+
+    root = g_ptr_array_index (roots, i);
+    for (j = 0; j < (int) roots->len; j++)
+    {
+        other = g_ptr_array_index (roots, j);
+        if (j == i)
+        {
+            continue;
+        }
+
+        /* Of two equal roots, keep the first. */
+        if (strcmp (root, other) == 0)
+        {
+            if (j < i)
+            {
+                return TRUE;
+            }
+            continue;
+        }
+
+        length = strlen (other);
+        if (strncmp (root, other, length) == 0 &&
+                (root[length] == '/' || other[length - 1] == '/'))
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static char **
+get_configured_roots (void)
+{
+    GPtrArray *roots;
+    char **settings_roots;
+    char *root;
+    int i;
+
+    settings_roots = g_settings_get_strv (caja_preferences,
+                                         CAJA_PREFERENCES_SEARCH_INDEX_ROOTS);
+
+    roots = g_ptr_array_new ();
+    for (i = 0; settings_roots[i] != NULL; i++)
+    {
+        if (settings_roots[i][0] == '~')
+        {
+            root = g_build_filename (g_get_home_dir (), settings_roots[i] + 1, NULL);
+        }
+        else
+        {
+            root = g_strdup (settings_roots[i]);
+        }
+
+        /* Keep a slash at the end only for "/" itself. */
+        while (strlen (root) > 1 && g_str_has_suffix (root, "/"))
+        {
+            root[strlen (root) - 1] = '\0';
+        }
+
+        if (g_path_is_absolute (root))
+        {
+            g_ptr_array_add (roots, root);
+        }
+        else
+        {
+            g_free (root);
+        }
+    }
+    g_strfreev (settings_roots);
+
+    /* A root inside another one is indexed as part of that one. */
+    for (i = (int) roots->len - 1; i >= 0; i--)
+    {
+        if (root_is_nested (roots, i))
+        {
+            g_free (g_ptr_array_remove_index (roots, i));
+        }
+    }
+    g_ptr_array_add (roots, NULL);
+
+    return (char **) g_ptr_array_free (roots, FALSE);
+}
+
+/* Start building the index if there is none yet, it is too old or
+ * the preference changed.
+ */
+static void
+index_ensure (void)
+{
+    GThread *thread;
+    char **roots;
+    gboolean roots_changed;
+
+    roots = get_configured_roots ();
+
+    g_mutex_lock (&index_lock);
+
+    roots_changed = !roots_equal (roots, index_roots);
+    if (roots_changed)
+    {
+        g_strfreev (index_roots);
+        index_roots = g_strdupv (roots);
+
+        /* An index of other folders is no use; searches go to the
+         * simple engine until the new one is built.
+         */
+        if (live_index != NULL)
+        {
+            file_name_index_unref (live_index);
+            live_index = NULL;
+        }
+    }
+
+    if (roots[0] != NULL &&
+            (roots_changed ||
+             (!index_building &&
+              (live_index == NULL ||
+               g_get_monotonic_time () - live_index->build_time > INDEX_MAX_AGE))))
+    {
+        index_building = TRUE;
+        thread = g_thread_new ("caja-search-index", index_build_thread_func,
+                               g_strdupv (roots));
+        g_thread_unref (thread);
+    }
+
+    g_mutex_unlock (&index_lock);
+
+    g_strfreev (roots);
+}
+
+/* Whether searching at a path can use the index. */
+static gboolean
+index_covers_path (const char *path)
+{
+    const char *rest;
+    gboolean covered;
+    char **components;
+    int i;
+
+    /* Rather than waiting for the first build, which takes a while
+     * on a big home folder, searches use the simple engine until then.
+     */
+    g_mutex_lock (&index_lock);
+    covered = live_index != NULL && find_root (index_roots, path, &rest) != NULL;
+    g_mutex_unlock (&index_lock);
+
+    if (!covered)
+    {
+        return FALSE;
+    }
+
+    /* Hidden folders are not indexed. */
+    components = g_strsplit (rest, "/", -1);
+    for (i = 0; components[i] != NULL; i++)
+    {
+        if (components[i][0] != '\0' && name_is_hidden (components[i]))
+        {
+            covered = FALSE;
+            break;
+        }
+    }
+    g_strfreev (components);
+
+    return covered;
+}
+
+/* Replace the live index by a compacted copy. The copy is made
+ * without the lock; this is safe because only this thread changes the
+ * live index.
+ */
+static void
+index_compact (FileNameIndex *index)
+{
+    FileNameIndex *compacted;
+
+    compacted = file_name_index_compact (index);
+
+    g_mutex_lock (&index_lock);
+    if (live_index == index)
+    {
+        live_index = compacted;
+        compacted = index;
+    }
+    g_mutex_unlock (&index_lock);
+
+    /* Drops either the old live index or the unused copy. */
+    file_name_index_unref (compacted);
+    file_name_index_unref (index);
+}
+
+static void
+index_change_thread_func (gpointer data,
+                          gpointer user_data)
+{
+    IndexChange *change;
+    FileNameIndex *garbage_index;
+    GFile *file;
+
+    change = data;
+
+    if (change->kind == INDEX_CHANGE_ADDED)
+    {
+        file = g_file_new_for_path (change->path);
+        change->is_directory =
+            g_file_query_file_type (file, G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL) == G_FILE_TYPE_DIRECTORY;
+        g_object_unref (file);
+    }
+
+    garbage_index = NULL;
+
+    g_mutex_lock (&index_lock);
+
+    if (live_index != NULL)
+    {
+        file_name_index_apply (live_index, change);
+
+        if (live_index->n_garbage >= COMPACT_MIN_GARBAGE &&
+                live_index->n_garbage >= live_index->entries->len / 8)
+        {
+            garbage_index = file_name_index_ref (live_index);
+        }
+    }
+
+    if (index_building)
+    {
+        index_journal = g_list_prepend (index_journal, change);
+    }
+    else
+    {
+        index_change_free (change);
+    }
+
+    g_mutex_unlock (&index_lock);
+
+    if (garbage_index != NULL)
+    {
+        index_compact (garbage_index);
+    }
+}
+
+/* Changes are applied in order by a single thread, which also looks up
+ * the file types, so none of that is done on the main thread.
+ */
+static void
+index_record_change (IndexChange *change)
+{
+    if (index_change_pool == NULL)
+    {
+        index_change_pool = g_thread_pool_new (index_change_thread_func, NULL,
+                                               1, FALSE, NULL);
+    }
+
+    g_thread_pool_push (index_change_pool, change, NULL);
+}
+
+static gboolean
+index_is_active (void)
+{
+    gboolean active;
+
+    g_mutex_lock (&index_lock);
+    active = live_index != NULL || index_building;
+    g_mutex_unlock (&index_lock);
+
+    return active;
+}
+
+void
+caja_search_engine_index_files_added (GList *locations)
+{
+    IndexChange *change;
+    GList *l;
+    char *path;
+
+    if (!index_is_active ())
+    {
+        return;
+    }
+
+    for (l = locations; l != NULL; l = l->next)
+    {
+        path = g_file_get_path (l->data);
+        if (path == NULL)
+        {
+            continue;
+        }
+
+        change = g_new0 (IndexChange, 1);
+        change->kind = INDEX_CHANGE_ADDED;
+        change->path = path;
+        index_record_change (change);
+    }
+}
+
+void
+caja_search_engine_index_files_removed (GList *locations)
+{
+    IndexChange *change;
+    GList *l;
+    char *path;
+
+    if (!index_is_active ())
+    {
+        return;
+    }
+
+    for (l = locations; l != NULL; l = l->next)
+    {
+        path = g_file_get_path (l->data);
+        if (path == NULL)
+        {
+            continue;
+        }
+
+        change = g_new0 (IndexChange, 1);
+        change->kind = INDEX_CHANGE_REMOVED;
+        change->path = path;
+        index_record_change (change);
+    }
+}
+
+void
+caja_search_engine_index_files_moved (GList *pairs)
+{
+    IndexChange *change;
+    GFilePair *pair;
+    GList *l;
+    char *path, *to_path;
+
+    if (!index_is_active ())
+    {
+        return;
+    }
+
+    for (l = pairs; l != NULL; l = l->next)
+    {
+        pair = l->data;
+        path = g_file_get_path (pair->from);
+        to_path = g_file_get_path (pair->to);
+        if (path == NULL || to_path == NULL)
+        {
+            g_free (path);
+            g_free (to_path);
+            continue;
+        }
+
+        change = g_new0 (IndexChange, 1);
+        change->kind = INDEX_CHANGE_MOVED;
+        change->path = path;
+        change->to_path = to_path;
+        index_record_change (change);
+    }
+}
+
+static void
+finalize (GObject *object)
+{
+    CajaSearchEngineIndex *index;
+
+    index = CAJA_SEARCH_ENGINE_INDEX (object);
+
+    if (index->details->query)
+    {
+        g_object_unref (index->details->query);
+        index->details->query = NULL;
+    }
+
+    if (index->details->fallback)
+    {
+        g_object_unref (index->details->fallback);
+        index->details->fallback = NULL;
+    }
+
+    g_free (index->details);
+
+    EEL_CALL_PARENT (G_OBJECT_CLASS, finalize, (object));
+}
+
+static SearchThreadData *
+search_thread_data_new (CajaSearchEngineIndex *engine,
+                        CajaQuery *query,
+                        char *location)
+{
+    SearchThreadData *data;
+    char *text;
+
+    data = g_new0 (SearchThreadData, 1);
+
+    data->engine = engine;
+    data->location = location;
+
+    text = caja_query_get_text (query);
+    data->matcher = caja_search_matcher_new (text);
+    g_free (text);
+
+    data->mime_types = caja_query_get_mime_types (query);
+
+    data->cancellable = g_cancellable_new ();
+
+    return data;
+}
+
+static void
+search_thread_data_free (SearchThreadData *data)
+{
+    g_object_unref (data->cancellable);
+    caja_search_matcher_free (data->matcher);
+    g_list_free_full (data->mime_types, g_free);
+    g_free (data->location);
+    g_free (data);
+}
+
+static gboolean
+search_thread_done_idle (gpointer user_data)
+{
+    SearchThreadData *data;
+
+    data = user_data;
+
+    if (!g_cancellable_is_cancelled (data->cancellable))
+    {
+        caja_search_engine_finished (CAJA_SEARCH_ENGINE (data->engine));
+        data->engine->details->active_search = NULL;
+    }
+
+    search_thread_data_free (data);
+
+    return FALSE;
+}
+
+typedef struct
+{
+    GList *uris;
+    SearchThreadData *thread_data;
+} SearchHits;
+
+
+static gboolean
+search_thread_add_hits_idle (gpointer user_data)
+{
+    SearchHits *hits;
+
+    hits = user_data;
+
+    if (!g_cancellable_is_cancelled (hits->thread_data->cancellable))
+    {
+        caja_search_engine_hits_added (CAJA_SEARCH_ENGINE (hits->thread_data->engine),
+                                       hits->uris);
+    }
+
+    g_list_free_full (hits->uris, g_free);
+    g_free (hits);
+
+    return FALSE;
+}
+
+static void
+send_batch (SearchThreadData *data,
+            GList *uris)
+{
+    SearchHits *hits;
+
+    if (uris != NULL)
+    {
+        hits = g_new (SearchHits, 1);
+        hits->uris = uris;
+        hits->thread_data = data;
+        g_idle_add (search_thread_add_hits_idle, hits);
+    }
+}
+
+/* Returns the entries that can match, or NULL to try them all. Sets
+ * no_match if some trigram of the words is in no name at all.
+ */
+static GArray *
+get_candidates (FileNameIndex *index,
+                CajaSearchMatcher *matcher,
+                gboolean *no_match)
+{
+    const char * const *words;
+    GArray *posting, *best;
+    gsize i, length;
+    int j;
+
+    *no_match = FALSE;
+    best = NULL;
+
+    words = caja_search_matcher_get_words (matcher);
+    for (j = 0; words[j] != NULL; j++)
+    {
+        length = strlen (words[j]);
+        for (i = 0; i + 3 <= length; i++)
+        {
+            posting = g_hash_table_lookup (index->trigrams,
+                                           GUINT_TO_POINTER (pack_trigram (words[j] + i)));
+            if (posting == NULL)
+            {
+                *no_match = TRUE;
+                return NULL;
+            }
+            if (best == NULL || posting->len < best->len)
+            {
+                best = posting;
+            }
+        }
+    }
+
+    return best;
+}
+
+static gboolean
+mime_type_matches (const char *name,
+                   gboolean is_directory,
+                   GList *mime_types)
+{
+    char *mime_type;
+    gboolean hit;
+    GList *l;
+
+    if (is_directory)
+    {
+        mime_type = g_strdup ("inode/directory");
+    }
+    else
+    {
+        mime_type = g_content_type_guess (name, NULL, 0, NULL);
+    }
+
+    hit = FALSE;
+    for (l = mime_types; l != NULL; l = l->next)
+    {
+        if (g_content_type_equals (mime_type, l->data))
+        {
+            hit = TRUE;
+            break;
+        }
+    }
+    g_free (mime_type);
+
+    return hit;
+}
+
+typedef struct
+{
+    guint32 id;
+    const char *name; /* stays valid as long as the index does */
+    gboolean is_directory;
+} SearchCandidate;
+
+static gpointer
+search_thread_func (gpointer user_data)
+{
+    SearchThreadData *data;
+    FileNameIndex *index;
+    IndexEntry *entry;
+    GArray *posting, *candidates, *chunk;
+    SearchCandidate *candidate;
+    GHashTable *seen;
+    GList *uris;
+    guint32 location_id, id;
+    guint i, j, start, end, n_candidates, n_hits, n_uris;
+    gboolean no_match;
+    const char *name;
+    char *path, *display_name;
+
+    data = user_data;
+    uris = NULL;
+    n_uris = 0;
+
+    g_mutex_lock (&index_lock);
+
+    /* The index may be gone again if the roots changed since the
+     * search was started; then there are simply no hits.
+     */
+    index = NULL;
+    location_id = NO_ENTRY;
+    candidates = NULL;
+    n_candidates = 0;
+    if (live_index != NULL && !g_cancellable_is_cancelled (data->cancellable))
+    {
+        location_id = file_name_index_lookup (live_index, data->location);
+    }
+
+    if (location_id != NO_ENTRY)
+    {
+        /* Keep this version of the index around, even if it is
+         * compacted or rebuilt while we look at it.
+         */
+        index = file_name_index_ref (live_index);
+
+        posting = get_candidates (index, data->matcher, &no_match);
+        if (no_match)
+        {
+            n_candidates = 0;
+        }
+        else if (posting != NULL)
+        {
+            candidates = g_array_sized_new (FALSE, FALSE, sizeof (guint32), posting->len);
+            g_array_append_vals (candidates, posting->data, posting->len);
+            n_candidates = candidates->len;
+        }
+        else
+        {
+            n_candidates = index->entries->len;
+        }
+    }
+
+    g_mutex_unlock (&index_lock);
+
+    /* A moved file can be listed twice. */
+    seen = g_hash_table_new (g_direct_hash, g_direct_equal);
+    chunk = g_array_new (FALSE, FALSE, sizeof (SearchCandidate));
+
+    for (start = 0;
+            start < n_candidates && !g_cancellable_is_cancelled (data->cancellable);
+            start = end)
+    {
+        end = MIN (start + SEARCH_CHUNK_SIZE, n_candidates);
+
+        /* Following the parents needs the lock, since changes move and
+         * remove entries.
+         */
+        g_array_set_size (chunk, 0);
+        g_mutex_lock (&index_lock);
+        for (i = start; i < end; i++)
+        {
+            id = candidates != NULL ? g_array_index (candidates, guint32, i) : i;
+            if (g_hash_table_contains (seen, GUINT_TO_POINTER (id)) ||
+                    !file_name_index_is_inside (index, id, location_id))
+            {
+                continue;
+            }
+            g_hash_table_add (seen, GUINT_TO_POINTER (id));
+
+            entry = get_entry (index, id);
+            g_array_set_size (chunk, chunk->len + 1);
+            candidate = &g_array_index (chunk, SearchCandidate, chunk->len - 1);
+            candidate->id = id;
+            candidate->name = entry->name;
+            candidate->is_directory = entry->is_directory;
+        }
+        g_mutex_unlock (&index_lock);
+
+        /* Matching the names is the expensive part, and needs no lock. */
+        n_hits = 0;
+        for (j = 0; j < chunk->len; j++)
+        {
+            candidate = &g_array_index (chunk, SearchCandidate, j);
+            display_name = get_display_name_if_different (candidate->name);
+            name = display_name != NULL ? display_name : candidate->name;
+            if (caja_search_matcher_matches (data->matcher, name) &&
+                    (data->mime_types == NULL ||
+                     mime_type_matches (name, candidate->is_directory,
+                                        data->mime_types)))
+            {
+                g_array_index (chunk, SearchCandidate, n_hits++) = *candidate;
+            }
+            g_free (display_name);
+        }
+
+        if (n_hits == 0)
+        {
+            continue;
+        }
+
+        g_mutex_lock (&index_lock);
+        for (j = 0; j < n_hits; j++)
+        {
+            candidate = &g_array_index (chunk, SearchCandidate, j);
+            if (!file_name_index_is_inside (index, candidate->id, location_id))
+            {
+                continue;
+            }
+
+            path = file_name_index_get_path (index, candidate->id);
+            uris = g_list_prepend (uris, g_filename_to_uri (path, NULL, NULL));
+            g_free (path);
+            n_uris++;
+        }
+        g_mutex_unlock (&index_lock);
+
+        if (n_uris >= BATCH_SIZE)
+        {
+            send_batch (data, uris);
+            uris = NULL;
+            n_uris = 0;
+        }
+    }
+
+    g_array_free (chunk, TRUE);
+    g_hash_table_destroy (seen);
+    if (candidates != NULL)
+    {
+        g_array_free (candidates, TRUE);
+    }
+    if (index != NULL)
+    {
+        file_name_index_unref (index);
+    }
+
+    send_batch (data, uris);
+    g_idle_add (search_thread_done_idle, data);
+
+    return NULL;
+}
+
+static void
+fallback_hits_added (CajaSearchEngine *fallback,
+                     GList *hits,
+                     CajaSearchEngine *engine)
+{
+    caja_search_engine_hits_added (engine, hits);
+}
+
+static void
+fallback_hits_subtracted (CajaSearchEngine *fallback,
+                          GList *hits,
+                          CajaSearchEngine *engine)
+{
+    caja_search_engine_hits_subtracted (engine, hits);
+}
+
+static void
+fallback_finished (CajaSearchEngine *fallback,
+                   CajaSearchEngine *engine)
+{
+    caja_search_engine_finished (engine);
+}
+
+static void
+fallback_error (CajaSearchEngine *fallback,
+                const char *error_message,
+                CajaSearchEngine *engine)
+{
+    caja_search_engine_error (engine, error_message);
+}
+
+static void
+start_fallback (CajaSearchEngineIndex *index)
+{
+    CajaSearchEngine *fallback;
+
+    if (index->details->fallback == NULL)
+    {
+        fallback = caja_search_engine_simple_new ();
+        g_signal_connect (fallback, "hits-added",
+                          G_CALLBACK (fallback_hits_added), index);
+        g_signal_connect (fallback, "hits-subtracted",
+                          G_CALLBACK (fallback_hits_subtracted), index);
+        g_signal_connect (fallback, "finished",
+                          G_CALLBACK (fallback_finished), index);
+        g_signal_connect (fallback, "error",
+                          G_CALLBACK (fallback_error), index);
+        index->details->fallback = fallback;
+    }
+
+    caja_search_engine_set_query (index->details->fallback, index->details->query);
+    caja_search_engine_start (index->details->fallback);
+}
+
+static void
+caja_search_engine_index_start (CajaSearchEngine *engine)
+{
+    CajaSearchEngineIndex *index;
+    SearchThreadData *data;
+    GThread *thread;
+    GFile *location;
+    char *uri, *path;
+
+    index = CAJA_SEARCH_ENGINE_INDEX (engine);
+
+    if (index->details->active_search != NULL)
+    {
+        return;
+    }
+
+    if (index->details->query == NULL)
+    {
+        return;
+    }
+
+    index_ensure ();
+
+    path = NULL;
+    uri = caja_query_get_location (index->details->query);
+    if (uri != NULL)
+    {
+        location = g_file_new_for_uri (uri);
+        path = g_file_get_path (location);
+        g_object_unref (location);
+        g_free (uri);
+    }
+    else
+    {
+        path = g_strdup ("/");
+    }
+
+    if (path == NULL || !index_covers_path (path))
+    {
+        g_free (path);
+        start_fallback (index);
+        return;
+    }
+
+    data = search_thread_data_new (index, index->details->query, path);
+
+    thread = g_thread_new ("caja-search-index", search_thread_func, data);
+    g_thread_unref (thread);
+
+    index->details->active_search = data;
+}
+
+static void
+caja_search_engine_index_stop (CajaSearchEngine *engine)
+{
+    CajaSearchEngineIndex *index;
+
+    index = CAJA_SEARCH_ENGINE_INDEX (engine);
+
+    if (index->details->active_search != NULL)
+    {
+        g_cancellable_cancel (index->details->active_search->cancellable);
+        index->details->active_search = NULL;
+    }
+
+    if (index->details->fallback != NULL)
+    {
+        caja_search_engine_stop (index->details->fallback);
+    }
+}
+
+static gboolean
+caja_search_engine_index_is_indexed (CajaSearchEngine *engine)
+{
+    return TRUE;
+}
+
+static void
+caja_search_engine_index_set_query (CajaSearchEngine *engine, CajaQuery *query)
+{
+    CajaSearchEngineIndex *index;
+
+    index = CAJA_SEARCH_ENGINE_INDEX (engine);
+
+    if (query)
+    {
+        g_object_ref (query);
+    }
+
+    if (index->details->query)
+    {
+        g_object_unref (index->details->query);
+    }
+
+    index->details->query = query;
+}
+
+static void
+caja_search_engine_index_class_init (CajaSearchEngineIndexClass *class)
+{
+    GObjectClass *gobject_class;
+    CajaSearchEngineClass *engine_class;
+
+    parent_class = g_type_class_peek_parent (class);
+
+    gobject_class = G_OBJECT_CLASS (class);
+    gobject_class->finalize = finalize;
+
+    engine_class = CAJA_SEARCH_ENGINE_CLASS (class);
+    engine_class->set_query = caja_search_engine_index_set_query;
+    engine_class->start = caja_search_engine_index_start;
+    engine_class->stop = caja_search_engine_index_stop;
+    engine_class->is_indexed = caja_search_engine_index_is_indexed;
+}
+
+static void
+caja_search_engine_index_init (CajaSearchEngineIndex *engine)
+{
+    engine->details = g_new0 (CajaSearchEngineIndexDetails, 1);
+}
+
+
+CajaSearchEngine *
+caja_search_engine_index_new (void)
+{
+    CajaSearchEngine *engine;
+    char **roots;
+
+    roots = get_configured_roots ();
+    if (roots[0] == NULL)
+    {
+        g_strfreev (roots);
+        return NULL;
+    }
+    g_strfreev (roots);
+
+    engine = g_object_new (CAJA_TYPE_SEARCH_ENGINE_INDEX, NULL);
+
+    /* Get a head start on the first search. */
+    index_ensure ();
+
+    return engine;
+}
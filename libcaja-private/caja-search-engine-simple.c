@@ -23,6 +23,7 @@
 
 #include <config.h>
 #include "caja-search-engine-simple.h"
+#include "caja-search-matcher.h"
 
 #include <string.h>
 #include <glib.h>
@@ -32,22 +33,60 @@
 
 #define BATCH_SIZE 500
 
+/* The directory walk is mostly waiting on I/O, so use more threads
+ * than there are processors, up to this many.
+ */
+#define MAX_SEARCH_THREADS 16
+
+/* How long an idle worker sleeps before it looks for work again, in
+ * case the search was cancelled meanwhile (usec).
+ */
+#define SEARCH_IDLE_WAIT (100 * 1000)
+
+typedef struct SearchThreadData SearchThreadData;
+
 typedef struct
+{
+    SearchThreadData *data;
+    guint index;
+
+    /* Directories this worker has found and not visited yet. The
+     * worker itself takes the newest ones from the tail, idle workers
+     * steal the oldest ones from the head.
+     */
+    GMutex lock;
+    GQueue directories; /* GFiles */
+
+    gint n_processed_files;
+    GList *uri_hits;
+} SearchWorker;
+
+struct SearchThreadData
 {
     CajaSearchEngineSimple *engine;
     GCancellable *cancellable;
 
     GList *mime_types;
-    char **words;
-    GList *found_list;
+    CajaSearchMatcher *matcher;
 
-    GQueue *directories; /* GFiles */
+    GFile *toplevel;
 
-    GHashTable *visited;
+    SearchWorker *workers;
+    guint n_workers;
+    gint n_running_workers;
 
-    gint n_processed_files;
-    GList *uri_hits;
-} SearchThreadData;
+    /* Directories queued or being visited; the search is over when
+     * this drops to zero.
+     */
+    gint n_pending;
+
+    GMutex lock;
+    GCond work_available;
+    guint work_generation;
+
+    GMutex visited_lock;
+    GHashTable *visited;
+};
 
 
 struct CajaSearchEngineSimpleDetails
@@ -92,14 +131,18 @@ search_thread_data_new (CajaSearchEngineSimple *engine,
                         CajaQuery *query)
 {
     SearchThreadData *data;
-    char *text, *lower, *normalized, *uri;
+    char *text, *uri;
     GFile *location;
+    guint i;
 
     data = g_new0 (SearchThreadData, 1);
 
     data->engine = engine;
-    data->directories = g_queue_new ();
     data->visited = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    g_mutex_init (&data->visited_lock);
+    g_mutex_init (&data->lock);
+    g_cond_init (&data->work_available);
+
     uri = caja_query_get_location (query);
     location = NULL;
     if (uri != NULL)
@@ -111,34 +154,59 @@ search_thread_data_new (CajaSearchEngineSimple *engine,
     {
         location = g_file_new_for_path ("/");
     }
-    g_queue_push_tail (data->directories, location);
+    data->toplevel = location;
+    /* The toplevel directory counts as pending until the first
+     * worker queues it.
+     */
+    data->n_pending = 1;
 
     text = caja_query_get_text (query);
-    normalized = g_utf8_normalize (text, -1, G_NORMALIZE_NFD);
-    lower = g_utf8_strdown (normalized, -1);
-    data->words = g_strsplit (lower, " ", -1);
+    data->matcher = caja_search_matcher_new (text);
     g_free (text);
-    g_free (lower);
-    g_free (normalized);
 
     data->mime_types = caja_query_get_mime_types (query);
 
     data->cancellable = g_cancellable_new ();
 
+    data->n_workers = CLAMP (g_get_num_processors () * 2, 2, MAX_SEARCH_THREADS);
+    data->n_running_workers = data->n_workers;
+    data->workers = g_new0 (SearchWorker, data->n_workers);
+    for (i = 0; i < data->n_workers; i++)
+    {
+        data->workers[i].data = data;
+        data->workers[i].index = i;
+        g_mutex_init (&data->workers[i].lock);
+        g_queue_init (&data->workers[i].directories);
+    }
+
     return data;
 }
 
 static void
 search_thread_data_free (SearchThreadData *data)
 {
-    g_queue_foreach (data->directories,
-                     (GFunc)g_object_unref, NULL);
-    g_queue_free (data->directories);
+    SearchWorker *worker;
+    guint i;
+
+    for (i = 0; i < data->n_workers; i++)
+    {
+        worker = &data->workers[i];
+        g_queue_foreach (&worker->directories,
+                         (GFunc)g_object_unref, NULL);
+        g_queue_clear (&worker->directories);
+        g_mutex_clear (&worker->lock);
+        g_list_free_full (worker->uri_hits, g_free);
+    }
+    g_free (data->workers);
+
+    g_object_unref (data->toplevel);
     g_hash_table_destroy (data->visited);
+    g_mutex_clear (&data->visited_lock);
+    g_mutex_clear (&data->lock);
+    g_cond_clear (&data->work_available);
     g_object_unref (data->cancellable);
-    g_strfreev (data->words);
+    caja_search_matcher_free (data->matcher);
     g_list_free_full (data->mime_types, g_free);
-    g_list_free_full (data->uri_hits, g_free);
     g_free (data);
 }
 
@@ -187,20 +255,135 @@ search_thread_add_hits_idle (gpointer user_data)
 }
 
 static void
-send_batch (SearchThreadData *data)
+send_batch (SearchWorker *worker)
 {
     SearchHits *hits;
 
-    data->n_processed_files = 0;
+    worker->n_processed_files = 0;
 
-    if (data->uri_hits)
+    if (worker->uri_hits)
     {
         hits = g_new (SearchHits, 1);
-        hits->uris = data->uri_hits;
-        hits->thread_data = data;
+        hits->uris = worker->uri_hits;
+        hits->thread_data = worker->data;
         g_idle_add (search_thread_add_hits_idle, hits);
     }
-    data->uri_hits = NULL;
+    worker->uri_hits = NULL;
+}
+
+/* Returns TRUE if the directory with this id had not been seen yet. */
+static gboolean
+mark_visited (SearchThreadData *data,
+              const char *id)
+{
+    gboolean first_visit;
+
+    g_mutex_lock (&data->visited_lock);
+    first_visit = !g_hash_table_lookup_extended (data->visited, id, NULL, NULL);
+    if (first_visit)
+    {
+        g_hash_table_insert (data->visited, g_strdup (id), NULL);
+    }
+    g_mutex_unlock (&data->visited_lock);
+
+    return first_visit;
+}
+
+static void
+wake_up_workers (SearchThreadData *data)
+{
+    g_mutex_lock (&data->lock);
+    data->work_generation++;
+    g_cond_broadcast (&data->work_available);
+    g_mutex_unlock (&data->lock);
+}
+
+static void
+queue_directory (SearchWorker *worker,
+                 GFile *dir,
+                 gboolean counted)
+{
+    if (!counted)
+    {
+        g_atomic_int_inc (&worker->data->n_pending);
+    }
+
+    g_mutex_lock (&worker->lock);
+    g_queue_push_tail (&worker->directories, g_object_ref (dir));
+    g_mutex_unlock (&worker->lock);
+
+    wake_up_workers (worker->data);
+}
+
+static void
+directory_done (SearchThreadData *data)
+{
+    if (g_atomic_int_dec_and_test (&data->n_pending))
+    {
+        /* That was the last one; let the idle workers exit. */
+        wake_up_workers (data);
+    }
+}
+
+/* Get the next directory to visit: one of our own if we have any,
+ * otherwise one stolen from another worker. Returns NULL once the
+ * search is complete or cancelled.
+ */
+static GFile *
+next_directory (SearchWorker *worker)
+{
+    SearchThreadData *data;
+    SearchWorker *victim;
+    GFile *dir;
+    guint generation, i;
+
+    data = worker->data;
+
+    while (!g_cancellable_is_cancelled (data->cancellable))
+    {
+        g_mutex_lock (&data->lock);
+        generation = data->work_generation;
+        g_mutex_unlock (&data->lock);
+
+        g_mutex_lock (&worker->lock);
+        dir = g_queue_pop_tail (&worker->directories);
+        g_mutex_unlock (&worker->lock);
+        if (dir != NULL)
+        {
+            return dir;
+        }
+
+        for (i = 1; i < data->n_workers; i++)
+        {
+            victim = &data->workers[(worker->index + i) % data->n_workers];
+
+            g_mutex_lock (&victim->lock);
+            dir = g_queue_pop_head (&victim->directories);
+            g_mutex_unlock (&victim->lock);
+            if (dir != NULL)
+            {
+                return dir;
+            }
+        }
+
+        /* Nothing to do right now. Sleep until someone queues a
+         * directory, unless that happened while we were looking.
+         */
+        g_mutex_lock (&data->lock);
+        if (g_atomic_int_get (&data->n_pending) == 0)
+        {
+            g_mutex_unlock (&data->lock);
+            return NULL;
+        }
+        if (generation == data->work_generation)
+        {
+            g_cond_wait_until (&data->work_available, &data->lock,
+                               g_get_monotonic_time () + SEARCH_IDLE_WAIT);
+        }
+        g_mutex_unlock (&data->lock);
+    }
+
+    return NULL;
 }
 
 #define STD_ATTRIBUTES \
@@ -211,18 +394,18 @@ send_batch (SearchThreadData *data)
 	G_FILE_ATTRIBUTE_ID_FILE
 
 static void
-visit_directory (GFile *dir, SearchThreadData *data)
+visit_directory (GFile *dir, SearchWorker *worker)
 {
+    SearchThreadData *data;
     GFileEnumerator *enumerator;
     GFileInfo *info;
     GFile *child;
     const char *mime_type, *display_name;
-    char *lower_name, *normalized;
     gboolean hit;
-    int i;
     GList *l;
     const char *id;
-    gboolean visited;
+
+    data = worker->data;
 
     enumerator = g_file_enumerate_children (dir,
                                             data->mime_types != NULL ?
@@ -251,20 +434,7 @@ visit_directory (GFile *dir, SearchThreadData *data)
             goto next;
         }
 
-        normalized = g_utf8_normalize (display_name, -1, G_NORMALIZE_NFD);
-        lower_name = g_utf8_strdown (normalized, -1);
-        g_free (normalized);
-
-        hit = TRUE;
-        for (i = 0; data->words[i] != NULL; i++)
-        {
-            if (strstr (lower_name, data->words[i]) == NULL)
-            {
-                hit = FALSE;
-                break;
-            }
-        }
-        g_free (lower_name);
+        hit = caja_search_matcher_matches (data->matcher, display_name);
 
         if (hit && data->mime_types)
         {
@@ -285,35 +455,21 @@ visit_directory (GFile *dir, SearchThreadData *data)
 
         if (hit)
         {
-            data->uri_hits = g_list_prepend (data->uri_hits, g_file_get_uri (child));
+            worker->uri_hits = g_list_prepend (worker->uri_hits, g_file_get_uri (child));
         }
 
-        data->n_processed_files++;
-        if (data->n_processed_files > BATCH_SIZE)
+        worker->n_processed_files++;
+        if (worker->n_processed_files > BATCH_SIZE)
         {
-            send_batch (data);
+            send_batch (worker);
         }
 
         if (g_file_info_get_file_type (info) == G_FILE_TYPE_DIRECTORY)
         {
             id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
-            visited = FALSE;
-            if (id)
-            {
-                if (g_hash_table_lookup_extended (data->visited,
-                                                  id, NULL, NULL))
-                {
-                    visited = TRUE;
-                }
-                else
-                {
-                    g_hash_table_insert (data->visited, g_strdup (id), NULL);
-                }
-            }
-
-            if (!visited)
+            if (id == NULL || mark_visited (data, id))
             {
-                g_queue_push_tail (data->directories, g_object_ref (child));
+                queue_directory (worker, child, FALSE);
             }
         }
 
@@ -329,35 +485,45 @@ next:
 static gpointer
 search_thread_func (gpointer user_data)
 {
+    SearchWorker *worker;
     SearchThreadData *data;
     GFile *dir;
     GFileInfo *info;
     const char *id;
 
-    data = user_data;
+    worker = user_data;
+    data = worker->data;
 
-    /* Insert id for toplevel directory into visited */
-    dir = g_queue_peek_head (data->directories);
-    info = g_file_query_info (dir, G_FILE_ATTRIBUTE_ID_FILE, 0, data->cancellable, NULL);
-    if (info)
+    if (worker->index == 0)
     {
-        id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
-        if (id)
+        /* Insert id for toplevel directory into visited */
+        info = g_file_query_info (data->toplevel, G_FILE_ATTRIBUTE_ID_FILE, 0, data->cancellable, NULL);
+        if (info)
         {
-            g_hash_table_insert (data->visited, g_strdup (id), NULL);
+            id = g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE);
+            if (id)
+            {
+                mark_visited (data, id);
+            }
+            g_object_unref (info);
         }
-        g_object_unref (info);
+
+        queue_directory (worker, data->toplevel, TRUE);
     }
 
-    while (!g_cancellable_is_cancelled (data->cancellable) &&
-            (dir = g_queue_pop_head (data->directories)) != NULL)
+    while ((dir = next_directory (worker)) != NULL)
     {
-        visit_directory (dir, data);
+        visit_directory (dir, worker);
         g_object_unref (dir);
+        directory_done (data);
     }
-    send_batch (data);
+    send_batch (worker);
 
-    g_idle_add (search_thread_done_idle, data);
+    /* The last worker out reports the search as done. */
+    if (g_atomic_int_dec_and_test (&data->n_running_workers))
+    {
+        g_idle_add (search_thread_done_idle, data);
+    }
 
     return NULL;
 }
@@ -368,6 +534,7 @@ caja_search_engine_simple_start (CajaSearchEngine *engine)
     CajaSearchEngineSimple *simple;
     SearchThreadData *data;
     GThread *thread;
+    guint i;
 
     simple = CAJA_SEARCH_ENGINE_SIMPLE (engine);
 
@@ -383,10 +550,12 @@ caja_search_engine_simple_start (CajaSearchEngine *engine)
 
     data = search_thread_data_new (simple, simple->details->query);
 
-    thread = g_thread_new ("caja-search-simple", search_thread_func, data);
+    for (i = 0; i < data->n_workers; i++)
+    {
+        thread = g_thread_new ("caja-search-simple", search_thread_func, &data->workers[i]);
+        g_thread_unref (thread);
+    }
     simple->details->active_search = data;
-
-    g_thread_unref (thread);
 }
 
 static void
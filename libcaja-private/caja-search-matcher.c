@@ -0,0 +1,178 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   caja-search-matcher.c: Matching file names against search text.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+/* Most file names are plain ASCII. For those, normalizing to NFD and
+ * lowercasing come down to an ASCII lowercase, which we do into a
+ * buffer on the stack and then hand to the C library's strstr, which
+ * is already vectorized where it matters. Anything else takes the
+ * general (allocating) path.
+ */
+
+#include <config.h>
+#include "caja-search-matcher.h"
+
+#include <string.h>
+
+/* Longer names take the general path. */
+#define NAME_BUFFER_SIZE 512
+
+struct CajaSearchMatcher
+{
+    char **words;
+
+    /* TRUE if every word is ASCII; otherwise no ASCII name can match. */
+    gboolean words_ascii;
+
+    /* FALSE in locales where lowercasing ASCII can give something
+     * else (the Turkic dotless i), where we always use the general
+     * path.
+     */
+    gboolean ascii_fast_path;
+};
+
+char *
+caja_search_matcher_fold (const char *string)
+{
+    char *normalized, *folded;
+
+    normalized = g_utf8_normalize (string, -1, G_NORMALIZE_NFD);
+    if (normalized == NULL)
+    {
+        return NULL;
+    }
+    folded = g_utf8_strdown (normalized, -1);
+    g_free (normalized);
+
+    return folded;
+}
+
+CajaSearchMatcher *
+caja_search_matcher_new (const char *text)
+{
+    CajaSearchMatcher *matcher;
+    char *lower;
+    char **words;
+    int i, j;
+
+    matcher = g_new0 (CajaSearchMatcher, 1);
+
+    lower = caja_search_matcher_fold (text);
+    words = g_strsplit (lower, " ", -1);
+    g_free (lower);
+
+    /* Empty words (from repeated spaces) match anything. */
+    matcher->words_ascii = TRUE;
+    for (i = 0, j = 0; words[i] != NULL; i++)
+    {
+        if (words[i][0] == '\0')
+        {
+            g_free (words[i]);
+            continue;
+        }
+        if (!g_str_is_ascii (words[i]))
+        {
+            matcher->words_ascii = FALSE;
+        }
+        words[j++] = words[i];
+    }
+    words[j] = NULL;
+    matcher->words = words;
+
+    lower = g_utf8_strdown ("I", -1);
+    matcher->ascii_fast_path = strcmp (lower, "i") == 0;
+    g_free (lower);
+
+    return matcher;
+}
+
+void
+caja_search_matcher_free (CajaSearchMatcher *matcher)
+{
+    g_strfreev (matcher->words);
+    g_free (matcher);
+}
+
+const char * const *
+caja_search_matcher_get_words (CajaSearchMatcher *matcher)
+{
+    return (const char * const *) matcher->words;
+}
+
+static gboolean
+matches_all_words (CajaSearchMatcher *matcher,
+                   const char *lower_name)
+{
+    int i;
+
+    for (i = 0; matcher->words[i] != NULL; i++)
+    {
+        if (strstr (lower_name, matcher->words[i]) == NULL)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+gboolean
+caja_search_matcher_matches (CajaSearchMatcher *matcher,
+                             const char *name)
+{
+    char buffer[NAME_BUFFER_SIZE];
+    char *lower_name;
+    gboolean hit;
+    int i;
+
+    if (matcher->words[0] == NULL)
+    {
+        return TRUE;
+    }
+
+    if (matcher->ascii_fast_path)
+    {
+        for (i = 0; i < NAME_BUFFER_SIZE; i++)
+        {
+            if ((guchar) name[i] >= 0x80)
+            {
+                break;
+            }
+
+            buffer[i] = g_ascii_tolower (name[i]);
+            if (name[i] == '\0')
+            {
+                /* An ASCII name never matches non-ASCII words. */
+                return matcher->words_ascii &&
+                       matches_all_words (matcher, buffer);
+            }
+        }
+    }
+
+    lower_name = caja_search_matcher_fold (name);
+    if (lower_name == NULL)
+    {
+        return FALSE;
+    }
+
+    hit = matches_all_words (matcher, lower_name);
+    g_free (lower_name);
+
+    return hit;
+}
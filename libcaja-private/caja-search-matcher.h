@@ -0,0 +1,45 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 8; tab-width: 8 -*-
+
+   caja-search-matcher.h: Matching file names against search text.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, write to the
+   Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+   Boston, MA 02110-1301, USA.
+*/
+
+#ifndef CAJA_SEARCH_MATCHER_H
+#define CAJA_SEARCH_MATCHER_H
+
+#include <glib.h>
+
+typedef struct CajaSearchMatcher CajaSearchMatcher;
+
+/* The text is split into words at spaces; a name matches if it
+ * contains every word, ignoring case and accents. A matcher is never
+ * modified after it is made, so several threads can share one.
+ */
+CajaSearchMatcher *caja_search_matcher_new     (const char        *text);
+void               caja_search_matcher_free    (CajaSearchMatcher *matcher);
+gboolean           caja_search_matcher_matches (CajaSearchMatcher *matcher,
+                                                const char        *name);
+
+/* The words of the search text, folded the way names are. */
+const char * const *caja_search_matcher_get_words (CajaSearchMatcher *matcher);
+
+/* Returns a newly allocated copy of a string with case and accents
+ * folded, as used for matching, or NULL if it is not valid UTF-8.
+ */
+char              *caja_search_matcher_fold    (const char        *string);
+
+#endif /* CAJA_SEARCH_MATCHER_H */
@@ -64,6 +64,18 @@ static void thumbnail_thread_func (GTask        *task,
                                    gpointer      task_data,
                                    GCancellable *cancellable);
 
+/* Thumbnails of files on screen are made first, then those of the files a
+   page further, then all others, and last those of folders nobody shows
+   any more. */
+typedef enum
+{
+    THUMBNAIL_PRIORITY_VISIBLE,
+    THUMBNAIL_PRIORITY_NEXT_PAGE,
+    THUMBNAIL_PRIORITY_NORMAL,
+    THUMBNAIL_PRIORITY_BACKGROUND,
+    THUMBNAIL_N_PRIORITIES
+} ThumbnailPriority;
+
 /* structure used for making thumbnails, associating a uri with where the thumbnail is to be stored */
 
 typedef struct
@@ -71,37 +83,62 @@ typedef struct
     char *image_uri;
     char *mime_type;
     time_t original_file_mtime;
+
+    /* The queue it waits in, and its link there, or NULL while a
+       thumbnail thread is making this one. */
+    ThumbnailPriority priority;
+    GList *link;
 } CajaThumbnailInfo;
 
 /*
  * Thumbnail thread state.
  */
 
-/* The id of the idle handler used to start the thumbnail thread, or 0 if no
+/* The id of the idle handler used to start thumbnail threads, or 0 if no
    idle handler is currently registered. */
 static guint thumbnail_thread_starter_id = 0;
 
 /* Our mutex used when accessing data shared between the main thread and the
-   thumbnail thread, i.e. the thumbnail_thread_is_running flag and the
-   thumbnails_to_make list. */
+   thumbnail threads, i.e. the thumbnail_threads_running count, the
+   thumbnails_to_make list and its hash table. */
 static GMutex thumbnails_mutex;
 
-/* A flag to indicate whether a thumbnail thread is running, so we don't
-   start more than one. Lock thumbnails_mutex when accessing this. */
-static volatile gboolean thumbnail_thread_is_running = FALSE;
+/* The number of thumbnail threads running. We run at most one per
+   processor. Lock thumbnails_mutex when accessing this. */
+static guint thumbnail_threads_running = 0;
 
-/* The list of CajaThumbnailInfo structs containing information about the
-   thumbnails we are making. Lock thumbnails_mutex when accessing this. */
-static volatile GQueue thumbnails_to_make = G_QUEUE_INIT;
+/* The lists of CajaThumbnailInfo structs containing information about the
+   thumbnails waiting to be made, one for each priority, next one first.
+   Lock thumbnails_mutex when accessing this. */
+static GQueue thumbnails_to_make[THUMBNAIL_N_PRIORITIES] =
+{
+    G_QUEUE_INIT, G_QUEUE_INIT, G_QUEUE_INIT, G_QUEUE_INIT
+};
 
-/* Quickly check if uri is in thumbnails_to_make list */
+/* Maps uris to the CajaThumbnailInfo of thumbnails that are waiting or
+   being made, so we never add one twice. Lock thumbnails_mutex when
+   accessing this. */
 static GHashTable *thumbnails_to_make_hash = NULL;
 
-/* The currently thumbnailed icon. it also exists in the thumbnails_to_make list
- * to avoid adding it again. Lock thumbnails_mutex when accessing this. */
-static CajaThumbnailInfo *currently_thumbnailing = NULL;
+/* What each view last said was on screen and on its next page. */
+typedef struct
+{
+    GList *visible_uris;
+    GList *next_page_uris;
+} VisibleFiles;
+
+/* Maps the clients of caja_thumbnail_update_visible to their
+   VisibleFiles. Lock thumbnails_mutex when accessing this. */
+static GHashTable *visible_files = NULL;
+
+/* Maps the uris of the files on screen or on the next page in any view to
+   their priority. Lock thumbnails_mutex when accessing this. */
+static GHashTable *visible_uris = NULL;
 
-static MateDesktopThumbnailFactory *thumbnail_factory = NULL;
+/* Thumbnail factories are not thread safe, so each thread gets its own.
+   Those of threads that exited wait here for the next thread. Lock
+   thumbnails_mutex when accessing this. */
+static GSList *idle_thumbnail_factories = NULL;
 
 static gboolean
 get_file_mtime (const char *file_uri, time_t* mtime)
@@ -152,36 +189,116 @@ get_thumbnail_factory (void)
 }
 
 
+/* These expect thumbnails_mutex to be locked. */
+static guint
+get_n_thumbnails_waiting (void)
+{
+    guint n, i;
+
+    n = 0;
+    for (i = 0; i < THUMBNAIL_N_PRIORITIES; i++)
+    {
+        n += thumbnails_to_make[i].length;
+    }
+
+    return n;
+}
+
+static void
+queue_thumbnail (CajaThumbnailInfo *info,
+                 ThumbnailPriority priority,
+                 gboolean at_head)
+{
+    GQueue *queue;
+
+    queue = &thumbnails_to_make[priority];
+    info->priority = priority;
+    if (at_head)
+    {
+        g_queue_push_head (queue, info);
+        info->link = g_queue_peek_head_link (queue);
+    }
+    else
+    {
+        g_queue_push_tail (queue, info);
+        info->link = g_queue_peek_tail_link (queue);
+    }
+}
+
+static void
+unqueue_thumbnail (CajaThumbnailInfo *info)
+{
+    g_queue_delete_link (&thumbnails_to_make[info->priority], info->link);
+    info->link = NULL;
+}
+
+static guint
+get_max_thumbnail_threads (void)
+{
+    return MAX (g_get_num_processors (), 1);
+}
+
 /* This function is added as a very low priority idle function to start the
-   thread to create any needed thumbnails. It is added with a very low priority
-   so that it doesn't delay showing the directory in the icon/list views.
-   We want to show the files in the directory as quickly as possible. */
+   threads to create any needed thumbnails. It is added with a very low
+   priority so that it doesn't delay showing the directory in the icon/list
+   views. We want to show the files in the directory as quickly as possible. */
 static gboolean
 thumbnail_thread_starter_cb (gpointer data)
 {
+    MateDesktopThumbnailFactory *factory;
+    GSList *factories;
     GTask *task;
+    guint max_threads, n_threads;
 
-    /* Don't do this in thread, since g_object_ref is not threadsafe */
-    if (thumbnail_factory == NULL)
+    max_threads = get_max_thumbnail_threads ();
+    factories = NULL;
+    n_threads = 0;
+
+    g_mutex_lock (&thumbnails_mutex);
+
+    /* Start a thread for each waiting thumbnail, up to the limit. Threads
+       that find the queue empty exit, so there is no point in starting
+       more than that. */
+    while (thumbnail_threads_running < max_threads &&
+            thumbnail_threads_running < get_n_thumbnails_waiting ())
     {
-        thumbnail_factory = get_thumbnail_factory ();
+        thumbnail_threads_running++;
+        n_threads++;
+
+        if (idle_thumbnail_factories != NULL)
+        {
+            factories = g_slist_prepend (factories, idle_thumbnail_factories->data);
+            idle_thumbnail_factories = g_slist_delete_link (idle_thumbnail_factories,
+                                                            idle_thumbnail_factories);
+        }
     }
 
+    thumbnail_thread_starter_id = 0;
+
+    g_mutex_unlock (&thumbnails_mutex);
+
+    /* Make the missing factories here rather than in the threads, as
+       they read the settings. */
+    for (; n_threads > 0; n_threads--)
+    {
 #ifdef DEBUG_THUMBNAILS
-    g_message ("(Main Thread) Creating thumbnails thread\n");
+        g_message ("(Main Thread) Creating thumbnails thread\n");
 #endif
-    /* We set a flag to indicate the thread is running, so we don't create
-       a new one. We don't need to lock a mutex here, as the thumbnail
-       thread isn't running yet. And we know we won't create the thread
-       twice, as we also check thumbnail_thread_starter_id before
-       scheduling this idle function. */
-    thumbnail_thread_is_running = TRUE;
-    task = g_task_new (NULL, NULL, NULL, NULL);
-    g_task_run_in_thread (task, thumbnail_thread_func);
-
-    thumbnail_thread_starter_id = 0;
+        if (factories != NULL)
+        {
+            factory = factories->data;
+            factories = g_slist_delete_link (factories, factories);
+        }
+        else
+        {
+            factory = mate_desktop_thumbnail_factory_new (MATE_DESKTOP_THUMBNAIL_SIZE_NORMAL);
+        }
 
-    g_object_unref (task);
+        task = g_task_new (NULL, NULL, NULL, NULL);
+        g_task_set_task_data (task, factory, NULL);
+        g_task_run_in_thread (task, thumbnail_thread_func);
+        g_object_unref (task);
+    }
 
     return FALSE;
 }
@@ -189,7 +306,7 @@ thumbnail_thread_starter_cb (gpointer data)
 void
 caja_thumbnail_remove_from_queue (const char *file_uri)
 {
-    GList *node;
+    CajaThumbnailInfo *info;
 
 #ifdef DEBUG_THUMBNAILS
     g_message ("(Remove from queue) Locking mutex\n");
@@ -202,13 +319,13 @@ caja_thumbnail_remove_from_queue (const char *file_uri)
 
     if (thumbnails_to_make_hash)
     {
-        node = g_hash_table_lookup (thumbnails_to_make_hash, file_uri);
+        info = g_hash_table_lookup (thumbnails_to_make_hash, file_uri);
 
-        if (node && node->data != currently_thumbnailing)
+        if (info && info->link != NULL)
         {
             g_hash_table_remove (thumbnails_to_make_hash, file_uri);
-            free_thumbnail_info (node->data);
-            g_queue_delete_link ((GQueue *)&thumbnails_to_make, node);
+            unqueue_thumbnail (info);
+            free_thumbnail_info (info);
         }
     }
 
@@ -225,7 +342,7 @@ caja_thumbnail_remove_from_queue (const char *file_uri)
 void
 caja_thumbnail_prioritize (const char *file_uri)
 {
-    GList *node;
+    CajaThumbnailInfo *info;
 
 #ifdef DEBUG_THUMBNAILS
     g_message ("(Prioritize) Locking mutex\n");
@@ -238,12 +355,12 @@ caja_thumbnail_prioritize (const char *file_uri)
 
     if (thumbnails_to_make_hash)
     {
-        node = g_hash_table_lookup (thumbnails_to_make_hash, file_uri);
+        info = g_hash_table_lookup (thumbnails_to_make_hash, file_uri);
 
-        if (node && node->data != currently_thumbnailing)
+        if (info && info->link != NULL)
         {
-            g_queue_unlink ((GQueue *)&thumbnails_to_make, node);
-            g_queue_push_head_link ((GQueue *)&thumbnails_to_make, node);
+            unqueue_thumbnail (info);
+            queue_thumbnail (info, THUMBNAIL_PRIORITY_VISIBLE, TRUE);
         }
     }
 
@@ -257,6 +374,275 @@ caja_thumbnail_prioritize (const char *file_uri)
     g_mutex_unlock (&thumbnails_mutex);
 }
 
+static gboolean
+uri_is_in_directory (const char *uri,
+                     const char *directory_uri,
+                     gsize directory_uri_length)
+{
+    const char *rest;
+
+    if (strncmp (uri, directory_uri, directory_uri_length) != 0)
+    {
+        return FALSE;
+    }
+
+    rest = uri + directory_uri_length;
+    if (directory_uri_length == 0 || directory_uri[directory_uri_length - 1] != '/')
+    {
+        if (*rest != '/')
+        {
+            return FALSE;
+        }
+        rest++;
+    }
+
+    return *rest != '\0' && strchr (rest, '/') == NULL;
+}
+
+/* Nobody shows the folder any more, but a view that shows it again, like
+   the one we switch to, wants the same thumbnails. So they are not thrown
+   away, just made after all others. */
+void
+caja_thumbnail_deprioritize_directory (const char *directory_uri)
+{
+    CajaThumbnailInfo *info;
+    GList *node, *next;
+    gsize length;
+    int i;
+
+    length = strlen (directory_uri);
+
+    g_mutex_lock (&thumbnails_mutex);
+
+    /*********************************
+     * MUTEX LOCKED
+     *********************************/
+
+    for (i = 0; i < THUMBNAIL_PRIORITY_BACKGROUND; i++)
+    {
+        for (node = thumbnails_to_make[i].head; node != NULL; node = next)
+        {
+            next = node->next;
+            info = node->data;
+
+            if (uri_is_in_directory (info->image_uri, directory_uri, length))
+            {
+                unqueue_thumbnail (info);
+                queue_thumbnail (info, THUMBNAIL_PRIORITY_BACKGROUND, FALSE);
+            }
+        }
+    }
+
+    /*********************************
+     * MUTEX UNLOCKED
+     *********************************/
+
+    g_mutex_unlock (&thumbnails_mutex);
+}
+
+/* Still nobody shows the folder a while later, so forget the thumbnails
+   of it that are still waiting rather than keep the processors busy with
+   them. Those being made are finished. */
+void
+caja_thumbnail_cancel_directory (const char *directory_uri)
+{
+    CajaThumbnailInfo *info;
+    CajaFile *file;
+    GList *node, *next, *cancelled, *l;
+    gsize length;
+
+    length = strlen (directory_uri);
+    cancelled = NULL;
+
+    g_mutex_lock (&thumbnails_mutex);
+
+    /*********************************
+     * MUTEX LOCKED
+     *********************************/
+
+    for (node = thumbnails_to_make[THUMBNAIL_PRIORITY_BACKGROUND].head; node != NULL; node = next)
+    {
+        next = node->next;
+        info = node->data;
+
+        if (uri_is_in_directory (info->image_uri, directory_uri, length))
+        {
+            unqueue_thumbnail (info);
+            g_hash_table_remove (thumbnails_to_make_hash, info->image_uri);
+            cancelled = g_list_prepend (cancelled, info);
+        }
+    }
+
+    /*********************************
+     * MUTEX UNLOCKED
+     *********************************/
+
+    g_mutex_unlock (&thumbnails_mutex);
+
+    /* So that they are asked for again when they are shown again */
+    for (l = cancelled; l != NULL; l = l->next)
+    {
+        info = l->data;
+
+        file = caja_file_get_existing_by_uri (info->image_uri);
+        if (file != NULL)
+        {
+            caja_file_set_is_thumbnailing (file, FALSE);
+            caja_file_unref (file);
+        }
+        free_thumbnail_info (info);
+    }
+    g_list_free (cancelled);
+}
+
+static void
+set_visible_uris (GList *uris,
+                  ThumbnailPriority priority)
+{
+    CajaThumbnailInfo *info;
+    GList *l;
+
+    for (l = uris; l != NULL; l = l->next)
+    {
+        if (g_hash_table_lookup (visible_uris, l->data) != NULL)
+        {
+            continue;
+        }
+        g_hash_table_insert (visible_uris, g_strdup (l->data),
+                             GINT_TO_POINTER (priority + 1));
+
+        if (thumbnails_to_make_hash == NULL)
+        {
+            continue;
+        }
+        info = g_hash_table_lookup (thumbnails_to_make_hash, l->data);
+        if (info != NULL && info->link != NULL)
+        {
+            unqueue_thumbnail (info);
+            queue_thumbnail (info, priority, FALSE);
+        }
+    }
+}
+
+static void
+visible_files_free (VisibleFiles *files)
+{
+    g_list_free_full (files->visible_uris, g_free);
+    g_list_free_full (files->next_page_uris, g_free);
+    g_free (files);
+}
+
+static GList *
+copy_uri_list (GList *uris)
+{
+    GList *copy, *l;
+
+    copy = NULL;
+    for (l = uris; l != NULL; l = l->next)
+    {
+        copy = g_list_prepend (copy, g_strdup (l->data));
+    }
+
+    return g_list_reverse (copy);
+}
+
+/* Merge what all views show into the priorities. This expects
+   thumbnails_mutex to be locked. */
+static void
+update_visible_priorities (void)
+{
+    CajaThumbnailInfo *info;
+    GHashTableIter iter;
+    VisibleFiles *files;
+    int i;
+
+    if (visible_uris == NULL)
+    {
+        visible_uris = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                              g_free, NULL);
+    }
+    g_hash_table_remove_all (visible_uris);
+
+    /* What was on screen before goes back to the normal queue, but
+       ahead of the files that never were. */
+    for (i = THUMBNAIL_PRIORITY_NEXT_PAGE; i >= THUMBNAIL_PRIORITY_VISIBLE; i--)
+    {
+        while ((info = g_queue_peek_tail (&thumbnails_to_make[i])) != NULL)
+        {
+            unqueue_thumbnail (info);
+            queue_thumbnail (info, THUMBNAIL_PRIORITY_NORMAL, TRUE);
+        }
+    }
+
+    /* Being on screen in one view beats being on the next page of
+       another. */
+    g_hash_table_iter_init (&iter, visible_files);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &files))
+    {
+        set_visible_uris (files->visible_uris, THUMBNAIL_PRIORITY_VISIBLE);
+    }
+    g_hash_table_iter_init (&iter, visible_files);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &files))
+    {
+        set_visible_uris (files->next_page_uris, THUMBNAIL_PRIORITY_NEXT_PAGE);
+    }
+}
+
+void
+caja_thumbnail_update_visible (gconstpointer client,
+                               GList *visible_file_uris,
+                               GList *next_page_file_uris)
+{
+    VisibleFiles *files;
+
+    files = g_new0 (VisibleFiles, 1);
+    files->visible_uris = copy_uri_list (visible_file_uris);
+    files->next_page_uris = copy_uri_list (next_page_file_uris);
+
+    g_mutex_lock (&thumbnails_mutex);
+
+    /*********************************
+     * MUTEX LOCKED
+     *********************************/
+
+    if (visible_files == NULL)
+    {
+        visible_files = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                               NULL, (GDestroyNotify) visible_files_free);
+    }
+    g_hash_table_replace (visible_files, (gpointer) client, files);
+
+    update_visible_priorities ();
+
+    /*********************************
+     * MUTEX UNLOCKED
+     *********************************/
+
+    g_mutex_unlock (&thumbnails_mutex);
+}
+
+void
+caja_thumbnail_forget_visible (gconstpointer client)
+{
+    g_mutex_lock (&thumbnails_mutex);
+
+    /*********************************
+     * MUTEX LOCKED
+     *********************************/
+
+    if (visible_files != NULL &&
+            g_hash_table_remove (visible_files, client))
+    {
+        update_visible_priorities ();
+    }
+
+    /*********************************
+     * MUTEX UNLOCKED
+     *********************************/
+
+    g_mutex_unlock (&thumbnails_mutex);
+}
+
 
 /***************************************************************************
  * Thumbnail Thread Functions.
@@ -395,7 +781,7 @@ caja_create_thumbnail (CajaFile *file)
     time_t file_mtime = 0;
     CajaThumbnailInfo *info;
     CajaThumbnailInfo *existing_info;
-    GList *existing, *node;
+    ThumbnailPriority priority;
 
     caja_file_set_is_thumbnailing (file, TRUE);
 
@@ -435,24 +821,30 @@ caja_create_thumbnail (CajaFile *file)
     }
 
     /* Check if it is already in the list of thumbnails to make. */
-    existing = g_hash_table_lookup (thumbnails_to_make_hash, info->image_uri);
-    if (existing == NULL)
+    existing_info = g_hash_table_lookup (thumbnails_to_make_hash, info->image_uri);
+    if (existing_info == NULL)
     {
         /* Add the thumbnail to the list. */
 #ifdef DEBUG_THUMBNAILS
         g_message ("(Main Thread) Adding thumbnail: %s\n",
                    info->image_uri);
 #endif
-        g_queue_push_tail ((GQueue *)&thumbnails_to_make, info);
-        node = g_queue_peek_tail_link ((GQueue *)&thumbnails_to_make);
+        priority = THUMBNAIL_PRIORITY_NORMAL;
+        if (visible_uris != NULL &&
+                g_hash_table_lookup (visible_uris, info->image_uri) != NULL)
+        {
+            priority = GPOINTER_TO_INT (g_hash_table_lookup (visible_uris, info->image_uri)) - 1;
+        }
+        queue_thumbnail (info, priority, FALSE);
         g_hash_table_insert (thumbnails_to_make_hash,
                              info->image_uri,
-                             node);
-        /* If the thumbnail thread isn't running, and we haven't
-           scheduled an idle function to start it up, do that now.
-           We don't want to start it until all the other work is done,
+                             info);
+        /* If not all thumbnail threads are running, and we haven't
+           scheduled an idle function to start more, do that now.
+           We don't want to start them until all the other work is done,
            so the GUI will be updated as quickly as possible.*/
-        if (thumbnail_thread_is_running == FALSE &&
+        if (thumbnail_threads_running < get_max_thumbnail_threads () &&
+                thumbnail_threads_running < get_n_thumbnails_waiting () &&
                 thumbnail_thread_starter_id == 0)
         {
             thumbnail_thread_starter_id = g_idle_add_full (G_PRIORITY_LOW, thumbnail_thread_starter_cb, NULL, NULL);
@@ -465,9 +857,16 @@ caja_create_thumbnail (CajaFile *file)
                    info->image_uri);
 #endif
         /* The file in the queue might need a new original mtime */
-        existing_info = existing->data;
         existing_info->original_file_mtime = info->original_file_mtime;
         free_thumbnail_info (info);
+
+        /* Someone wants it again. */
+        if (existing_info->link != NULL &&
+                existing_info->priority == THUMBNAIL_PRIORITY_BACKGROUND)
+        {
+            unqueue_thumbnail (existing_info);
+            queue_thumbnail (existing_info, THUMBNAIL_PRIORITY_NORMAL, FALSE);
+        }
     }
 
     /*********************************
@@ -480,18 +879,21 @@ caja_create_thumbnail (CajaFile *file)
     g_mutex_unlock (&thumbnails_mutex);
 }
 
-/* thumbnail_thread is invoked as a separate thread to to make thumbnails. */
+/* thumbnail_thread is invoked as separate threads to make thumbnails. */
 static void
 thumbnail_thread_func (GTask        *task,
                        gpointer      source_object,
                        gpointer      task_data,
                        GCancellable *cancellable)
 {
+    MateDesktopThumbnailFactory *thumbnail_factory;
     CajaThumbnailInfo *info = NULL;
     GdkPixbuf *pixbuf;
     time_t current_orig_mtime = 0;
     time_t current_time;
-    GList *node;
+    int i;
+
+    thumbnail_factory = task_data;
 
     /* We loop until there are no more thumbails to make, at which point
        we exit the thread. */
@@ -506,43 +908,52 @@ thumbnail_thread_func (GTask        *task,
          * MUTEX LOCKED
          *********************************/
 
-        /* Pop the last thumbnail we just made off the head of the
-           list and free it. I did this here so we only have to lock
-           the mutex once per thumbnail, rather than once before
-           creating it and once after.
-           Don't pop the thumbnail off the queue if the original file
-           mtime of the request changed. Then we need to redo the thumbnail.
+        /* Forget the thumbnail we just made. I did this here so we
+           only have to lock the mutex once per thumbnail, rather than
+           once before creating it and once after.
+           If the original file mtime of the request changed meanwhile,
+           put it back at the head of the queue instead, as we need to
+           redo the thumbnail.
         */
-        if (currently_thumbnailing &&
-                currently_thumbnailing->original_file_mtime == current_orig_mtime)
+        if (info != NULL)
         {
-            g_assert (info == currently_thumbnailing);
-            node = g_hash_table_lookup (thumbnails_to_make_hash, info->image_uri);
-            g_assert (node != NULL);
-            g_hash_table_remove (thumbnails_to_make_hash, info->image_uri);
-            free_thumbnail_info (info);
-            g_queue_delete_link ((GQueue *)&thumbnails_to_make, node);
+            if (info->original_file_mtime == current_orig_mtime)
+            {
+                g_hash_table_remove (thumbnails_to_make_hash, info->image_uri);
+                free_thumbnail_info (info);
+            }
+            else
+            {
+                queue_thumbnail (info, info->priority, TRUE);
+            }
+            info = NULL;
         }
-        currently_thumbnailing = NULL;
 
-        /* If there are no more thumbnails to make, reset the
-           thumbnail_thread_is_running flag, unlock the mutex, and
-           exit the thread. */
-        if (g_queue_is_empty ((GQueue *)&thumbnails_to_make))
+        /* If there are no more thumbnails to make, count this thread
+           out, unlock the mutex, and exit the thread. */
+        if (get_n_thumbnails_waiting () == 0)
         {
 #ifdef DEBUG_THUMBNAILS
             g_message ("(Thumbnail Thread) Exiting\n");
 #endif
-            thumbnail_thread_is_running = FALSE;
+            thumbnail_threads_running--;
+            idle_thumbnail_factories = g_slist_prepend (idle_thumbnail_factories,
+                                                        thumbnail_factory);
             g_mutex_unlock (&thumbnails_mutex);
             return;
         }
 
-        /* Get the next one to make. We leave it on the list until it
-           is created so the main thread doesn't add it again while we
-           are creating it. */
-        info = g_queue_peek_head ((GQueue *)&thumbnails_to_make);
-        currently_thumbnailing = info;
+        /* Get the next one to make. We take it off the queue so the
+           other threads don't make it too, but leave it in the hash
+           table so the main thread doesn't add it again while we are
+           creating it. */
+        i = 0;
+        while (g_queue_is_empty (&thumbnails_to_make[i]))
+        {
+            i++;
+        }
+        info = g_queue_pop_head (&thumbnails_to_make[i]);
+        info->link = NULL;
         current_orig_mtime = info->original_file_mtime;
         /*********************************
          * MUTEX UNLOCKED
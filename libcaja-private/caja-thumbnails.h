@@ -38,6 +38,18 @@ gboolean   caja_thumbnail_is_mimetype_limited_by_size
 /* Queue handling: */
 void       caja_thumbnail_remove_from_queue     (const char   *file_uri);
 void       caja_thumbnail_prioritize            (const char   *file_uri);
+void       caja_thumbnail_deprioritize_directory (const char   *directory_uri);
+void       caja_thumbnail_cancel_directory      (const char   *directory_uri);
+
+/* Tell the thumbnailer which files a view shows and which are on its next
+   page, by uri, top to bottom. The files on screen in any view are made
+   first, then those on the next page of any view; each call replaces what
+   the same client said before. Call caja_thumbnail_forget_visible when the
+   client goes away. */
+void       caja_thumbnail_update_visible        (gconstpointer client,
+                                                 GList        *visible_file_uris,
+                                                 GList        *next_page_file_uris);
+void       caja_thumbnail_forget_visible        (gconstpointer client);
 
 
 #endif /* CAJA_THUMBNAILS_H */
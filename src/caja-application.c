@@ -760,6 +760,14 @@ automount_all_volumes_idle_cb (gpointer data)
     return FALSE;
 }
 
+static gboolean
+resume_interrupted_operations_idle_cb (gpointer data)
+{
+    caja_file_operations_resume_interrupted ();
+
+    return FALSE;
+}
+
 static void
 mark_desktop_files_trusted (void)
 {
@@ -1158,6 +1166,10 @@ finish_startup (CajaApplication *application,
         g_idle_add_full (G_PRIORITY_LOW,
                          automount_all_volumes_idle_cb,
                          application, NULL);
+
+    g_idle_add_full (G_PRIORITY_LOW,
+                     resume_interrupted_operations_idle_cb,
+                     NULL, NULL);
 }
 
 static void
@@ -3229,6 +3241,10 @@ caja_application_startup (GApplication *app)
                      automount_all_volumes_idle_cb,
                      self, NULL);
 
+    g_idle_add_full (G_PRIORITY_LOW,
+                     resume_interrupted_operations_idle_cb,
+                     NULL, NULL);
+
     /* Check the user's ~/.caja directories and post warnings
      * if there are problems.
      */
@@ -2056,9 +2056,41 @@ fm_directory_view_init_view_iface (CajaViewIface *iface)
 	iface->drop_proxy_received_netscape_url = (gpointer)fm_directory_view_drop_proxy_received_netscape_url;
 }
 
+static gboolean
+adjustment_is_near_end (GtkAdjustment *adjustment)
+{
+	double page_size;
+
+	page_size = gtk_adjustment_get_page_size (adjustment);
+
+	return gtk_adjustment_get_value (adjustment) + 2 * page_size >=
+		gtk_adjustment_get_upper (adjustment);
+}
+
+/* Search hits below the first screen are only added as the view gets
+ * close to them, in whichever direction it scrolls.
+ */
+static void
+check_search_needs_more_hits (FMDirectoryView *view)
+{
+	GtkScrolledWindow *scrolled_window;
+
+	if (view->details->model == NULL ||
+	    !CAJA_IS_SEARCH_DIRECTORY (view->details->model)) {
+		return;
+	}
+
+	scrolled_window = GTK_SCROLLED_WINDOW (view);
+	if (adjustment_is_near_end (gtk_scrolled_window_get_hadjustment (scrolled_window)) &&
+	    adjustment_is_near_end (gtk_scrolled_window_get_vadjustment (scrolled_window))) {
+		caja_search_directory_show_more_hits (CAJA_SEARCH_DIRECTORY (view->details->model));
+	}
+}
+
 static void
 fm_directory_view_init (FMDirectoryView *view)
 {
+	GtkAdjustment *adjustment;
 	CajaDirectory *scripts_directory;
 	CajaDirectory *templates_directory;
 	char *templates_uri;
@@ -2081,6 +2113,17 @@ fm_directory_view_init (FMDirectoryView *view)
 	gtk_scrolled_window_set_vadjustment (GTK_SCROLLED_WINDOW (view), NULL);
 	gtk_scrolled_window_set_shadow_type (GTK_SCROLLED_WINDOW (view), GTK_SHADOW_ETCHED_IN);
 
+	adjustment = gtk_scrolled_window_get_hadjustment (GTK_SCROLLED_WINDOW (view));
+	g_signal_connect_swapped (adjustment, "changed",
+				  G_CALLBACK (check_search_needs_more_hits), view);
+	g_signal_connect_swapped (adjustment, "value-changed",
+				  G_CALLBACK (check_search_needs_more_hits), view);
+	adjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (view));
+	g_signal_connect_swapped (adjustment, "changed",
+				  G_CALLBACK (check_search_needs_more_hits), view);
+	g_signal_connect_swapped (adjustment, "value-changed",
+				  G_CALLBACK (check_search_needs_more_hits), view);
+
 	set_up_scripts_directory_global ();
 	scripts_directory = caja_directory_get_by_uri (scripts_directory_uri);
 	add_directory_to_scripts_directory_list (view, scripts_directory);
@@ -2985,6 +3028,84 @@ process_new_files (FMDirectoryView *view)
 
 }
 
+/* The batched class methods bypass the add_file and file_changed
+ * signals, so they can only be used when nothing but the class
+ * handler is listening.
+ */
+static gboolean
+can_send_in_batches (FMDirectoryView *view, guint signal)
+{
+	FMDirectoryViewClass *klass;
+
+	klass = FM_DIRECTORY_VIEW_GET_CLASS (view);
+
+	if ((signal == ADD_FILE && klass->add_files == NULL) ||
+	    (signal == FILE_CHANGED && klass->files_changed == NULL)) {
+		return FALSE;
+	}
+
+	return !g_signal_has_handler_pending (view, signals[signal], 0, TRUE);
+}
+
+static void
+send_file_batch (FMDirectoryView *view,
+		 GList **batch,
+		 CajaDirectory *directory,
+		 gboolean added)
+{
+	FMDirectoryViewClass *klass;
+
+	if (*batch == NULL) {
+		return;
+	}
+
+	klass = FM_DIRECTORY_VIEW_GET_CLASS (view);
+	*batch = g_list_reverse (*batch);
+
+	if (added) {
+		klass->add_files (view, *batch, directory);
+	} else {
+		klass->files_changed (view, *batch, directory);
+	}
+
+	g_list_free (*batch);
+	*batch = NULL;
+}
+
+/* Hands the files over one run of files from the same directory
+ * at a time, keeping their sorted order.
+ */
+static void
+send_files_in_batches (FMDirectoryView *view,
+		       GList *pending_files,
+		       gboolean added)
+{
+	GList *node, *batch;
+	FileAndDirectory *pending;
+	CajaDirectory *directory;
+
+	batch = NULL;
+	directory = NULL;
+
+	for (node = pending_files; node != NULL; node = node->next) {
+		pending = node->data;
+
+		if (!added && !still_should_show_file (view, pending->file, pending->directory)) {
+			g_signal_emit (view,
+				       signals[REMOVE_FILE], 0, pending->file, pending->directory);
+			continue;
+		}
+
+		if (pending->directory != directory) {
+			send_file_batch (view, &batch, directory, added);
+			directory = pending->directory;
+		}
+		batch = g_list_prepend (batch, pending->file);
+	}
+
+	send_file_batch (view, &batch, directory, added);
+}
+
 static void
 process_old_files (FMDirectoryView *view)
 {
@@ -3001,22 +3122,35 @@ process_old_files (FMDirectoryView *view)
 	if (files_added != NULL || files_changed != NULL) {
 		g_signal_emit (view, signals[BEGIN_FILE_CHANGES], 0);
 
-		for (node = files_added; node != NULL; node = node->next) {
-			pending = node->data;
-			g_signal_emit (view,
-				       signals[ADD_FILE], 0, pending->file, pending->directory);
+		if (can_send_in_batches (view, ADD_FILE)) {
+			send_files_in_batches (view, files_added, TRUE);
+		} else {
+			for (node = files_added; node != NULL; node = node->next) {
+				pending = node->data;
+				g_signal_emit (view,
+					       signals[ADD_FILE], 0, pending->file, pending->directory);
+			}
 		}
 
-		for (node = files_changed; node != NULL; node = node->next) {
-			pending = node->data;
-			g_signal_emit (view,
-				       signals[still_should_show_file (view, pending->file, pending->directory)
-					       ? FILE_CHANGED : REMOVE_FILE], 0,
-				       pending->file, pending->directory);
+		if (can_send_in_batches (view, FILE_CHANGED)) {
+			send_files_in_batches (view, files_changed, FALSE);
+		} else {
+			for (node = files_changed; node != NULL; node = node->next) {
+				pending = node->data;
+				g_signal_emit (view,
+					       signals[still_should_show_file (view, pending->file, pending->directory)
+						       ? FILE_CHANGED : REMOVE_FILE], 0,
+					       pending->file, pending->directory);
+			}
 		}
 
 		g_signal_emit (view, signals[END_FILE_CHANGES], 0);
 
+		/* The adjustments don't change while the hits shown fit */
+		if (files_added != NULL) {
+			check_search_needs_more_hits (view);
+		}
+
 		if (files_changed != NULL) {
 			selection = fm_directory_view_get_selection (view);
 			files = file_and_directory_list_to_files (files_changed);
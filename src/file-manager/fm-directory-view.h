@@ -96,6 +96,18 @@ struct FMDirectoryViewClass
                                       CajaFile *file,
                                       CajaDirectory *directory);
 
+    /* Optional batched versions of add_file and file_changed, which
+     * are given files that all belong to the same directory. They
+     * are used instead of emitting the signals once per file when
+     * nobody else is connected to those signals.
+     */
+    void    (* add_files)            (FMDirectoryView *view,
+                                      GList *files,
+                                      CajaDirectory *directory);
+    void    (* files_changed)        (FMDirectoryView *view,
+                                      GList *files,
+                                      CajaDirectory *directory);
+
     /* The 'end_file_changes' signal is emitted after a set of files
      * are added to the view. It can be replaced by a subclass to do any
      * necessary cleanup (typically, cleanup for code in begin_file_changes).
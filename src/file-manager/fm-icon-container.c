@@ -190,6 +190,8 @@ fm_icon_container_prioritize_thumbnailing (CajaIconContainer *container,
 
     g_assert (CAJA_IS_FILE (file));
 
+    caja_file_prioritize_io (file);
+
     if (caja_file_is_thumbnailing (file))
     {
         uri = caja_file_get_uri (file);
@@ -198,6 +200,36 @@ fm_icon_container_prioritize_thumbnailing (CajaIconContainer *container,
     }
 }
 
+static GList *
+icon_data_list_to_uri_list (GList *data_list)
+{
+    GList *uris, *l;
+
+    uris = NULL;
+    for (l = data_list; l != NULL; l = l->next)
+    {
+        uris = g_list_prepend (uris, caja_file_get_uri (CAJA_FILE (l->data)));
+    }
+
+    return g_list_reverse (uris);
+}
+
+static void
+fm_icon_container_update_visible_icons (CajaIconContainer *container,
+                                        GList *visible_data,
+                                        GList *next_page_data)
+{
+    GList *visible_uris, *next_page_uris;
+
+    visible_uris = icon_data_list_to_uri_list (visible_data);
+    next_page_uris = icon_data_list_to_uri_list (next_page_data);
+
+    caja_thumbnail_update_visible (container, visible_uris, next_page_uris);
+
+    g_list_free_full (visible_uris, g_free);
+    g_list_free_full (next_page_uris, g_free);
+}
+
 /*
  * Get the preference for which caption text should appear
  * beneath icons.
@@ -526,6 +558,25 @@ fm_icon_container_compare_icons (CajaIconContainer *container,
                                        (CajaFile *)icon_b);
 }
 
+static gboolean
+fm_icon_container_prepare_to_sort (CajaIconContainer *container,
+                                   GList             *icon_data)
+{
+    FMIconView *icon_view;
+
+    icon_view = get_icon_view (container);
+    g_return_val_if_fail (icon_view != NULL, FALSE);
+
+    if (FM_ICON_CONTAINER (container)->sort_for_desktop)
+    {
+        return FALSE;
+    }
+
+    fm_icon_view_prepare_to_compare_files (icon_view, icon_data);
+
+    return TRUE;
+}
+
 static int
 fm_icon_container_compare_icons_by_name (CajaIconContainer *container,
         CajaIconData      *icon_a,
@@ -565,6 +616,8 @@ fm_icon_container_dispose (GObject *object)
 
     icon_container->view = NULL;
 
+    caja_thumbnail_forget_visible (icon_container);
+
     G_OBJECT_CLASS (fm_icon_container_parent_class)->dispose (object);
 }
 
@@ -583,9 +636,11 @@ fm_icon_container_class_init (FMIconContainerClass *klass)
     ic_class->start_monitor_top_left = fm_icon_container_start_monitor_top_left;
     ic_class->stop_monitor_top_left = fm_icon_container_stop_monitor_top_left;
     ic_class->prioritize_thumbnailing = fm_icon_container_prioritize_thumbnailing;
+    ic_class->update_visible_icons = fm_icon_container_update_visible_icons;
 
     ic_class->compare_icons = fm_icon_container_compare_icons;
     ic_class->compare_icons_by_name = fm_icon_container_compare_icons_by_name;
+    ic_class->prepare_to_sort = fm_icon_container_prepare_to_sort;
     ic_class->freeze_updates = fm_icon_container_freeze_updates;
     ic_class->unfreeze_updates = fm_icon_container_unfreeze_updates;
 
@@ -627,6 +627,51 @@ fm_icon_view_add_file (FMDirectoryView *view, CajaFile *file, CajaDirectory *dir
     }
 }
 
+static void
+fm_icon_view_add_files (FMDirectoryView *view, GList *files, CajaDirectory *directory)
+{
+    FMIconView *icon_view;
+    CajaIconContainer *icon_container;
+    GList *data_list, *added, *l;
+
+    g_assert (directory == fm_directory_view_get_model (view));
+
+    icon_view = FM_ICON_VIEW (view);
+    icon_container = get_icon_container (icon_view);
+
+    data_list = NULL;
+    for (l = files; l != NULL; l = l->next)
+    {
+        if (icon_view->details->filter_by_screen &&
+                !should_show_file_on_screen (view, l->data))
+        {
+            continue;
+        }
+        data_list = g_list_prepend (data_list, CAJA_ICON_CONTAINER_ICON_DATA (l->data));
+    }
+    data_list = g_list_reverse (data_list);
+
+    if (data_list == NULL)
+    {
+        return;
+    }
+
+    /* Reset scroll region for the first icons added when loading a directory. */
+    if (fm_directory_view_get_loading (view) && caja_icon_container_is_empty (icon_container))
+    {
+        caja_icon_container_reset_scroll_region (icon_container);
+    }
+
+    added = caja_icon_container_add_list (icon_container, data_list);
+    for (l = added; l != NULL; l = l->next)
+    {
+        caja_file_ref (CAJA_FILE (l->data));
+    }
+
+    g_list_free (added);
+    g_list_free (data_list);
+}
+
 static void
 fm_icon_view_flush_added_files (FMDirectoryView *view)
 {
@@ -664,6 +709,33 @@ fm_icon_view_file_changed (FMDirectoryView *view, CajaFile *file, CajaDirectory
     }
 }
 
+static void
+fm_icon_view_files_changed (FMDirectoryView *view, GList *files, CajaDirectory *directory)
+{
+    FMIconView *icon_view;
+    GList *data_list, *l;
+
+    g_assert (directory == fm_directory_view_get_model (view));
+
+    icon_view = FM_ICON_VIEW (view);
+
+    data_list = NULL;
+    for (l = files; l != NULL; l = l->next)
+    {
+        if (icon_view->details->filter_by_screen &&
+                !should_show_file_on_screen (view, l->data))
+        {
+            fm_icon_view_remove_file (view, l->data, directory);
+            continue;
+        }
+        data_list = g_list_prepend (data_list, CAJA_ICON_CONTAINER_ICON_DATA (l->data));
+    }
+
+    caja_icon_container_request_update_list (get_icon_container (icon_view),
+                                             data_list);
+    g_list_free (data_list);
+}
+
 static gboolean
 fm_icon_view_supports_auto_layout (FMIconView *view)
 {
@@ -2421,6 +2493,16 @@ fm_icon_view_compare_files (FMIconView   *icon_view,
             icon_view->details->sort_reversed);
 }
 
+/* Builds everything fm_icon_view_compare_files needs for these files,
+ * after which it can compare them from other threads.
+ */
+void
+fm_icon_view_prepare_to_compare_files (FMIconView *icon_view,
+                                       GList      *files)
+{
+    caja_file_prepare_sort_keys (files, icon_view->details->sort->sort_type);
+}
+
 static int
 compare_files (FMDirectoryView   *icon_view,
                CajaFile *a,
@@ -3165,6 +3247,7 @@ fm_icon_view_class_init (FMIconViewClass *klass)
     GTK_WIDGET_CLASS (klass)->scroll_event = fm_icon_view_scroll_event;
 
     fm_directory_view_class->add_file = fm_icon_view_add_file;
+    fm_directory_view_class->add_files = fm_icon_view_add_files;
     fm_directory_view_class->flush_added_files = fm_icon_view_flush_added_files;
     fm_directory_view_class->begin_loading = fm_icon_view_begin_loading;
     fm_directory_view_class->bump_zoom_level = fm_icon_view_bump_zoom_level;
@@ -3174,6 +3257,7 @@ fm_icon_view_class_init (FMIconViewClass *klass)
     fm_directory_view_class->clear = fm_icon_view_clear;
     fm_directory_view_class->end_loading = fm_icon_view_end_loading;
     fm_directory_view_class->file_changed = fm_icon_view_file_changed;
+    fm_directory_view_class->files_changed = fm_icon_view_files_changed;
 #if !GTK_CHECK_VERSION(3, 21, 0)
     fm_directory_view_class->get_background_widget = fm_icon_view_get_background_widget;
 #endif
@@ -126,6 +126,8 @@ GType   fm_icon_view_get_type      (void);
 int     fm_icon_view_compare_files (FMIconView   *icon_view,
                                     CajaFile *a,
                                     CajaFile *b);
+void    fm_icon_view_prepare_to_compare_files (FMIconView *icon_view,
+                                               GList      *files);
 void    fm_icon_view_filter_by_screen (FMIconView *icon_view, gboolean filter);
 gboolean fm_icon_view_is_compact   (FMIconView *icon_view);
 
@@ -37,11 +37,13 @@
 #include <gtk/gtk.h>
 #include <glib/gi18n.h>
 #include <libcaja-private/caja-dnd.h>
+#include <eel/eel-glib-extensions.h>
 #include <glib.h>
 
 enum
 {
     SUBDIRECTORY_UNLOADED,
+    SORT_PROGRESS,
     LAST_SIGNAL
 };
 
@@ -52,6 +54,13 @@ static GQuark attribute_name_q,
 /* msec delay after Loading... dummy row turns into (empty) */
 #define LOADING_TO_EMPTY_DELAY 100
 
+/* Top level rows are sorted in the background from this many on */
+#define BACKGROUND_SORT_MIN_FILES 20000
+/* Sort keys built per idle callback while preparing such a sort */
+#define SORT_KEYS_PER_IDLE 2000
+/* Background sorts started over before sorting right away instead */
+#define SORT_MAX_RESTARTS 3
+
 static guint list_model_signals[LAST_SIGNAL] = { 0 };
 
 static int fm_list_model_file_entry_compare_func (gconstpointer a,
@@ -60,6 +69,11 @@ static int fm_list_model_file_entry_compare_func (gconstpointer a,
 static void fm_list_model_tree_model_init (GtkTreeModelIface *iface);
 static void fm_list_model_sortable_init (GtkTreeSortableIface *iface);
 static void fm_list_model_multi_drag_source_init (EggTreeMultiDragSourceIface *iface);
+static void fm_list_model_sort (FMListModel *model);
+static void resort_changed_row (gpointer key, gpointer value, gpointer user_data);
+static gboolean sort_in_background (FMListModel *model);
+
+typedef struct SortJob SortJob;
 
 struct FMListModelDetails
 {
@@ -81,6 +95,10 @@ struct FMListModelDetails
     GPtrArray *columns;
 
     GList *highlight_files;
+
+    guint files_generation; /* bumped whenever top level rows are added, removed or moved */
+    SortJob *sort_job;
+    int sort_restarts;
 };
 
 typedef struct
@@ -794,6 +812,10 @@ fm_list_model_sort_file_entries (FMListModel *model, GSequence *files, GtkTreePa
 
     /* sort */
     g_sequence_sort (files, fm_list_model_file_entry_compare_func, model);
+    if (files == model->details->files)
+    {
+        model->details->files_generation++;
+    }
 
     /* generate new order */
     new_order = g_new (int, length);
@@ -823,11 +845,358 @@ fm_list_model_sort_file_entries (FMListModel *model, GSequence *files, GtkTreePa
     g_free (new_order);
 }
 
+/* A large top level is sorted in the background: the sort keys are
+ * built on the main thread a slice at a time, sorted on worker threads
+ * and the new order is applied with a single rows_reordered. The sort
+ * starts over if top level rows are added or removed in the meantime,
+ * up to SORT_MAX_RESTARTS times. Rows that only changed are put in
+ * place after it is applied.
+ */
+typedef struct
+{
+    GSequenceIter *ptr;
+    GBytes *key;
+    GBytes *directory_key; /* only once files of several directories are seen */
+    gboolean is_directory;
+    int position;
+} SortItem;
+
+struct SortJob
+{
+    FMListModel *model;
+    guint files_generation;
+
+    CajaFileSortType sort_type;
+    gboolean directories_first;
+    gboolean reversed;
+
+    SortItem *items;
+    gpointer *order; /* SortItem pointers, sorted by the worker threads */
+    int n_items;
+    int n_prepared;
+    gboolean several_directories;
+
+    /* Top level rows that changed meanwhile, put in place once the
+     * sort is applied rather than moved under it */
+    GHashTable *changed_rows;
+
+    guint idle_id;
+    GCancellable *cancellable;
+};
+
+static void
+sort_job_free (SortJob *job)
+{
+    int i;
+
+    for (i = 0; i < job->n_prepared; i++)
+    {
+        g_bytes_unref (job->items[i].key);
+        if (job->items[i].directory_key != NULL)
+        {
+            g_bytes_unref (job->items[i].directory_key);
+        }
+    }
+
+    if (job->idle_id != 0)
+    {
+        g_source_remove (job->idle_id);
+    }
+
+    g_hash_table_destroy (job->changed_rows);
+    g_object_unref (job->cancellable);
+    g_free (job->items);
+    g_free (job->order);
+    g_free (job);
+}
+
+static void
+cancel_sort_job (FMListModel *model)
+{
+    SortJob *job;
+
+    job = model->details->sort_job;
+    if (job == NULL)
+    {
+        return;
+    }
+    model->details->sort_job = NULL;
+
+    if (job->idle_id != 0)
+    {
+        /* Still building keys */
+        sort_job_free (job);
+    }
+    else
+    {
+        /* Freed once the sorting threads are done */
+        g_cancellable_cancel (job->cancellable);
+    }
+}
+
+static gint
+compare_sort_items (gconstpointer a,
+                    gconstpointer b,
+                    gpointer      user_data)
+{
+    const SortItem *item_1, *item_2;
+    const SortJob *job;
+    int result;
+
+    item_1 = a;
+    item_2 = b;
+    job = user_data;
+
+    /* Same as caja_file_compare_for_sort, without touching the files */
+    if (job->directories_first && item_1->is_directory != item_2->is_directory)
+    {
+        return item_1->is_directory ? -1 : +1;
+    }
+
+    result = g_bytes_compare (item_1->key, item_2->key);
+    if (result == 0 && job->several_directories)
+    {
+        result = g_bytes_compare (item_1->directory_key, item_2->directory_key);
+    }
+
+    return job->reversed ? -result : result;
+}
+
+static void
+sort_thread (GTask        *task,
+             gpointer      source_object,
+             gpointer      task_data,
+             GCancellable *cancellable)
+{
+    SortJob *job;
+
+    job = task_data;
+    eel_sort_in_parallel (job->order, job->n_items, compare_sort_items, job);
+
+    g_task_return_boolean (task, TRUE);
+}
+
+static void
+apply_sort_job (FMListModel *model, SortJob *job)
+{
+    GSequenceIter *end;
+    GtkTreePath *path;
+    FileEntry *file_entry;
+    SortItem *item;
+    int *new_order;
+    int i;
+
+    /* Moving every row to the end in the new order leaves them sorted */
+    end = g_sequence_get_end_iter (model->details->files);
+    new_order = g_new (int, job->n_items);
+    for (i = 0; i < job->n_items; i++)
+    {
+        item = job->order[i];
+        new_order[i] = item->position;
+        g_sequence_move (item->ptr, end);
+    }
+    model->details->files_generation++;
+
+    path = gtk_tree_path_new ();
+    gtk_tree_model_rows_reordered (GTK_TREE_MODEL (model), path, NULL, new_order);
+    g_free (new_order);
+
+    /* Expanded directories are small enough to be sorted right away */
+    for (i = 0; i < job->n_items; i++)
+    {
+        item = job->order[i];
+        file_entry = g_sequence_get (item->ptr);
+        if (file_entry->files != NULL)
+        {
+            gtk_tree_path_append_index (path, i);
+            fm_list_model_sort_file_entries (model, file_entry->files, path);
+            gtk_tree_path_up (path);
+        }
+    }
+    gtk_tree_path_free (path);
+}
+
+/* When rows keep being added or removed a background sort may never
+ * get to finish, after a few tries the rows are sorted right away.
+ */
+static void
+restart_sort (FMListModel *model)
+{
+    GtkTreePath *path;
+
+    model->details->sort_restarts++;
+    if (model->details->sort_restarts < SORT_MAX_RESTARTS &&
+            sort_in_background (model))
+    {
+        return;
+    }
+
+    model->details->sort_restarts = 0;
+
+    path = gtk_tree_path_new ();
+    fm_list_model_sort_file_entries (model, model->details->files, path);
+    gtk_tree_path_free (path);
+
+    g_signal_emit (model, list_model_signals[SORT_PROGRESS], 0, 1.0);
+}
+
+static void
+sort_done_callback (GObject      *source_object,
+                    GAsyncResult *result,
+                    gpointer      user_data)
+{
+    FMListModel *model;
+    SortJob *job;
+
+    model = FM_LIST_MODEL (source_object);
+    job = g_task_get_task_data (G_TASK (result));
+
+    if (g_cancellable_is_cancelled (job->cancellable))
+    {
+        sort_job_free (job);
+        return;
+    }
+
+    model->details->sort_job = NULL;
+
+    if (job->files_generation != model->details->files_generation)
+    {
+        sort_job_free (job);
+        restart_sort (model);
+        return;
+    }
+
+    model->details->sort_restarts = 0;
+    apply_sort_job (model, job);
+    g_hash_table_foreach (job->changed_rows, resort_changed_row, model);
+    sort_job_free (job);
+
+    g_signal_emit (model, list_model_signals[SORT_PROGRESS], 0, 1.0);
+}
+
+static gboolean
+prepare_sort_keys_idle (gpointer user_data)
+{
+    SortJob *job;
+    FMListModel *model;
+    FileEntry *file_entry;
+    CajaFile *first_file;
+    SortItem *item;
+    GTask *task;
+    int i, end;
+
+    job = user_data;
+    model = job->model;
+
+    if (job->files_generation != model->details->files_generation)
+    {
+        /* The rows the job points to may be gone */
+        job->idle_id = 0;
+        model->details->sort_job = NULL;
+        sort_job_free (job);
+        restart_sort (model);
+        return FALSE;
+    }
+
+    end = MIN (job->n_prepared + SORT_KEYS_PER_IDLE, job->n_items);
+    for (; job->n_prepared < end; job->n_prepared++)
+    {
+        item = &job->items[job->n_prepared];
+        file_entry = g_sequence_get (item->ptr);
+        item->key = caja_file_get_sort_key (file_entry->file, job->sort_type);
+        item->is_directory = caja_file_is_directory (file_entry->file);
+
+        /* Directories only break ties in views like search results */
+        first_file = ((FileEntry *) g_sequence_get (job->items[0].ptr))->file;
+        if (!job->several_directories &&
+                !caja_file_is_in_same_directory (file_entry->file, first_file))
+        {
+            job->several_directories = TRUE;
+            for (i = 0; i < job->n_prepared; i++)
+            {
+                job->items[i].directory_key = caja_file_get_directory_sort_key (first_file);
+            }
+        }
+        if (job->several_directories)
+        {
+            item->directory_key = caja_file_get_directory_sort_key (file_entry->file);
+        }
+    }
+
+    if (job->n_prepared < job->n_items)
+    {
+        /* Building the keys is where most of the time goes */
+        g_signal_emit (model, list_model_signals[SORT_PROGRESS], 0,
+                       0.9 * job->n_prepared / job->n_items);
+        return TRUE;
+    }
+
+    job->idle_id = 0;
+
+    task = g_task_new (model, job->cancellable, sort_done_callback, NULL);
+    g_task_set_task_data (task, job, NULL);
+    g_task_run_in_thread (task, sort_thread);
+    g_object_unref (task);
+
+    return FALSE;
+}
+
+static gboolean
+sort_in_background (FMListModel *model)
+{
+    SortJob *job;
+    GSequenceIter *ptr;
+    CajaFileSortType sort_type;
+    int i;
+
+    sort_type = caja_file_get_sort_type_for_attribute_q (model->details->sort_attribute);
+    if (sort_type == CAJA_FILE_SORT_NONE ||
+            g_sequence_get_length (model->details->files) < BACKGROUND_SORT_MIN_FILES)
+    {
+        return FALSE;
+    }
+
+    job = g_new0 (SortJob, 1);
+    job->model = model;
+    job->files_generation = model->details->files_generation;
+    job->sort_type = sort_type;
+    job->directories_first = model->details->sort_directories_first;
+    job->reversed = model->details->order == GTK_SORT_DESCENDING;
+    job->n_items = g_sequence_get_length (model->details->files);
+    job->items = g_new0 (SortItem, job->n_items);
+    job->order = g_new (gpointer, job->n_items);
+
+    ptr = g_sequence_get_begin_iter (model->details->files);
+    for (i = 0; i < job->n_items; i++)
+    {
+        job->items[i].ptr = ptr;
+        job->items[i].position = i;
+        job->order[i] = &job->items[i];
+        ptr = g_sequence_iter_next (ptr);
+    }
+
+    job->changed_rows = g_hash_table_new (NULL, NULL);
+    job->cancellable = g_cancellable_new ();
+    job->idle_id = g_idle_add (prepare_sort_keys_idle, job);
+    model->details->sort_job = job;
+
+    g_signal_emit (model, list_model_signals[SORT_PROGRESS], 0, 0.0);
+
+    return TRUE;
+}
+
 static void
 fm_list_model_sort (FMListModel *model)
 {
     GtkTreePath *path;
 
+    cancel_sort_job (model);
+    model->details->sort_restarts = 0;
+    if (sort_in_background (model))
+    {
+        return;
+    }
+
     path = gtk_tree_path_new ();
 
     fm_list_model_sort_file_entries (model, model->details->files, path);
@@ -1077,6 +1446,10 @@ fm_list_model_add_file (FMListModel *model, CajaFile *file,
 
     file_entry->ptr = g_sequence_insert_sorted (files, file_entry,
                       fm_list_model_file_entry_compare_func, model);
+    if (file_entry->parent == NULL)
+    {
+        model->details->files_generation++;
+    }
 
     g_hash_table_insert (parent_hash, file, file_entry->ptr);
 
@@ -1107,26 +1480,106 @@ fm_list_model_add_file (FMListModel *model, CajaFile *file,
     return TRUE;
 }
 
+/* Adds files that all belong to @directory. */
 void
-fm_list_model_file_changed (FMListModel *model, CajaFile *file,
-                            CajaDirectory *directory)
+fm_list_model_add_files (FMListModel *model, GList *files,
+                         CajaDirectory *directory)
+{
+    GList *l;
+
+    for (l = files; l != NULL; l = l->next)
+    {
+        fm_list_model_add_file (model, l->data, directory);
+    }
+}
+
+static int
+file_entry_ptr_compare_func (gconstpointer a,
+                             gconstpointer b,
+                             gpointer      user_data)
+{
+    return fm_list_model_file_entry_compare_func (*(FileEntry **) a,
+                                                  *(FileEntry **) b,
+                                                  user_data);
+}
+
+/* Adds files to the top level all at once: the new entries are
+ * sorted on their own, merged into the existing ones in a single
+ * pass and indexed as they go. No row signals are emitted, this is
+ * only meant to be used while the model is not attached to a tree
+ * view, which then picks up every row when it gets the model back.
+ */
+void
+fm_list_model_load_files (FMListModel *model, GList *files)
+{
+    GPtrArray *entries;
+    FileEntry *file_entry, *dummy_entry;
+    GSequenceIter *ptr;
+    GList *l;
+    guint i;
+
+    entries = g_ptr_array_sized_new (g_list_length (files));
+    for (l = files; l != NULL; l = l->next)
+    {
+        if (g_hash_table_lookup (model->details->top_reverse_map, l->data) != NULL)
+        {
+            g_warning ("file already in tree!!!\n");
+            continue;
+        }
+
+        file_entry = g_new0 (FileEntry, 1);
+        file_entry->file = caja_file_ref (CAJA_FILE (l->data));
+        g_ptr_array_add (entries, file_entry);
+    }
+
+    g_ptr_array_sort_with_data (entries, file_entry_ptr_compare_func, model);
+
+    /* Outstanding iters point into the old rows */
+    model->details->stamp++;
+    model->details->files_generation++;
+
+    ptr = g_sequence_get_begin_iter (model->details->files);
+    for (i = 0; i < entries->len; i++)
+    {
+        file_entry = g_ptr_array_index (entries, i);
+
+        /* Both are sorted, so this only ever moves forward */
+        while (!g_sequence_iter_is_end (ptr) &&
+                fm_list_model_file_entry_compare_func (g_sequence_get (ptr),
+                        file_entry, model) <= 0)
+        {
+            ptr = g_sequence_iter_next (ptr);
+        }
+
+        file_entry->ptr = g_sequence_insert_before (ptr, file_entry);
+        g_hash_table_insert (model->details->top_reverse_map,
+                             file_entry->file, file_entry->ptr);
+
+        if (caja_file_is_directory (file_entry->file))
+        {
+            file_entry->files = g_sequence_new ((GDestroyNotify)file_entry_free);
+
+            dummy_entry = g_new0 (FileEntry, 1);
+            dummy_entry->parent = file_entry;
+            dummy_entry->ptr = g_sequence_append (file_entry->files, dummy_entry);
+        }
+    }
+
+    g_ptr_array_free (entries, TRUE);
+}
+
+/* Moves the row at ptr to where it belongs now, telling the view */
+static void
+resort_row (FMListModel *model, GSequenceIter *ptr)
 {
     FileEntry *parent_file_entry;
     GtkTreeIter iter;
-    GtkTreePath *path, *parent_path;
-    GSequenceIter *ptr;
+    GtkTreePath *parent_path;
     int pos_before, pos_after, length, i, old;
     int *new_order;
     gboolean has_iter;
     GSequence *files;
 
-    ptr = lookup_file (model, file, directory);
-    if (!ptr)
-    {
-        return;
-    }
-
-
     pos_before = g_sequence_iter_get_position (ptr);
 
     g_sequence_sort_changed (ptr, fm_list_model_file_entry_compare_func, model);
@@ -1144,6 +1597,7 @@ fm_list_model_file_changed (FMListModel *model, CajaFile *file,
             has_iter = FALSE;
             parent_path = gtk_tree_path_new ();
             files = model->details->files;
+            model->details->files_generation++;
         }
         else
         {
@@ -1176,6 +1630,50 @@ fm_list_model_file_changed (FMListModel *model, CajaFile *file,
         gtk_tree_path_free (parent_path);
         g_free (new_order);
     }
+}
+
+static void
+resort_changed_row (gpointer key, gpointer value, gpointer user_data)
+{
+    resort_row (FM_LIST_MODEL (user_data), key);
+}
+
+/* Whether the row is one a background sort is about to move, in which
+ * case it is put in place afterwards instead.
+ */
+static gboolean
+defer_resort_row (FMListModel *model, GSequenceIter *ptr)
+{
+    FileEntry *file_entry;
+
+    file_entry = g_sequence_get (ptr);
+    if (model->details->sort_job == NULL || file_entry->parent != NULL)
+    {
+        return FALSE;
+    }
+
+    g_hash_table_add (model->details->sort_job->changed_rows, ptr);
+    return TRUE;
+}
+
+void
+fm_list_model_file_changed (FMListModel *model, CajaFile *file,
+                            CajaDirectory *directory)
+{
+    GtkTreeIter iter;
+    GtkTreePath *path;
+    GSequenceIter *ptr;
+
+    ptr = lookup_file (model, file, directory);
+    if (!ptr)
+    {
+        return;
+    }
+
+    if (!defer_resort_row (model, ptr))
+    {
+        resort_row (model, ptr);
+    }
 
     fm_list_model_ptr_to_iter (model, ptr, &iter);
     path = gtk_tree_model_get_path (GTK_TREE_MODEL (model), &iter);
@@ -1183,6 +1681,133 @@ fm_list_model_file_changed (FMListModel *model, CajaFile *file,
     gtk_tree_path_free (path);
 }
 
+/* Like fm_list_model_file_changed for files that all belong to
+ * @directory, but reports all the rows that moved with a single
+ * rows_reordered instead of one per file.
+ */
+void
+fm_list_model_files_changed (FMListModel *model, GList *files,
+                             CajaDirectory *directory)
+{
+    FileEntry *parent_file_entry;
+    GtkTreeIter iter;
+    GtkTreePath *path, *parent_path;
+    GSequenceIter *ptr, *parent_ptr, **old_order;
+    GSequence *sequence;
+    GList *l;
+    int pos_before, length, i;
+    int *new_order;
+    gboolean moved;
+
+    if (files == NULL)
+    {
+        return;
+    }
+
+    if (files->next == NULL)
+    {
+        fm_list_model_file_changed (model, files->data, directory);
+        return;
+    }
+
+    parent_ptr = NULL;
+    if (directory)
+    {
+        parent_ptr = g_hash_table_lookup (model->details->directory_reverse_map,
+                                          directory);
+    }
+
+    if (parent_ptr)
+    {
+        parent_file_entry = g_sequence_get (parent_ptr);
+        sequence = parent_file_entry->files;
+    }
+    else
+    {
+        parent_file_entry = NULL;
+        sequence = model->details->files;
+    }
+
+    length = g_sequence_get_length (sequence);
+    old_order = g_new (GSequenceIter *, length);
+    ptr = g_sequence_get_begin_iter (sequence);
+    for (i = 0; i < length; i++)
+    {
+        old_order[i] = ptr;
+        ptr = g_sequence_iter_next (ptr);
+    }
+
+    moved = FALSE;
+    for (l = files; l != NULL; l = l->next)
+    {
+        ptr = lookup_file (model, l->data, directory);
+        if (!ptr)
+        {
+            continue;
+        }
+
+        if (defer_resort_row (model, ptr))
+        {
+            continue;
+        }
+
+        pos_before = g_sequence_iter_get_position (ptr);
+        g_sequence_sort_changed (ptr, fm_list_model_file_entry_compare_func, model);
+        if (g_sequence_iter_get_position (ptr) != pos_before)
+        {
+            moved = TRUE;
+        }
+    }
+
+    if (moved && parent_file_entry == NULL)
+    {
+        model->details->files_generation++;
+    }
+
+    if (moved)
+    {
+        /* Note: new_order[newpos] = oldpos */
+        new_order = g_new (int, length);
+        for (i = 0; i < length; i++)
+        {
+            new_order[g_sequence_iter_get_position (old_order[i])] = i;
+        }
+
+        if (parent_file_entry == NULL)
+        {
+            parent_path = gtk_tree_path_new ();
+        }
+        else
+        {
+            fm_list_model_ptr_to_iter (model, parent_ptr, &iter);
+            parent_path = gtk_tree_model_get_path (GTK_TREE_MODEL (model), &iter);
+        }
+
+        gtk_tree_model_rows_reordered (GTK_TREE_MODEL (model),
+                                       parent_path,
+                                       parent_file_entry != NULL ? &iter : NULL,
+                                       new_order);
+
+        gtk_tree_path_free (parent_path);
+        g_free (new_order);
+    }
+    g_free (old_order);
+
+    for (l = files; l != NULL; l = l->next)
+    {
+        ptr = lookup_file (model, l->data, directory);
+        if (!ptr)
+        {
+            continue;
+        }
+
+        fm_list_model_ptr_to_iter (model, ptr, &iter);
+        path = gtk_tree_model_get_path (GTK_TREE_MODEL (model), &iter);
+        gtk_tree_model_row_changed (GTK_TREE_MODEL (model), path, &iter);
+        gtk_tree_path_free (path);
+    }
+}
+
 gboolean
 fm_list_model_is_empty (FMListModel *model)
 {
@@ -1195,6 +1820,12 @@ fm_list_model_get_length (FMListModel *model)
     return g_sequence_get_length (model->details->files);
 }
 
+gboolean
+fm_list_model_has_loaded_subdirectories (FMListModel *model)
+{
+    return g_hash_table_size (model->details->directory_reverse_map) != 0;
+}
+
 static void
 fm_list_model_remove (FMListModel *model, GtkTreeIter *iter)
 {
@@ -1234,6 +1865,11 @@ fm_list_model_remove (FMListModel *model, GtkTreeIter *iter)
 
     }
 
+    if (file_entry->parent == NULL)
+    {
+        model->details->files_generation++;
+    }
+
     if (file_entry->file != NULL)   /* Don't try to remove dummy row */
     {
         if (file_entry->parent != NULL)
@@ -1323,6 +1959,7 @@ fm_list_model_clear (FMListModel *model)
 {
     g_return_if_fail (model != NULL);
 
+    cancel_sort_job (model);
     fm_list_model_clear_directory (model, model->details->files);
 }
 
@@ -1601,6 +2238,8 @@ fm_list_model_dispose (GObject *object)
 
     model = FM_LIST_MODEL (object);
 
+    cancel_sort_job (model);
+
     if (model->details->columns)
     {
         for (i = 0; i < model->details->columns->len; i++)
@@ -1683,6 +2322,16 @@ fm_list_model_class_init (FMListModelClass *klass)
                       g_cclosure_marshal_VOID__OBJECT,
                       G_TYPE_NONE, 1,
                       CAJA_TYPE_DIRECTORY);
+
+    list_model_signals[SORT_PROGRESS] =
+        g_signal_new ("sort_progress",
+                      FM_TYPE_LIST_MODEL,
+                      G_SIGNAL_RUN_LAST,
+                      G_STRUCT_OFFSET (FMListModelClass, sort_progress),
+                      NULL, NULL,
+                      g_cclosure_marshal_VOID__DOUBLE,
+                      G_TYPE_NONE, 1,
+                      G_TYPE_DOUBLE);
 }
 
 static void
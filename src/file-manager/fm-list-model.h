@@ -72,6 +72,12 @@ typedef struct
 
     void (* subdirectory_unloaded)(FMListModel *model,
                                    CajaDirectory *subdirectory);
+
+    /* Emitted while a large model is sorted in the background,
+     * with 1.0 once it is sorted.
+     */
+    void (* sort_progress)        (FMListModel *model,
+                                   double fraction);
 } FMListModelClass;
 
 GType    fm_list_model_get_type                          (void);
@@ -81,8 +87,17 @@ gboolean fm_list_model_add_file                          (FMListModel          *
 void     fm_list_model_file_changed                      (FMListModel          *model,
         CajaFile         *file,
         CajaDirectory    *directory);
+void     fm_list_model_add_files                         (FMListModel          *model,
+        GList            *files,
+        CajaDirectory    *directory);
+void     fm_list_model_load_files                        (FMListModel          *model,
+        GList            *files);
+void     fm_list_model_files_changed                     (FMListModel          *model,
+        GList            *files,
+        CajaDirectory    *directory);
 gboolean fm_list_model_is_empty                          (FMListModel          *model);
 guint    fm_list_model_get_length                        (FMListModel          *model);
+gboolean fm_list_model_has_loaded_subdirectories         (FMListModel          *model);
 void     fm_list_model_remove_file                       (FMListModel          *model,
         CajaFile         *file,
         CajaDirectory    *directory);
@@ -58,6 +58,7 @@
 #include <libcaja-private/caja-icon-dnd.h>
 #include <libcaja-private/caja-metadata.h>
 #include <libcaja-private/caja-module.h>
+#include <libcaja-private/caja-thumbnails.h>
 #include <libcaja-private/caja-tree-view-drag-dest.h>
 #include <libcaja-private/caja-view-factory.h>
 #include <libcaja-private/caja-clipboard.h>
@@ -116,6 +117,8 @@ struct FMListViewDetails
     gulong clipboard_handler_id;
 
     GQuark last_sort_attr;
+
+    guint update_visible_rows_idle_id;
 };
 
 struct SelectionForeachData
@@ -134,6 +137,9 @@ struct SelectionForeachData
 /* We wait two seconds after row is collapsed to unload the subdirectory */
 #define COLLAPSE_TO_UNLOAD_DELAY 2
 
+/* Smaller batches of new files are inserted into the model one by one */
+#define BULK_LOAD_MIN_FILES 200
+
 /* Wait for the rename to end when activating a file being renamed */
 #define WAIT_FOR_RENAME_ON_ACTIVATE 200
 
@@ -1124,6 +1130,29 @@ subdirectory_unloaded_callback (FMListModel *model,
     fm_directory_view_remove_subdirectory (FM_DIRECTORY_VIEW (view), directory);
 }
 
+static void
+sort_progress_callback (FMListModel *model,
+                        double fraction,
+                        gpointer callback_data)
+{
+    FMDirectoryView *view;
+    char *status;
+
+    view = FM_DIRECTORY_VIEW (callback_data);
+
+    if (fraction < 1.0)
+    {
+        status = g_strdup_printf (_("Sorting items… %d%%"), (int) (fraction * 100));
+        caja_window_slot_info_set_status (fm_directory_view_get_caja_window_slot (view),
+                                          status);
+        g_free (status);
+    }
+    else
+    {
+        fm_directory_view_display_selection_info (view);
+    }
+}
+
 static gboolean
 key_press_callback (GtkWidget *widget, GdkEventKey *event, gpointer callback_data)
 {
@@ -1659,6 +1688,115 @@ focus_in_event_callback (GtkWidget *widget, GdkEventFocus *event, gpointer user_
     return FALSE;
 }
 
+/* Move to the row below, as shown: into expanded folders and out of
+ * finished ones.
+ */
+static gboolean
+next_shown_row (GtkTreeView *tree_view,
+                GtkTreeModel *model,
+                GtkTreePath *path)
+{
+    GtkTreeIter iter;
+
+    if (gtk_tree_view_row_expanded (tree_view, path))
+    {
+        gtk_tree_path_down (path);
+        if (gtk_tree_model_get_iter (model, &iter, path))
+        {
+            return TRUE;
+        }
+        gtk_tree_path_up (path);
+    }
+
+    for (;;)
+    {
+        gtk_tree_path_next (path);
+        if (gtk_tree_model_get_iter (model, &iter, path))
+        {
+            return TRUE;
+        }
+        if (!gtk_tree_path_up (path) || gtk_tree_path_get_depth (path) == 0)
+        {
+            return FALSE;
+        }
+    }
+}
+
+static gboolean
+update_visible_rows_idle_callback (gpointer data)
+{
+    FMListView *view;
+    GtkTreeModel *model;
+    GtkTreePath *start, *end;
+    GList *visible_uris, *next_page_uris;
+    CajaFile *file;
+    int n_visible, n;
+    gboolean more, in_view;
+
+    view = FM_LIST_VIEW (data);
+    view->details->update_visible_rows_idle_id = 0;
+
+    if (!gtk_tree_view_get_visible_range (view->details->tree_view, &start, &end))
+    {
+        return FALSE;
+    }
+
+    model = GTK_TREE_MODEL (view->details->model);
+    visible_uris = NULL;
+    next_page_uris = NULL;
+    n_visible = 0;
+    n = 0;
+    in_view = TRUE;
+
+    /* The visible rows, then as many again for the next page. */
+    for (more = TRUE; more && (in_view || n < n_visible);
+            more = next_shown_row (view->details->tree_view, model, start))
+    {
+        file = fm_list_model_file_for_path (view->details->model, start);
+        if (file != NULL)
+        {
+            if (in_view)
+            {
+                visible_uris = g_list_prepend (visible_uris, caja_file_get_uri (file));
+                n_visible++;
+            }
+            else
+            {
+                next_page_uris = g_list_prepend (next_page_uris, caja_file_get_uri (file));
+                n++;
+            }
+            caja_file_unref (file);
+        }
+
+        if (in_view && gtk_tree_path_compare (start, end) >= 0)
+        {
+            in_view = FALSE;
+        }
+    }
+
+    visible_uris = g_list_reverse (visible_uris);
+    next_page_uris = g_list_reverse (next_page_uris);
+    caja_thumbnail_update_visible (view, visible_uris, next_page_uris);
+
+    g_list_free_full (visible_uris, g_free);
+    g_list_free_full (next_page_uris, g_free);
+    gtk_tree_path_free (start);
+    gtk_tree_path_free (end);
+
+    return FALSE;
+}
+
+static void
+schedule_update_visible_rows (GtkAdjustment *adjustment,
+                              FMListView *view)
+{
+    if (view->details->update_visible_rows_idle_id == 0)
+    {
+        view->details->update_visible_rows_idle_id =
+            g_idle_add (update_visible_rows_idle_callback, view);
+    }
+}
+
 static void
 create_and_set_up_tree_view (FMListView *view)
 {
@@ -1747,6 +1885,8 @@ create_and_set_up_tree_view (FMListView *view)
 
     g_signal_connect_object (view->details->model, "subdirectory_unloaded",
                              G_CALLBACK (subdirectory_unloaded_callback), view, 0);
+    g_signal_connect_object (view->details->model, "sort_progress",
+                             G_CALLBACK (sort_progress_callback), view, 0);
 
     gtk_tree_selection_set_mode (gtk_tree_view_get_selection (view->details->tree_view), GTK_SELECTION_MULTIPLE);
 #if !GTK_CHECK_VERSION (3, 0, 0)
@@ -1860,6 +2000,14 @@ create_and_set_up_tree_view (FMListView *view)
     gtk_widget_show (GTK_WIDGET (view->details->tree_view));
     gtk_container_add (GTK_CONTAINER (view), GTK_WIDGET (view->details->tree_view));
 
+    /* Have the thumbnails of the rows on screen made first. */
+    g_signal_connect_object (gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (view)),
+                             "value-changed",
+                             G_CALLBACK (schedule_update_visible_rows), view, 0);
+    g_signal_connect_object (gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (view)),
+                             "changed",
+                             G_CALLBACK (schedule_update_visible_rows), view, 0);
+
 
     atk_obj = gtk_widget_get_accessible (GTK_WIDGET (view->details->tree_view));
     atk_object_set_name (atk_obj, _("List View"));
@@ -1874,6 +2022,64 @@ fm_list_view_add_file (FMDirectoryView *view, CajaFile *file, CajaDirectory *dir
     fm_list_model_add_file (model, file, directory);
 }
 
+/* Attaching the model again walks all of its rows, which only pays
+ * off when most of them are new. Nothing the user can see must be
+ * lost on the way either, so the model is only swapped when no row
+ * is selected, expanded or being renamed and the view is scrolled
+ * to the top, as it is while a directory starts loading.
+ */
+static gboolean
+can_load_in_bulk (FMListView *list_view, GList *files, CajaDirectory *directory)
+{
+    GtkAdjustment *vadjustment;
+    guint count;
+
+    if (directory != fm_directory_view_get_model (FM_DIRECTORY_VIEW (list_view)) ||
+            list_view->details->editable_widget != NULL ||
+            fm_list_model_has_loaded_subdirectories (list_view->details->model) ||
+            gtk_tree_selection_count_selected_rows (gtk_tree_view_get_selection (list_view->details->tree_view)) != 0)
+    {
+        return FALSE;
+    }
+
+    vadjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (list_view));
+    if (gtk_adjustment_get_value (vadjustment) > gtk_adjustment_get_lower (vadjustment))
+    {
+        return FALSE;
+    }
+
+    count = g_list_length (files);
+
+    return count >= BULK_LOAD_MIN_FILES &&
+           count >= fm_list_model_get_length (list_view->details->model);
+}
+
+static void
+fm_list_view_add_files (FMDirectoryView *view, GList *files, CajaDirectory *directory)
+{
+    FMListView *list_view;
+    GtkTreeView *tree_view;
+
+    list_view = FM_LIST_VIEW (view);
+
+    if (!can_load_in_bulk (list_view, files, directory))
+    {
+        fm_list_model_add_files (list_view->details->model, files, directory);
+        return;
+    }
+
+    /* The tree view gets all the rows at once when the model comes
+     * back, instead of one row_inserted per file.
+     */
+    tree_view = list_view->details->tree_view;
+    gtk_tree_view_set_model (tree_view, NULL);
+    fm_list_model_load_files (list_view->details->model, files);
+    gtk_tree_view_set_model (tree_view, GTK_TREE_MODEL (list_view->details->model));
+
+    /* Unsetting the model forgets the search column */
+    gtk_tree_view_set_search_column (tree_view, list_view->details->file_name_column_num);
+}
+
 static char **
 get_visible_columns (FMListView *list_view)
 {
@@ -2125,22 +2331,17 @@ fm_list_view_rename_callback (CajaFile *file,
 
 
 static void
-fm_list_view_file_changed (FMDirectoryView *view, CajaFile *file, CajaDirectory *directory)
+scroll_to_renamed_file (FMListView *listview, CajaFile *file, CajaDirectory *directory)
 {
-    FMListView *listview;
     GtkTreeIter iter;
     GtkTreePath *file_path;
 
-    listview = FM_LIST_VIEW (view);
-
-    fm_list_model_file_changed (listview->details->model, file, directory);
-
     if (listview->details->renaming_file != NULL &&
             file == listview->details->renaming_file &&
             listview->details->rename_done)
     {
         /* This is (probably) the result of the rename operation, and
-         * the tree-view changes above could have resorted the list, so
+         * the tree-view changes could have resorted the list, so
          * scroll to the new position
          */
         if (fm_list_model_get_tree_iter_from_file (listview->details->model, file, directory, &iter))
@@ -2157,6 +2358,34 @@ fm_list_view_file_changed (FMDirectoryView *view, CajaFile *file, CajaDirectory
     }
 }
 
+static void
+fm_list_view_file_changed (FMDirectoryView *view, CajaFile *file, CajaDirectory *directory)
+{
+    FMListView *listview;
+
+    listview = FM_LIST_VIEW (view);
+
+    fm_list_model_file_changed (listview->details->model, file, directory);
+
+    scroll_to_renamed_file (listview, file, directory);
+}
+
+static void
+fm_list_view_files_changed (FMDirectoryView *view, GList *files, CajaDirectory *directory)
+{
+    FMListView *listview;
+
+    listview = FM_LIST_VIEW (view);
+
+    fm_list_model_files_changed (listview->details->model, files, directory);
+
+    if (listview->details->renaming_file != NULL &&
+            g_list_find (files, listview->details->renaming_file) != NULL)
+    {
+        scroll_to_renamed_file (listview, listview->details->renaming_file, directory);
+    }
+}
+
 #if !GTK_CHECK_VERSION(3, 21, 0)
 static GtkWidget *
 fm_list_view_get_background_widget (FMDirectoryView *view)
@@ -3118,6 +3347,13 @@ fm_list_view_dispose (GObject *object)
         list_view->details->renaming_file_activate_timeout = 0;
     }
 
+    if (list_view->details->update_visible_rows_idle_id != 0)
+    {
+        g_source_remove (list_view->details->update_visible_rows_idle_id);
+        list_view->details->update_visible_rows_idle_id = 0;
+    }
+    caja_thumbnail_forget_visible (list_view);
+
     if (list_view->details->clipboard_handler_id != 0)
     {
         g_signal_handler_disconnect (caja_clipboard_monitor_get (),
@@ -3357,6 +3593,7 @@ fm_list_view_class_init (FMListViewClass *class)
     G_OBJECT_CLASS (class)->finalize = fm_list_view_finalize;
 
     fm_directory_view_class->add_file = fm_list_view_add_file;
+    fm_directory_view_class->add_files = fm_list_view_add_files;
     fm_directory_view_class->begin_loading = fm_list_view_begin_loading;
     fm_directory_view_class->end_loading = fm_list_view_end_loading;
     fm_directory_view_class->bump_zoom_level = fm_list_view_bump_zoom_level;
@@ -3365,6 +3602,7 @@ fm_list_view_class_init (FMListViewClass *class)
     fm_directory_view_class->click_policy_changed = fm_list_view_click_policy_changed;
     fm_directory_view_class->clear = fm_list_view_clear;
     fm_directory_view_class->file_changed = fm_list_view_file_changed;
+    fm_directory_view_class->files_changed = fm_list_view_files_changed;
 #if !GTK_CHECK_VERSION(3, 21, 0)
     fm_directory_view_class->get_background_widget = fm_list_view_get_background_widget;
 #endif
@@ -0,0 +1,124 @@
+#include <libcaja-private/caja-search-matcher.h>
+#include <string.h>
+
+/* Times name matching over a synthetic corpus, against the
+ * normalize-and-lowercase approach the matcher replaced.
+ */
+
+#define N_NAMES 1000000
+
+static const char *stems[] = {
+	"IMG_", "Report ", "invoice-", "holiday", "README", "Makefile",
+	"Résumé ", "notes_", "Übersicht ", "backup.", "photo", "draft "
+};
+
+static const char *extensions[] = {
+	".jpg", ".txt", ".pdf", ".tar.gz", ".c", ".odt", "", ".PNG"
+};
+
+static char **
+make_corpus (void)
+{
+	char **names;
+	GRand *rand;
+	int i;
+
+	rand = g_rand_new_with_seed (42);
+	names = g_new (char *, N_NAMES + 1);
+	for (i = 0; i < N_NAMES; i++) {
+		names[i] = g_strdup_printf ("%s%d%s",
+					    stems[g_rand_int_range (rand, 0, G_N_ELEMENTS (stems))],
+					    g_rand_int_range (rand, 0, 100000),
+					    extensions[g_rand_int_range (rand, 0, G_N_ELEMENTS (extensions))]);
+	}
+	names[N_NAMES] = NULL;
+	g_rand_free (rand);
+
+	return names;
+}
+
+static gboolean
+old_matches (char **words, const char *name)
+{
+	char *normalized, *lower_name;
+	gboolean hit;
+	int i;
+
+	normalized = g_utf8_normalize (name, -1, G_NORMALIZE_NFD);
+	lower_name = g_utf8_strdown (normalized, -1);
+	g_free (normalized);
+
+	hit = TRUE;
+	for (i = 0; words[i] != NULL; i++) {
+		if (strstr (lower_name, words[i]) == NULL) {
+			hit = FALSE;
+			break;
+		}
+	}
+	g_free (lower_name);
+
+	return hit;
+}
+
+static void
+run (char **names, const char *text)
+{
+	CajaSearchMatcher *matcher;
+	char *normalized, *lower;
+	char **words;
+	gint64 start, old_time, new_time;
+	int i, old_hits, new_hits;
+
+	normalized = g_utf8_normalize (text, -1, G_NORMALIZE_NFD);
+	lower = g_utf8_strdown (normalized, -1);
+	words = g_strsplit (lower, " ", -1);
+	g_free (normalized);
+	g_free (lower);
+
+	start = g_get_monotonic_time ();
+	old_hits = 0;
+	for (i = 0; names[i] != NULL; i++) {
+		old_hits += old_matches (words, names[i]);
+	}
+	old_time = g_get_monotonic_time () - start;
+
+	matcher = caja_search_matcher_new (text);
+	start = g_get_monotonic_time ();
+	new_hits = 0;
+	for (i = 0; names[i] != NULL; i++) {
+		new_hits += caja_search_matcher_matches (matcher, names[i]);
+	}
+	new_time = g_get_monotonic_time () - start;
+	caja_search_matcher_free (matcher);
+
+	g_strfreev (words);
+
+	g_print ("%-16s %8d hits  old %6" G_GINT64_FORMAT " ms  new %6" G_GINT64_FORMAT " ms%s\n",
+		 text, new_hits, old_time / 1000, new_time / 1000,
+		 old_hits != new_hits ? "  MISMATCH" : "");
+}
+
+int
+main (int argc, char* argv[])
+{
+	char **names;
+	int i;
+
+	names = make_corpus ();
+
+	if (argc > 1) {
+		for (i = 1; i < argc; i++) {
+			run (names, argv[i]);
+		}
+	} else {
+		run (names, "img");
+		run (names, "report 12");
+		run (names, "resume");
+		run (names, "übersicht");
+		run (names, "nothing-matches");
+	}
+
+	g_strfreev (names);
+
+	return 0;
+}